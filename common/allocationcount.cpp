@@ -0,0 +1,145 @@
+/**************************************************************************//**
+ * @file allocationcount.cpp
+ * @brief Count of the heap allocations of the process
+ *
+ * This file replaces the allocation functions with ones that count every
+ * call and then forward it. The glibc versions call the __libc_ functions
+ * the library exports for this purpose, so memory allocated here may be
+ * released by the library and the other way round. The counters are
+ * initialized statically, because allocations happen before any
+ * constructor of this program has run; the count of a thread lives in
+ * static thread-local storage, which takes no allocation to reach.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <cstdlib>
+#include <new>
+#include <QAtomicInt>
+#include "allocationcount.h"
+
+namespace {
+
+QBasicAtomicInt counter = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+#if defined (__GNUC__)
+__thread unsigned int threadCounter __attribute__((tls_model("initial-exec"))) = 0;
+#else
+thread_local unsigned int threadCounter = 0;
+#endif
+
+inline void count()
+{
+    counter.fetchAndAddRelaxed(1);
+    ++threadCounter;
+}
+
+} // namespace
+
+unsigned int allocationCount()
+{
+    return static_cast<unsigned int>(counter.load());
+}
+
+unsigned int threadAllocationCount()
+{
+    return threadCounter;
+}
+
+#if defined (__GLIBC__)
+
+#include <cerrno>
+
+// operator new is implemented with malloc by libstdc++ and needs no replacement
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    count();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count_, size_t size)
+{
+    count();
+    return __libc_calloc(count_, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void*) || (alignment & (alignment-1)) != 0)
+    {
+        return EINVAL;
+    }
+    count();
+    void *p = __libc_memalign(alignment, size);
+    if (!p)
+    {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+} // extern "C"
+
+#else
+
+void *operator new(std::size_t size)
+{
+    count();
+    void *p = std::malloc(size > 0 ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) throw()
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) throw()
+{
+    std::free(ptr);
+}
+
+#endif
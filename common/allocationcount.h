@@ -0,0 +1,68 @@
+/**************************************************************************//**
+ * @file allocationcount.h
+ * @brief Count of the heap allocations of the process
+ *
+ * This file declares the counters of the heap allocations and the check of
+ * the frame path built on them. With glibc, malloc and its relatives are
+ * replaced, so the allocations inside the Qt libraries are counted as
+ * well; elsewhere only the global operator new of the program is replaced.
+ * Programs link allocationcount.cpp to use the counters; debug builds of
+ * mpi-visualize do and define FRAME_ALLOCATION_CHECK.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef ALLOCATIONCOUNT_H
+#define ALLOCATIONCOUNT_H
+
+#include <QtGlobal>
+
+// frames a stage may allocate in after the start or a reset, while its
+// buffers grow to the size of the frames
+#define ALLOCATION_CHECK_WARMUP 16
+
+// number of allocations since the start of the program, wraps around
+unsigned int allocationCount();
+
+// number of allocations made by the calling thread, wraps around
+unsigned int threadAllocationCount();
+
+// Warns when a stage of the frame path still allocates on the heap once it
+// has warmed up; every new maximum is reported once, QT_FATAL_WARNINGS
+// turns the warning into an abort. Only the calling thread is counted, so
+// the stage must begin and end in the same thread. Without
+// FRAME_ALLOCATION_CHECK begin and end do nothing.
+class AllocationCheck
+{
+public:
+    explicit AllocationCheck(const char *stage) : mStage(stage), mFrames(0), mStart(0), mMax(0) {}
+
+    // the stage warms up again, e.g. after the size of the frames changed
+    void reset() { mFrames = 0; mMax = 0; }
+
+#ifdef FRAME_ALLOCATION_CHECK
+    void begin() { mStart = threadAllocationCount(); }
+    void end()
+    {
+        const unsigned int count = threadAllocationCount()-mStart;
+        if (++mFrames > ALLOCATION_CHECK_WARMUP && count > mMax)
+        {
+            mMax = count;
+            qWarning("%s allocated %u times in frame %d after the warm-up", mStage, count, mFrames);
+        }
+    }
+#else
+    void begin() {}
+    void end() {}
+#endif
+
+private:
+    const char *mStage;
+    int mFrames;
+    unsigned int mStart;
+    unsigned int mMax;      // allocations of the worst frame reported
+};
+
+#endif // ALLOCATIONCOUNT_H
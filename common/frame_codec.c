@@ -0,0 +1,503 @@
+/**************************************************************************//**
+ * @file frame_codec.c
+ * @brief Compression of image data messages
+ *
+ * This file implements the codec stage. Byte shuffling stores the first
+ * byte of all elements, then the second byte and so on; smooth fields have
+ * long runs of equal high order bytes this way, which fast compressors
+ * handle well. Quantization only applies to segments holding a rectangle of
+ * elements, the payload of a delta encoded message also holds tile indices.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame_codec.h"
+#ifdef FRAME_CODEC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FRAME_CODEC_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef FRAME_CODEC_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define FRAME_CODEC_ZSTD_LEVEL 1
+
+/* ------------------------------------------------------------------------- */
+
+static int isQuantized(const frame_codec* c, const frame_segment* segment)
+{
+    return (c->flags & FRAME_CODEC_QUANTIZE) && segment->nx > 0 &&
+           (c->element_type == IMAGE_TYPE_FLOAT || c->element_type == IMAGE_TYPE_DOUBLE);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void shuffle(const unsigned char* in, unsigned char* out, size_t bytes, int width)
+{
+    const size_t n = bytes / width;
+    size_t i;
+    int b;
+
+    for (b = 0; b < width; ++b)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            out[b * n + i] = in[i * width + b];
+        }
+    }
+    memcpy(out + n * width, in + n * width, bytes - n * width);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void unshuffle(const unsigned char* in, unsigned char* out, size_t bytes, int width)
+{
+    const size_t n = bytes / width;
+    size_t i;
+    int b;
+
+    for (b = 0; b < width; ++b)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            out[i * width + b] = in[b * n + i];
+        }
+    }
+    memcpy(out + n * width, in + n * width, bytes - n * width);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int quantizeValue(double v)
+{
+    if (!(v == v)) return 0; // NaN
+    if (v <= (double)INT_MIN) return INT_MIN;
+    if (v >= (double)INT_MAX) return INT_MAX;
+    return (int)lrint(v);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void quantize(const frame_codec* c, const void* raw, size_t n, int* q)
+{
+    const double inverse_step = 1.0 / c->quantize_step;
+    size_t i;
+
+    if (c->element_type == IMAGE_TYPE_FLOAT)
+    {
+        const float* f = (const float*)raw;
+        for (i = 0; i < n; ++i) q[i] = quantizeValue(f[i] * inverse_step);
+    }
+    else
+    {
+        const double* d = (const double*)raw;
+        for (i = 0; i < n; ++i) q[i] = quantizeValue(d[i] * inverse_step);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void dequantize(const frame_codec* c, const int* q, size_t n, void* raw)
+{
+    size_t i;
+
+    if (c->element_type == IMAGE_TYPE_FLOAT)
+    {
+        float* f = (float*)raw;
+        for (i = 0; i < n; ++i) f[i] = (float)(q[i] * c->quantize_step);
+    }
+    else
+    {
+        double* d = (double*)raw;
+        for (i = 0; i < n; ++i) d[i] = q[i] * c->quantize_step;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns the compressed size or 0 if the backend failed or is not available
+static size_t compressBackend(int codec, const void* in, size_t bytes, void* out, size_t capacity)
+{
+    switch (codec)
+    {
+#ifdef FRAME_CODEC_HAVE_ZLIB
+    case FRAME_CODEC_ZLIB:
+    {
+        uLongf size = (uLongf)capacity;
+        if (compress2((Bytef*)out, &size, (const Bytef*)in, (uLong)bytes, Z_BEST_SPEED) != Z_OK) return 0;
+        return size;
+    }
+#endif
+#ifdef FRAME_CODEC_HAVE_LZ4
+    case FRAME_CODEC_LZ4:
+    {
+        const int size = LZ4_compress_default((const char*)in, (char*)out, (int)bytes,
+                                              capacity > INT_MAX ? INT_MAX : (int)capacity);
+        return size > 0 ? (size_t)size : 0;
+    }
+#endif
+#ifdef FRAME_CODEC_HAVE_ZSTD
+    case FRAME_CODEC_ZSTD:
+    {
+        const size_t size = ZSTD_compress(out, capacity, in, bytes, FRAME_CODEC_ZSTD_LEVEL);
+        return ZSTD_isError(size) ? 0 : size;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// creates the decompression state of a backend unless it exists;
+// returns 0 if out of memory
+static int createDecoder(frame_codec* c, int codec)
+{
+#ifdef FRAME_CODEC_HAVE_ZLIB
+    if (codec == FRAME_CODEC_ZLIB && !c->zlib_stream)
+    {
+        z_stream* stream = (z_stream*)calloc(1, sizeof(z_stream));
+        if (!stream) return 0;
+        if (inflateInit(stream) != Z_OK)
+        {
+            free(stream);
+            return 0;
+        }
+        c->zlib_stream = stream;
+    }
+#endif
+#ifdef FRAME_CODEC_HAVE_ZSTD
+    if (codec == FRAME_CODEC_ZSTD && !c->zstd_context)
+    {
+        c->zstd_context = ZSTD_createDCtx();
+        if (!c->zstd_context) return 0;
+    }
+#endif
+    (void)c;
+    (void)codec;
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns 1 if exactly bytes were decompressed; unlike uncompress and
+// ZSTD_decompress, the state of zlib and zstd is created once and reused
+static int decompressBackend(frame_codec* c, int codec, const void* in, size_t compressed_bytes, void* out, size_t bytes)
+{
+    if (!createDecoder(c, codec))
+    {
+        return 0;
+    }
+
+    switch (codec)
+    {
+    case FRAME_CODEC_NONE:
+        if (compressed_bytes != bytes) return 0;
+        memcpy(out, in, bytes);
+        return 1;
+#ifdef FRAME_CODEC_HAVE_ZLIB
+    case FRAME_CODEC_ZLIB:
+    {
+        z_stream* stream = (z_stream*)c->zlib_stream;
+        if (inflateReset(stream) != Z_OK)
+        {
+            return 0;
+        }
+        stream->next_in = (Bytef*)in;
+        stream->avail_in = (uInt)compressed_bytes;
+        stream->next_out = (Bytef*)out;
+        stream->avail_out = (uInt)bytes;
+        return inflate(stream, Z_FINISH) == Z_STREAM_END && stream->total_out == bytes;
+    }
+#endif
+#ifdef FRAME_CODEC_HAVE_LZ4
+    case FRAME_CODEC_LZ4:
+        return LZ4_decompress_safe((const char*)in, (char*)out, (int)compressed_bytes, (int)bytes) == (int)bytes;
+#endif
+#ifdef FRAME_CODEC_HAVE_ZSTD
+    case FRAME_CODEC_ZSTD:
+        return ZSTD_decompressDCtx((ZSTD_DCtx*)c->zstd_context, out, bytes, in, compressed_bytes) == bytes;
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns 1 if messages have to use the segment format
+int frameCodecIsActive(const frame_codec* c)
+{
+    return c->codec != FRAME_CODEC_NONE || c->flags != 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int frameCodecIsAvailable(int codec)
+{
+    switch (codec)
+    {
+    case FRAME_CODEC_NONE:
+        return 1;
+#ifdef FRAME_CODEC_HAVE_ZLIB
+    case FRAME_CODEC_ZLIB:
+        return 1;
+#endif
+#ifdef FRAME_CODEC_HAVE_LZ4
+    case FRAME_CODEC_LZ4:
+        return 1;
+#endif
+#ifdef FRAME_CODEC_HAVE_ZSTD
+    case FRAME_CODEC_ZSTD:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// largest payload (segment table and padded segments) of a message whose
+// num_segments segments hold raw_bytes in total; covers the worst case
+// expansion of all backends
+size_t frameCodecBound(size_t raw_bytes, int num_segments)
+{
+    return frameSegmentTableSize(num_segments) + raw_bytes + raw_bytes / 128 + (size_t)num_segments * 136;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// bytes of scratch memory needed to encode or decode a segment of raw_bytes
+size_t frameCodecScratchSize(size_t raw_bytes)
+{
+    return 2 * raw_bytes;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// transforms and compresses raw into out; the rectangle of segment
+// (nx = 0 for a payload) has to be set, the other fields are filled in;
+// returns the bytes written including the padding to a multiple of 8
+size_t frameCodecEncode(const frame_codec* c, const void* raw, size_t raw_bytes,
+                        frame_segment* segment, void* out, size_t capacity, void* scratch)
+{
+    const unsigned char* data = (const unsigned char*)raw;
+    unsigned char* stage = (unsigned char*)scratch;
+    size_t size = raw_bytes;
+    int width = imageElementSize(c->element_type);
+
+    if (isQuantized(c, segment))
+    {
+        const size_t n = raw_bytes / width;
+        quantize(c, raw, n, (int*)stage);
+        data = stage;
+        size = n * sizeof(int);
+        width = sizeof(int);
+        stage += raw_bytes;
+    }
+
+    if ((c->flags & FRAME_CODEC_SHUFFLE) && width > 1)
+    {
+        shuffle(data, stage, size, width);
+        data = stage;
+    }
+
+    segment->codec = FRAME_CODEC_NONE;
+    segment->compressed_bytes = (int)size;
+    segment->raw_bytes = (int)raw_bytes;
+    segment->reserved = 0;
+
+    if (c->codec != FRAME_CODEC_NONE)
+    {
+        const size_t compressed = compressBackend(c->codec, data, size, out, capacity);
+
+        if (compressed > 0 && compressed < size)
+        {
+            segment->codec = c->codec;
+            segment->compressed_bytes = (int)compressed;
+        }
+    }
+
+    if (segment->codec == FRAME_CODEC_NONE)
+    {
+        memcpy(out, data, size);
+    }
+
+    size = segment->compressed_bytes;
+    memset((unsigned char*)out + size, 0, ((size + 7) & ~(size_t)7) - size);
+    return (size + 7) & ~(size_t)7;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// decompresses a segment into its segment->raw_bytes long raw data,
+// returns 0 if the segment is corrupt or its codec is not available
+int frameCodecDecode(frame_codec* c, const frame_segment* segment, const void* in,
+                     void* raw, void* scratch)
+{
+    const int element_size = imageElementSize(c->element_type);
+    const int quantized = isQuantized(c, segment);
+    const size_t raw_bytes = segment->raw_bytes;
+    const size_t size = quantized ? (raw_bytes / element_size) * sizeof(int) : raw_bytes;
+    const int width = quantized ? (int)sizeof(int) : element_size;
+    const int shuffled = (c->flags & FRAME_CODEC_SHUFFLE) && width > 1;
+    unsigned char* data = (shuffled || quantized) ? (unsigned char*)scratch : (unsigned char*)raw;
+
+    // stored segments come first if the data does not compress at the start
+    if (!createDecoder(c, c->codec) ||
+        segment->compressed_bytes < 0 || segment->raw_bytes < 0 ||
+        !decompressBackend(c, segment->codec, in, segment->compressed_bytes, data, size))
+    {
+        return 0;
+    }
+
+    if (shuffled)
+    {
+        unsigned char* target = quantized ? (unsigned char*)scratch + raw_bytes : (unsigned char*)raw;
+        unshuffle(data, target, size, width);
+        data = target;
+    }
+
+    if (quantized)
+    {
+        dequantize(c, (const int*)data, raw_bytes / element_size, raw);
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// checks the segment table of a compressed message of payload_bytes for an
+// nx x ny block before anything is decoded: every segment has to lie within
+// the payload and either be the only one, a payload segment (nx = 0) of at
+// most max_raw_bytes, or a rectangle of the block holding num_channels
+// channels in a FRAME_ENCODING_FULL message, the rectangles adding up to the
+// whole block; returns the number of segments or 0 if the table is corrupt
+int frameCodecCheckSegments(const frame_codec* c, const void* payload, size_t payload_bytes, int max_segments,
+                            int encoding, int nx, int ny, int num_channels, size_t max_raw_bytes)
+{
+    const size_t element_size = imageElementSize(c->element_type);
+    const frame_segment* segments = (const frame_segment*)((const char*)payload + 2 * sizeof(int));
+    size_t offset, raw_bytes = 0;
+    int num_segments = 0;
+    int i;
+
+    if (payload_bytes < (size_t)frameSegmentTableSize(0))
+    {
+        return 0;
+    }
+    memcpy(&num_segments, payload, sizeof(int));
+    if (num_segments < 1 || num_segments > max_segments ||
+        (size_t)frameSegmentTableSize(num_segments) > payload_bytes)
+    {
+        return 0;
+    }
+
+    offset = frameSegmentTableSize(num_segments);
+    for (i = 0; i < num_segments; ++i)
+    {
+        const frame_segment* segment = &segments[i];
+
+        if (segment->compressed_bytes < 0 || segment->raw_bytes < 0 || offset > payload_bytes ||
+            (size_t)segment->compressed_bytes > payload_bytes - offset)
+        {
+            return 0;
+        }
+
+        if (segment->nx == 0)
+        {
+            // the whole payload of a delta encoded message
+            if (num_segments != 1 || (size_t)segment->raw_bytes > max_raw_bytes)
+            {
+                return 0;
+            }
+            return 1;
+        }
+
+        if (encoding != FRAME_ENCODING_FULL ||
+            segment->offset_x < 0 || segment->offset_y < 0 || segment->nx < 1 || segment->ny < 1 ||
+            segment->nx > nx - segment->offset_x || segment->ny > ny - segment->offset_y ||
+            (size_t)segment->raw_bytes != (size_t)segment->nx * segment->ny * element_size * num_channels)
+        {
+            return 0;
+        }
+
+        raw_bytes += segment->raw_bytes;
+        offset += ((size_t)segment->compressed_bytes + 7) & ~(size_t)7;
+    }
+
+    // the rectangles make up the whole block
+    return raw_bytes == (size_t)nx * ny * element_size * num_channels ? num_segments : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// frees the decompression state of the backends, the codec may be used again
+void frameCodecRelease(frame_codec* c)
+{
+#ifdef FRAME_CODEC_HAVE_ZLIB
+    if (c->zlib_stream)
+    {
+        inflateEnd((z_stream*)c->zlib_stream);
+        free(c->zlib_stream);
+    }
+#endif
+#ifdef FRAME_CODEC_HAVE_ZSTD
+    ZSTD_freeDCtx((ZSTD_DCtx*)c->zstd_context);
+#endif
+    c->zlib_stream = 0;
+    c->zstd_context = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int frameCodecFromString(const char* name, int* codec)
+{
+    if (strcmp(name, "none") == 0)
+    {
+        *codec = FRAME_CODEC_NONE;
+        return 1;
+    }
+    else if (strcmp(name, "zlib") == 0)
+    {
+        *codec = FRAME_CODEC_ZLIB;
+        return 1;
+    }
+    else if (strcmp(name, "lz4") == 0)
+    {
+        *codec = FRAME_CODEC_LZ4;
+        return 1;
+    }
+    else if (strcmp(name, "zstd") == 0)
+    {
+        *codec = FRAME_CODEC_ZSTD;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+const char* frameCodecToString(int codec)
+{
+    switch (codec)
+    {
+    case FRAME_CODEC_ZLIB: return "zlib";
+    case FRAME_CODEC_LZ4:  return "lz4";
+    case FRAME_CODEC_ZSTD: return "zstd";
+    case FRAME_CODEC_NONE:
+    default:               return "none";
+    }
+}
@@ -0,0 +1,58 @@
+/**************************************************************************//**
+ * @file frame_codec.h
+ * @brief Compression of image data messages
+ *
+ * This file declares the codec stage shared by server and client. A segment
+ * of a message is optionally quantized (lossy, float and double elements
+ * only) and byte-shuffled before it is compressed by one of the backends
+ * compiled in (FRAME_CODEC_HAVE_ZLIB, FRAME_CODEC_HAVE_LZ4,
+ * FRAME_CODEC_HAVE_ZSTD). Data that does not get smaller is stored. The
+ * decompression state of the backends is kept in the codec, so decoding
+ * allocates nothing after the first segment of each backend.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <stddef.h>
+#include "mpi_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    int codec;              // FRAME_CODEC_*
+    int flags;              // FRAME_CODEC_SHUFFLE | FRAME_CODEC_QUANTIZE
+    int element_type;       // IMAGE_TYPE_*
+    double quantize_step;   // in element units
+    void* zlib_stream;      // decompression state, 0 until the first segment needs it
+    void* zstd_context;     // (see frameCodecRelease)
+} frame_codec;
+
+/* ------------------------------------------------------------------------- */
+
+int    frameCodecIsActive(const frame_codec* c);
+int    frameCodecIsAvailable(int codec);
+size_t frameCodecBound(size_t raw_bytes, int num_segments);
+size_t frameCodecScratchSize(size_t raw_bytes);
+size_t frameCodecEncode(const frame_codec* c, const void* raw, size_t raw_bytes,
+                        frame_segment* segment, void* out, size_t capacity, void* scratch);
+int    frameCodecDecode(frame_codec* c, const frame_segment* segment, const void* in,
+                        void* raw, void* scratch);
+int    frameCodecCheckSegments(const frame_codec* c, const void* payload, size_t payload_bytes, int max_segments,
+                               int encoding, int nx, int ny, int num_channels, size_t max_raw_bytes);
+void   frameCodecRelease(frame_codec* c);
+int    frameCodecFromString(const char* name, int* codec);
+const char* frameCodecToString(int codec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_CODEC_H
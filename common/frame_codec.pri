@@ -0,0 +1,19 @@
+# codec stage of the image data messages, shared by server and client;
+# zlib is always compiled in, add CONFIG+=lz4 and/or CONFIG+=zstd to the
+# qmake call to enable the other backends
+
+SOURCES += $$PWD/frame_codec.c
+HEADERS += $$PWD/frame_codec.h
+
+DEFINES += FRAME_CODEC_HAVE_ZLIB
+LIBS += -lz
+
+lz4 {
+    DEFINES += FRAME_CODEC_HAVE_LZ4
+    LIBS += -llz4
+}
+
+zstd {
+    DEFINES += FRAME_CODEC_HAVE_ZSTD
+    LIBS += -lzstd
+}
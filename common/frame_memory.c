@@ -0,0 +1,326 @@
+/**************************************************************************//**
+ * @file frame_memory.c
+ * @brief Memory of the buffers the frames are sent from and received into
+ *
+ * This file implements the frame buffer allocator. The first page of every
+ * allocation ends with a header describing it, the buffer starts right
+ * after it on the next page boundary, so frameMemoryFree needs nothing but
+ * the buffer. Huge pages are taken from the reserved pool (MAP_HUGETLB,
+ * MEM_LARGE_PAGES) if possible and requested as transparent huge pages
+ * (MADV_HUGEPAGE) otherwise, which includes the memory of MPI_Alloc_mem.
+ * Pinning is subject to the locked memory limit of the process.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+#include "frame_memory.h"
+#if defined (_WIN32) || defined (_WIN64)
+#include <Windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// size of the reserved huge pages mappings are rounded to
+#define FRAME_MEMORY_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+#define MEMORY_SOURCE_SYSTEM 0  // mmap or VirtualAlloc
+#define MEMORY_SOURCE_MPI    1  // MPI_Alloc_mem
+
+typedef struct
+{
+    void* base;             // start of the allocation
+    size_t length;          // bytes allocated
+    size_t bytes;           // bytes of the buffer
+    int source;             // MEMORY_SOURCE_*
+    int flags;              // FRAME_MEMORY_* the buffer got
+} memory_header;
+
+/* ------------------------------------------------------------------------- */
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static memory_header* headerOf(const void* memory)
+{
+    return (memory_header*)((char*)memory - sizeof(memory_header));
+}
+
+/* ------------------------------------------------------------------------- */
+
+// maps length bytes of the system, from huge pages if *flags has
+// FRAME_MEMORY_HUGE, which is cleared if there are none
+static void* mapMemory(size_t* length, int* flags)
+{
+    void* base = 0;
+
+#if defined (_WIN32) || defined (_WIN64)
+    if (*flags & FRAME_MEMORY_HUGE)
+    {
+        const size_t huge = GetLargePageMinimum();
+        // needs the SeLockMemoryPrivilege
+        if (huge > 0)
+        {
+            const size_t hugeLength = alignUp(*length, huge);
+            base = VirtualAlloc(NULL, hugeLength, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (base)
+            {
+                *length = hugeLength;
+                return base;
+            }
+        }
+        *flags &= ~FRAME_MEMORY_HUGE;
+    }
+    return VirtualAlloc(NULL, *length, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+#ifdef MAP_HUGETLB
+    if (*flags & FRAME_MEMORY_HUGE)
+    {
+        const size_t hugeLength = alignUp(*length, FRAME_MEMORY_HUGE_PAGE_SIZE);
+        base = mmap(NULL, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED)
+        {
+            *length = hugeLength;
+            return base;
+        }
+    }
+#endif
+    base = mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return 0;
+    }
+#ifdef MADV_HUGEPAGE
+    if ((*flags & FRAME_MEMORY_HUGE) && madvise(base, *length, MADV_HUGEPAGE) != 0)
+    {
+        *flags &= ~FRAME_MEMORY_HUGE;
+    }
+#else
+    *flags &= ~FRAME_MEMORY_HUGE;
+#endif
+    return base;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void unmapMemory(void* base, size_t length)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    (void)length;
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, length);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int lockMemory(void* memory, size_t bytes)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    return VirtualLock(memory, bytes) != 0;
+#else
+    return mlock(memory, bytes) == 0;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void unlockMemory(void* memory, size_t bytes)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    VirtualUnlock(memory, bytes);
+#else
+    munlock(memory, bytes);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+size_t frameMemoryPageSize(void)
+{
+#if defined (_WIN32) || defined (_WIN64)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    const long page = sysconf(_SC_PAGESIZE);
+    return page > 0 ? (size_t)page : 4096;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns a page aligned buffer of bytes bytes with as many of the
+// properties in flags as the system provides, or 0 if there is no memory;
+// FRAME_MEMORY_MPI is left out if MPI is not initialized
+void* frameMemoryAlloc(size_t bytes, int flags)
+{
+    const size_t page = frameMemoryPageSize();
+    memory_header header;
+    char* memory = 0;
+    int initialized = 0;
+
+    memset(&header, 0, sizeof(header));
+    header.bytes = bytes;
+    header.flags = flags & (FRAME_MEMORY_MPI | FRAME_MEMORY_HUGE | FRAME_MEMORY_PINNED);
+
+    MPI_Initialized(&initialized);
+    if (!initialized)
+    {
+        header.flags &= ~FRAME_MEMORY_MPI;
+    }
+
+    if (header.flags & FRAME_MEMORY_MPI)
+    {
+        // the header fits in front of the first page boundary within
+        header.length = bytes + page + sizeof(memory_header);
+        if (MPI_Alloc_mem((MPI_Aint)header.length, MPI_INFO_NULL, &header.base) == MPI_SUCCESS)
+        {
+            header.source = MEMORY_SOURCE_MPI;
+            memory = (char*)alignUp((size_t)header.base + sizeof(memory_header), page);
+#ifdef MADV_HUGEPAGE
+            if ((header.flags & FRAME_MEMORY_HUGE) &&
+                (bytes < page || madvise(memory, bytes / page * page, MADV_HUGEPAGE) != 0))
+            {
+                header.flags &= ~FRAME_MEMORY_HUGE;
+            }
+#else
+            header.flags &= ~FRAME_MEMORY_HUGE;
+#endif
+        }
+        else
+        {
+            header.flags &= ~FRAME_MEMORY_MPI;
+        }
+    }
+
+    if (!memory)
+    {
+        // the header takes the first page
+        header.length = bytes + page;
+        header.source = MEMORY_SOURCE_SYSTEM;
+        header.base = mapMemory(&header.length, &header.flags);
+        if (!header.base)
+        {
+            return 0;
+        }
+        memory = (char*)header.base + page;
+    }
+
+    if ((header.flags & FRAME_MEMORY_PINNED) && (bytes == 0 || !lockMemory(memory, bytes)))
+    {
+        header.flags &= ~FRAME_MEMORY_PINNED;
+    }
+
+    memcpy(headerOf(memory), &header, sizeof(header));
+    return memory;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void frameMemoryFree(void* memory)
+{
+    memory_header header;
+
+    if (!memory)
+    {
+        return;
+    }
+
+    memcpy(&header, headerOf(memory), sizeof(header));
+
+    if (header.flags & FRAME_MEMORY_PINNED)
+    {
+        unlockMemory(memory, header.bytes);
+    }
+
+    if (header.source == MEMORY_SOURCE_MPI)
+    {
+        MPI_Free_mem(header.base);
+    }
+    else
+    {
+        unmapMemory(header.base, header.length);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// FRAME_MEMORY_* the buffer got
+int frameMemoryFlags(const void* memory)
+{
+    return memory ? headerOf(memory)->flags : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// comma separated list of mpi, huge and pinned, or default for none;
+// returns 0 for an unknown name
+int frameMemoryFromString(const char* names, int* flags)
+{
+    const char* name = names;
+    int result = 0;
+
+    if (strcmp(names, "default") == 0)
+    {
+        *flags = 0;
+        return 1;
+    }
+
+    while (*name)
+    {
+        const char* end = strchr(name, ',');
+        const size_t length = end ? (size_t)(end - name) : strlen(name);
+
+        if (length == 3 && strncmp(name, "mpi", length) == 0)
+        {
+            result |= FRAME_MEMORY_MPI;
+        }
+        else if (length == 4 && strncmp(name, "huge", length) == 0)
+        {
+            result |= FRAME_MEMORY_HUGE;
+        }
+        else if (length == 6 && strncmp(name, "pinned", length) == 0)
+        {
+            result |= FRAME_MEMORY_PINNED;
+        }
+        else
+        {
+            return 0;
+        }
+
+        name += end ? length + 1 : length;
+    }
+
+    *flags = result;
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// flags in the form frameMemoryFromString takes, written to text
+const char* frameMemoryToString(int flags, char* text, size_t capacity)
+{
+    snprintf(text, capacity, "%s%s%s%s%s",
+             (flags & FRAME_MEMORY_MPI) ? "mpi" : "",
+             (flags & FRAME_MEMORY_MPI) && (flags & (FRAME_MEMORY_HUGE | FRAME_MEMORY_PINNED)) ? "," : "",
+             (flags & FRAME_MEMORY_HUGE) ? "huge" : "",
+             (flags & FRAME_MEMORY_HUGE) && (flags & FRAME_MEMORY_PINNED) ? "," : "",
+             (flags & FRAME_MEMORY_PINNED) ? "pinned" : "");
+    if (flags == 0)
+    {
+        snprintf(text, capacity, "default");
+    }
+    return text;
+}
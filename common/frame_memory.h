@@ -0,0 +1,45 @@
+/**************************************************************************//**
+ * @file frame_memory.h
+ * @brief Memory of the buffers the frames are sent from and received into
+ *
+ * This file declares the allocator shared by server and client for the
+ * buffers MPI reads frames from or writes them to. Every buffer starts at
+ * a page boundary and may be allocated by MPI_Alloc_mem, which lets the
+ * MPI library register it with the network once instead of on every
+ * transfer, backed by huge pages and pinned in physical memory. What is
+ * not available on the system is left out; frameMemoryFlags tells what
+ * a buffer got.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef FRAME_MEMORY_H
+#define FRAME_MEMORY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// properties of a buffer, page aligned memory of the system if none is set
+#define FRAME_MEMORY_MPI    1   // MPI_Alloc_mem, needs MPI to be initialized and freed before MPI_Finalize
+#define FRAME_MEMORY_HUGE   2   // huge pages: reserved ones if there are, transparent ones otherwise
+#define FRAME_MEMORY_PINNED 4   // locked, never paged out
+
+/* ------------------------------------------------------------------------- */
+
+void*  frameMemoryAlloc(size_t bytes, int flags);
+void   frameMemoryFree(void* memory);
+int    frameMemoryFlags(const void* memory);
+size_t frameMemoryPageSize(void);
+int    frameMemoryFromString(const char* names, int* flags);
+const char* frameMemoryToString(int flags, char* text, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_MEMORY_H
@@ -0,0 +1,66 @@
+/**************************************************************************//**
+ * @file frame_recording.h
+ * @brief File format of frame recordings
+ *
+ * This file is shared by the server (mpi-compute, C), which records the
+ * frames it computes, and the client (mpi-visualize, C++), which replays
+ * them, and defines the layout of a recording file.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef FRAME_RECORDING_H
+#define FRAME_RECORDING_H
+
+// bump whenever the layout below changes
+#define FRAME_RECORDING_VERSION 1
+
+#define FRAME_RECORDING_MAGIC "MPIFRAME"
+
+// the header and every chunk start at a multiple of this
+#define FRAME_RECORDING_ALIGNMENT 4096
+
+/*
+ * A recording starts with a frame_recording_header, padded to data_offset
+ * bytes. Frame k is stored in the chunk at data_offset + k * chunk_size: a
+ * frame_record followed by the width*height elements of the whole image at
+ * full resolution, stored row-major, and padding up to chunk_size. Every
+ * chunk has the same size, so a frame is found without reading the frames
+ * before it. All values are stored in the byte order of the server; an
+ * element e represents the value e / scale.
+ *
+ * Every process of the server writes its own block into each chunk, rank 0
+ * also writes the record. num_frames is written when the recording is
+ * closed; if it is 0 the recording was interrupted and the number of
+ * complete chunks follows from the size of the file, a chunk whose frame
+ * does not match its position has not been written completely.
+ */
+typedef struct
+{
+    char magic[8];          // FRAME_RECORDING_MAGIC, not terminated
+    int version;            // FRAME_RECORDING_VERSION
+    int width;              // size of the whole image in x
+    int height;             // size of the whole image in y
+    int element_type;       // IMAGE_TYPE_* of mpi_protocol.h
+    int num_frames;         // 0 while recording, see above
+    int reserved;
+    double scale;           // element value = scale * physical value
+    long long data_offset;  // bytes before the first chunk
+    long long chunk_size;   // bytes from one chunk to the next
+} frame_recording_header;
+
+typedef struct
+{
+    int frame;              // position of the chunk in the file
+    int sequence;           // frame number of the server, see frame_header
+    double time;            // seconds since the server started computing
+    double min_value;       // range of the elements of the whole image
+    double max_value;
+} frame_record;
+
+// the elements follow the record, which keeps them aligned
+#define FRAME_RECORD_SIZE (int)sizeof(frame_record)
+
+#endif // FRAME_RECORDING_H
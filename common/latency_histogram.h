@@ -0,0 +1,187 @@
+/**************************************************************************//**
+ * @file latency_histogram.h
+ * @brief Fixed-size latency histograms
+ *
+ * This file is shared by the server (mpi-compute, C) and the client
+ * (mpi-visualize, C++) and implements histograms with logarithmic bins
+ * from 1 us to 100 s (20 bins per decade, i.e. percentiles are accurate to
+ * about 12%), so that recording a sample never allocates. Histograms of all
+ * pipeline stages are exported in the same CSV or JSON layout by both
+ * programs.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define LATENCY_MIN_SECONDS     1e-6
+#define LATENCY_BINS_PER_DECADE 20
+#define LATENCY_DECADES         8
+// bin 0 collects samples below LATENCY_MIN_SECONDS, the last bin those above 100 s
+#define LATENCY_BINS (LATENCY_BINS_PER_DECADE * LATENCY_DECADES + 2)
+
+typedef struct
+{
+    int count;
+    double sum;                 // seconds
+    double max;                 // seconds
+    int bins[LATENCY_BINS];
+} latency_histogram;
+
+/* ------------------------------------------------------------------------- */
+
+static inline void latencyHistogramReset(latency_histogram* h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void latencyHistogramAdd(latency_histogram* h, double seconds)
+{
+    int bin = 0;
+
+    // negative values only come from clock offset errors, count them as 0
+    if (seconds > LATENCY_MIN_SECONDS)
+    {
+        bin = 1 + (int)(log10(seconds / LATENCY_MIN_SECONDS) * LATENCY_BINS_PER_DECADE);
+        if (bin > LATENCY_BINS - 1)
+        {
+            bin = LATENCY_BINS - 1;
+        }
+    }
+    else if (!(seconds > 0.0))
+    {
+        seconds = 0.0;
+    }
+
+    if (h->count == 0 || seconds > h->max)
+    {
+        h->max = seconds;
+    }
+    h->sum += seconds;
+    ++h->count;
+    ++h->bins[bin];
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void latencyHistogramMerge(latency_histogram* dst, const latency_histogram* src)
+{
+    int bin;
+
+    if (src->count == 0)
+    {
+        return;
+    }
+    if (dst->count == 0 || src->max > dst->max)
+    {
+        dst->max = src->max;
+    }
+    dst->sum += src->sum;
+    dst->count += src->count;
+    for (bin = 0; bin < LATENCY_BINS; ++bin)
+    {
+        dst->bins[bin] += src->bins[bin];
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// upper edge of the bin containing the p-quantile (0 <= p <= 1), at most max
+static inline double latencyHistogramPercentile(const latency_histogram* h, double p)
+{
+    const double target = p * h->count;
+    double edge = LATENCY_MIN_SECONDS;
+    int cumulative = 0;
+    int bin;
+
+    if (h->count == 0)
+    {
+        return 0.0;
+    }
+
+    for (bin = 0; bin < LATENCY_BINS; ++bin)
+    {
+        cumulative += h->bins[bin];
+        if (bin > 0)
+        {
+            edge = LATENCY_MIN_SECONDS * pow(10.0, (double)bin / LATENCY_BINS_PER_DECADE);
+        }
+        if (cumulative >= target && cumulative > 0)
+        {
+            break;
+        }
+    }
+
+    return (edge < h->max) ? edge : h->max;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline double latencyHistogramMean(const latency_histogram* h)
+{
+    return h->count ? h->sum / h->count : 0.0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// writes one entry per stage to the file, as JSON if the name ends with
+// ".json" and as CSV otherwise; times are given in milliseconds
+static inline int latencyHistogramWriteFile(const char* file_name, const char* const* stages,
+                                            const latency_histogram* h, int num_stages)
+{
+    const size_t length = strlen(file_name);
+    const int json = length >= 5 && strcmp(file_name + length - 5, ".json") == 0;
+    FILE* file = fopen(file_name, "wt");
+    int i;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    if (json)
+    {
+        fprintf(file, "{\n");
+    }
+    else
+    {
+        fprintf(file, "stage,count,mean_ms,p50_ms,p99_ms,max_ms\n");
+    }
+
+    for (i = 0; i < num_stages; ++i)
+    {
+        const double mean = 1e3 * latencyHistogramMean(&h[i]);
+        const double p50 = 1e3 * latencyHistogramPercentile(&h[i], 0.50);
+        const double p99 = 1e3 * latencyHistogramPercentile(&h[i], 0.99);
+        const double max = 1e3 * h[i].max;
+
+        if (json)
+        {
+            fprintf(file, "  \"%s\": {\"count\": %d, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}%s\n",
+                    stages[i], h[i].count, mean, p50, p99, max, (i + 1 < num_stages) ? "," : "");
+        }
+        else
+        {
+            fprintf(file, "%s,%d,%.4f,%.4f,%.4f,%.4f\n", stages[i], h[i].count, mean, p50, p99, max);
+        }
+    }
+
+    if (json)
+    {
+        fprintf(file, "}\n");
+    }
+
+    fclose(file);
+    return 1;
+}
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,395 @@
+/**************************************************************************//**
+ * @file mpi_protocol.h
+ * @brief Messages exchanged between mpi-compute and mpi-visualize
+ *
+ * This file is shared by the server (mpi-compute, C) and the client
+ * (mpi-visualize, C++) and defines the message tags and the layout
+ * of the messages sent over the intercommunicator.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef MPI_PROTOCOL_H
+#define MPI_PROTOCOL_H
+
+#include <mpi.h>
+#include <string.h>
+
+// bump whenever the layout of any message below changes
+#define MPI_PROTOCOL_VERSION 9
+
+#define MPI_TAG_MESSAGE_QUIT   0
+#define MPI_TAG_IMAGE_DATA     1
+#define MPI_TAG_HANDSHAKE      2
+#define MPI_TAG_VIEW_REQUEST   3
+#define MPI_TAG_PROBE_REQUEST  4
+#define MPI_TAG_PROBE_DATA     5
+#define MPI_TAG_WINDOW         6
+#define MPI_TAG_IMAGE_CREDIT   7
+
+// name the server publishes its port under (MPI_Publish_name) by default
+#define MPI_SERVICE_NAME "mpi-compute"
+
+// how image data reaches the client
+#define FRAME_MODE_GATHER 0     // rank 0 gathers and sends the whole image
+#define FRAME_MODE_DIRECT 1     // every rank sends its own block
+
+// how a message of image data gets into the receive buffer of the client
+#define FRAME_TRANSPORT_SEND 0  // sent into a posted receive
+#define FRAME_TRANSPORT_PUT  1  // put into a window of the receive buffers, see below
+
+// element type of the image data
+#define IMAGE_TYPE_INT8   0
+#define IMAGE_TYPE_INT16  1
+#define IMAGE_TYPE_FLOAT  2
+#define IMAGE_TYPE_DOUBLE 3
+
+// content of an image data message
+#define FRAME_ENCODING_FULL  0  // all elements of the block
+#define FRAME_ENCODING_TILES 1  // only the tiles that changed, see below
+
+// compression of the payload of an image data message
+#define FRAME_CODEC_NONE 0
+#define FRAME_CODEC_ZLIB 1
+#define FRAME_CODEC_LZ4  2
+#define FRAME_CODEC_ZSTD 3
+
+// transformations applied before compressing
+#define FRAME_CODEC_SHUFFLE  1  // group the bytes of the elements by significance
+#define FRAME_CODEC_QUANTIZE 2  // lossy: float/double elements as int32 multiples of quantize_step
+
+// most fields (channels) a frame may consist of
+#define FRAME_MAX_CHANNELS 8
+#define FRAME_CHANNEL_NAME_LENGTH 16
+
+// shape of a probe
+#define FRAME_PROBE_POINT 0     // a single element
+#define FRAME_PROBE_LINE  1     // the elements on a line
+#define FRAME_PROBE_RECT  2     // the elements of a rectangle
+
+// most probes of a client and steps of a probe data message
+#define FRAME_MAX_PROBES 8
+#define FRAME_PROBE_MAX_STEPS 256
+
+/*
+ * Handshake, sent by rank 0 of the server right after the connection has
+ * been accepted: one frame_handshake (as MPI_BYTE) followed by num_blocks
+ * frame_block entries (as MPI_INT). From then on block i is sent by rank i
+ * of the server group with tag MPI_TAG_IMAGE_DATA as one frame_header
+ * followed by its payload (as MPI_BYTE). An element e of the image
+ * represents the value e / scale.
+ */
+typedef struct
+{
+    int version;        // MPI_PROTOCOL_VERSION of the server
+    int mode;           // FRAME_MODE_GATHER or FRAME_MODE_DIRECT
+    int transport;      // FRAME_TRANSPORT_* the server offers
+    int width;          // size of the whole image in x
+    int height;         // size of the whole image in y
+    int element_type;   // IMAGE_TYPE_*
+    int tiles_x;        // number of blocks of the server decomposition in x
+    int tiles_y;        // number of blocks of the server decomposition in y
+    int num_blocks;     // number of frame_block entries that follow
+    int delta_tile;     // tile size of the delta encoding, 0 = always FRAME_ENCODING_FULL
+    int codec;          // FRAME_CODEC_*
+    int codec_flags;    // FRAME_CODEC_SHUFFLE | FRAME_CODEC_QUANTIZE
+    int max_segments;   // most segments a message may consist of
+    int max_level;      // coarsest level a view may ask for
+    int num_channels;   // fields of the image, 1 to FRAME_MAX_CHANNELS
+    double scale;       // element value = scale * physical value
+    double quantize_step; // FRAME_CODEC_QUANTIZE: element value = quantized value * quantize_step
+    char channel_names[FRAME_MAX_CHANNELS][FRAME_CHANNEL_NAME_LENGTH]; // terminated
+} frame_handshake;
+
+typedef struct
+{
+    int offset_x;
+    int offset_y;
+    int nx;
+    int ny;
+} frame_block;
+
+#define FRAME_BLOCK_INTS (int)(sizeof(frame_block) / sizeof(int))
+
+// after the block table the client sends its time (one MPI_DOUBLE, tag
+// MPI_TAG_HANDSHAKE) this often and rank 0 answers each with its MPI_Wtime;
+// all times of frame_header refer to the clock of server rank 0
+#define FRAME_CLOCK_SYNC_ROUNDS 8
+
+// coarsest downsampled level of the image
+#define FRAME_MAX_LEVEL 10
+
+/*
+ * A view is a region of a downsampled level of the image and the channels
+ * the client subscribes to; it is requested by sending a frame_view (as
+ * MPI_INT, tag MPI_TAG_VIEW_REQUEST) to server rank 0. Cell (i, j) of level
+ * l averages the elements [i * 2^l, (i + 1) * 2^l) x [j * 2^l, (j + 1) * 2^l)
+ * within the block holding its first element (see frameViewBlockCells).
+ * The view with id 0 is the full view of the first channel.
+ */
+typedef struct
+{
+    int id;                 // increases with every request of the client
+    int level;              // cells are 2^level x 2^level elements
+    int x;                  // region of the image, in cells of the level
+    int y;
+    int nx;
+    int ny;
+    int channels;           // bit mask of the channels, channel c is bit c
+} frame_view;
+
+#define FRAME_VIEW_INTS (int)(sizeof(frame_view) / sizeof(int))
+
+/*
+ * The payload after the header holds every channel of the view one after
+ * the other: the elements of the block, or its cells of the view, stored
+ * row-major, or for FRAME_ENCODING_TILES num_tiles tile indices (int,
+ * padded to a multiple of 8 bytes) followed by the elements of these
+ * tiles. Delta tiles are delta_tile x delta_tile elements, smaller at the
+ * right and bottom edge, numbered row-major within the block; tile t of
+ * the i-th channel of the message has the index i * tiles + t. The messages
+ * of a block have to be applied in order, outside of the full view
+ * (frameViewIsFull) they are always FRAME_ENCODING_FULL.
+ */
+typedef struct
+{
+    int sequence;           // frame number of the server, equal for all blocks of a frame
+    int block;              // index into the block table of the handshake
+    int encoding;           // FRAME_ENCODING_*
+    int num_tiles;          // number of tiles in a FRAME_ENCODING_TILES message
+    frame_view view;        // the message holds the cells of this view owned by the block
+    double compute_start;   // MPI_Wtime when computing the frame started
+    double compute_time;    // seconds spent computing the block
+    double gather_time;     // seconds spent gathering and assembling the image, 0 in direct mode
+    double encode_time;     // seconds spent on delta encoding and compression
+    double post_time;       // MPI_Wtime when the send was posted
+    double min_value[FRAME_MAX_CHANNELS]; // range of the elements of channel c of the view before
+    double max_value[FRAME_MAX_CHANNELS]; // encoding (the whole image in gather mode), min > max if empty
+} frame_header;
+
+// the elements follow the header, which keeps them aligned
+#define FRAME_HEADER_SIZE (int)sizeof(frame_header)
+
+/*
+ * FRAME_TRANSPORT_PUT: after the clock synchronization the client and the
+ * server group merge the intercomm (server group first) and create a
+ * window in which the client exposes its receive buffers. Once an
+ * MPI_Allreduce (MPI_MIN of one MPI_INT) agrees that every process created
+ * it, the client sends every server rank a frame_window_slots (tag
+ * MPI_TAG_WINDOW), and the window is used if a second one agrees that all
+ * of them are usable. A server rank then puts every message into the next buffer of
+ * its block in ring order and sends a frame_put_notice (tag
+ * MPI_TAG_IMAGE_DATA) once it arrived; the client gives each buffer back
+ * by sending its index (one MPI_INT, tag MPI_TAG_IMAGE_CREDIT).
+ */
+typedef struct
+{
+    MPI_Aint displacement;  // of the first receive buffer of the block in the window
+    MPI_Aint slot_bytes;    // distance of the buffers, and the most a message may have
+    int slot_count;         // buffers of the block
+    int reserved;
+} frame_window_slots;
+
+typedef struct
+{
+    int slot;               // receive buffer the message was put into
+    int bytes;              // size of the message
+} frame_put_notice;
+
+#define FRAME_PUT_NOTICE_INTS (int)(sizeof(frame_put_notice) / sizeof(int))
+
+/*
+ * Probes are points, lines and rectangles of elements of one channel; a
+ * frame_probe_request (as MPI_INT, tag MPI_TAG_PROBE_REQUEST) to server
+ * rank 0 replaces those of the client. The server samples them every
+ * interval seconds, independently of the frames, and sends the steps since
+ * its previous message as one frame_probe_header followed by num_steps *
+ * num_probes frame_probe_stats, step-major (as MPI_BYTE, tag
+ * MPI_TAG_PROBE_DATA).
+ */
+typedef struct
+{
+    int type;               // FRAME_PROBE_*
+    int channel;
+    int x0;                 // elements of the image: the point, the ends of the
+    int y0;                 // line or opposite corners of the rectangle
+    int x1;
+    int y1;
+} frame_probe;
+
+typedef struct
+{
+    int id;                 // increases with every request of the client
+    int num_probes;         // 0 to FRAME_MAX_PROBES
+    frame_probe probes[FRAME_MAX_PROBES];
+} frame_probe_request;
+
+#define FRAME_PROBE_REQUEST_INTS (int)(sizeof(frame_probe_request) / sizeof(int))
+
+typedef struct
+{
+    int request;            // id of the request the probes were registered with
+    int num_probes;
+    int first_step;         // steps missing before it were dropped
+    int num_steps;
+    double interval;        // seconds between two steps
+    double post_time;       // MPI_Wtime when the message was sent
+} frame_probe_header;
+
+typedef struct
+{
+    double min_value;       // of the physical values of the probe elements
+    double max_value;
+    double mean;
+    double rms;             // root mean square
+} frame_probe_stats;
+
+// bytes of a probe data message
+static inline int frameProbeMessageSize(int num_probes, int num_steps)
+{
+    return (int)(sizeof(frame_probe_header) + (size_t)num_probes * num_steps * sizeof(frame_probe_stats));
+}
+
+/*
+ * If codec or codec_flags are set, the payload is split into segments that
+ * are compressed independently: an int with the number of segments, an int
+ * of padding, the frame_segment table and the data of every segment, padded
+ * to a multiple of 8 bytes. A segment holds a rectangle of the block of
+ * every channel one after the other or, if nx is 0, the whole payload.
+ */
+typedef struct
+{
+    int codec;              // FRAME_CODEC_* actually used, incompressible data is stored
+    int compressed_bytes;   // without padding
+    int raw_bytes;          // after decompressing and undoing the transformations
+    int offset_x;           // rectangle within the block, nx = 0 for a payload segment
+    int offset_y;
+    int nx;
+    int ny;
+    int reserved;
+} frame_segment;
+
+#define FRAME_SEGMENT_INTS (int)(sizeof(frame_segment) / sizeof(int))
+
+// bytes of the segment table of a compressed message
+static inline int frameSegmentTableSize(int num_segments)
+{
+    return (int)(2 * sizeof(int) + num_segments * sizeof(frame_segment));
+}
+
+// bytes of the tile index table of a FRAME_ENCODING_TILES message
+static inline int frameTileTableSize(int num_tiles)
+{
+    return (int)((num_tiles * sizeof(int) + 7) & ~(size_t)7);
+}
+
+// number of delta tiles of an n elements long block edge
+static inline int frameTileCount(int n, int delta_tile)
+{
+    return (n + delta_tile - 1) / delta_tile;
+}
+
+// returns 1 if the view holds every element of a width x height image
+static inline int frameViewIsFull(const frame_view* view, int width, int height)
+{
+    return view->level == 0 && view->x == 0 && view->y == 0 && view->nx == width && view->ny == height;
+}
+
+// number of channels in a bit mask of channels
+static inline int frameChannelCount(int channels)
+{
+    int n = 0;
+
+    for (; channels; channels &= channels - 1)
+    {
+        ++n;
+    }
+    return n;
+}
+
+// bit mask of all channels of an image of num_channels channels
+static inline int frameAllChannels(int num_channels)
+{
+    return (1 << num_channels) - 1;
+}
+
+// cells of the view owned by the block, i.e. the cells whose first element
+// lies within the block; in cells of the view level, nx or ny may be 0
+static inline frame_block frameViewBlockCells(const frame_view* view, const frame_block* block)
+{
+    const int f = 1 << view->level;
+    const int x0 = (block->offset_x + f - 1) / f;
+    const int y0 = (block->offset_y + f - 1) / f;
+    const int x1 = (block->offset_x + block->nx + f - 1) / f;
+    const int y1 = (block->offset_y + block->ny + f - 1) / f;
+    frame_block cells;
+
+    cells.offset_x = x0 > view->x ? x0 : view->x;
+    cells.offset_y = y0 > view->y ? y0 : view->y;
+    cells.nx = (x1 < view->x + view->nx ? x1 : view->x + view->nx) - cells.offset_x;
+    cells.ny = (y1 < view->y + view->ny ? y1 : view->y + view->ny) - cells.offset_y;
+    if (cells.nx < 0 || cells.ny < 0)
+    {
+        cells.nx = 0;
+        cells.ny = 0;
+    }
+    return cells;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline int imageElementSize(int element_type)
+{
+    switch (element_type)
+    {
+    case IMAGE_TYPE_INT8:   return 1;
+    case IMAGE_TYPE_INT16:  return 2;
+    case IMAGE_TYPE_FLOAT:  return 4;
+    case IMAGE_TYPE_DOUBLE: return 8;
+    default:                return 0;
+    }
+}
+
+static inline MPI_Datatype imageElementMpiType(int element_type)
+{
+    switch (element_type)
+    {
+    case IMAGE_TYPE_INT8:   return MPI_SIGNED_CHAR;
+    case IMAGE_TYPE_INT16:  return MPI_SHORT;
+    case IMAGE_TYPE_FLOAT:  return MPI_FLOAT;
+    case IMAGE_TYPE_DOUBLE: return MPI_DOUBLE;
+    default:                return MPI_DATATYPE_NULL;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns 1 and sets *transport if name is "send" or "put"
+static inline int frameTransportFromString(const char* name, int* transport)
+{
+    if (strcmp(name, "send") == 0)
+    {
+        *transport = FRAME_TRANSPORT_SEND;
+        return 1;
+    }
+    else if (strcmp(name, "put") == 0)
+    {
+        *transport = FRAME_TRANSPORT_PUT;
+        return 1;
+    }
+    return 0;
+}
+
+static inline const char* frameTransportToString(int transport)
+{
+    switch (transport)
+    {
+    case FRAME_TRANSPORT_SEND: return "send";
+    case FRAME_TRANSPORT_PUT:  return "put";
+    default:                   return "unknown";
+    }
+}
+
+#endif // MPI_PROTOCOL_H
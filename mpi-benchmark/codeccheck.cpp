@@ -0,0 +1,565 @@
+/**************************************************************************//**
+ * @file codeccheck.cpp
+ * @brief Round trips through the encoding of image data messages
+ *
+ * This file checks what the server encodes against what the client
+ * decodes, without MPI communication. Blocks of every element type are
+ * compressed by every backend compiled in, with and without shuffling and
+ * quantization, and have to decode to their elements, exactly or within
+ * half a quantization step. A sequence of delta encoded messages with
+ * keyframes and a dropped message whose tiles are resent is applied to a
+ * copy of the block as the client does, which has to stay within the
+ * threshold of the block. Finally the segment table check of the client
+ * has to accept a message of several segments and reject corrupt tables.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <QtGlobal>
+#include "codeccheck.h"
+#include "frame_codec.h"
+#include "delta.h"
+
+#define QUANTIZE_STEP 0.01
+#define DELTA_FRAMES 20
+
+namespace {
+
+const char *elementTypeNames[] = { "int8", "int16", "float", "double" };
+
+double elementAt(int elementType, const char *data, size_t i)
+{
+    switch (elementType)
+    {
+    case IMAGE_TYPE_INT8:
+        return reinterpret_cast<const signed char*>(data)[i];
+    case IMAGE_TYPE_INT16:
+        return reinterpret_cast<const short*>(data)[i];
+    case IMAGE_TYPE_FLOAT:
+        return reinterpret_cast<const float*>(data)[i];
+    default:
+        return reinterpret_cast<const double*>(data)[i];
+    }
+}
+
+// integer elements are rounded and clamped to their type
+void setElement(int elementType, char *data, size_t i, double value)
+{
+    switch (elementType)
+    {
+    case IMAGE_TYPE_INT8:
+        reinterpret_cast<signed char*>(data)[i] = static_cast<signed char>(std::floor(qBound(-128.0, value, 127.0)+0.5));
+        break;
+    case IMAGE_TYPE_INT16:
+        reinterpret_cast<short*>(data)[i] = static_cast<short>(std::floor(qBound(-32768.0, value, 32767.0)+0.5));
+        break;
+    case IMAGE_TYPE_FLOAT:
+        reinterpret_cast<float*>(data)[i] = static_cast<float>(value);
+        break;
+    default:
+        reinterpret_cast<double*>(data)[i] = value;
+        break;
+    }
+}
+
+// n elements of a smooth field, which compresses, or of noise, which is
+// stored; with specials some of them are not finite
+void fillElements(int elementType, size_t n, int nx, bool smooth, bool specials, std::vector<char> *data)
+{
+    data->assign(n*imageElementSize(elementType), 0);
+    unsigned int random = 12345;
+    for (size_t i=0; i<n; ++i)
+    {
+        const int x = int(i % nx);
+        const int y = int(i / nx);
+        random = random*1103515245u + 12345u;
+        const double noise = (random >> 16) % 1000 * 0.1 - 50.0;
+        setElement(elementType, data->data(), i, smooth ? 100.0*std::sin(0.1*x)*std::cos(0.07*y) + 0.01*noise : noise);
+    }
+    if (specials && (elementType == IMAGE_TYPE_FLOAT || elementType == IMAGE_TYPE_DOUBLE))
+    {
+        const double special[] = { std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity(),
+                                   -std::numeric_limits<double>::infinity(), -0.0 };
+        for (size_t i=0; i<n; i+=7)
+        {
+            setElement(elementType, data->data(), i, special[(i/7) % 4]);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// compresses raw as a segment of the nx x ny rectangle (nx = 0 for a
+// payload) and decompresses it again; quantized elements may differ by half
+// a step, all others have to be reproduced exactly
+bool roundTrip(frame_codec *codec, const std::vector<char> &raw, int nx, int ny, const char *what)
+{
+    frame_segment segment;
+    memset(&segment, 0, sizeof(segment));
+    segment.nx = nx;
+    segment.ny = ny;
+    std::vector<char> encoded(frameCodecBound(raw.size(), 1));
+    std::vector<char> scratch(frameCodecScratchSize(raw.size()));
+    std::vector<char> decoded(raw.size());
+
+    const size_t size = frameCodecEncode(codec, raw.data(), raw.size(), &segment, encoded.data(), encoded.size(), scratch.data());
+    if (size > encoded.size() || size_t(segment.raw_bytes) != raw.size() ||
+        !frameCodecDecode(codec, &segment, encoded.data(), decoded.data(), scratch.data()))
+    {
+        std::cerr << what << ": failed to decode " << raw.size() << " bytes" << std::endl << std::flush;
+        return false;
+    }
+
+    const bool quantized = (codec->flags & FRAME_CODEC_QUANTIZE) && nx > 0 &&
+                           (codec->element_type == IMAGE_TYPE_FLOAT || codec->element_type == IMAGE_TYPE_DOUBLE);
+    if (!quantized)
+    {
+        if (memcmp(raw.data(), decoded.data(), raw.size()) != 0)
+        {
+            std::cerr << what << ": the decoded bytes differ" << std::endl << std::flush;
+            return false;
+        }
+        return true;
+    }
+
+    const double epsilon = codec->element_type == IMAGE_TYPE_FLOAT ? FLT_EPSILON : 4*DBL_EPSILON;
+    const size_t n = raw.size()/imageElementSize(codec->element_type);
+    for (size_t i=0; i<n; ++i)
+    {
+        const double value = elementAt(codec->element_type, raw.data(), i);
+        const double error = std::fabs(elementAt(codec->element_type, decoded.data(), i) - value);
+        if (!(error <= 0.5*codec->quantize_step + std::fabs(value)*epsilon))
+        {
+            std::cerr << what << ": element " << i << " is " << elementAt(codec->element_type, decoded.data(), i)
+                      << " instead of " << value << std::endl << std::flush;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool codecCases(int *count)
+{
+    // sizes whose elements are no multiple of the shuffle and chunk widths
+    static const int rectangles[][3] = { {1, 1, 1}, {7, 3, 1}, {64, 48, 1}, {123, 37, 1}, {123, 37, 3} };
+    const int numRectangles = sizeof(rectangles)/sizeof(rectangles[0]);
+
+    for (int codecIndex=FRAME_CODEC_NONE; codecIndex<=FRAME_CODEC_ZSTD; ++codecIndex)
+    {
+        if (!frameCodecIsAvailable(codecIndex))
+        {
+            std::cout << frameCodecToString(codecIndex) << " is not compiled in, skipped" << std::endl << std::flush;
+            continue;
+        }
+        for (int elementType=IMAGE_TYPE_INT8; elementType<=IMAGE_TYPE_DOUBLE; ++elementType)
+        {
+            for (int flags=0; flags<=(FRAME_CODEC_SHUFFLE | FRAME_CODEC_QUANTIZE); ++flags)
+            {
+                frame_codec codec;
+                memset(&codec, 0, sizeof(codec));
+                codec.codec = codecIndex;
+                codec.flags = flags;
+                codec.element_type = elementType;
+                codec.quantize_step = QUANTIZE_STEP;
+                const int elementSize = imageElementSize(elementType);
+                std::vector<char> raw;
+                bool ok = true;
+
+                for (int smooth=0; smooth<2 && ok; ++smooth)
+                {
+                    // quantization maps the elements that are not finite to 0
+                    const bool specials = !(flags & FRAME_CODEC_QUANTIZE);
+                    for (int r=0; r<numRectangles && ok; ++r)
+                    {
+                        const int nx = rectangles[r][0];
+                        const int ny = rectangles[r][1];
+                        fillElements(elementType, size_t(nx)*ny*rectangles[r][2], nx, smooth, specials, &raw);
+                        ok = roundTrip(&codec, raw, nx, ny, "rectangle");
+                        ++*count;
+                    }
+                    // a payload segment need not hold whole elements
+                    for (int tail=0; tail<elementSize && ok; ++tail)
+                    {
+                        fillElements(IMAGE_TYPE_INT8, 1000*elementSize + tail, 100, smooth, false, &raw);
+                        ok = roundTrip(&codec, raw, 0, 0, "payload");
+                        ++*count;
+                    }
+                }
+                frameCodecRelease(&codec);
+                if (!ok)
+                {
+                    std::cerr << "with " << frameCodecToString(codecIndex) << ", " << elementTypeNames[elementType]
+                              << ((flags & FRAME_CODEC_SHUFFLE) ? ", shuffled" : "")
+                              << ((flags & FRAME_CODEC_QUANTIZE) ? ", quantized" : "") << std::endl << std::flush;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the block of a frame of the delta sequence: a smooth field, a bump on a
+// tile that moves with the frame, a row that changes by at most the
+// threshold and a region of the last channel drifting by half of it per frame
+void fillDeltaFrame(const delta_encoder &e, int frame, std::vector<char> *image)
+{
+    const int bumpTile = (frame*7) % e.tiles_per_channel;
+    const int bumpChannel = frame % e.num_channels;
+    const int bumpX = (bumpTile % e.tiles_x)*e.tile_size;
+    const int bumpY = (bumpTile / e.tiles_x)*e.tile_size;
+    const double wobble = (frame % 3)*0.5*e.threshold;
+    const double drift = frame*0.25*e.threshold;
+
+    image->assign(size_t(e.nx)*e.ny*e.num_channels*e.element_size, 0);
+    for (int c=0; c<e.num_channels; ++c)
+    {
+        for (int y=0; y<e.ny; ++y)
+        {
+            for (int x=0; x<e.nx; ++x)
+            {
+                double value = 80.0*std::sin(0.1*x + c)*std::cos(0.07*y);
+                if (c == bumpChannel && x >= bumpX && x < bumpX+e.tile_size && y >= bumpY && y < bumpY+e.tile_size)
+                {
+                    value += 30.0;
+                }
+                if (y == frame % e.ny)
+                {
+                    value += wobble;
+                }
+                if (c == e.num_channels-1 && x < 20)
+                {
+                    value += drift;
+                }
+                setElement(e.element_type, image->data(), (size_t(c)*e.ny + y)*e.nx + x, value);
+            }
+        }
+    }
+}
+
+// copies the tiles of a decoded message into the block as the client does
+bool applyDelta(const delta_encoder &e, const frame_header &header, const char *payload, size_t payloadBytes, std::vector<char> *block)
+{
+    if (header.encoding == FRAME_ENCODING_FULL)
+    {
+        if (payloadBytes != block->size())
+        {
+            return false;
+        }
+        memcpy(block->data(), payload, payloadBytes);
+        return true;
+    }
+
+    const int *indices = reinterpret_cast<const int*>(payload);
+    size_t offset = frameTileTableSize(header.num_tiles);
+    for (int i=0; i<header.num_tiles; ++i)
+    {
+        if (indices[i] < 0 || indices[i] >= e.num_tiles)
+        {
+            return false;
+        }
+        const int plane = indices[i] / e.tiles_per_channel;
+        const int t = indices[i] % e.tiles_per_channel;
+        const int x = (t % e.tiles_x)*e.tile_size;
+        const int y = (t / e.tiles_x)*e.tile_size;
+        const size_t rowBytes = size_t(qMin(e.tile_size, e.nx-x))*e.element_size;
+        const int h = qMin(e.tile_size, e.ny-y);
+        if (offset + rowBytes*h > payloadBytes)
+        {
+            return false;
+        }
+        for (int row=0; row<h; ++row)
+        {
+            memcpy(block->data() + ((size_t(plane)*e.ny + y + row)*e.nx + x)*e.element_size, payload + offset, rowBytes);
+            offset += rowBytes;
+        }
+    }
+    return offset == payloadBytes;
+}
+
+// encodes a sequence of frames into the two buffers of a send pool, one
+// message being dropped on the way, and passes every message through the
+// codec; the block of the client has to stay within the threshold
+bool deltaSequence(int elementType, double threshold, int codecIndex, int *count)
+{
+    // the edge tiles are cut off
+    const int nx = 70, ny = 45, numChannels = 2, tileSize = 16;
+    delta_encoder e;
+    if (!deltaEncoderCreate(&e, nx, ny, numChannels, elementType, tileSize, threshold, 5, 2))
+    {
+        return false;
+    }
+
+    frame_codec codec;
+    memset(&codec, 0, sizeof(codec));
+    codec.codec = codecIndex;
+    codec.flags = FRAME_CODEC_SHUFFLE;
+    codec.element_type = elementType;
+
+    std::vector<char> image, client(size_t(nx)*ny*numChannels*e.element_size, 0);
+    std::vector<char> payload(deltaEncoderMaxSize(&e));
+    std::vector<char> message(frameCodecBound(payload.size(), 1));
+    std::vector<char> scratch(frameCodecScratchSize(payload.size()));
+    std::vector<char> decoded(payload.size());
+    int tileMessages = 0;
+    int dropped = -1;   // buffer of the message the client missed
+    bool ok = true;
+
+    for (int frame=0; frame<DELTA_FRAMES && ok; ++frame)
+    {
+        const int buffer = frame % 2;
+        if (frame == 12)
+        {
+            deltaEncoderRequestKeyframe(&e); // e.g. for a new client
+        }
+        fillDeltaFrame(e, frame, &image);
+
+        frame_header header;
+        memset(&header, 0, sizeof(header));
+        const size_t payloadBytes = deltaEncode(&e, image.data(), numChannels, &header, payload.data(), buffer,
+                                                dropped >= 0 ? deltaEncoderBufferTiles(&e, dropped) : 0);
+        dropped = -1;
+        if ((frame == 0 || frame == 12) && header.encoding != FRAME_ENCODING_FULL)
+        {
+            std::cerr << "frame " << frame << " is no keyframe" << std::endl << std::flush;
+            ok = false;
+            break;
+        }
+        tileMessages += header.encoding == FRAME_ENCODING_TILES;
+        ++*count;
+
+        // the drop policy 'oldest' replaces a queued message
+        if (frame == 7 || frame == 15)
+        {
+            dropped = buffer;
+            continue;
+        }
+
+        // a payload segment as the server sends it
+        const int tableSize = frameSegmentTableSize(1);
+        frame_segment *segment = reinterpret_cast<frame_segment*>(message.data() + 2*sizeof(int));
+        reinterpret_cast<int*>(message.data())[0] = 1;
+        reinterpret_cast<int*>(message.data())[1] = 0;
+        memset(segment, 0, sizeof(*segment));
+        const size_t messageBytes = tableSize + frameCodecEncode(&codec, payload.data(), payloadBytes, segment,
+                                                                 message.data() + tableSize, message.size() - tableSize, scratch.data());
+        ok = frameCodecCheckSegments(&codec, message.data(), messageBytes, 1, header.encoding, nx, ny, numChannels, payload.size()) == 1 &&
+             frameCodecDecode(&codec, segment, message.data() + tableSize, decoded.data(), scratch.data()) &&
+             applyDelta(e, header, decoded.data(), segment->raw_bytes, &client);
+        if (!ok)
+        {
+            std::cerr << "frame " << frame << " cannot be decoded" << std::endl << std::flush;
+            break;
+        }
+
+        const size_t n = size_t(nx)*ny*numChannels;
+        for (size_t i=0; i<n && ok; ++i)
+        {
+            const double error = std::fabs(elementAt(elementType, client.data(), i) - elementAt(elementType, image.data(), i));
+            if (!(error <= threshold))
+            {
+                std::cerr << "frame " << frame << ", element " << i << " differs by " << error << std::endl << std::flush;
+                ok = false;
+            }
+        }
+    }
+
+    if (ok && tileMessages == 0)
+    {
+        std::cerr << "no message was delta encoded" << std::endl << std::flush;
+        ok = false;
+    }
+    if (!ok)
+    {
+        std::cerr << "in the delta sequence of " << elementTypeNames[elementType] << " with threshold " << threshold
+                  << " and " << frameCodecToString(codecIndex) << std::endl << std::flush;
+    }
+    frameCodecRelease(&codec);
+    deltaEncoderDestroy(&e);
+    return ok;
+}
+
+bool deltaCases(int *count)
+{
+    const int codecIndex = frameCodecIsAvailable(FRAME_CODEC_ZLIB) ? FRAME_CODEC_ZLIB : FRAME_CODEC_NONE;
+    for (int elementType=IMAGE_TYPE_INT8; elementType<=IMAGE_TYPE_DOUBLE; ++elementType)
+    {
+        if (!deltaSequence(elementType, 0.0, codecIndex, count) || !deltaSequence(elementType, 2.0, codecIndex, count))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// corrupts the table of a message of four segments in one of the ways the
+// client has to reject; returns 0 past the last one
+const char *corruptTable(int way, std::vector<char> *message, size_t *messageBytes, int *encoding, size_t blockBytes)
+{
+    int *numSegments = reinterpret_cast<int*>(message->data());
+    frame_segment *segments = reinterpret_cast<frame_segment*>(message->data() + 2*sizeof(int));
+    switch (way)
+    {
+    case 0:
+        *numSegments = 0;
+        return "no segments";
+    case 1:
+        *numSegments = 5;
+        return "more segments than the handshake allows";
+    case 2:
+        *messageBytes = frameSegmentTableSize(4) - 1;
+        return "a table longer than the message";
+    case 3:
+        segments[1].compressed_bytes = -1;
+        return "a negative size";
+    case 4:
+        segments[3].compressed_bytes = int(*messageBytes);
+        return "a segment beyond the message";
+    case 5:
+        segments[3].offset_x += 1;
+        return "a rectangle beyond the block";
+    case 6:
+        segments[2].offset_y = -1;
+        return "a negative offset";
+    case 7:
+        segments[1].ny = 0;
+        return "an empty rectangle";
+    case 8:
+        segments[0].raw_bytes -= 4;
+        return "a size that does not match the rectangle";
+    case 9:
+        segments[0].nx = 0;
+        return "a payload segment among rectangles";
+    case 10:
+        *numSegments = 3;
+        return "rectangles that do not cover the block";
+    case 11:
+        *encoding = FRAME_ENCODING_TILES;
+        return "rectangles in a delta encoded message";
+    case 12:
+        *numSegments = 1;
+        segments[0].nx = 0;
+        segments[0].raw_bytes = int(blockBytes) + 1;
+        return "a payload segment larger than the block";
+    default:
+        return 0;
+    }
+}
+
+// a block of two float channels as four rectangles (e.g. of four server
+// ranks in gather mode), each holding both channels one after the other
+bool segmentTableCases(int *count)
+{
+    const int nx = 40, ny = 30, numChannels = 2, numSegments = 4;
+    const int rectX = nx/2, rectY = ny/2;
+    frame_codec codec;
+    memset(&codec, 0, sizeof(codec));
+    codec.codec = frameCodecIsAvailable(FRAME_CODEC_ZLIB) ? FRAME_CODEC_ZLIB : FRAME_CODEC_NONE;
+    codec.flags = FRAME_CODEC_SHUFFLE;
+    codec.element_type = IMAGE_TYPE_FLOAT;
+
+    std::vector<char> block;
+    fillElements(IMAGE_TYPE_FLOAT, size_t(nx)*ny*numChannels, nx, true, true, &block);
+    const size_t elementSize = sizeof(float);
+    const size_t rectBytes = size_t(rectX)*rectY*elementSize;
+    std::vector<char> rect(rectBytes*numChannels);
+    std::vector<char> valid(frameCodecBound(block.size(), numSegments));
+    std::vector<char> scratch(frameCodecScratchSize(block.size()));
+    frame_segment *segments = reinterpret_cast<frame_segment*>(valid.data() + 2*sizeof(int));
+    size_t validBytes = frameSegmentTableSize(numSegments);
+
+    reinterpret_cast<int*>(valid.data())[0] = numSegments;
+    reinterpret_cast<int*>(valid.data())[1] = 0;
+    for (int s=0; s<numSegments; ++s)
+    {
+        memset(&segments[s], 0, sizeof(segments[s]));
+        segments[s].offset_x = (s % 2)*rectX;
+        segments[s].offset_y = (s / 2)*rectY;
+        segments[s].nx = rectX;
+        segments[s].ny = rectY;
+        for (int c=0; c<numChannels; ++c)
+        {
+            for (int y=0; y<rectY; ++y)
+            {
+                memcpy(rect.data() + c*rectBytes + y*rectX*elementSize,
+                       block.data() + ((size_t(c)*ny + segments[s].offset_y + y)*nx + segments[s].offset_x)*elementSize,
+                       rectX*elementSize);
+            }
+        }
+        validBytes += frameCodecEncode(&codec, rect.data(), rect.size(), &segments[s], valid.data() + validBytes,
+                                       valid.size() - validBytes, scratch.data());
+    }
+
+    bool ok = frameCodecCheckSegments(&codec, valid.data(), validBytes, numSegments, FRAME_ENCODING_FULL,
+                                      nx, ny, numChannels, block.size()) == numSegments;
+    // the rectangles decode to the block
+    size_t offset = frameSegmentTableSize(numSegments);
+    std::vector<char> decoded(block.size());
+    for (int s=0; s<numSegments && ok; ++s)
+    {
+        ok = frameCodecDecode(&codec, &segments[s], valid.data() + offset, rect.data(), scratch.data());
+        for (int c=0; c<numChannels && ok; ++c)
+        {
+            for (int y=0; y<rectY; ++y)
+            {
+                memcpy(decoded.data() + ((size_t(c)*ny + segments[s].offset_y + y)*nx + segments[s].offset_x)*elementSize,
+                       rect.data() + c*rectBytes + y*rectX*elementSize, rectX*elementSize);
+            }
+        }
+        offset += (size_t(segments[s].compressed_bytes) + 7) & ~size_t(7);
+    }
+    ++*count;
+    if (!ok || memcmp(decoded.data(), block.data(), block.size()) != 0)
+    {
+        std::cerr << "a valid message of " << numSegments << " segments is not decoded" << std::endl << std::flush;
+        frameCodecRelease(&codec);
+        return false;
+    }
+
+    for (int way=0; ok; ++way)
+    {
+        std::vector<char> message(valid.begin(), valid.begin() + validBytes);
+        size_t messageBytes = validBytes;
+        int encoding = FRAME_ENCODING_FULL;
+        const char *what = corruptTable(way, &message, &messageBytes, &encoding, block.size());
+        if (!what)
+        {
+            break;
+        }
+        ++*count;
+        if (frameCodecCheckSegments(&codec, message.data(), messageBytes, numSegments, encoding,
+                                    nx, ny, numChannels, block.size()) != 0)
+        {
+            std::cerr << "a segment table with " << what << " is accepted" << std::endl << std::flush;
+            ok = false;
+        }
+    }
+    frameCodecRelease(&codec);
+    return ok;
+}
+
+} // namespace
+
+bool verifyCodec()
+{
+    int roundTrips = 0, deltaMessages = 0, segmentTables = 0;
+    if (!codecCases(&roundTrips) || !deltaCases(&deltaMessages) || !segmentTableCases(&segmentTables))
+    {
+        return false;
+    }
+    std::cout << roundTrips << " segments, " << deltaMessages << " delta encoded messages and "
+              << segmentTables << " segment tables are decoded as encoded" << std::endl << std::flush;
+    return true;
+}
@@ -0,0 +1,20 @@
+/**************************************************************************//**
+ * @file codeccheck.h
+ * @brief Round trips through the encoding of image data messages
+ *
+ * This file declares the offline check of the codec stage and the delta
+ * encoder, which the benchmark runs instead of connecting to a server.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef CODECCHECK_H
+#define CODECCHECK_H
+
+// returns false and prints the first difference if a decoded message does
+// not reproduce its elements or a corrupt segment table is accepted
+bool verifyCodec();
+
+#endif // CODECCHECK_H
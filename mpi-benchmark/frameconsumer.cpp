@@ -0,0 +1,132 @@
+/**************************************************************************//**
+ * @file frameconsumer.cpp
+ * @brief Headless consumer of the received frames
+ *
+ * This file implements the FrameConsumer class. Every frameReady signal
+ * exchanges the ready frame with the color map data, exactly like the main
+ * window before it colorizes; the end-to-end latency therefore ends when
+ * the frame has been fetched. Frames are counted by their sequence number,
+ * so the frames the server dropped for this client, the receiver replaced
+ * before publishing and the consumer did not fetch in time all show up as
+ * gaps in the sequence. The elements and changed cells are counted over
+ * the channels the frames hold.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include "frameconsumer.h"
+#include "qcustomplot.h"
+
+FrameConsumer::FrameConsumer(FrameReceiver *receiver, const QVector<QCPColorMapData *> &frames, QObject *parent) :
+    QObject(parent),
+    mReceiver(receiver),
+    mChannelFrames(frames),
+    mChangedCells(frames.size()),
+    mFrames(0),
+    mFirstSequence(-1),
+    mLastSequence(-1),
+    mFirstFetch(0.0),
+    mLastFetch(0.0),
+    mFirstBytes(0),
+    mLastBytes(0),
+    mImageBytes(0.0),
+    mChangedCellCount(0.0)
+{
+    mTimer.setSingleShot(true);
+    connect(&mTimer, SIGNAL(timeout()), this, SIGNAL(finished()));
+    connect(mReceiver, SIGNAL(frameReady()), this, SLOT(frameReadySlot()));
+    connect(mReceiver, SIGNAL(disconnected()), this, SLOT(serverDisconnectedSlot()));
+}
+
+/* ------------------------------------------------------------------------- */
+
+// measures for the given number of seconds, or until the server closes the
+// connection if seconds is 0
+void FrameConsumer::start(double seconds)
+{
+    if (seconds > 0.0)
+    {
+        mTimer.start(qRound(seconds*1000.0));
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+BenchmarkResult FrameConsumer::result() const
+{
+    BenchmarkResult r;
+    r.seconds = mLastFetch - mFirstFetch;
+    r.frames = mFrames;
+    r.droppedFrames = mFrames > 0 ? mLastSequence - mFirstSequence + 1 - mFrames : 0;
+    // the first frame starts the measurement
+    r.framesPerSecond = r.seconds > 0.0 ? (mFrames-1)/r.seconds : 0.0;
+    r.receivedBytesPerSecond = r.seconds > 0.0 ? (mLastBytes-mFirstBytes)/r.seconds : 0.0;
+    r.imageBytesPerSecond = r.seconds > 0.0 ? mImageBytes/r.seconds : 0.0;
+    r.changedCells = mFrames > 1 ? mChangedCellCount/(mFrames-1) : 0.0;
+    return r;
+}
+
+/* ------------------------------------------------------------------------- */
+
+PipelineLatency FrameConsumer::latency() const
+{
+    return mLatency;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void FrameConsumer::frameReadySlot()
+{
+    FrameTiming timing;
+    const double fetched = pipelineClock();
+    if (!mReceiver->exchangeFrame(mChannelFrames.constData(), mChannelFrames.size(), &timing, mChangedCells.data()))
+    {
+        return;
+    }
+    mLatency.add(PipelineLatency::stHandover, fetched-timing.published);
+    mLatency.add(PipelineLatency::stEndToEnd, fetched-timing.computeStart);
+
+    // an incomplete frame may hold no newer block than the previous one
+    if (timing.sequence <= mLastSequence)
+    {
+        return;
+    }
+
+    const qint64 receivedBytes = mReceiver->statistics().receivedBytes;
+    if (mFrames == 0)
+    {
+        mFirstSequence = timing.sequence;
+        mFirstFetch = fetched;
+        mFirstBytes = receivedBytes;
+    }
+    else
+    {
+        const frame_view view = mReceiver->frameView();
+        const double cells = double(view.nx)*view.ny*qMax(1, frameChannelCount(view.channels));
+        double changed = 0.0;
+        for (int c=0; c<mChangedCells.size(); ++c)
+        {
+            const QVector<QRect> &changedCells = mChangedCells.at(c);
+            for (int i=0; i<changedCells.size(); ++i)
+            {
+                changed += double(changedCells.at(i).width())*changedCells.at(i).height();
+            }
+        }
+        mImageBytes += cells*imageElementSize(mReceiver->handshake().element_type);
+        mChangedCellCount += changed/cells;
+    }
+    mLastSequence = timing.sequence;
+    mLastFetch = fetched;
+    mLastBytes = receivedBytes;
+    ++mFrames;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void FrameConsumer::serverDisconnectedSlot()
+{
+    mTimer.stop();
+    emit finished();
+}
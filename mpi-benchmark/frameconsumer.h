@@ -0,0 +1,76 @@
+/**************************************************************************//**
+ * @file frameconsumer.h
+ * @brief Headless consumer of the received frames
+ *
+ * This file contains the class declaration for the FrameConsumer class,
+ * which takes the place of the main window in the benchmark: it fetches
+ * every frame the FrameReceiver publishes into a color map data array, as
+ * the main window does, but neither colorizes nor replots it, so that the
+ * throughput and latency of the server, the network and decoding are
+ * measured apart from rendering.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef FRAMECONSUMER_H
+#define FRAMECONSUMER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QRect>
+#include "framereceiver.h"
+#include "pipelinelatency.h"
+
+class QCPColorMapData;
+
+// measured between the first and the last frame fetched
+struct BenchmarkResult
+{
+    double seconds;
+    int frames;             // frames fetched with a new sequence number
+    int droppedFrames;      // sequence numbers in between that were never fetched
+    double framesPerSecond;
+    double receivedBytesPerSecond;  // image data messages as received
+    double imageBytesPerSecond;     // elements of the frames fetched
+    double changedCells;    // share of the cells that changed per frame
+};
+
+class FrameConsumer : public QObject
+{
+    Q_OBJECT
+
+public:
+    FrameConsumer(FrameReceiver *receiver, const QVector<QCPColorMapData *> &frames, QObject *parent = 0);
+
+    void start(double seconds);
+    BenchmarkResult result() const;
+    PipelineLatency latency() const;
+
+signals:
+    void finished();        // the time is up or the server closed the connection
+
+private slots:
+    void frameReadySlot();
+    void serverDisconnectedSlot();
+
+private:
+    FrameReceiver *mReceiver;
+    QVector<QCPColorMapData *> mChannelFrames;  // one per channel
+    QTimer mTimer;          // ends the measurement
+    QVector<QVector<QRect> > mChangedCells;
+    PipelineLatency mLatency;   // stages measured by the consumer
+    int mFrames;
+    int mFirstSequence;
+    int mLastSequence;
+    double mFirstFetch;
+    double mLastFetch;
+    qint64 mFirstBytes;     // received until the first frame was fetched
+    qint64 mLastBytes;
+    double mImageBytes;
+    double mChangedCellCount;
+};
+
+#endif // FRAMECONSUMER_H
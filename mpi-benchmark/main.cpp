@@ -0,0 +1,280 @@
+/**************************************************************************//**
+ * @file main.cpp
+ * @brief Benchmark of the frame pipeline
+ *
+ * This file sets up the headless benchmark client: it connects to
+ * mpi-compute like mpi-visualize does, with the same FrameReceiver, lets a
+ * FrameConsumer fetch the frames without rendering them and reports the
+ * sustained frame rate, the bandwidth, the latency and the share of frames
+ * dropped on the way. A line of results may be appended to a CSV file, so
+ * that sweep.sh can collect the runs over several server configurations.
+ * Of a server computing several channels the full view of the channels
+ * chosen is requested. With --verify it checks the encoding of the
+ * messages offline instead (see codeccheck.h).
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <cstring>
+#include <iostream>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include "codeccheck.h"
+#include "frameconsumer.h"
+#include "framedecode.h"
+#include "frame_memory.h"
+#include "qcustomplot.h"
+
+namespace {
+
+struct BenchmarkOptions
+{
+    QString serviceName;
+    int receiveSlots;
+    int memory;             // FRAME_MEMORY_* of the receive buffers
+    double seconds;         // 0 = until the server closes the connection
+    QString csvFile;        // a line of results is appended, if not empty
+    QString label;          // first column of the line, e.g. the server options
+    QString statsFile;      // latency histograms, if not empty
+    int channels;           // bit mask of the channels requested, 0 = the first one
+    bool verify;            // check the codec and the delta encoder instead of connecting
+};
+
+// returns false if the program should not run
+bool parseArguments(BenchmarkOptions *options)
+{
+    const QStringList arguments = QCoreApplication::arguments();
+
+    for (int i=1; i<arguments.size(); ++i)
+    {
+        if (arguments.at(i) == "--service" && i+1 < arguments.size())
+        {
+            options->serviceName = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--receives" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const int slots = arguments.at(++i).toInt(&ok);
+            if (ok && slots >= 2)
+            {
+                options->receiveSlots = slots;
+            }
+            else
+            {
+                std::cerr << "Invalid number of receives " << arguments.at(i).toStdString() << ", need at least 2" << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--memory" && i+1 < arguments.size())
+        {
+            if (!frameMemoryFromString(arguments.at(++i).toStdString().c_str(), &options->memory))
+            {
+                std::cerr << "Unknown memory " << arguments.at(i).toStdString() << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--seconds" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const double seconds = arguments.at(++i).toDouble(&ok);
+            if (ok && seconds >= 0.0)
+            {
+                options->seconds = seconds;
+            }
+            else
+            {
+                std::cerr << "Invalid duration " << arguments.at(i).toStdString() << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--csv" && i+1 < arguments.size())
+        {
+            options->csvFile = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--label" && i+1 < arguments.size())
+        {
+            options->label = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--stats" && i+1 < arguments.size())
+        {
+            options->statsFile = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--channels" && i+1 < arguments.size())
+        {
+            const QStringList channels = arguments.at(++i).split(',');
+            for (int j=0; j<channels.size(); ++j)
+            {
+                bool ok = false;
+                const int channel = channels.at(j).toInt(&ok);
+                if (ok && channel >= 0 && channel < FRAME_MAX_CHANNELS)
+                {
+                    options->channels |= 1 << channel;
+                }
+                else
+                {
+                    std::cerr << "Invalid channel " << channels.at(j).toStdString() << ", need 0 <= c < " << FRAME_MAX_CHANNELS << std::endl << std::flush;
+                }
+            }
+        }
+        else if (arguments.at(i) == "--verify")
+        {
+            options->verify = true;
+        }
+        else if (arguments.at(i) == "--help")
+        {
+            std::cout << "receives the frames of mpi-compute without rendering them and reports the throughput\n"
+                         "use '--service <name>' to look up the server under name (default '" MPI_SERVICE_NAME "')\n"
+                         "use '--receives <n>' to post n receives per server block (default " << FRAME_RECEIVE_SLOTS << ")\n"
+                         "use '--memory default|mpi,huge,pinned' to allocate the receive buffers by MPI_Alloc_mem, on huge pages or pinned\n"
+                         "use '--seconds <s>' to measure for s seconds (default 0 = until the server disconnects)\n"
+                         "use '--csv <file>' to append a line of results to file\n"
+                         "use '--label <text>' to set the first column of that line\n"
+                         "use '--stats <file>' to write the latency histograms as CSV (or JSON if file ends with .json)\n"
+                         "use '--channels <c,...>' to request the channels listed of a server computing several (default 0)\n"
+                         "use '--verify' to check that encoded messages decode to their elements, without a server"
+                      << std::endl << std::flush;
+            return false;
+        }
+        else
+        {
+            std::cerr << "Unknown option " << arguments.at(i).toStdString() << std::endl << std::flush;
+        }
+    }
+    return true;
+}
+
+// the file mpi-compute also writes its port name to
+QString portFileName()
+{
+#if defined (_WIN32) || defined (_WIN64)
+    QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    if (path.isEmpty()) std::cerr << "Failed to obtain file path" << std::endl << std::flush;
+    QString fileName(path);
+    fileName.append(QDir::separator());
+    fileName.append("mpiportname.txt");
+#elif defined (__linux__ )
+    QString fileName("/tmp/mpiportname.txt");
+#endif
+    return fileName;
+}
+
+// one line per run, the header is written into a new file
+bool appendResult(const BenchmarkOptions &options, const frame_handshake &handshake, const BenchmarkResult &result,
+                  const PipelineLatency &latency)
+{
+    QFile file(options.csvFile);
+    const bool header = !file.exists() || file.size() == 0;
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    {
+        return false;
+    }
+
+    QTextStream out(&file);
+    if (header)
+    {
+        out << "label,width,height,element_type,mode,blocks,codec,delta_tile,channels,seconds,frames,frames_per_s,"
+               "received_GB_per_s,image_GB_per_s,changed_cells,drop_rate,"
+               "end_to_end_p50_ms,end_to_end_p99_ms,network_p99_ms,decompress_p99_ms,decode_p99_ms\n";
+    }
+    const double dropRate = result.frames > 0 ? double(result.droppedFrames)/(result.frames+result.droppedFrames) : 0.0;
+    out << "\"" << options.label << "\"," << handshake.width << "," << handshake.height << "," << handshake.element_type << ","
+        << (handshake.mode == FRAME_MODE_DIRECT ? "direct" : "gather") << "," << handshake.num_blocks << ","
+        << frameCodecToString(handshake.codec) << "," << handshake.delta_tile << ","
+        << qMax(1, frameChannelCount(options.channels & frameAllChannels(handshake.num_channels))) << ","
+        << result.seconds << "," << result.frames << "," << result.framesPerSecond << ","
+        << result.receivedBytesPerSecond*1e-9 << "," << result.imageBytesPerSecond*1e-9 << ","
+        << result.changedCells << "," << dropRate << ","
+        << 1e3*latencyHistogramPercentile(&latency.histogram(PipelineLatency::stEndToEnd), 0.50) << ","
+        << 1e3*latencyHistogramPercentile(&latency.histogram(PipelineLatency::stEndToEnd), 0.99) << ","
+        << 1e3*latencyHistogramPercentile(&latency.histogram(PipelineLatency::stNetwork), 0.99) << ","
+        << 1e3*latencyHistogramPercentile(&latency.histogram(PipelineLatency::stDecompress), 0.99) << ","
+        << 1e3*latencyHistogramPercentile(&latency.histogram(PipelineLatency::stDecode), 0.99) << "\n";
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("mpi-server-client");
+
+    BenchmarkOptions options;
+    options.serviceName = MPI_SERVICE_NAME;
+    options.receiveSlots = FRAME_RECEIVE_SLOTS;
+    options.seconds = 0.0;
+    options.channels = 0;
+    options.memory = 0;
+    options.verify = false;
+    if (!parseArguments(&options))
+    {
+        return 0;
+    }
+    if (options.verify)
+    {
+        return verifyCodec() ? 0 : 1;
+    }
+
+    // the receiver thread makes all MPI calls, starting with MPI_Init_thread
+    FrameReceiver receiver(options.serviceName, portFileName(), options.receiveSlots);
+    receiver.setMemory(options.memory);
+    receiver.start();
+    if (!receiver.waitForHandshake())
+    {
+        receiver.stop();
+        return 1;
+    }
+    const frame_handshake handshake = receiver.handshake();
+
+    // the cells the main window would colorize, in the element type of the frames
+    QVector<QCPColorMapData *> frames;
+    for (int c=0; c<handshake.num_channels; ++c)
+    {
+        frames.append(new QCPColorMapData(handshake.width, handshake.height, QCPRange(0.0, 1.0), QCPRange(0.0, 1.0)));
+        frames.last()->setCellType(frameCellType(handshake.element_type), 1.0/handshake.scale);
+    }
+
+    FrameConsumer consumer(&receiver, frames);
+    QObject::connect(&consumer, SIGNAL(finished()), &a, SLOT(quit()));
+    receiver.startReceiving(frames.at(0));
+    // the server starts out sending the full view of the first channel
+    const int channels = options.channels & frameAllChannels(handshake.num_channels);
+    if (channels > 1)
+    {
+        frame_view view;
+        memset(&view, 0, sizeof(view));
+        view.nx = handshake.width;
+        view.ny = handshake.height;
+        view.channels = channels;
+        receiver.requestView(view);
+    }
+    consumer.start(options.seconds);
+    a.exec();
+
+    receiver.stop(); // disconnects from the server and finalizes MPI
+    qDeleteAll(frames);
+
+    const BenchmarkResult result = consumer.result();
+    PipelineLatency latency = receiver.latency();
+    latency.merge(consumer.latency());
+    const double dropRate = result.frames > 0 ? double(result.droppedFrames)/(result.frames+result.droppedFrames) : 0.0;
+
+    std::cout << result.frames << " frames in " << result.seconds << " s: " << result.framesPerSecond << " frames/s, "
+              << result.receivedBytesPerSecond*1e-9 << " GB/s received, " << result.imageBytesPerSecond*1e-9 << " GB/s of elements, "
+              << 100.0*result.changedCells << "% of the cells changed per frame, "
+              << 100.0*dropRate << "% of the frames dropped\n"
+              << latency.overlayText().toStdString() << std::endl << std::flush;
+
+    if (!options.csvFile.isEmpty() && !appendResult(options, handshake, result, latency))
+    {
+        std::cerr << "Failed to write " << options.csvFile.toStdString() << std::endl << std::flush;
+    }
+    if (!options.statsFile.isEmpty() && !latency.writeFile(options.statsFile))
+    {
+        std::cerr << "Failed to write " << options.statsFile.toStdString() << std::endl << std::flush;
+    }
+    return 0;
+}
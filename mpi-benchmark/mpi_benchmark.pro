@@ -0,0 +1,49 @@
+# headless client that measures the frame pipeline without rendering; it
+# receives with the FrameReceiver of mpi-visualize into color map data and
+# checks the codec and delta encoder of mpi-compute with --verify
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets printsupport
+
+TARGET = mpi-benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    frameconsumer.cpp \
+    codeccheck.cpp \
+    ../mpi-visualize/framereceiver.cpp \
+    ../mpi-visualize/pipelinelatency.cpp \
+    ../mpi-visualize/qcustomplot.cpp \
+    ../common/frame_memory.c \
+    ../mpi-compute/delta.c
+
+HEADERS += frameconsumer.h \
+    codeccheck.h \
+    ../mpi-visualize/framereceiver.h \
+    ../mpi-visualize/framedecode.h \
+    ../mpi-visualize/pipelinelatency.h \
+    ../mpi-visualize/qcustomplot.h \
+    ../common/mpi_protocol.h \
+    ../common/latency_histogram.h \
+    ../common/allocationcount.h \
+    ../common/frame_memory.h \
+    ../mpi-compute/delta.h
+
+INCLUDEPATH += ../mpi-visualize ../mpi-compute ../common
+
+include(../common/frame_codec.pri)
+
+# MPI Settings
+QMAKE_CXX = mpicxx
+QMAKE_CXX_RELEASE = $$QMAKE_CXX
+QMAKE_CXX_DEBUG = $$QMAKE_CXX
+QMAKE_LINK = $$QMAKE_CXX
+QMAKE_CC = mpicc
+
+QMAKE_CFLAGS += $$system(mpicc --showme:compile)
+QMAKE_LFLAGS += $$system(mpicxx --showme:link)
+QMAKE_CXXFLAGS += $$system(mpicxx --showme:compile) -DMPICH_IGNORE_CXX_SEEK
+QMAKE_CXXFLAGS_RELEASE += $$system(mpicxx --showme:compile) -DMPICH_IGNORE_CXX_SEEK
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Runs mpi-compute with every combination of the parameters below and
+# measures each run with mpi-benchmark, which appends a line to $CSV.
+# Every parameter may be overridden from the environment, e.g.
+#
+#   SIZES="1024 4096" TYPES=float RANKS="2 8" ./sweep.sh
+#
+# MODES holds the buffering and compression modes as name=options entries
+# separated by ';', the name ends up in the label column of the results.
+
+COMPUTE=${COMPUTE:-../mpi-compute/mpi_compute}
+BENCHMARK=${BENCHMARK:-./mpi-benchmark}
+MPIRUN=${MPIRUN:-mpirun}
+CSV=${CSV:-benchmark.csv}
+DURATION=${DURATION:-10}        # seconds per run
+SIZES=${SIZES:-"512 2048"}      # square images
+TYPES=${TYPES:-"int16 float"}
+RANKS=${RANKS:-"1 4"}
+INTERVALS=${INTERVALS:-"0.03333 0.01 0"}
+MODES=${MODES:-"gather=;direct=--direct;buffers8=--send-buffers 8;delta=--delta 0.001;zlib=--codec zlib --shuffle"}
+PORT_FILE=/tmp/mpiportname.txt
+SERVICE=benchmark-$$
+
+# clients of other jobs find the server through a name server; with Open MPI
+# one is started unless MPIRUN_FLAGS already names one
+if [ -z "$MPIRUN_FLAGS" ] && command -v ompi-server > /dev/null 2>&1; then
+    URI_FILE=/tmp/ompi-server-$$.uri
+    ompi-server --no-daemonize --report-uri "$URI_FILE" &
+    NAME_SERVER=$!
+    while [ ! -s "$URI_FILE" ]; do sleep 0.1; done
+    MPIRUN_FLAGS="--ompi-server file:$URI_FILE"
+    trap 'kill $NAME_SERVER; rm -f "$URI_FILE"' EXIT
+fi
+
+runs=0
+for size in $SIZES; do
+for type in $TYPES; do
+for ranks in $RANKS; do
+for interval in $INTERVALS; do
+    modes=$MODES
+    while [ -n "$modes" ]; do
+        mode=${modes%%;*}
+        [ "$mode" = "$modes" ] && modes= || modes=${modes#*;}
+        name=${mode%%=*}
+        mode_options=${mode#*=}
+        label="size=$size type=$type ranks=$ranks interval=$interval mode=$name"
+        echo "$label"
+
+        # the server empties the port file when it ends
+        : > "$PORT_FILE"
+        $MPIRUN $MPIRUN_FLAGS -np "$ranks" "$COMPUTE" --openport --service "$SERVICE" --duration "$DURATION" \
+            --size "$size" "$size" --type "$type" --interval "$interval" $mode_options > /dev/null 2>&1 &
+        server=$!
+        while [ ! -s "$PORT_FILE" ] && kill -0 $server 2> /dev/null; do sleep 0.1; done
+
+        $MPIRUN $MPIRUN_FLAGS -np 1 "$BENCHMARK" --service "$SERVICE" --csv "$CSV" --label "$label" | grep " frames in "
+        wait $server
+        runs=$((runs+1))
+    done
+done
+done
+done
+done
+
+echo "$runs runs written to $CSV"
@@ -0,0 +1,114 @@
+/**************************************************************************//**
+ * @file decomposition.c
+ * @brief Block domain decomposition
+ *
+ * This file implements the block decomposition of the global image. Ranks
+ * are numbered row-major over the block grid, i.e.
+ * rank = coords[1] * dims[0] + coords[0], so that for row slabs the rank
+ * order equals the memory order of the global image.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+#include "decomposition.h"
+
+/* ------------------------------------------------------------------------- */
+
+// first global index owned by block 'id' when n elements are split into p blocks
+static int blockLow(int id, int p, int n)
+{
+    return (int)(((long long)id * n) / p);
+}
+
+/* ------------------------------------------------------------------------- */
+
+int decompositionCreate(domain_decomposition* d, decomposition_type type,
+                        int global_nx, int global_ny, int size, int rank)
+{
+    memset(d, 0, sizeof(*d));
+    d->type = type;
+    d->global_nx = global_nx;
+    d->global_ny = global_ny;
+
+    if (type == DECOMPOSITION_TILES)
+    {
+        // MPI_Dims_create returns dims in non-increasing order;
+        // give the larger count to the larger image dimension
+        int dims[2] = {0, 0};
+        MPI_Dims_create(size, 2, dims);
+
+        if (global_nx >= global_ny)
+        {
+            d->dims[0] = dims[0];
+            d->dims[1] = dims[1];
+        }
+        else
+        {
+            d->dims[0] = dims[1];
+            d->dims[1] = dims[0];
+        }
+    }
+    else
+    {
+        d->dims[0] = 1;
+        d->dims[1] = size;
+    }
+
+    if (d->dims[0] > global_nx || d->dims[1] > global_ny)
+    {
+        printf("Cannot decompose %d x %d image into %d x %d blocks!\n",
+               global_nx, global_ny, d->dims[0], d->dims[1]); fflush(stdout);
+        return 0;
+    }
+
+    d->coords[0] = rank % d->dims[0];
+    d->coords[1] = rank / d->dims[0];
+
+    decompositionBlock(d, rank, &d->offset_x, &d->offset_y, &d->nx, &d->ny);
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void decompositionBlock(const domain_decomposition* d, int rank,
+                        int* offset_x, int* offset_y, int* nx, int* ny)
+{
+    const int cx = rank % d->dims[0];
+    const int cy = rank / d->dims[0];
+
+    *offset_x = blockLow(cx,     d->dims[0], d->global_nx);
+    *offset_y = blockLow(cy,     d->dims[1], d->global_ny);
+    *nx       = blockLow(cx + 1, d->dims[0], d->global_nx) - *offset_x;
+    *ny       = blockLow(cy + 1, d->dims[1], d->global_ny) - *offset_y;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int decompositionTypeFromString(const char* name, decomposition_type* type)
+{
+    if (strcmp(name, "rows") == 0)
+    {
+        *type = DECOMPOSITION_ROWS;
+        return 1;
+    }
+    else if (strcmp(name, "tiles") == 0)
+    {
+        *type = DECOMPOSITION_TILES;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+const char* decompositionTypeToString(decomposition_type type)
+{
+    return (type == DECOMPOSITION_TILES) ? "tiles" : "rows";
+}
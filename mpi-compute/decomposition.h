@@ -0,0 +1,44 @@
+/**************************************************************************//**
+ * @file decomposition.h
+ * @brief Block domain decomposition
+ *
+ * This file declares the block decomposition of the global image into
+ * per-rank row slabs (1D) or tiles (2D).
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef DECOMPOSITION_H
+#define DECOMPOSITION_H
+
+typedef enum
+{
+    DECOMPOSITION_ROWS  = 0,    // 1 x world_size row slabs
+    DECOMPOSITION_TILES = 1     // px x py tiles as chosen by MPI_Dims_create
+} decomposition_type;
+
+typedef struct
+{
+    decomposition_type type;
+    int global_nx;              // size of the whole image in x
+    int global_ny;              // size of the whole image in y
+    int dims[2];                // number of blocks in x and y
+    int coords[2];              // block coordinates of this rank in x and y
+    int offset_x;               // global index of the first local column
+    int offset_y;               // global index of the first local row
+    int nx;                     // number of local columns
+    int ny;                     // number of local rows
+} domain_decomposition;
+
+/* ------------------------------------------------------------------------- */
+
+int  decompositionCreate(domain_decomposition* d, decomposition_type type,
+                         int global_nx, int global_ny, int size, int rank);
+void decompositionBlock(const domain_decomposition* d, int rank,
+                        int* offset_x, int* offset_y, int* nx, int* ny);
+int  decompositionTypeFromString(const char* name, decomposition_type* type);
+const char* decompositionTypeToString(decomposition_type type);
+
+#endif // DECOMPOSITION_H
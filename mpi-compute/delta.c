@@ -0,0 +1,255 @@
+/**************************************************************************//**
+ * @file delta.c
+ * @brief Dirty-tile encoding of image blocks
+ *
+ * This file implements the delta encoder. The reference holds the elements
+ * of every tile as they were last sent, so differences below the threshold
+ * never accumulate beyond it. As a client has to apply every message of a
+ * block in order, a message that replaces a queued one in its send queue
+ * (drop policy 'oldest') or follows one it dropped must also carry the
+ * tiles of the message it missed; the tiles encoded into each send buffer
+ * are remembered for this purpose and the caller passes the tiles to resend.
+ * Tiles hold absolute values, so resending a tile to clients that already
+ * have it does no harm. A message of fewer channels than the encoder was
+ * created for encodes the first planes only; as the planes then stand for
+ * other channels, the caller requests a keyframe whenever the channels
+ * change.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "delta.h"
+
+/* ------------------------------------------------------------------------- */
+
+// returns 1 if any element of the w x h tile differs by more than threshold
+#define DEFINE_TILE_CHANGED(name, type)                                              \
+static int name(const char* image, const char* reference, int stride, int w, int h,  \
+                double threshold)                                                    \
+{                                                                                    \
+    int x, y;                                                                        \
+    for (y = 0; y < h; ++y)                                                          \
+    {                                                                                \
+        const type* a = (const type*)image + (size_t)y * stride;                     \
+        const type* b = (const type*)reference + (size_t)y * stride;                 \
+        for (x = 0; x < w; ++x)                                                      \
+        {                                                                            \
+            if (fabs((double)a[x] - (double)b[x]) > threshold) return 1;             \
+        }                                                                            \
+    }                                                                                \
+    return 0;                                                                        \
+}
+
+DEFINE_TILE_CHANGED(tileChangedInt8,   signed char)
+DEFINE_TILE_CHANGED(tileChangedInt16,  short)
+DEFINE_TILE_CHANGED(tileChangedFloat,  float)
+DEFINE_TILE_CHANGED(tileChangedDouble, double)
+
+/* ------------------------------------------------------------------------- */
+
+// rectangle of the tile within its plane and the offset of its first element
+static size_t tileRect(const delta_encoder* e, int tile, int* x, int* y, int* w, int* h)
+{
+    const int plane = tile / e->tiles_per_channel;
+
+    tile %= e->tiles_per_channel;
+    *x = (tile % e->tiles_x) * e->tile_size;
+    *y = (tile / e->tiles_x) * e->tile_size;
+    *w = (*x + e->tile_size <= e->nx) ? e->tile_size : e->nx - *x;
+    *h = (*y + e->tile_size <= e->ny) ? e->tile_size : e->ny - *y;
+    return (((size_t)plane * e->ny + *y) * e->nx + *x) * e->element_size;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int tileChanged(const delta_encoder* e, const char* image, int tile)
+{
+    int x, y, w, h;
+    const size_t offset = tileRect(e, tile, &x, &y, &w, &h);
+
+    switch (e->element_type)
+    {
+    case IMAGE_TYPE_INT8:   return tileChangedInt8(image + offset, e->reference + offset, e->nx, w, h, e->threshold);
+    case IMAGE_TYPE_INT16:  return tileChangedInt16(image + offset, e->reference + offset, e->nx, w, h, e->threshold);
+    case IMAGE_TYPE_FLOAT:  return tileChangedFloat(image + offset, e->reference + offset, e->nx, w, h, e->threshold);
+    case IMAGE_TYPE_DOUBLE: return tileChangedDouble(image + offset, e->reference + offset, e->nx, w, h, e->threshold);
+    default:                return 1;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// appends the tile to the payload and updates the reference; returns the bytes written
+static size_t copyTile(delta_encoder* e, const char* image, int tile, char* payload)
+{
+    int x, y, w, h, row;
+    const size_t row_bytes_image = (size_t)e->nx * e->element_size;
+    const size_t offset = tileRect(e, tile, &x, &y, &w, &h);
+    const size_t row_bytes = (size_t)w * e->element_size;
+
+    for (row = 0; row < h; ++row)
+    {
+        memcpy(payload + row * row_bytes, image + offset + row * row_bytes_image, row_bytes);
+        memcpy(e->reference + offset + row * row_bytes_image, image + offset + row * row_bytes_image, row_bytes);
+    }
+
+    return row_bytes * h;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int deltaEncoderCreate(delta_encoder* e, int nx, int ny, int num_channels, int element_type, int tile_size,
+                       double threshold, int keyframe_interval, int num_buffers)
+{
+    memset(e, 0, sizeof(*e));
+
+    if (tile_size < 1)
+    {
+        printf("Invalid delta tile size %d!\n", tile_size); fflush(stdout);
+        return 0;
+    }
+
+    e->nx = nx;
+    e->ny = ny;
+    e->tile_size = tile_size;
+    e->tiles_x = frameTileCount(nx, tile_size);
+    e->tiles_y = frameTileCount(ny, tile_size);
+    e->tiles_per_channel = e->tiles_x * e->tiles_y;
+    e->num_channels = num_channels;
+    e->num_tiles = e->tiles_per_channel * num_channels;
+    e->element_type = element_type;
+    e->element_size = imageElementSize(element_type);
+    e->threshold = threshold;
+    e->keyframe_interval = keyframe_interval;
+    e->keyframe_requested = 1; // the client has nothing yet
+    e->num_buffers = num_buffers;
+
+    e->reference = (char*)calloc((size_t)nx * ny * num_channels, e->element_size);
+    e->buffer_tiles = (char*)calloc((size_t)num_buffers * e->num_tiles, 1);
+    e->tile_list = (int*)malloc(sizeof(int) * e->num_tiles);
+
+    if (!e->reference || !e->buffer_tiles || !e->tile_list)
+    {
+        printf("Failed to allocate delta encoder!\n"); fflush(stdout);
+        deltaEncoderDestroy(e);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void deltaEncoderDestroy(delta_encoder* e)
+{
+    free(e->reference);
+    free(e->buffer_tiles);
+    free(e->tile_list);
+    e->reference = 0;
+    e->buffer_tiles = 0;
+    e->tile_list = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the next message will be a keyframe
+void deltaEncoderRequestKeyframe(delta_encoder* e)
+{
+    e->keyframe_requested = 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// largest payload (bytes after the frame_header) deltaEncode may write
+size_t deltaEncoderMaxSize(const delta_encoder* e)
+{
+    return frameTileTableSize(e->num_tiles) + (size_t)e->nx * e->ny * e->num_channels * e->element_size;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// tiles encoded into the message of a send buffer, num_tiles flags
+const char* deltaEncoderBufferTiles(const delta_encoder* e, int buffer)
+{
+    return e->buffer_tiles + (size_t)buffer * e->num_tiles;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// encodes the num_channels planes of nx*ny elements of image, at most as
+// many as the encoder was created for, into payload and sets the encoding
+// fields of header; buffer is the index of the send buffer the message is
+// written to and resend_tiles, if not 0, flags the tiles of messages some
+// client missed; returns the size of the payload
+size_t deltaEncode(delta_encoder* e, const char* image, int num_channels, frame_header* header, char* payload,
+                   int buffer, const char* resend_tiles)
+{
+    const size_t image_bytes = (size_t)e->nx * e->ny * num_channels * e->element_size;
+    const int image_tiles = e->tiles_per_channel * num_channels;
+    char* sent_tiles = e->buffer_tiles + (size_t)buffer * e->num_tiles;
+    int keyframe = e->keyframe_requested ||
+                   (e->keyframe_interval > 0 && e->messages_since_keyframe + 1 >= e->keyframe_interval);
+    int num_tiles = 0;
+    size_t size;
+    int tile;
+
+    e->tiles_total += image_tiles;
+
+    if (!keyframe)
+    {
+        size_t tile_bytes = 0;
+
+        for (tile = 0; tile < image_tiles; ++tile)
+        {
+            // a missed message never reached the client, resend its tiles
+            if ((resend_tiles && resend_tiles[tile]) || tileChanged(e, image, tile))
+            {
+                int x, y, w, h;
+                tileRect(e, tile, &x, &y, &w, &h);
+                tile_bytes += (size_t)w * h * e->element_size;
+                e->tile_list[num_tiles++] = tile;
+            }
+        }
+
+        // the index table does not pay off if (almost) everything changed
+        keyframe = frameTileTableSize(num_tiles) + tile_bytes >= image_bytes;
+    }
+
+    if (keyframe)
+    {
+        memcpy(payload, image, image_bytes);
+        memcpy(e->reference, image, image_bytes);
+        memset(sent_tiles, 0, e->num_tiles);
+        memset(sent_tiles, 1, image_tiles);
+
+        header->encoding = FRAME_ENCODING_FULL;
+        header->num_tiles = image_tiles;
+        e->keyframe_requested = 0;
+        e->messages_since_keyframe = 0;
+        e->tiles_sent += image_tiles;
+        ++e->keyframes;
+        return image_bytes;
+    }
+
+    memcpy(payload, e->tile_list, sizeof(int) * num_tiles);
+    size = frameTileTableSize(num_tiles);
+    memset(sent_tiles, 0, e->num_tiles);
+
+    for (tile = 0; tile < num_tiles; ++tile)
+    {
+        size += copyTile(e, image, e->tile_list[tile], payload + size);
+        sent_tiles[e->tile_list[tile]] = 1;
+    }
+
+    header->encoding = FRAME_ENCODING_TILES;
+    header->num_tiles = num_tiles;
+    ++e->messages_since_keyframe;
+    e->tiles_sent += num_tiles;
+    return size;
+}
@@ -0,0 +1,72 @@
+/**************************************************************************//**
+ * @file delta.h
+ * @brief Dirty-tile encoding of image blocks
+ *
+ * This file declares the delta encoder, which splits a block into tiles
+ * and only puts the tiles into a message whose elements changed by more
+ * than a threshold since they were last sent. Keyframes holding the whole
+ * block are sent periodically and on request, e.g. for a new client. A
+ * block of several channels is a stack of as many planes, whose tiles are
+ * numbered plane after plane.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+#include "mpi_protocol.h"
+
+// defaults, may be changed at runtime
+#define DELTA_TILE_SIZE          32
+#define DELTA_KEYFRAME_INTERVAL  30
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    int nx;                     // block size
+    int ny;
+    int tile_size;
+    int tiles_x;
+    int tiles_y;
+    int tiles_per_channel;      // tiles_x * tiles_y
+    int num_channels;           // planes the reference holds
+    int num_tiles;              // of all planes
+    int element_type;
+    int element_size;
+    double threshold;           // in element units
+    int keyframe_interval;      // messages between keyframes, 0: only on request
+    int messages_since_keyframe;
+    int keyframe_requested;
+    char* reference;            // elements as last sent, nx*ny per plane
+    int num_buffers;            // buffers of the send pool
+    char* buffer_tiles;         // tiles encoded into each send buffer, num_buffers x num_tiles
+    int* tile_list;             // scratch for the tile indices of a message
+    // counters
+    int keyframes;
+    double tiles_sent;
+    double tiles_total;
+} delta_encoder;
+
+/* ------------------------------------------------------------------------- */
+
+int    deltaEncoderCreate(delta_encoder* e, int nx, int ny, int num_channels, int element_type, int tile_size,
+                          double threshold, int keyframe_interval, int num_buffers);
+void   deltaEncoderDestroy(delta_encoder* e);
+void   deltaEncoderRequestKeyframe(delta_encoder* e);
+size_t deltaEncoderMaxSize(const delta_encoder* e);
+const char* deltaEncoderBufferTiles(const delta_encoder* e, int buffer);
+size_t deltaEncode(delta_encoder* e, const char* image, int num_channels, frame_header* header, char* payload,
+                   int buffer, const char* resend_tiles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DELTA_H
@@ -0,0 +1,201 @@
+/**************************************************************************//**
+ * @file image.c
+ * @brief Image element types
+ *
+ * This file implements the conversion of the computed field into the
+ * element type selected at runtime. The type is dispatched once per call,
+ * the loops themselves are type specific.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <float.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "image.h"
+
+static int image_threads = 1;
+
+/* ------------------------------------------------------------------------- */
+
+// vectorized by OpenMP SIMD (see mpi_compute.pro), the loops do not depend
+// on it being available
+#if defined (_MSC_VER)
+#define CONVERT_SIMD
+#define restrict __restrict
+#else
+#define CONVERT_SIMD _Pragma("omp simd reduction(min:lo) reduction(max:hi)")
+#endif
+
+// values beyond the range of the type saturate at its limits; the min/max
+// updates are branch free so the loops vectorize; an empty range is
+// returned as min > max
+#define DEFINE_CONVERT(name, type, lower, upper)                                     \
+static void name(const double* restrict src, void* restrict dst, int n,              \
+                 double factor, double* min_value, double* max_value)                \
+{                                                                                    \
+    type* restrict out = (type*)dst;                                                 \
+    type lo = (type)upper, hi = (type)lower;                                         \
+    int i;                                                                           \
+    if (n <= 0)                                                                      \
+    {                                                                                \
+        *min_value = DBL_MAX;                                                        \
+        *max_value = -DBL_MAX;                                                       \
+        return;                                                                      \
+    }                                                                                \
+    CONVERT_SIMD                                                                     \
+    for (i = 0; i < n; ++i)                                                          \
+    {                                                                                \
+        double d = src[i] * factor;                                                  \
+        d = d > lower ? d : lower;  /* in this order NaN maps to lower */            \
+        d = d < upper ? d : upper;                                                   \
+        const type v = (type)d;                                                      \
+        out[i] = v;                                                                  \
+        lo = v < lo ? v : lo;                                                        \
+        hi = v > hi ? v : hi;                                                        \
+    }                                                                                \
+    *min_value = lo;                                                                 \
+    *max_value = hi;                                                                 \
+}
+
+DEFINE_CONVERT(convertInt8,   signed char, -128.0, 127.0)
+DEFINE_CONVERT(convertInt16,  short,       -32768.0, 32767.0)
+DEFINE_CONVERT(convertFloat,  float,       -FLT_MAX, FLT_MAX)
+DEFINE_CONVERT(convertDouble, double,      -DBL_MAX, DBL_MAX)
+
+typedef void (*convert_function)(const double* src, void* dst, int n, double factor,
+                                 double* min_value, double* max_value);
+
+/* ------------------------------------------------------------------------- */
+
+// threads per process for imageConvert, 0 = the OpenMP default (OMP_NUM_THREADS);
+// ignored without OpenMP
+void imageSetThreads(int threads)
+{
+#ifdef _OPENMP
+    image_threads = threads > 0 ? threads : omp_get_max_threads();
+#else
+    (void)threads;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+// threads a process converts with, 1 without OpenMP
+int imageThreads(void)
+{
+    return image_threads;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int imageTypeFromString(const char* name, int* element_type)
+{
+    if (strcmp(name, "int8") == 0)
+    {
+        *element_type = IMAGE_TYPE_INT8;
+    }
+    else if (strcmp(name, "int16") == 0)
+    {
+        *element_type = IMAGE_TYPE_INT16;
+    }
+    else if (strcmp(name, "float") == 0)
+    {
+        *element_type = IMAGE_TYPE_FLOAT;
+    }
+    else if (strcmp(name, "double") == 0)
+    {
+        *element_type = IMAGE_TYPE_DOUBLE;
+    }
+    else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+const char* imageTypeToString(int element_type)
+{
+    switch (element_type)
+    {
+    case IMAGE_TYPE_INT8:   return "int8";
+    case IMAGE_TYPE_INT16:  return "int16";
+    case IMAGE_TYPE_FLOAT:  return "float";
+    case IMAGE_TYPE_DOUBLE: return "double";
+    default:                return "unknown";
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+double imageTypeDefaultScale(int element_type)
+{
+    switch (element_type)
+    {
+    case IMAGE_TYPE_INT8:   return 127.0;
+    case IMAGE_TYPE_INT16:  return 32767.0;
+    default:                return 1.0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// converts n values of the field into elements of the selected type and
+// returns the range of the elements, tracked in the same pass; with several
+// threads every thread converts a contiguous part, the elements do not
+// depend on how the field is split
+void imageConvert(int element_type, const double* src, void* dst, int n, double factor,
+                  double* min_value, double* max_value)
+{
+    convert_function convert;
+
+    switch (element_type)
+    {
+    case IMAGE_TYPE_INT8:   convert = convertInt8; break;
+    case IMAGE_TYPE_INT16:  convert = convertInt16; break;
+    case IMAGE_TYPE_FLOAT:  convert = convertFloat; break;
+    case IMAGE_TYPE_DOUBLE: convert = convertDouble; break;
+    default:
+        *min_value = DBL_MAX;
+        *max_value = -DBL_MAX;
+        return;
+    }
+
+#ifdef _OPENMP
+    if (image_threads > 1 && n >= IMAGE_PARALLEL_MIN)
+    {
+        const int element_size = imageElementSize(element_type);
+        double lo = DBL_MAX, hi = -DBL_MAX;
+
+        #pragma omp parallel num_threads(image_threads)
+        {
+            // parts start at a multiple of 64 elements, so no two threads write the same cache line
+            const int chunk = ((n + omp_get_num_threads() - 1) / omp_get_num_threads() + 63) & ~63;
+            const int begin = omp_get_thread_num() * chunk;
+            const int count = begin < n ? (n - begin < chunk ? n - begin : chunk) : 0;
+            double part_min, part_max;
+
+            convert(src + begin, (char*)dst + (size_t)begin * element_size, count, factor, &part_min, &part_max);
+
+            #pragma omp critical
+            {
+                lo = part_min < lo ? part_min : lo;
+                hi = part_max > hi ? part_max : hi;
+            }
+        }
+
+        *min_value = lo;
+        *max_value = hi;
+        return;
+    }
+#endif
+
+    convert(src, dst, n, factor, min_value, max_value);
+}
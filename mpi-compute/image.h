@@ -0,0 +1,30 @@
+/**************************************************************************//**
+ * @file image.h
+ * @brief Image element types
+ *
+ * This file declares helpers to select the element type of the image at
+ * runtime and to convert the computed field into it. If built with OpenMP
+ * the conversion may use several threads per process.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "mpi_protocol.h"
+
+// elements below which a conversion stays on one thread
+#define IMAGE_PARALLEL_MIN 32768
+
+int    imageTypeFromString(const char* name, int* element_type);
+const char* imageTypeToString(int element_type);
+double imageTypeDefaultScale(int element_type);
+void   imageSetThreads(int threads);
+int    imageThreads(void);
+void   imageConvert(int element_type, const double* src, void* dst, int n, double factor,
+                    double* min_value, double* max_value);
+
+#endif // IMAGE_H
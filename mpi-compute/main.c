@@ -4,7 +4,9 @@
  *
  * This file demonstrate the server side setup for an MPI server-client
  * intercommunicator using MPI_Open_port and MPI_Comm_accept. Data is
- * exchanged using non-blocking MPI_Isend and MPI_Irecv.
+ * exchanged using non-blocking MPI_Isend and MPI_Irecv. The image is
+ * either gathered on rank 0 or, in direct mode, every rank sends its own
+ * block to the clients, which may connect at any time.
  * @author Daniel Queteschiner
  * @date June 2019
  *//*
@@ -13,243 +15,1980 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 #include <mpi.h>
+#include "decomposition.h"
+#include "mpi_protocol.h"
+#include "image.h"
+#include "sendpool.h"
+#include "delta.h"
+#include "frame_codec.h"
+#include "mip.h"
+#include "subscribers.h"
+#include "recorder.h"
+#include "probes.h"
+#include "frame_memory.h"
 #if defined (_WIN32) || defined (_WIN64)
 #include <Windows.h>
 #include <tchar.h>
 #include <ShlObj.h>
 #endif
 
-typedef short image_datatype;           // char // short // double
-#define IMAGE_DATA_SCALE 32767.0        // (127.) // (32767) // (1.0)
-#define MPI_IMAGE_DATATYPE MPI_SHORT    // MPI_SHORT // MPI_SHORT // MPI_DOUBLE
+// defaults, may be changed at runtime
+#define SIZE_X 512
+#define SIZE_Y 512
+
+#define PROGRAMM_DURATION 15.0
+#define SEND_INTERVAL 0.03333   // ~30fps should be enough for visualization
+
+#define CHANNEL_PHASE 0.5       // seconds the channels are apart in time
+
+#define STATS_FILE_LENGTH 256
+#define RECORD_FILE_LENGTH 256
+#define SERVICE_NAME_LENGTH 256
+
+static send_pool image_send_pool;
+static delta_encoder image_delta;
+static frame_codec image_codec;
+static subscriber_acceptor image_acceptor;
+static subscriber subscribers[MAX_SUBSCRIBERS];
+static int num_subscribers = 0;
+static int num_connections = 0;     // clients taken from the acceptor so far
+static frame_recorder image_recorder;
+static probe_sampler image_probes;
+
+typedef struct
+{
+    int open_port;
+    int direct;                 // every rank connects and sends its own block
+    decomposition_type decomposition;
+    int width;
+    int height;
+    int element_type;           // IMAGE_TYPE_*
+    double scale;               // element value = scale * physical value
+    int send_buffers;           // send buffers per client
+    int num_drop_policies;      // the n-th client gets the n-th policy, further ones the last
+    send_drop_policy drop_policies[MAX_SUBSCRIBERS];
+    char stats_file[STATS_FILE_LENGTH]; // latency histograms are written here, if not empty
+    int delta;                  // send only changed tiles
+    int delta_tile;
+    double delta_threshold;     // physical value a tile element has to change by
+    int keyframe_interval;
+    int codec;                  // FRAME_CODEC_*
+    int codec_flags;            // FRAME_CODEC_SHUFFLE | FRAME_CODEC_QUANTIZE
+    double quantize_step;       // physical value
+    int wait_clients;           // clients to wait for before computing
+    char record_file[RECORD_FILE_LENGTH]; // full resolution frames are recorded here, if not empty
+    int threads;                // OpenMP threads per process, 0 = OMP_NUM_THREADS
+    char service_name[SERVICE_NAME_LENGTH]; // the port is published under this name, if not empty
+    double send_interval;       // seconds between send opportunities
+    double duration;            // seconds to compute for
+    int num_channels;           // fields computed, 1 to FRAME_MAX_CHANNELS
+    double probe_interval;      // seconds between the steps the probes are sampled at
+    int memory;                 // FRAME_MEMORY_* of the buffers MPI reads frames from or writes them to
+    int transport;              // FRAME_TRANSPORT_* offered to the clients
+} compute_options;
+
+// state process 0 distributes at every send opportunity
+typedef struct
+{
+    double time;
+    frame_view view;            // view served to the clients
+    int accepted;               // clients accepted so far
+    int quit;                   // bit mask of the subscribers that sent the quit message
+    int lost;                   // bit mask of the subscribers whose connection failed
+    int stop;                   // the computation ends, no frame is sent
+    probe_table probes;         // probes of all clients
+} loop_sync;
+
+// stages of a frame of gather mode
+#define GATHER_IDLE     0       // no frame in flight
+#define GATHER_SEGMENTS 1       // process 0 waits for the segment table of the compressed blocks
+#define GATHER_POSTED   2       // all collectives of the frame are posted
+
+// a frame of gather mode whose collectives are in flight
+typedef struct
+{
+    int stage;                  // GATHER_*
+    frame_header header;
+    double time;
+    int full_view;
+    int send_index;             // process 0, -1 if the frame is dropped
+    char* image_target;         // process 0, the whole image is gathered here
+    char* payload;              // process 0, segment table and compressed blocks
+    size_t payload_size;        // process 0, views and compressed blocks
+    int part_size;              // own cells of the view (elements) or compressed block (bytes)
+    frame_segment segment;
+    int assemble;               // process 0, the gathered blocks are put in place
+    double range[2 * FRAME_MAX_CHANNELS]; // -min, max of the own block per channel
+    double image_range[2 * FRAME_MAX_CHANNELS]; // of the whole image or view, process 0
+    double gather_start;
+    MPI_Request requests[3];    // range, gather (of the segment table), gather of the compressed blocks
+} pending_frame;
+
+// what the handshake with a new client is made of
+typedef struct
+{
+    const domain_decomposition* decomposition;
+    const compute_options* options;
+} handshake_context;
+
+/* ------------------------------------------------------------------------- */
+
+FILE* mpiOpenPortFile(void);
+int  mpiOpenPort(char* port_name, const char* service_name, int* published);
+void mpiUnpublishPort(const char* port_name, const char* service_name, int published);
+int  mpiReceiveViewRequest(MPI_Comm comm, frame_view* view, int width, int height, int num_channels);
+void mpiSendHandshake(const domain_decomposition* d, const compute_options* options, MPI_Comm comm);
+void mpiGreetClient(MPI_Comm comm, void* context);
+int  mpiReceiveProbeRequest(MPI_Comm comm, frame_probe_request* probes, int width, int height, int num_channels);
+void pollSubscribers(loop_sync* sync, int width, int height, int num_channels, int* view_serial);
+void updateSubscribers(const loop_sync* sync, const compute_options* options, int local_rank, const frame_view* view);
+void removeSubscriber(int slot, int disconnect, int local_rank);
+void closeSubscribers(int local_rank, MPI_Comm local_comm);
+void progressSubscribers(void);
+void flushSubscribers(void);
+int  acquireFrame(void);
+const char* collectResendTiles(char* resend);
+void offerFrame(int index, int count, const char* tiles);
+void sampleProbes(probe_sampler* s, const double* base, const frame_block* block, int num_channels, int last_step);
+void offerProbes(void);
+void assembleTiles(const domain_decomposition* d, const char* tiles, char* image, int element_size, int num_channels);
+void assembleViewCells(const domain_decomposition* d, const frame_view* view, const char* tiles, char* image, int element_size);
+void gatherLayout(const domain_decomposition* d, const frame_view* view, int* counts, int* displs);
+const char* selectChannels(const char* planes, int channels, size_t plane_bytes, char* packed);
+size_t encodeMessage(const char* raw, size_t raw_bytes, int nx, int ny, char* payload, size_t capacity, char* scratch);
+void writeLatencyStatistics(const char* file_name, const latency_histogram* compute,
+                            const latency_histogram* gather, const latency_histogram* encode,
+                            const send_pool* pool);
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char** argv)
+{
+    int world_size;
+    int world_rank;
+    int thread_level;
+    char port_name[MPI_MAX_PORT_NAME] = {0};
+    int serving = 0;            // this process sends frames to the clients
+    int published = 0;          // process 0: the port name is published under options.service_name
+    int recording = 0;
+    compute_options options = { 0, 0, DECOMPOSITION_ROWS, SIZE_X, SIZE_Y, IMAGE_TYPE_INT16, 0.0, SEND_POOL_BUFFERS, 1, { SEND_DROP_OLDEST }, "",
+                                  0, DELTA_TILE_SIZE, 0.0, DELTA_KEYFRAME_INTERVAL, FRAME_CODEC_NONE, 0, 0.0, 0, "", 1, MPI_SERVICE_NAME,
+                                  SEND_INTERVAL, PROGRAMM_DURATION, 1, PROBE_INTERVAL, 0, FRAME_TRANSPORT_SEND };
+    domain_decomposition decomposition;
+    handshake_context greeting;
+    MPI_Comm local_comm = MPI_COMM_SELF; // server side group of the intercomms
+    int intercomm_member = 0;
+
+    double* image_part_base = 0;
+    char* image_part = 0;
+    char* image_scratch = 0;    // frames in between send opportunities
+    char* image_data = 0;
+    char* image_tiles = 0;  // block-major gather buffer (tiles or several channels)
+    char* channel_part = 0;     // channels to send packed, if they are not adjacent
+    int element_size;
+    MPI_Datatype image_mpi_type;
+    int* gather_counts = 0;
+    int* gather_displs = 0;
+    int codec_active;
+    char* codec_part = 0;       // compressed own block (gather mode)
+    size_t codec_part_size = 0;
+    char* codec_payload = 0;    // delta encoded payload before compression
+    char* codec_scratch = 0;
+    char* codec_gather = 0;     // gather target of process 0 if the frame is dropped
+    int* codec_counts = 0;
+    int* codec_displs = 0;
+    double codec_raw_bytes = 0.0;
+    double codec_sent_bytes = 0.0;
+    frame_block own_block;
+    char* view_part = 0;        // cells of the view owned by this process
+    char* view_tiles = 0;       // block-major gather buffer of the view cells (gather mode)
+    int* view_counts = 0;
+    int* view_displs = 0;
+    char* delta_resend = 0;     // tiles some client missed (delta encoding)
+    int slot;
+
+    // initialize the MPI environment, clients are accepted on a helper thread if possible
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_level);
+
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
+    {
+        subscribers[slot].comm = MPI_COMM_NULL;
+    }
+
+    // get the number of processes
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+    // get the rank of the process
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+    if (world_rank == 0)
+    {
+        // parse command line arguments
+        for (int iarg = 1; iarg < argc; ++iarg)
+        {
+            if (strcmp(argv[iarg], "--version") == 0)
+            {
+                printf("mpi_compute_19.06.1\n");
+            }
+            else if (strcmp(argv[iarg], "--help") == 0)
+            {
+                printf("run with any number of processes, e.g. mpirun -np 4\n"
+                       "use '--openport' to connect with visualization program\n"
+                       "use '--service <name>' to publish the port under name (default '%s', '' = only write the port file)\n"
+                       "use '--decomposition rows|tiles' to split the image into row slabs (default) or 2D tiles\n"
+                       "use '--direct' to let every process send its own block instead of gathering on process 0\n"
+                       "use '--size <nx> <ny>' to set the image size (default %d x %d)\n"
+                       "use '--type int8|int16|float|double' to set the image element type (default int16)\n"
+                       "use '--channels <n>' to compute n fields, which the clients subscribe to (default 1, at most %d)\n"
+                       "use '--scale <s>' to set the factor between physical and element values\n"
+                       "use '--clients <n>' to wait for n clients before computing (default 0), more may connect any time\n"
+                       "use '--send-buffers <n>' to set the number of send buffers per client (default %d)\n"
+                       "use '--drop oldest|newest|block[,...]' to choose what happens if all send buffers of a client are busy:\n"
+                       "    replace the oldest unsent frame (default), discard the new frame or wait for the client;\n"
+                       "    the n-th policy applies to the n-th client, the last one to all further clients\n"
+                       "use '--stats <file>' to write latency histograms of process 0 as CSV (or JSON if file ends with .json)\n"
+                       "use '--delta <threshold>' to send only tiles that changed by more than threshold (physical value)\n"
+                       "use '--delta-tile <n>' to set the tile size of the delta encoding (default %d)\n"
+                       "use '--keyframe <n>' to send the whole image every n-th frame in delta mode (default %d, 0 = never)\n"
+                       "use '--codec none|zlib|lz4|zstd' to compress the image data (default none)\n"
+                       "use '--shuffle' to group the bytes of the elements by significance before compressing\n"
+                       "use '--quantize <step>' to round float/double elements to multiples of step (physical value, lossy)\n"
+                       "use '--record <file>' to record the frames of channel 0 at full resolution for 'mpi-visualize --replay <file>'\n"
+                       "use '--threads <n>' to compute with n threads per process (default 1, 0 = OMP_NUM_THREADS), needs OpenMP\n"
+                       "use '--interval <s>' to set the seconds between frames sent (default %g)\n"
+                       "use '--probe-interval <s>' to set the seconds between the steps probes are sampled at (default %g)\n"
+                       "use '--memory default|mpi,huge,pinned' to allocate the frame buffers by MPI_Alloc_mem, on huge pages\n"
+                       "    or pinned (default: page aligned system memory), what the system does not provide is left out\n"
+                       "use '--transport send|put' to send the frames or put them into a window of the receive buffers of\n"
+                       "    the clients (default send), frames are sent if the window cannot be created\n"
+                       "use '--duration <s>' to set the seconds to compute for (default %g)\n",
+                       MPI_SERVICE_NAME, SIZE_X, SIZE_Y, FRAME_MAX_CHANNELS, SEND_POOL_BUFFERS, DELTA_TILE_SIZE, DELTA_KEYFRAME_INTERVAL,
+                       SEND_INTERVAL, PROBE_INTERVAL, PROGRAMM_DURATION);
+            }
+            else if (strcmp(argv[iarg], "--openport") == 0)
+            {
+                options.open_port = 1;
+            }
+            else if (strcmp(argv[iarg], "--service") == 0 && iarg + 1 < argc)
+            {
+                strncpy(options.service_name, argv[++iarg], SERVICE_NAME_LENGTH - 1);
+            }
+            else if (strcmp(argv[iarg], "--direct") == 0)
+            {
+                options.direct = 1;
+            }
+            else if (strcmp(argv[iarg], "--decomposition") == 0 && iarg + 1 < argc)
+            {
+                if (!decompositionTypeFromString(argv[++iarg], &options.decomposition))
+                {
+                    printf("unknown decomposition '%s'\n", argv[iarg]);
+                }
+            }
+            else if (strcmp(argv[iarg], "--size") == 0 && iarg + 2 < argc)
+            {
+                options.width = atoi(argv[++iarg]);
+                options.height = atoi(argv[++iarg]);
+            }
+            else if (strcmp(argv[iarg], "--type") == 0 && iarg + 1 < argc)
+            {
+                if (!imageTypeFromString(argv[++iarg], &options.element_type))
+                {
+                    printf("unknown type '%s'\n", argv[iarg]);
+                }
+            }
+            else if (strcmp(argv[iarg], "--channels") == 0 && iarg + 1 < argc)
+            {
+                options.num_channels = atoi(argv[++iarg]);
+                if (options.num_channels < 1 || options.num_channels > FRAME_MAX_CHANNELS)
+                {
+                    printf("invalid channel count %d\n", options.num_channels);
+                    options.num_channels = 1;
+                }
+            }
+            else if (strcmp(argv[iarg], "--scale") == 0 && iarg + 1 < argc)
+            {
+                options.scale = atof(argv[++iarg]);
+            }
+            else if (strcmp(argv[iarg], "--send-buffers") == 0 && iarg + 1 < argc)
+            {
+                options.send_buffers = atoi(argv[++iarg]);
+            }
+            else if (strcmp(argv[iarg], "--clients") == 0 && iarg + 1 < argc)
+            {
+                options.wait_clients = atoi(argv[++iarg]);
+            }
+            else if (strcmp(argv[iarg], "--drop") == 0 && iarg + 1 < argc)
+            {
+                char* name = strtok(argv[++iarg], ",");
+
+                options.num_drop_policies = 0;
+                while (name && options.num_drop_policies < MAX_SUBSCRIBERS)
+                {
+                    if (sendPoolPolicyFromString(name, &options.drop_policies[options.num_drop_policies]))
+                    {
+                        ++options.num_drop_policies;
+                    }
+                    else
+                    {
+                        printf("unknown drop policy '%s'\n", name);
+                    }
+                    name = strtok(0, ",");
+                }
+
+                if (options.num_drop_policies == 0)
+                {
+                    options.drop_policies[0] = SEND_DROP_OLDEST;
+                    options.num_drop_policies = 1;
+                }
+            }
+            else if (strcmp(argv[iarg], "--stats") == 0 && iarg + 1 < argc)
+            {
+                strncpy(options.stats_file, argv[++iarg], STATS_FILE_LENGTH - 1);
+            }
+            else if (strcmp(argv[iarg], "--delta") == 0 && iarg + 1 < argc)
+            {
+                options.delta = 1;
+                options.delta_threshold = atof(argv[++iarg]);
+            }
+            else if (strcmp(argv[iarg], "--delta-tile") == 0 && iarg + 1 < argc)
+            {
+                options.delta_tile = atoi(argv[++iarg]);
+            }
+            else if (strcmp(argv[iarg], "--keyframe") == 0 && iarg + 1 < argc)
+            {
+                options.keyframe_interval = atoi(argv[++iarg]);
+            }
+            else if (strcmp(argv[iarg], "--codec") == 0 && iarg + 1 < argc)
+            {
+                if (!frameCodecFromString(argv[++iarg], &options.codec))
+                {
+                    printf("unknown codec '%s'\n", argv[iarg]);
+                }
+                else if (!frameCodecIsAvailable(options.codec))
+                {
+                    printf("codec '%s' is not available in this build\n", argv[iarg]);
+                    options.codec = FRAME_CODEC_NONE;
+                }
+            }
+            else if (strcmp(argv[iarg], "--shuffle") == 0)
+            {
+                options.codec_flags |= FRAME_CODEC_SHUFFLE;
+            }
+            else if (strcmp(argv[iarg], "--quantize") == 0 && iarg + 1 < argc)
+            {
+                options.quantize_step = atof(argv[++iarg]);
+                options.codec_flags |= FRAME_CODEC_QUANTIZE;
+            }
+            else if (strcmp(argv[iarg], "--threads") == 0 && iarg + 1 < argc)
+            {
+                options.threads = atoi(argv[++iarg]);
+                if (options.threads < 0)
+                {
+                    printf("invalid thread count %d\n", options.threads);
+                    options.threads = 1;
+                }
+            }
+            else if (strcmp(argv[iarg], "--record") == 0 && iarg + 1 < argc)
+            {
+                strncpy(options.record_file, argv[++iarg], RECORD_FILE_LENGTH - 1);
+            }
+            else if (strcmp(argv[iarg], "--interval") == 0 && iarg + 1 < argc)
+            {
+                options.send_interval = atof(argv[++iarg]);
+                if (options.send_interval < 0.0)
+                {
+                    printf("invalid send interval %g\n", options.send_interval);
+                    options.send_interval = SEND_INTERVAL;
+                }
+            }
+            else if (strcmp(argv[iarg], "--probe-interval") == 0 && iarg + 1 < argc)
+            {
+                options.probe_interval = atof(argv[++iarg]);
+                if (!(options.probe_interval > 0.0))
+                {
+                    printf("invalid probe interval %g\n", options.probe_interval);
+                    options.probe_interval = PROBE_INTERVAL;
+                }
+            }
+            else if (strcmp(argv[iarg], "--memory") == 0 && iarg + 1 < argc)
+            {
+                if (!frameMemoryFromString(argv[++iarg], &options.memory))
+                {
+                    printf("unknown memory '%s'\n", argv[iarg]);
+                }
+            }
+            else if (strcmp(argv[iarg], "--transport") == 0 && iarg + 1 < argc)
+            {
+                if (!frameTransportFromString(argv[++iarg], &options.transport))
+                {
+                    printf("unknown transport '%s'\n", argv[iarg]);
+                }
+            }
+            else if (strcmp(argv[iarg], "--duration") == 0 && iarg + 1 < argc)
+            {
+                options.duration = atof(argv[++iarg]);
+            }
+            else
+            {
+                printf("unknown option\n");
+            }
+        }
+    }
+
+    if (options.scale == 0.0)
+    {
+        options.scale = imageTypeDefaultScale(options.element_type);
+    }
+
+    if (options.codec_flags & FRAME_CODEC_QUANTIZE)
+    {
+        // the payload of a delta message also holds the tile indices
+        if ((options.element_type != IMAGE_TYPE_FLOAT && options.element_type != IMAGE_TYPE_DOUBLE) ||
+            options.delta || options.quantize_step <= 0.0)
+        {
+            if (world_rank == 0)
+            {
+                printf("quantization needs float or double elements, a positive step and no delta encoding, disabled\n");
+            }
+            options.codec_flags &= ~FRAME_CODEC_QUANTIZE;
+        }
+    }
+
+    // distribute options parsed on rank 0
+    MPI_Bcast(&options, sizeof(options), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    if (options.width < 1 || options.height < 1)
+    {
+        if (world_rank == 0)
+        {
+            printf("invalid image size %d x %d!\n", options.width, options.height); fflush(stdout);
+        }
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (!decompositionCreate(&decomposition, options.decomposition, options.width, options.height, world_size, world_rank))
+    {
+        MPI_Finalize();
+        return 0;
+    }
+
+    imageSetThreads(options.threads);
+
+    element_size = imageElementSize(options.element_type);
+    image_mpi_type = imageElementMpiType(options.element_type);
+
+    image_codec.codec = options.codec;
+    image_codec.flags = options.codec_flags;
+    image_codec.element_type = options.element_type;
+    image_codec.quantize_step = options.quantize_step * options.scale;
+    codec_active = frameCodecIsActive(&image_codec);
+
+    if (world_rank == 0)
+    {
+        printf("image: %d x %d %s (scale %g), %d channel(s), decomposition: %s, %d x %d blocks\n",
+               options.width, options.height, imageTypeToString(options.element_type), options.scale, options.num_channels,
+               decompositionTypeToString(decomposition.type),
+               decomposition.dims[0], decomposition.dims[1]); fflush(stdout);
+
+#ifdef _OPENMP
+        printf("threads per process: %d\n", imageThreads()); fflush(stdout);
+#else
+        if (options.threads != 1)
+        {
+            printf("built without OpenMP, computing with one thread per process\n"); fflush(stdout);
+        }
+#endif
+    }
+
+    // every process writes its own block, with or without clients
+    if (options.record_file[0])
+    {
+        recording = frameRecorderOpen(&image_recorder, options.record_file, &decomposition,
+                                      options.element_type, options.scale, MPI_COMM_WORLD);
+        if (recording && world_rank == 0)
+        {
+            printf("recording to %s, %lld bytes per frame\n", options.record_file,
+                   image_recorder.header.chunk_size); fflush(stdout);
+        }
+    }
+
+    // in direct mode all processes form the server side of the intercomm
+    if (options.direct)
+    {
+        local_comm = MPI_COMM_WORLD;
+        intercomm_member = 1;
+    }
+    else
+    {
+        intercomm_member = (world_rank == 0);
+    }
+
+    // open port for intercommunication
+    if (intercomm_member && options.open_port)
+    {
+        // only the root of local_comm opens the port and publishes its name
+        if (world_rank == 0)
+        {
+            serving = mpiOpenPort(port_name, options.service_name, &published);
+        }
+        MPI_Bcast(&serving, 1, MPI_INT, 0, local_comm);
+
+        if (serving)
+        {
+            const int threaded = (thread_level >= MPI_THREAD_MULTIPLE);
+
+            if (!threaded)
+            {
+                if (world_rank == 0)
+                {
+                    printf("MPI does not support MPI_THREAD_MULTIPLE, clients may only connect at startup\n"); fflush(stdout);
+                }
+                // nobody could ever connect otherwise
+                if (options.wait_clients < 1)
+                {
+                    options.wait_clients = 1;
+                }
+            }
+
+            greeting.decomposition = &decomposition;
+            greeting.options = &options;
+            subscriberAcceptorStart(&image_acceptor, port_name, local_comm, threaded, mpiGreetClient, &greeting);
+        }
+    }
+
+    // one plane per channel; the buffers MPI reads or writes are frame memory
+    image_part_base = (double*)malloc(sizeof(double) * decomposition.nx * decomposition.ny * options.num_channels);
+    image_part = (char*)frameMemoryAlloc((size_t)element_size * decomposition.nx * decomposition.ny * options.num_channels, options.memory);
+    image_scratch = (char*)malloc((size_t)element_size * decomposition.nx * decomposition.ny * options.num_channels);
+    if (options.num_channels > 2)
+    {
+        channel_part = (char*)frameMemoryAlloc((size_t)element_size * decomposition.nx * decomposition.ny * options.num_channels, options.memory);
+    }
+
+    if (world_rank == 0 && options.memory != 0 && image_part)
+    {
+        char granted[32], asked[32];
+        printf("frame memory: %s (asked for %s)\n", frameMemoryToString(frameMemoryFlags(image_part), granted, sizeof(granted)),
+               frameMemoryToString(options.memory, asked, sizeof(asked))); fflush(stdout);
+    }
+
+    // image_part is overwritten while previous sends may still be in flight
+    if (serving)
+    {
+        const size_t image_size = options.num_channels * (options.direct ?
+            (size_t)element_size * decomposition.nx * decomposition.ny :
+            (size_t)element_size * options.width * options.height);
+        const int send_nx = options.direct ? decomposition.nx : options.width;
+        const int send_ny = options.direct ? decomposition.ny : options.height;
+        size_t payload_size = image_size;
+        size_t send_size;
+        // in gather mode without delta encoding every process compresses its own block
+        const int max_segments = (options.direct || options.delta) ? 1 : world_size;
+        // every client may hold as many buffers as its queue (see sendQueueBuffers),
+        // one more is written to
+        const int pool_buffers = MAX_SUBSCRIBERS * (options.send_buffers < 2 ? 2 : options.send_buffers) + 1;
+
+        if (options.delta)
+        {
+            if (!deltaEncoderCreate(&image_delta, send_nx, send_ny, options.num_channels, options.element_type, options.delta_tile,
+                                    options.delta_threshold * options.scale, options.keyframe_interval,
+                                    pool_buffers))
+            {
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            }
+            payload_size = deltaEncoderMaxSize(&image_delta);
+            delta_resend = (char*)malloc(image_delta.num_tiles);
+        }
+
+        if (codec_active)
+        {
+            if (options.delta)
+            {
+                codec_payload = (char*)malloc(payload_size);
+            }
+            if (options.direct || options.delta)
+            {
+                codec_scratch = (char*)malloc(frameCodecScratchSize(payload_size));
+            }
+            payload_size = frameCodecBound(payload_size, max_segments);
+        }
+
+        // header and elements, keep consecutive buffers aligned
+        send_size = (FRAME_HEADER_SIZE + payload_size + 7) & ~(size_t)7;
+
+        if (!sendPoolCreate(&image_send_pool, pool_buffers, send_size))
+        {
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        image_send_pool.stamp_offset = (int)offsetof(frame_header, post_time);
+        image_send_pool.memory_flags = options.memory;
+
+        if (world_rank == 0)
+        {
+            int i;
+
+            printf("send buffers per client: %d, drop policy:", options.send_buffers);
+            for (i = 0; i < options.num_drop_policies; ++i)
+            {
+                printf("%s %s", i > 0 ? "," : "", sendPoolPolicyToString(options.drop_policies[i]));
+            }
+            printf(", transport: %s\n", frameTransportToString(options.transport)); fflush(stdout);
+
+            if (options.delta)
+            {
+                printf("delta encoding: %d x %d tiles of %d x %d elements, threshold %g, keyframe every %d frames\n",
+                       image_delta.tiles_x, image_delta.tiles_y, options.delta_tile, options.delta_tile,
+                       options.delta_threshold, options.keyframe_interval); fflush(stdout);
+            }
+
+            if (codec_active)
+            {
+                printf("codec: %s%s%s", frameCodecToString(options.codec),
+                       (options.codec_flags & FRAME_CODEC_SHUFFLE) ? ", shuffle" : "",
+                       (options.codec_flags & FRAME_CODEC_QUANTIZE) ? ", quantize" : "");
+                if (options.codec_flags & FRAME_CODEC_QUANTIZE)
+                {
+                    printf(" (step %g)", options.quantize_step);
+                }
+                printf("\n"); fflush(stdout);
+            }
+        }
+    }
+
+    // every process compresses its own block before the gather, so the cost
+    // scales with the number of processes
+    if (codec_active && !options.direct && !options.delta)
+    {
+        const size_t part_size = (size_t)element_size * decomposition.nx * decomposition.ny * options.num_channels;
+        const size_t image_size = (size_t)element_size * options.width * options.height * options.num_channels;
+
+        codec_part_size = frameCodecBound(part_size, 1);
+        codec_part = (char*)frameMemoryAlloc(codec_part_size, options.memory);
+        // process 0 also compresses whole views
+        codec_scratch = (char*)malloc(frameCodecScratchSize(world_rank == 0 ? image_size : part_size));
+
+        if (world_rank == 0)
+        {
+            codec_gather = (char*)frameMemoryAlloc(frameCodecBound(image_size, world_size), options.memory);
+            codec_counts = (int*)malloc(sizeof(int) * world_size);
+            codec_displs = (int*)malloc(sizeof(int) * world_size);
+        }
+    }
+
+    own_block.offset_x = decomposition.offset_x;
+    own_block.offset_y = decomposition.offset_y;
+    own_block.nx = decomposition.nx;
+    own_block.ny = decomposition.ny;
+
+    // a process never owns more cells of a view than it has elements
+    view_part = (char*)frameMemoryAlloc((size_t)element_size * decomposition.nx * decomposition.ny * options.num_channels, options.memory);
+
+    // all processes sample the probes of the clients, also those that are
+    // not part of the intercomms
+    if (options.open_port &&
+        !probeSamplerCreate(&image_probes, options.probe_interval, FRAME_PROBE_MAX_STEPS, world_rank == 0))
+    {
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    // only the root needs the whole image and the gather layout
+    if (!options.direct && world_rank == 0)
+    {
+        // the layout depends on the channels of the view, see gatherLayout
+        image_data = (char*)frameMemoryAlloc((size_t)element_size * options.width * options.height * options.num_channels, options.memory);
+        gather_counts = (int*)malloc(sizeof(int) * world_size);
+        gather_displs = (int*)malloc(sizeof(int) * world_size);
+
+        // row slabs of a single channel arrive in memory order, tiles and
+        // several channels have to be rearranged
+        if (decomposition.type == DECOMPOSITION_TILES || options.num_channels > 1)
+        {
+            image_tiles = (char*)frameMemoryAlloc((size_t)element_size * options.width * options.height * options.num_channels, options.memory);
+        }
+
+        view_tiles = (char*)frameMemoryAlloc((size_t)element_size * options.width * options.height * options.num_channels, options.memory);
+        view_counts = (int*)malloc(sizeof(int) * world_size);
+        view_displs = (int*)malloc(sizeof(int) * world_size);
+    }
+
+    // compute base data; channel c is the field of channel 0 turned by
+    // c * pi / num_channels
+    {
+        const int nx = decomposition.nx;
+        const int ny = decomposition.ny;
+        double x, y, z, r, d;
+        int xIndex, yIndex, c;
+
+        for (c = 0; c < options.num_channels; ++c)
+        {
+            const double angle = c * 4.0 * atan(1.0) / options.num_channels;
+            const double cos_angle = cos(angle);
+            const double sin_angle = sin(angle);
+            double* base = image_part_base + (size_t)c * nx * ny;
+
+            // rows are independent, every thread computes some of them
+            #pragma omp parallel for private(xIndex, x, y, z, r, d) num_threads(imageThreads())
+            for (yIndex = 0; yIndex < ny; ++yIndex)
+            {
+                y = (1.0 * (yIndex + decomposition.offset_y)) / options.height * 8.0 - 4.0; // scale to [-4,4]
+
+                for (xIndex = 0; xIndex < nx; ++xIndex)
+                {
+                    x = (1.0 * (xIndex + decomposition.offset_x)) / options.width  * 8.0 - 4.0; // scale to [-4,4]
+                    d = x * cos_angle - y * sin_angle; // along the turned axis
+                    r = 3.0 * sqrt(x * x + y * y) + 1e-2;
+                    z = 2.0 * d * (cos(r + 2.) / r - sin(r + 2.) / r);
+                    base[xIndex + yIndex * nx] = z;
+                }
+            }
+        }
+    }
+
+    {
+        const int nx = decomposition.nx;
+        const int ny = decomposition.ny;
+        const size_t plane_bytes = (size_t)element_size * nx * ny; // of one channel of the own block
+        int frames = 0;
+        int sequence = 0; // counts send opportunities, in step on all processes
+        int view_serial = 0; // numbers the views served, clients number their requests themselves
+        double time, start_time, end_time, last_send_time;
+        latency_histogram compute_latency, gather_latency, encode_latency;
+        frame_view view;
+        loop_sync sync;         // the state all processes applied last
+        loop_sync sync_next;    // process 0: collected for the next send opportunity
+        loop_sync sync_buffer;  // of the broadcast in flight
+        MPI_Request sync_request = MPI_REQUEST_NULL;
+        pending_frame pending;
+
+        mipFullView(&view, options.width, options.height);
+        sync.view = view;
+        sync.quit = 0;
+        sync.lost = 0;
+        sync.stop = 0;
+        memset(&sync.probes, 0, sizeof(sync.probes));
+        pending.stage = GATHER_IDLE;
+
+        // start with the clients asked for
+        if (serving)
+        {
+            subscriberAcceptorWait(&image_acceptor, options.wait_clients);
+        }
+        sync.accepted = (world_rank == 0 && serving) ? subscriberAcceptorCount(&image_acceptor) : 0;
+        MPI_Bcast(&sync.accepted, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (serving)
+        {
+            updateSubscribers(&sync, &options, world_rank, &view);
+        }
+        sync_next = sync;
+
+        latencyHistogramReset(&compute_latency);
+        latencyHistogramReset(&gather_latency);
+        latencyHistogramReset(&encode_latency);
+
+        start_time = MPI_Wtime();  // get current time
+        MPI_Bcast(&start_time, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD); // sync time on all processes
+        // frame timestamps refer to the clock of process 0
+        image_send_pool.clock_offset = start_time - MPI_Wtime();
+        time = start_time;
+        last_send_time = start_time;
+        end_time = start_time + options.duration;
+
+        // the state of the first send opportunity
+        if (world_rank != 0)
+        {
+            MPI_Ibcast(&sync_buffer, sizeof(sync_buffer), MPI_BYTE, 0, MPI_COMM_WORLD, &sync_request);
+        }
+
+        // main loop: process 0 decides when to send and distributes its state
+        // with a non-blocking broadcast, which the other processes poll for
+        // while they keep computing; the collectives of a frame in gather
+        // mode complete while the next frames are computed
+        while (!sync.stop)
+        {
+            int send_frame = 0;     // this iteration is a send opportunity
+            int full_view;
+            int num_selected;       // channels of the view
+            int c;
+            char* planes;
+            frame_header header;
+
+            if (world_rank == 0)
+            {
+                time = MPI_Wtime();
+
+                if (serving)
+                {
+                    pollSubscribers(&sync_next, options.width, options.height, options.num_channels, &view_serial);
+                }
+
+                // process 0 posts the gather of the compressed blocks before
+                // the next broadcast
+                if ((time - last_send_time > options.send_interval || time >= end_time) && pending.stage != GATHER_SEGMENTS)
+                {
+                    // the previous broadcast was posted a frame interval ago
+                    MPI_Wait(&sync_request, MPI_STATUS_IGNORE);
+                    sync_next.time = time;
+                    sync_next.stop = (time >= end_time);
+                    sync_buffer = sync_next;
+                    MPI_Ibcast(&sync_buffer, sizeof(sync_buffer), MPI_BYTE, 0, MPI_COMM_WORLD, &sync_request);
+                    sync_next.quit = 0;
+                    sync_next.lost = 0;
+                    last_send_time = time;
+                    send_frame = 1;
+                }
+            }
+            else
+            {
+                time = MPI_Wtime() + image_send_pool.clock_offset;
+                MPI_Test(&sync_request, &send_frame, MPI_STATUS_IGNORE);
+            }
+
+            // the frame in flight is completed at the latest before the next
+            // send opportunity, a frame interval after it was posted
+            if (pending.stage == GATHER_SEGMENTS)
+            {
+                int done;
+
+                MPI_Test(&pending.requests[1], &done, MPI_STATUS_IGNORE);
+
+                if (done)
+                {
+                    const frame_segment* segments = (const frame_segment*)(pending.payload + 2 * sizeof(int));
+                    const int table_size = frameSegmentTableSize(world_size);
+                    int rank, displ = 0;
+
+                    ((int*)pending.payload)[0] = world_size;
+                    ((int*)pending.payload)[1] = 0;
+
+                    for (rank = 0; rank < world_size; ++rank)
+                    {
+                        codec_counts[rank] = (segments[rank].compressed_bytes + 7) & ~7;
+                        codec_displs[rank] = displ;
+                        displ += codec_counts[rank];
+                    }
+                    pending.payload_size = table_size + displ;
+                    codec_raw_bytes += (double)element_size * options.width * options.height *
+                                       frameChannelCount(pending.header.view.channels);
+                    codec_sent_bytes += pending.payload_size;
+
+                    MPI_Igatherv(codec_part, pending.part_size, MPI_BYTE,
+                                 pending.payload + table_size, codec_counts, codec_displs, MPI_BYTE,
+                                 0, MPI_COMM_WORLD, &pending.requests[2]);
+                    pending.stage = GATHER_POSTED;
+                }
+            }
+
+            if (pending.stage == GATHER_POSTED)
+            {
+                int done = 1;
+
+                if (send_frame)
+                {
+                    MPI_Waitall(3, pending.requests, MPI_STATUSES_IGNORE);
+                }
+                else
+                {
+                    MPI_Testall(3, pending.requests, &done, MPI_STATUSES_IGNORE);
+                }
+
+                if (done)
+                {
+                    pending.header.gather_time = MPI_Wtime() - pending.gather_start;
+                    latencyHistogramAdd(&gather_latency, pending.header.gather_time);
+
+                    if (world_rank == 0)
+                    {
+                        const frame_view* pending_view = &pending.header.view;
+                        const int pending_channels = frameChannelCount(pending_view->channels);
+
+                        for (c = 0; c < options.num_channels; ++c)
+                        {
+                            pending.header.min_value[c] = -pending.image_range[2 * c];
+                            pending.header.max_value[c] = pending.image_range[2 * c + 1];
+                        }
+
+                        if (!pending.full_view)
+                        {
+                            const size_t view_size = (size_t)element_size * pending_view->nx * pending_view->ny * pending_channels;
+                            char* payload = (pending.send_index >= 0) ? sendPoolBuffer(&image_send_pool, pending.send_index) + FRAME_HEADER_SIZE : 0;
+
+                            assembleViewCells(&decomposition, pending_view, view_tiles,
+                                              (payload && !codec_active) ? payload : image_data, element_size);
+                            pending.payload_size = view_size;
+
+                            if (payload && codec_active)
+                            {
+                                const double encode_start = MPI_Wtime();
+                                codec_raw_bytes += view_size;
+                                pending.payload_size = encodeMessage(image_data, view_size, pending_view->nx, pending_view->ny, payload,
+                                                                     image_send_pool.buffer_size - FRAME_HEADER_SIZE, codec_scratch);
+                                codec_sent_bytes += pending.payload_size;
+                                pending.header.encode_time = MPI_Wtime() - encode_start;
+                            }
+                        }
+                        else if (pending.assemble)
+                        {
+                            assembleTiles(&decomposition, image_tiles, pending.image_target, element_size, pending_channels);
+                        }
+
+                        // send data to the visualization programs
+                        if (num_subscribers > 0)
+                        {
+                            printf("updated time: %lf\n", pending.time - start_time); fflush(stdout);
+                        }
+
+                        if (pending.send_index >= 0)
+                        {
+                            // send new data
+                            char* buffer = sendPoolBuffer(&image_send_pool, pending.send_index);
+                            size_t payload_size = (size_t)element_size * options.width * options.height * pending_channels;
+
+                            if (!pending.full_view || codec_part)
+                            {
+                                payload_size = pending.payload_size;
+                            }
+                            else if (options.delta)
+                            {
+                                const double encode_start = MPI_Wtime();
+                                payload_size = deltaEncode(&image_delta, image_data, pending_channels, &pending.header,
+                                                           codec_active ? codec_payload : buffer + FRAME_HEADER_SIZE,
+                                                           pending.send_index, collectResendTiles(delta_resend));
+                                if (codec_active)
+                                {
+                                    codec_raw_bytes += payload_size;
+                                    payload_size = encodeMessage(codec_payload, payload_size, 0, 0, buffer + FRAME_HEADER_SIZE,
+                                                                 image_send_pool.buffer_size - FRAME_HEADER_SIZE, codec_scratch);
+                                    codec_sent_bytes += payload_size;
+                                }
+                                pending.header.encode_time = MPI_Wtime() - encode_start;
+                            }
+                            memcpy(buffer, &pending.header, FRAME_HEADER_SIZE);
+                            offerFrame(pending.send_index, FRAME_HEADER_SIZE + (int)payload_size,
+                                       (pending.full_view && options.delta) ? deltaEncoderBufferTiles(&image_delta, pending.send_index) : 0);
+                        }
+                    }
+
+                    if (pending.header.encode_time > 0.0)
+                    {
+                        latencyHistogramAdd(&encode_latency, pending.header.encode_time);
+                    }
+                    pending.stage = GATHER_IDLE;
+                }
+            }
+
+            // all processes apply the same state at the same send opportunity
+            if (send_frame)
+            {
+                sync = sync_buffer;
+                time = sync.time;
+
+                if (sync.view.id != view.id)
+                {
+                    view = sync.view;
+
+                    // the clients only kept the tiles of the full view up to date
+                    if (options.delta && serving && frameViewIsFull(&view, options.width, options.height))
+                    {
+                        deltaEncoderRequestKeyframe(&image_delta);
+                    }
+                }
+
+                // all processes of the server group take and remove the same clients
+                if (serving)
+                {
+                    updateSubscribers(&sync, &options, world_rank, &view);
+                }
+
+                if (sync.stop)
+                {
+                    break;
+                }
+
+                // the steps of the probes up to this send opportunity are
+                // reduced while the next frames are computed, the previous
+                // ones were posted a frame interval ago
+                if (options.open_port)
+                {
+                    const int last_step = (int)floor((time - start_time) / options.probe_interval);
+
+                    if (probeSamplerTest(&image_probes, 1) && world_rank == 0)
+                    {
+                        offerProbes();
+                    }
+
+                    if (sync.probes.id != image_probes.table.id)
+                    {
+                        probeSamplerReset(&image_probes, &sync.probes, last_step + 1);
+                    }
+                    else if (image_probes.table.num_probes > 0)
+                    {
+                        probeSamplerLimit(&image_probes, last_step);
+                        sampleProbes(&image_probes, image_part_base, &own_block, options.num_channels, last_step);
+                        probeSamplerPost(&image_probes, last_step, 0, MPI_COMM_WORLD);
+                    }
+                }
+            }
+            else if (image_probes.in_flight && probeSamplerTest(&image_probes, 0) && world_rank == 0)
+            {
+                offerProbes();
+            }
+
+            // sample the probes of the steps passed since the last iteration
+            if (image_probes.table.num_probes > 0)
+            {
+                sampleProbes(&image_probes, image_part_base, &own_block, options.num_channels,
+                             (int)floor((time - start_time) / options.probe_interval));
+            }
+
+            // compute data; the frames in between keep the simulation going,
+            // image_part is only written for frames that are sent. Only the
+            // channels of the view are converted, and channel 0 for the recording
+            full_view = frameViewIsFull(&view, options.width, options.height);
+            num_selected = frameChannelCount(view.channels);
+            planes = send_frame ? image_part : image_scratch;
+
+            header.compute_start = MPI_Wtime() + image_send_pool.clock_offset;
+            for (c = 0; c < options.num_channels; ++c)
+            {
+                if ((view.channels & (1 << c)) || (c == 0 && recording))
+                {
+                    const double time_factor = options.scale * fabs(sin(time - start_time + c * CHANNEL_PHASE));
+                    imageConvert(options.element_type, image_part_base + (size_t)c * nx * ny, planes + c * plane_bytes,
+                                 nx * ny, time_factor, &header.min_value[c], &header.max_value[c]);
+                }
+                else
+                {
+                    header.min_value[c] = 1.0;
+                    header.max_value[c] = 0.0;
+                }
+            }
+            for (; c < FRAME_MAX_CHANNELS; ++c)
+            {
+                header.min_value[c] = 1.0;
+                header.max_value[c] = 0.0;
+            }
+            header.compute_time = MPI_Wtime() + image_send_pool.clock_offset - header.compute_start;
+            header.gather_time = 0.0;
+            header.encode_time = 0.0;
+            header.post_time = 0.0;
+            header.encoding = FRAME_ENCODING_FULL;
+            header.num_tiles = 0;
+            header.view = view;
+            latencyHistogramAdd(&compute_latency, header.compute_time);
+
+            // record the whole image of every send opportunity, the clients may
+            // see views or drop frames; recordings hold channel 0
+            if (send_frame && recording)
+            {
+                frameRecorderWrite(&image_recorder, image_part, sequence, time - start_time,
+                                   header.min_value[0], header.max_value[0]);
+            }
+
+            // time for intercommunication?
+            if (send_frame && options.direct)
+            {
+                header.sequence = sequence++;
+                header.block = world_rank;
+
+                // send own block to the visualization programs
+                if (num_subscribers > 0)
+                {
+                    if (world_rank == 0)
+                    {
+                        printf("updated time: %lf\n", time - start_time); fflush(stdout);
+                    }
+
+                    // unless asked to block, a process never waits for a client here:
+                    // it would hold back the send opportunities of all others
+                    const int send_index = acquireFrame();
+
+                    if (send_index >= 0)
+                    {
+                        // send new data
+                        char* buffer = sendPoolBuffer(&image_send_pool, send_index);
+                        char* payload = buffer + FRAME_HEADER_SIZE;
+                        const size_t capacity = image_send_pool.buffer_size - FRAME_HEADER_SIZE;
+                        const double encode_start = MPI_Wtime();
+                        size_t payload_size = plane_bytes * num_selected;
+
+                        if (!full_view)
+                        {
+                            const frame_block cells = frameViewBlockCells(&view, &own_block);
+                            const size_t cell_bytes = (size_t)element_size * cells.nx * cells.ny;
+                            char* out = (codec_active && cell_bytes > 0) ? view_part : payload;
+                            payload_size = cell_bytes * num_selected;
+
+                            for (c = 0; c < options.num_channels; ++c)
+                            {
+                                if (view.channels & (1 << c))
+                                {
+                                    mipDownsample(options.element_type, image_part + c * plane_bytes, &own_block, &view, &cells, out,
+                                                  &header.min_value[c], &header.max_value[c]);
+                                    out += cell_bytes;
+                                }
+                            }
+
+                            if (codec_active && cell_bytes > 0)
+                            {
+                                codec_raw_bytes += payload_size;
+                                payload_size = encodeMessage(view_part, payload_size, cells.nx, cells.ny, payload, capacity, codec_scratch);
+                                codec_sent_bytes += payload_size;
+                            }
+                        }
+                        else if (options.delta)
+                        {
+                            payload_size = deltaEncode(&image_delta, selectChannels(image_part, view.channels, plane_bytes, channel_part),
+                                                       num_selected, &header, codec_active ? codec_payload : payload,
+                                                       send_index, collectResendTiles(delta_resend));
+                            if (codec_active)
+                            {
+                                codec_raw_bytes += payload_size;
+                                payload_size = encodeMessage(codec_payload, payload_size, 0, 0, payload, capacity, codec_scratch);
+                                codec_sent_bytes += payload_size;
+                            }
+                        }
+                        else if (codec_active)
+                        {
+                            codec_raw_bytes += payload_size;
+                            payload_size = encodeMessage(selectChannels(image_part, view.channels, plane_bytes, channel_part),
+                                                         payload_size, nx, ny, payload, capacity, codec_scratch);
+                            codec_sent_bytes += payload_size;
+                        }
+                        else
+                        {
+                            // packs the channels straight into the message if they are not adjacent
+                            const char* selected = selectChannels(image_part, view.channels, plane_bytes, payload);
+                            if (selected != payload)
+                            {
+                                memcpy(payload, selected, payload_size);
+                            }
+                        }
+                        header.encode_time = MPI_Wtime() - encode_start;
+                        memcpy(buffer, &header, FRAME_HEADER_SIZE);
+                        offerFrame(send_index, FRAME_HEADER_SIZE + (int)payload_size,
+                                   (full_view && options.delta) ? deltaEncoderBufferTiles(&image_delta, send_index) : 0);
+                    }
+                }
+
+                if (header.encode_time > 0.0)
+                {
+                    latencyHistogramAdd(&encode_latency, header.encode_time);
+                }
+            }
+            else if (send_frame)
+            {
+                // post the collectives of the frame, it is sent once they completed
+                pending.header = header;
+                pending.header.sequence = sequence++;
+                pending.header.block = 0;
+                pending.time = time;
+                pending.full_view = full_view;
+                // row slabs of a single channel are gathered in place
+                pending.assemble = full_view && !codec_part && image_tiles &&
+                                   (decomposition.type == DECOMPOSITION_TILES || num_selected > 1);
+                pending.send_index = -1;
+                pending.image_target = image_data;
+                pending.payload = 0;
+                pending.payload_size = 0;
+                pending.requests[0] = MPI_REQUEST_NULL;
+                pending.requests[1] = MPI_REQUEST_NULL;
+                pending.requests[2] = MPI_REQUEST_NULL;
+
+                // pick the send buffer first, so that row slabs are gathered in place;
+                // if the frame is dropped image_data serves as scratch buffer,
+                // the delta encoder needs the whole image there anyway
+                if (world_rank == 0 && num_subscribers > 0)
+                {
+                    pending.send_index = acquireFrame();
+
+                    if (pending.send_index >= 0 && !options.delta)
+                    {
+                        pending.image_target = sendPoolBuffer(&image_send_pool, pending.send_index) + FRAME_HEADER_SIZE;
+                    }
+                }
+
+                if (!full_view)
+                {
+                    // downsample the own block, the cells are put in place once gathered
+                    const frame_block cells = frameViewBlockCells(&view, &own_block);
+                    char* out = view_part;
+
+                    for (c = 0; c < options.num_channels; ++c)
+                    {
+                        if (view.channels & (1 << c))
+                        {
+                            mipDownsample(options.element_type, image_part + c * plane_bytes, &own_block, &view, &cells, out,
+                                          &pending.header.min_value[c], &pending.header.max_value[c]);
+                            out += (size_t)element_size * cells.nx * cells.ny;
+                        }
+                    }
+                    pending.part_size = cells.nx * cells.ny * num_selected;
+
+                    if (world_rank == 0)
+                    {
+                        gatherLayout(&decomposition, &view, view_counts, view_displs);
+                    }
+                }
+                else if (codec_part)
+                {
+                    // compress the own block, the segment table is gathered before the compressed blocks
+                    const double encode_start = MPI_Wtime();
+
+                    pending.segment.offset_x = decomposition.offset_x;
+                    pending.segment.offset_y = decomposition.offset_y;
+                    pending.segment.nx = nx;
+                    pending.segment.ny = ny;
+                    pending.part_size = (int)frameCodecEncode(&image_codec, selectChannels(image_part, view.channels, plane_bytes, channel_part),
+                                                               plane_bytes * num_selected, &pending.segment,
+                                                               codec_part, codec_part_size, codec_scratch);
+                    pending.header.encode_time = MPI_Wtime() - encode_start;
+                    pending.payload = (pending.send_index >= 0) ? pending.image_target : codec_gather;
+                }
+
+                // range of the whole image (or view) from the ranges of the blocks
+                for (c = 0; c < options.num_channels; ++c)
+                {
+                    pending.range[2 * c] = -pending.header.min_value[c];
+                    pending.range[2 * c + 1] = pending.header.max_value[c];
+                }
+                pending.gather_start = MPI_Wtime();
+                MPI_Ireduce(pending.range, pending.image_range, 2 * options.num_channels, MPI_DOUBLE, MPI_MAX,
+                            0, MPI_COMM_WORLD, &pending.requests[0]);
+
+                if (!full_view)
+                {
+                    MPI_Igatherv(view_part, pending.part_size, image_mpi_type,
+                                 view_tiles, view_counts, view_displs, image_mpi_type,
+                                 0, MPI_COMM_WORLD, &pending.requests[1]);
+                    pending.stage = GATHER_POSTED;
+                }
+                else if (codec_part)
+                {
+                    MPI_Igather(&pending.segment, FRAME_SEGMENT_INTS, MPI_INT,
+                                pending.payload ? pending.payload + 2 * sizeof(int) : 0,
+                                FRAME_SEGMENT_INTS, MPI_INT, 0, MPI_COMM_WORLD, &pending.requests[1]);
+
+                    // process 0 needs the segment table to place the compressed blocks
+                    if (world_rank == 0)
+                    {
+                        pending.stage = GATHER_SEGMENTS;
+                    }
+                    else
+                    {
+                        MPI_Igatherv(codec_part, pending.part_size, MPI_BYTE,
+                                     0, 0, 0, MPI_BYTE, 0, MPI_COMM_WORLD, &pending.requests[2]);
+                        pending.stage = GATHER_POSTED;
+                    }
+                }
+                else
+                {
+                    // collect image data, the channels of a block one after the other
+                    if (world_rank == 0)
+                    {
+                        gatherLayout(&decomposition, &view, gather_counts, gather_displs);
+                    }
+                    MPI_Igatherv(selectChannels(image_part, view.channels, plane_bytes, channel_part), nx * ny * num_selected, image_mpi_type,
+                                 pending.assemble ? image_tiles : pending.image_target, gather_counts, gather_displs, image_mpi_type,
+                                 0, MPI_COMM_WORLD, &pending.requests[1]);
+                    pending.stage = GATHER_POSTED;
+                }
+            }
+
+            // post frames queued while all sends were in flight
+            if (serving)
+            {
+                progressSubscribers();
+            }
+
+            // the state of the next send opportunity, after the collectives of this one
+            if (send_frame && world_rank != 0)
+            {
+                MPI_Ibcast(&sync_buffer, sizeof(sync_buffer), MPI_BYTE, 0, MPI_COMM_WORLD, &sync_request);
+            }
+
+            ++frames;
+        } // end loop
+
+        // the last broadcast of process 0
+        MPI_Wait(&sync_request, MPI_STATUS_IGNORE);
+
+        if (options.open_port)
+        {
+            if (world_rank == 0 && image_probes.steps_dropped > 0)
+            {
+                printf("%d: probes dropped %d steps\n", world_rank, image_probes.steps_dropped); fflush(stdout);
+            }
+            probeSamplerDestroy(&image_probes); // completes the last reduction
+        }
+
+        if (serving && num_subscribers > 0)
+        {
+            printf("%d: Waiting for last image send to be received ...\n", world_rank); fflush(stdout);
+            flushSubscribers();
+        }
+
+        printf("%d: end time = %lf, frames %d (sent %d, dropped %d), FPS %lf, sFPS %lf\n",
+               world_rank, time,
+               frames, image_send_pool.sent, image_send_pool.dropped,
+               frames / (time - start_time), image_send_pool.sent / (time - start_time));
+        fflush(stdout);
+
+        if (options.delta && serving && image_delta.tiles_total > 0)
+        {
+            printf("%d: delta encoding sent %.1f%% of the tiles, %d keyframes\n",
+                   world_rank, 100.0 * image_delta.tiles_sent / image_delta.tiles_total, image_delta.keyframes);
+            fflush(stdout);
+        }
+
+        if (codec_active && world_rank == 0 && codec_raw_bytes > 0)
+        {
+            printf("%d: %s compressed the image data to %.1f%%\n",
+                   world_rank, frameCodecToString(options.codec), 100.0 * codec_sent_bytes / codec_raw_bytes);
+            fflush(stdout);
+        }
+
+        if (world_rank == 0 && options.stats_file[0])
+        {
+            writeLatencyStatistics(options.stats_file, &compute_latency, &gather_latency, &encode_latency, &image_send_pool);
+        }
+    }
+
+    if (recording)
+    {
+        frameRecorderClose(&image_recorder);
+    }
+
+    // disconnect
+    if (serving)
+    {
+        // no new client should find the port while it is being closed
+        if (world_rank == 0)
+        {
+            mpiUnpublishPort(port_name, options.service_name, published);
+        }
+        closeSubscribers(world_rank, local_comm);
+        subscriberAcceptorStop(&image_acceptor);
+    }
+
+    // memory of MPI_Alloc_mem has to go before MPI_Finalize
+    frameMemoryFree(image_part);
+    frameMemoryFree(image_data);
+    frameMemoryFree(image_tiles);
+    frameMemoryFree(channel_part);
+    sendPoolDestroy(&image_send_pool);
+    frameMemoryFree(codec_part);
+    frameMemoryFree(codec_gather);
+    frameMemoryFree(view_part);
+    frameMemoryFree(view_tiles);
+
+    // finalize the MPI environment.
+    printf("Finalizing MPI ...\n"); fflush(stdout);
+    MPI_Finalize();
+    printf("MPI finalized\n"); fflush(stdout);
+
+    free(image_part_base);
+    free(image_scratch);
+    deltaEncoderDestroy(&image_delta);
+    free(gather_counts);
+    free(gather_displs);
+    free(codec_payload);
+    free(codec_scratch);
+    free(codec_counts);
+    free(codec_displs);
+    free(view_counts);
+    free(view_displs);
+    free(delta_resend);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// puts the blocks gathered one after the other in place within the image,
+// every block holding num_channels planes; so does the image
+void assembleTiles(const domain_decomposition* d, const char* tiles, char* image, int element_size, int num_channels)
+{
+    const int num_blocks = d->dims[0] * d->dims[1];
+    const size_t image_plane = (size_t)d->global_nx * d->global_ny * element_size;
+    int rank, c, yIndex;
+
+    for (rank = 0; rank < num_blocks; ++rank)
+    {
+        int offset_x, offset_y, nx, ny;
+        decompositionBlock(d, rank, &offset_x, &offset_y, &nx, &ny);
+
+        for (c = 0; c < num_channels; ++c)
+        {
+            for (yIndex = 0; yIndex < ny; ++yIndex)
+            {
+                memcpy(image + c * image_plane + ((size_t)(offset_y + yIndex) * d->global_nx + offset_x) * element_size,
+                       tiles + (size_t)yIndex * nx * element_size,
+                       (size_t)element_size * nx);
+            }
+
+            tiles += (size_t)nx * ny * element_size;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// puts the view cells gathered block after block in place within the view,
+// the cells of every channel of the view one after the other
+void assembleViewCells(const domain_decomposition* d, const frame_view* view, const char* tiles, char* image, int element_size)
+{
+    const int num_blocks = d->dims[0] * d->dims[1];
+    const int num_channels = frameChannelCount(view->channels);
+    const size_t view_plane = (size_t)view->nx * view->ny * element_size;
+    int rank, c, yIndex;
+
+    for (rank = 0; rank < num_blocks; ++rank)
+    {
+        frame_block block, cells;
+        decompositionBlock(d, rank, &block.offset_x, &block.offset_y, &block.nx, &block.ny);
+        cells = frameViewBlockCells(view, &block);
+
+        for (c = 0; c < num_channels; ++c)
+        {
+            for (yIndex = 0; yIndex < cells.ny; ++yIndex)
+            {
+                memcpy(image + c * view_plane + ((size_t)(cells.offset_y - view->y + yIndex) * view->nx + cells.offset_x - view->x) * element_size,
+                       tiles + (size_t)yIndex * cells.nx * element_size,
+                       (size_t)element_size * cells.nx);
+            }
+
+            tiles += (size_t)cells.nx * cells.ny * element_size;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// process 0: the counts and displacements (in elements) of gathering the
+// cells of the view, all its channels, from every block
+void gatherLayout(const domain_decomposition* d, const frame_view* view, int* counts, int* displs)
+{
+    const int num_blocks = d->dims[0] * d->dims[1];
+    const int num_channels = frameChannelCount(view->channels);
+    int rank, displ = 0;
+
+    for (rank = 0; rank < num_blocks; ++rank)
+    {
+        frame_block block, cells;
+        decompositionBlock(d, rank, &block.offset_x, &block.offset_y, &block.nx, &block.ny);
+        cells = frameViewBlockCells(view, &block);
+        counts[rank] = cells.nx * cells.ny * num_channels;
+        displs[rank] = displ;
+        displ += counts[rank];
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the planes of the channels in the bit mask one after the other: planes
+// itself if they are adjacent, else packed copies of them in packed
+const char* selectChannels(const char* planes, int channels, size_t plane_bytes, char* packed)
+{
+    int first = 0;
+    char* out = packed;
+
+    while (!(channels & (1 << first)))
+    {
+        ++first;
+    }
+
+    if (((channels >> first) & ((channels >> first) + 1)) == 0)
+    {
+        return planes + first * plane_bytes;
+    }
+
+    for (; channels >> first; ++first)
+    {
+        if (channels & (1 << first))
+        {
+            memcpy(out, planes + first * plane_bytes, plane_bytes);
+            out += plane_bytes;
+        }
+    }
+
+    return packed;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// compresses raw as a single segment into the payload of a message; nx = 0
+// for a delta encoded payload; returns the size of the payload
+size_t encodeMessage(const char* raw, size_t raw_bytes, int nx, int ny, char* payload, size_t capacity, char* scratch)
+{
+    const int table_size = frameSegmentTableSize(1);
+    frame_segment* segment = (frame_segment*)(payload + 2 * sizeof(int));
+
+    ((int*)payload)[0] = 1;
+    ((int*)payload)[1] = 0;
+    segment->offset_x = 0;
+    segment->offset_y = 0;
+    segment->nx = nx;
+    segment->ny = ny;
+
+    return table_size + frameCodecEncode(&image_codec, raw, raw_bytes, segment,
+                                         payload + table_size, capacity - table_size, scratch);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void writeLatencyStatistics(const char* file_name, const latency_histogram* compute,
+                            const latency_histogram* gather, const latency_histogram* encode,
+                            const send_pool* pool)
+{
+    const char* stages[5] = { "compute", "gather", "encode", "queue", "send" };
+    latency_histogram histograms[5];
+
+    histograms[0] = *compute;
+    histograms[1] = *gather;
+    histograms[2] = *encode;
+    histograms[3] = pool->queue_latency;
+    histograms[4] = pool->send_latency;
+
+    if (latencyHistogramWriteFile(file_name, stages, histograms, 5))
+    {
+        printf("Latency statistics written to %s\n", file_name); fflush(stdout);
+    }
+    else
+    {
+        printf("Failed to write latency statistics to %s\n", file_name); fflush(stdout);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// process 0 only: checks the connections of the clients and takes their
+// view and probe requests; a single client is served the view it asked
+// for, several clients share the full view of all the channels they asked
+// for. The clients number their requests independently, so the views
+// served are numbered here. The probes of all clients are sampled
+// together. The clients that quit are collected in sync until it is
+// distributed.
+void pollSubscribers(loop_sync* sync, int width, int height, int num_channels, int* view_serial)
+{
+    frame_view view;
+    probe_table probes;
+    int channels = 0;
+    int slot, i;
+
+    probes.num_probes = 0;
+
+    sync->accepted = subscriberAcceptorCount(&image_acceptor);
+    mipFullView(&view, width, height);
+
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
+    {
+        subscriber* s = &subscribers[slot];
+        int status;
+
+        if (s->comm == MPI_COMM_NULL || ((sync->quit | sync->lost) & (1 << slot)))
+        {
+            continue;
+        }
+
+        status = subscriberPollQuit(s);
+
+        if (status == 0)
+        {
+            sync->quit |= 1 << slot;
+        }
+        else if (status < 0)
+        {
+            sync->lost |= 1 << slot;
+        }
+        else
+        {
+            if (mpiReceiveViewRequest(s->comm, &s->view, width, height, num_channels))
+            {
+                printf("view %d of client %d: level %d, %d x %d cells at %d, %d, channels 0x%x\n", s->view.id, s->id, s->view.level,
+                       s->view.nx, s->view.ny, s->view.x, s->view.y, s->view.channels); fflush(stdout);
+            }
+
+            if (mpiReceiveProbeRequest(s->comm, &s->probes, width, height, num_channels))
+            {
+                printf("probes %d of client %d: %d probes\n", s->probes.id, s->id, s->probes.num_probes); fflush(stdout);
+            }
+
+            // the probes of all clients, in the order of the slots
+            for (i = 0; i < s->probes.num_probes && probes.num_probes < PROBE_TABLE_SIZE; ++i)
+            {
+                probes.probes[probes.num_probes] = s->probes.probes[i];
+                probes.owner[probes.num_probes] = s->id;
+                probes.request[probes.num_probes] = s->probes.id;
+                ++probes.num_probes;
+            }
+
+            channels |= s->view.channels;
+
+            if (num_subscribers == 1)
+            {
+                view = s->view;
+            }
+        }
+    }
+
+    if (num_subscribers > 1 && channels)
+    {
+        view.channels = channels;
+    }
+
+    if (view.level != sync->view.level || view.x != sync->view.x || view.y != sync->view.y ||
+        view.nx != sync->view.nx || view.ny != sync->view.ny || view.channels != sync->view.channels)
+    {
+        sync->view = view;
+        sync->view.id = ++*view_serial;
+    }
+
+    if (probes.num_probes != sync->probes.num_probes ||
+        memcmp(probes.probes, sync->probes.probes, sizeof(frame_probe) * probes.num_probes) != 0 ||
+        memcmp(probes.owner, sync->probes.owner, sizeof(int) * probes.num_probes) != 0 ||
+        memcmp(probes.request, sync->probes.request, sizeof(int) * probes.num_probes) != 0)
+    {
+        probes.id = sync->probes.id + 1;
+        sync->probes = probes;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// removes the clients that quit and takes the clients accepted up to
+// sync->accepted, in the same order on all processes of the server group
+void updateSubscribers(const loop_sync* sync, const compute_options* options, int local_rank, const frame_view* view)
+{
+    int slot;
 
-#define SIZE_X 512
-#define SIZE_Y 512
-#define SIZE_Y_HALF (SIZE_Y >> 1)
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
+    {
+        if ((sync->quit | sync->lost) & (1 << slot))
+        {
+            removeSubscriber(slot, (sync->quit & (1 << slot)) != 0, local_rank);
+        }
+    }
 
-#define MPI_TAG_MESSAGE_QUIT 0
-#define MPI_TAG_IMAGE_DATA   1
+    while (num_connections < sync->accepted)
+    {
+        const MPI_Comm comm = subscriberAcceptorTake(&image_acceptor);
+        const int id = num_connections++;
+        const send_drop_policy policy = options->drop_policies[id < options->num_drop_policies ? id : options->num_drop_policies - 1];
+        frame_view full;
 
-#define PROGRAMM_DURATION 15.0
+        // the acceptor never hands out more connections than there are slots
+        for (slot = 0; subscribers[slot].comm != MPI_COMM_NULL; ++slot)
+        {
+        }
 
-static MPI_Request recv_disconnect_request = MPI_REQUEST_NULL;
-static MPI_Request send_image_data_request = MPI_REQUEST_NULL;
+        // a new client starts with the full view
+        mipFullView(&full, options->width, options->height);
 
-/* ------------------------------------------------------------------------- */
+        if (!subscriberOpen(&subscribers[slot], comm, id, local_rank, &full, options->send_buffers, policy,
+                            options->delta ? image_delta.num_tiles : 0))
+        {
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        ++num_subscribers;
+
+        if (local_rank == 0)
+        {
+            printf("client %d connected, drop policy: %s, %d clients\n", id, sendPoolPolicyToString(policy), num_subscribers); fflush(stdout);
+        }
 
-int  mpiConnect(char* port_name, MPI_Comm* comm);
-void mpiDisconnect(const char* port_name, MPI_Comm* comm);
-int  mpiIsIntercommAlive(const char* port_name, MPI_Comm* comm);
+        // the client takes part as soon as its handshake is done
+        if (options->transport == FRAME_TRANSPORT_PUT)
+        {
+            const int put = subscriberOpenWindow(&subscribers[slot], image_send_pool.buffer_size);
+            if (local_rank == 0)
+            {
+                printf("client %d: frames are %s\n", id, put ? "put into its window" : "sent, the window could not be set up"); fflush(stdout);
+            }
+        }
+
+        // the new client has none of the tiles
+        if (options->delta && frameViewIsFull(view, options->width, options->height))
+        {
+            deltaEncoderRequestKeyframe(&image_delta);
+        }
+    }
+}
 
 /* ------------------------------------------------------------------------- */
 
-int main(int argc, char** argv)
+// collective over the server group if disconnect is set
+void removeSubscriber(int slot, int disconnect, int local_rank)
 {
-    int world_size;
-    int world_rank;
-    char port_name[MPI_MAX_PORT_NAME] = {0};
-    MPI_Comm intercomm = MPI_COMM_NULL;
-    int open_port = 0;
-    int connected = 0;
+    subscriber* s = &subscribers[slot];
 
-    const int nx = SIZE_X;
-    const int ny = SIZE_Y_HALF;
-    double* image_part_base = 0;
-    image_datatype* image_part = 0;
-    image_datatype* image_data = 0;
+    if (local_rank == 0)
+    {
+        printf("client %d: sent %d, dropped %d\n", s->id, s->queue.sent, s->queue.dropped); fflush(stdout);
+        if (s->probe_messages > 0)
+        {
+            printf("client %d: probe data sent %d, dropped %d\n", s->id, s->probe_messages, s->probe_dropped); fflush(stdout);
+        }
+    }
 
-    // initialize the MPI environment
-    MPI_Init(&argc, &argv);
+    subscriberClose(s, &image_send_pool, disconnect);
+    subscriberAcceptorRelease(&image_acceptor);
+    --num_subscribers;
+}
 
-    // get the number of processes
-    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+/* ------------------------------------------------------------------------- */
 
-    // get the rank of the process
-    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+// tells the clients still connected to quit and disconnects from them
+// (collective over the server group)
+void closeSubscribers(int local_rank, MPI_Comm local_comm)
+{
+    int status[2] = { 0, 0 }; // quit, lost
+    int slot;
 
-    if (world_rank == 0)
+    // clients that quit meanwhile are only disconnected
+    if (local_rank == 0)
     {
-        // parse command line arguments
-        for (int iarg = 1; iarg < argc; ++iarg)
+        for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
         {
-            if (strcmp(argv[iarg], "--version") == 0)
-            {
-                printf("mpi_compute_19.06.1\n");
-            }
-            else if (strcmp(argv[iarg], "--help") == 0)
-            {
-                printf("run with 2 processes, i.e. mpirun -np 2\n"
-                       "use '--openport' to connect with visualization program\n");
-            }
-            else if (strcmp(argv[iarg], "--openport") == 0)
+            if (subscribers[slot].comm != MPI_COMM_NULL)
             {
-                open_port = 1;
-            }
-            else
-            {
-                printf("unknown option\n");
+                const int alive = subscriberPollQuit(&subscribers[slot]);
+
+                if (alive == 0)
+                {
+                    status[0] |= 1 << slot;
+                }
+                else if (alive < 0)
+                {
+                    status[1] |= 1 << slot;
+                }
             }
         }
     }
+    MPI_Bcast(status, 2, MPI_INT, 0, local_comm);
 
-    if (world_size != 2)
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
     {
-        printf("demo must run with 2 procs!\n"); fflush(stdout);
-        MPI_Finalize();
-        return 0;
+        if (subscribers[slot].comm == MPI_COMM_NULL)
+        {
+            continue;
+        }
+
+        if (!((status[0] | status[1]) & (1 << slot)) && local_rank == 0)
+        {
+            int message = 1;
+            printf("Sending disconnection message to client %d\n", subscribers[slot].id); fflush(stdout);
+            MPI_Ssend(&message, 1, MPI_INT, 0, MPI_TAG_MESSAGE_QUIT, subscribers[slot].comm);
+        }
+
+        removeSubscriber(slot, !(status[1] & (1 << slot)), local_rank);
     }
+}
 
-    // open port for intercommunication
-    if (world_rank == 0 && open_port)
+/* ------------------------------------------------------------------------- */
+
+// releases completed sends and posts queued frames of all clients
+void progressSubscribers(void)
+{
+    int slot;
+
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
+    {
+        if (subscribers[slot].comm != MPI_COMM_NULL)
+        {
+            sendQueueProgress(&subscribers[slot].queue, &image_send_pool);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// waits until all clients received the frames handed to their queues
+void flushSubscribers(void)
+{
+    int slot;
+
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
     {
-        connected = mpiConnect(port_name, &intercomm);
+        if (subscribers[slot].comm != MPI_COMM_NULL)
+        {
+            sendQueueFlush(&subscribers[slot].queue, &image_send_pool);
+        }
     }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns the send buffer to write the next frame to, or -1 if the frame
+// is not needed because every client would drop it
+int acquireFrame(void)
+{
+    int slot, accepts = 0;
 
-    image_part_base = (double*)malloc(sizeof(double) * SIZE_X * SIZE_Y_HALF);
-    image_part = (image_datatype*)malloc(sizeof(image_datatype) * SIZE_X * SIZE_Y_HALF);
-    image_data = (image_datatype*)malloc(sizeof(image_datatype) * SIZE_X * SIZE_Y);
+    progressSubscribers();
 
-    // compute base data
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
     {
-        double x, y, z, r;
-        int xIndex, yIndex;
+        if (subscribers[slot].comm != MPI_COMM_NULL && sendQueueAccepts(&subscribers[slot].queue))
+        {
+            accepts = 1;
+        }
+    }
 
-        for (yIndex = 0; yIndex < ny; ++yIndex)
+    if (!accepts)
+    {
+        for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
         {
-            for (xIndex = 0; xIndex < nx; ++xIndex)
+            if (subscribers[slot].comm != MPI_COMM_NULL)
             {
-                x = (1.0 * xIndex)                   / SIZE_X * 8.0 - 4.0; // scale to [-4,4]
-                y = (yIndex + 1.0 * ny * world_rank) / SIZE_Y * 8.0 - 4.0; // scale to [-4,4]
-                r = 3.0 * sqrt(x * x + y * y) + 1e-2;
-                z = 2.0 * x * (cos(r + 2.) / r - sin(r + 2.) / r);
-                image_part_base[xIndex + yIndex * nx] = z;
+                ++subscribers[slot].queue.dropped;
+                ++image_send_pool.dropped;
             }
         }
+        return -1;
     }
 
-    {
-        int frames = 0;
-        int sent_frames = 0;
-        double time, start_time, end_time, last_send_time;
+    return sendPoolAcquire(&image_send_pool);
+}
 
-        start_time = MPI_Wtime();  // get current time
-        MPI_Bcast(&start_time, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD); // sync time on all processes
-        time = start_time;
-        last_send_time = start_time;
-        end_time = start_time + PROGRAMM_DURATION;
+/* ------------------------------------------------------------------------- */
+
+// flags the tiles a delta encoded frame offered now has to carry for some
+// client besides the changed ones: those of the frames it dropped and
+// those of the queued frame the new one replaces
+const char* collectResendTiles(char* resend)
+{
+    int slot, tile;
 
-        // main loop
-        while (time < end_time)
+    memset(resend, 0, image_delta.num_tiles);
+
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
+    {
+        const subscriber* s = &subscribers[slot];
+
+        if (s->comm != MPI_COMM_NULL)
         {
-            // compute data
-            double time_factor = IMAGE_DATA_SCALE * fabs(sin(time - start_time));
-            int xIndex, yIndex;
+            const int replaced = sendQueueReplaces(&s->queue);
+            const char* replaced_tiles = (replaced >= 0) ? deltaEncoderBufferTiles(&image_delta, replaced) : 0;
 
-            for (yIndex = 0; yIndex < ny; ++yIndex)
+            for (tile = 0; tile < image_delta.num_tiles; ++tile)
             {
-                for (xIndex = 0; xIndex < nx; ++xIndex)
-                {
-                    image_part[xIndex + yIndex * nx] = (image_datatype)(image_part_base[xIndex + yIndex * nx] * time_factor);
-                }
+                resend[tile] |= s->missed_tiles[tile] | (replaced_tiles ? replaced_tiles[tile] : 0);
             }
+        }
+    }
 
-            // time for intercommunication?
-            if (time - last_send_time > 0.03333) // ~30fps should be enough for visualization
-            {
-                // collect image data
-                MPI_Gather(image_part, SIZE_X * SIZE_Y_HALF, MPI_IMAGE_DATATYPE,
-                           image_data, SIZE_X * SIZE_Y_HALF, MPI_IMAGE_DATATYPE,
-                           0, MPI_COMM_WORLD);
+    return resend;
+}
 
-                // send data to visualization program
-                if (world_rank == 0 && connected)
-                {
-                    printf("updated time: %lf\n", time - start_time); fflush(stdout);
+/* ------------------------------------------------------------------------- */
 
-                    // update connection status
-                    connected = mpiIsIntercommAlive(port_name, &intercomm);
+// offers the message of count bytes written to the acquired buffer to all
+// clients; tiles flags the tiles of a delta encoded message, which clients
+// dropping it miss
+void offerFrame(int index, int count, const char* tiles)
+{
+    int slot, tile;
 
-                    if (connected)
-                    {
-                        // wait for previous data to be received
-                        MPI_Wait(&send_image_data_request, MPI_STATUS_IGNORE);
+    sendPoolSubmit(&image_send_pool, index, count);
 
-                        // update connection status
-                        connected = mpiIsIntercommAlive(port_name, &intercomm);
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
+    {
+        subscriber* s = &subscribers[slot];
 
-                        if (connected)
-                        {
-                            // send new data
-                            MPI_Isend(image_data, SIZE_X * SIZE_Y, MPI_IMAGE_DATATYPE, 0, MPI_TAG_IMAGE_DATA, intercomm, &send_image_data_request);
-                            ++sent_frames;
-                        }
-                    }
-                }
+        if (s->comm == MPI_COMM_NULL)
+        {
+            continue;
+        }
 
-                last_send_time = time;
+        if (sendQueueOffer(&s->queue, &image_send_pool, index))
+        {
+            if (s->missed_tiles)
+            {
+                memset(s->missed_tiles, 0, image_delta.num_tiles);
             }
-
-            if (world_rank == 0)
+        }
+        else if (s->missed_tiles && tiles)
+        {
+            for (tile = 0; tile < image_delta.num_tiles; ++tile)
             {
-                time = MPI_Wtime();
+                s->missed_tiles[tile] |= tiles[tile];
             }
-            MPI_Bcast(&time, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        }
+    }
 
-            ++frames;
-        } // end loop
+    sendPoolRelease(&image_send_pool, index);
+}
 
-        if (world_rank == 0 && connected)
+/* ------------------------------------------------------------------------- */
+
+// samples the probes at the steps up to last_step the sampler has room
+// for; step k is the field at k * interval seconds after the start
+void sampleProbes(probe_sampler* s, const double* base, const frame_block* block, int num_channels, int last_step)
+{
+    double factors[FRAME_MAX_CHANNELS];
+    int c;
+
+    while (s->next <= last_step)
+    {
+        for (c = 0; c < num_channels; ++c)
         {
-            printf("Waiting for last image send to be received ...\n"); fflush(stdout);
-            MPI_Wait(&send_image_data_request, MPI_STATUS_IGNORE);
+            factors[c] = fabs(sin(s->next * s->interval + c * CHANNEL_PHASE));
+        }
+        if (!probeSamplerAdd(s, base, block, factors))
+        {
+            break;
         }
-
-        printf("%d: end time = %lf, frames %d (sent %d), FPS %lf, sFPS %lf\n",
-               world_rank, time,
-               frames, sent_frames,
-               frames / (time - start_time), sent_frames / (time - start_time));
-        fflush(stdout);
     }
+}
 
-    // disconnect
-    if (world_rank == 0 && connected)
+/* ------------------------------------------------------------------------- */
+
+// process 0 only: sends the steps of the probes reduced last to every
+// client that registered probes; a client still receiving the previous
+// message misses these steps, the compute loop never waits for it
+void offerProbes(void)
+{
+    int slot;
+
+    for (slot = 0; slot < MAX_SUBSCRIBERS; ++slot)
     {
-        connected = mpiIsIntercommAlive(port_name, &intercomm);
+        subscriber* s = &subscribers[slot];
+        int bytes, done = 1;
 
-        if (connected)
+        if (s->comm == MPI_COMM_NULL || s->probes.num_probes == 0)
         {
-            int message = 1;
-            printf("Sending disconnection message\n"); fflush(stdout);
-            MPI_Ssend(&message, 1, MPI_INT, 0, MPI_TAG_MESSAGE_QUIT, intercomm);
-            connected = mpiIsIntercommAlive(port_name, &intercomm);
-
-            if (connected)
-            {
-                mpiDisconnect(port_name, &intercomm);
-            }
+            continue;
         }
-    }
-
-    // finalize the MPI environment.
-    printf("Finalizing MPI ...\n"); fflush(stdout);
-    MPI_Finalize();
-    printf("MPI finalized\n"); fflush(stdout);
 
-    free(image_part_base);
-    free(image_part);
-    free(image_data);
+        if (s->probe_request != MPI_REQUEST_NULL)
+        {
+            MPI_Test(&s->probe_request, &done, MPI_STATUS_IGNORE);
+        }
+        if (!done)
+        {
+            ++s->probe_dropped;
+            continue;
+        }
 
-    return 0;
+        bytes = probeSamplerMessage(&image_probes, s->id, s->probe_message);
+        if (bytes > 0)
+        {
+            MPI_Isend(s->probe_message, bytes, MPI_BYTE, 0, MPI_TAG_PROBE_DATA, s->comm, &s->probe_request);
+            ++s->probe_messages;
+        }
+    }
 }
 
 /* ------------------------------------------------------------------------- */
 
-int mpiConnect(char* port_name, MPI_Comm* comm)
+// opens the file clients read the port name from, for writing
+FILE* mpiOpenPortFile(void)
 {
-    // write port name to file
     FILE* port_file = 0;
 #if defined (_WIN32) || defined (_WIN64)
     int csidl = CSIDL_APPDATA;
@@ -293,111 +2032,248 @@ int mpiConnect(char* port_name, MPI_Comm* comm)
     port_file = fopen(file_name, "wt");
 #endif
 
+    return port_file;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// opens the port and makes its name known to the clients: it is written to
+// the port file and published under service_name (unless empty); returns 0
+// if neither worked
+int mpiOpenPort(char* port_name, const char* service_name, int* published)
+{
+    FILE* port_file = mpiOpenPortFile();
+    int written = 0;
+
+    // open port
+    printf("Opening port for intercomm\n"); fflush(stdout);
+    MPI_Open_port(MPI_INFO_NULL, port_name);
+
     if (port_file)
     {
-        // open port
-        printf("Opening port for intercomm\n"); fflush(stdout);
-        MPI_Open_port(MPI_INFO_NULL, port_name);
-
-        fprintf(port_file, "%s", port_name); fflush(stdout);
-        fclose(port_file);
+        fprintf(port_file, "%s", port_name);
+        written = (fclose(port_file) == 0);
     }
     else
     {
         printf("Failed to open file\n"); fflush(stdout);
-        return 0;
     }
 
-    // accept connection from client (blocks until client called MPI_Comm_connect)
-    printf("Waiting for intercomm ...\n");  fflush(stdout);
-    MPI_Comm_accept(port_name, MPI_INFO_NULL, 0, MPI_COMM_SELF, comm);
+    *published = 0;
+    if (service_name[0])
+    {
+        // publishing needs a name server (e.g. ompi-server), without one it fails
+        MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
+        MPI_Comm_set_errhandler(MPI_COMM_SELF, MPI_ERRORS_RETURN);
+        *published = (MPI_Publish_name((char*)service_name, MPI_INFO_NULL, port_name) == MPI_SUCCESS);
+        MPI_Comm_set_errhandler(MPI_COMM_SELF, MPI_ERRORS_ARE_FATAL);
+        MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_ARE_FATAL);
+
+        if (*published)
+        {
+            printf("Published port as '%s'\n", service_name); fflush(stdout);
+        }
+        else
+        {
+            printf("Failed to publish port as '%s'\n", service_name); fflush(stdout);
+        }
+    }
 
-    if (*comm == MPI_COMM_NULL)
+    if (!written && !*published)
     {
-        printf("Error: no intercommunicator!\n"); fflush(stdout);
+        MPI_Close_port(port_name);
         return 0;
     }
 
-    printf("Intercomm accepted\n");
     return 1;
 }
 
 /* ------------------------------------------------------------------------- */
 
-void mpiDisconnect(const char* port_name, MPI_Comm* comm)
+// withdraws the port name before the port is closed, so that clients looking
+// for a server do not find this one any more
+void mpiUnpublishPort(const char* port_name, const char* service_name, int published)
+{
+    FILE* port_file;
+
+    if (published)
+    {
+        MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
+        MPI_Comm_set_errhandler(MPI_COMM_SELF, MPI_ERRORS_RETURN);
+        if (MPI_Unpublish_name((char*)service_name, MPI_INFO_NULL, (char*)port_name) != MPI_SUCCESS)
+        {
+            printf("Failed to unpublish port '%s'\n", service_name); fflush(stdout);
+        }
+        MPI_Comm_set_errhandler(MPI_COMM_SELF, MPI_ERRORS_ARE_FATAL);
+        MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_ARE_FATAL);
+    }
+
+    // an empty port file tells the clients that no server is running
+    port_file = mpiOpenPortFile();
+    if (port_file)
+    {
+        fclose(port_file);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void mpiSendHandshake(const domain_decomposition* d, const compute_options* options, MPI_Comm comm)
 {
-    if (*comm == MPI_COMM_NULL)
+    frame_handshake handshake;
+    frame_block* blocks = 0;
+    int rank, round;
+
+    memset(&handshake, 0, sizeof(handshake));
+    handshake.version = MPI_PROTOCOL_VERSION;
+    handshake.mode = options->direct ? FRAME_MODE_DIRECT : FRAME_MODE_GATHER;
+    handshake.transport = options->transport;
+    handshake.width = d->global_nx;
+    handshake.height = d->global_ny;
+    handshake.element_type = options->element_type;
+    handshake.tiles_x = d->dims[0];
+    handshake.tiles_y = d->dims[1];
+    handshake.num_blocks = options->direct ? d->dims[0] * d->dims[1] : 1;
+    handshake.delta_tile = options->delta ? options->delta_tile : 0;
+    handshake.codec = options->codec;
+    handshake.codec_flags = options->codec_flags;
+    handshake.max_segments = (options->direct || options->delta) ? 1 : d->dims[0] * d->dims[1];
+    handshake.max_level = mipMaxLevel(d->global_nx, d->global_ny);
+    handshake.scale = options->scale;
+    handshake.quantize_step = options->quantize_step * options->scale;
+    handshake.num_channels = options->num_channels;
+
+    for (rank = 0; rank < options->num_channels; ++rank)
     {
-        printf("Communicator is already NULL!\n"); fflush(stdout);
-        return;
+        snprintf(handshake.channel_names[rank], FRAME_CHANNEL_NAME_LENGTH, "field %c", '0' + rank);
     }
 
-    if (send_image_data_request != MPI_REQUEST_NULL)
+    blocks = (frame_block*)malloc(sizeof(frame_block) * handshake.num_blocks);
+
+    if (options->direct)
     {
-        printf("Cancelling send_image_data request!\n"); fflush(stdout);
-        MPI_Cancel(&send_image_data_request);
-        MPI_Request_free(&send_image_data_request);
+        for (rank = 0; rank < handshake.num_blocks; ++rank)
+        {
+            decompositionBlock(d, rank, &blocks[rank].offset_x, &blocks[rank].offset_y,
+                               &blocks[rank].nx, &blocks[rank].ny);
+        }
     }
-    if (recv_disconnect_request != MPI_REQUEST_NULL)
+    else
     {
-        printf("Cancelling recv_disconnect request!\n"); fflush(stdout);
-        MPI_Cancel(&recv_disconnect_request);
-        MPI_Request_free(&recv_disconnect_request);
+        blocks[0].offset_x = 0;
+        blocks[0].offset_y = 0;
+        blocks[0].nx = d->global_nx;
+        blocks[0].ny = d->global_ny;
     }
 
-    printf("Disconnecting ...\n"); fflush(stdout);
-    MPI_Comm_disconnect(comm);
-    *comm = MPI_COMM_NULL;
-    printf("Disconnected\n"); fflush(stdout);
+    MPI_Send(&handshake, sizeof(handshake), MPI_BYTE, 0, MPI_TAG_HANDSHAKE, comm);
+    MPI_Send(blocks, FRAME_BLOCK_INTS * handshake.num_blocks, MPI_INT, 0, MPI_TAG_HANDSHAKE, comm);
+
+    // answer the clock requests of the client with our time
+    for (round = 0; round < FRAME_CLOCK_SYNC_ROUNDS; ++round)
+    {
+        double now;
+        MPI_Recv(&now, 1, MPI_DOUBLE, 0, MPI_TAG_HANDSHAKE, comm, MPI_STATUS_IGNORE);
+        now = MPI_Wtime();
+        MPI_Send(&now, 1, MPI_DOUBLE, 0, MPI_TAG_HANDSHAKE, comm);
+    }
 
-    MPI_Close_port(port_name);
-    printf("Port closed\n"); fflush(stdout);
+    free(blocks);
 }
 
 /* ------------------------------------------------------------------------- */
 
-int mpiIsIntercommAlive(const char* port_name, MPI_Comm* comm)
+// runs on the accept thread of process 0
+void mpiGreetClient(MPI_Comm comm, void* context)
 {
-    MPI_Comm intercomm = *comm;
+    const handshake_context* greeting = (const handshake_context*)context;
 
-    if (intercomm == MPI_COMM_NULL)
-    {
-        printf("Intercommunicator is NULL!\n"); fflush(stdout);
-        return 0;
-    }
-    else
+    mpiSendHandshake(greeting->decomposition, greeting->options, comm);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// takes the view requests a client sent to this process (rank 0 of the
+// server group), limited to the channels of the image; returns 1 if view
+// was replaced by a newer one
+int mpiReceiveViewRequest(MPI_Comm comm, frame_view* view, int width, int height, int num_channels)
+{
+    int changed = 0;
+
+    for (;;)
     {
-        int flag;
+        frame_view request;
+        int flag = 0;
 
-        if (recv_disconnect_request == MPI_REQUEST_NULL)
+        MPI_Iprobe(0, MPI_TAG_VIEW_REQUEST, comm, &flag, MPI_STATUS_IGNORE);
+        if (!flag)
         {
-            // wait for a quit message
-            static int message = -1;
+            break;
+        }
 
-            if (MPI_Irecv(&message, 1, MPI_INT, 0, MPI_TAG_MESSAGE_QUIT, intercomm, &recv_disconnect_request) != MPI_SUCCESS)
-            {
-                printf("MPI_Irecv communication failed!\n"); fflush(stdout);
-                *comm = MPI_COMM_NULL;
-                MPI_Abort(MPI_COMM_WORLD, -1);
-            }
+        MPI_Recv(&request, FRAME_VIEW_INTS, MPI_INT, 0, MPI_TAG_VIEW_REQUEST, comm, MPI_STATUS_IGNORE);
+
+        request.channels &= frameAllChannels(num_channels);
+
+        if (request.id > view->id && request.channels && mipClipView(&request, width, height))
+        {
+            *view = request;
+            changed = 1;
+        }
+        else
+        {
+            printf("Ignoring view request %d\n", request.id); fflush(stdout);
+        }
+    }
+
+    return changed;
+}
 
-            return 1;
+/* ------------------------------------------------------------------------- */
+
+// takes the probe requests a client sent to this process (rank 0 of the
+// server group); probes of an unknown type or channel are left out, the
+// others moved into the image. Returns 1 if probes were replaced by a
+// newer request.
+int mpiReceiveProbeRequest(MPI_Comm comm, frame_probe_request* probes, int width, int height, int num_channels)
+{
+    int changed = 0;
+
+    for (;;)
+    {
+        frame_probe_request request;
+        int flag = 0;
+        int i, n = 0;
+
+        MPI_Iprobe(0, MPI_TAG_PROBE_REQUEST, comm, &flag, MPI_STATUS_IGNORE);
+        if (!flag)
+        {
+            break;
         }
 
-        if (MPI_Test(&recv_disconnect_request, &flag, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+        MPI_Recv(&request, FRAME_PROBE_REQUEST_INTS, MPI_INT, 0, MPI_TAG_PROBE_REQUEST, comm, MPI_STATUS_IGNORE);
+
+        if (request.id <= probes->id || request.num_probes < 0 || request.num_probes > FRAME_MAX_PROBES)
         {
-            printf("MPI_Test communication failed!\n"); fflush(stdout);
-            *comm = MPI_COMM_NULL;
-            return 0;
+            printf("Ignoring probe request %d\n", request.id); fflush(stdout);
+            continue;
         }
 
-        if (flag) // received quit message
+        for (i = 0; i < request.num_probes; ++i)
         {
-            printf("Received disconnect message from client program'\n"); fflush(stdout);
-            mpiDisconnect(port_name, comm);
-            return 0;
+            if (probeClip(&request.probes[i], width, height, num_channels))
+            {
+                request.probes[n++] = request.probes[i];
+            }
+            else
+            {
+                printf("Ignoring probe %d of request %d\n", i, request.id); fflush(stdout);
+            }
         }
+        request.num_probes = n;
+        *probes = request;
+        changed = 1;
     }
 
-    return 1;
+    return changed;
 }
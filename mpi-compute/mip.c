@@ -0,0 +1,148 @@
+/**************************************************************************//**
+ * @file mip.c
+ * @brief Downsampled levels of the image
+ *
+ * This file implements the downsampling of the views. A cell averages the
+ * elements it covers within the block owning its first element; cells at
+ * the border of a block thus average fewer elements, which needs no data
+ * from neighbouring processes.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <float.h>
+#include <math.h>
+#include "mip.h"
+
+/* ------------------------------------------------------------------------- */
+
+// averages the cells (cell x0 + i*f, y0 + j*f of the block being its first
+// element) into the nx*ny row-major out and returns the range of the cells
+#define DEFINE_DOWNSAMPLE(name, type, round)                                         \
+static void name(const char* block, int block_nx, int block_ny, int f,               \
+                 int x0, int y0, int nx, int ny, char* out,                          \
+                 double* min_value, double* max_value)                               \
+{                                                                                    \
+    const type* in = (const type*)block;                                             \
+    type* cells = (type*)out;                                                        \
+    double lo = DBL_MAX, hi = -DBL_MAX;                                              \
+    int cx, cy, x, y;                                                                \
+    for (cy = 0; cy < ny; ++cy)                                                      \
+    {                                                                                \
+        const int ey0 = y0 + cy * f;                                                 \
+        const int ey1 = (ey0 + f < block_ny) ? ey0 + f : block_ny;                   \
+        for (cx = 0; cx < nx; ++cx)                                                  \
+        {                                                                            \
+            const int ex0 = x0 + cx * f;                                             \
+            const int ex1 = (ex0 + f < block_nx) ? ex0 + f : block_nx;               \
+            double sum = 0.0;                                                        \
+            type v;                                                                  \
+            for (y = ey0; y < ey1; ++y)                                              \
+            {                                                                        \
+                const type* row = in + (size_t)y * block_nx;                         \
+                for (x = ex0; x < ex1; ++x)                                          \
+                {                                                                    \
+                    sum += row[x];                                                   \
+                }                                                                    \
+            }                                                                        \
+            v = (type)round(sum / ((ey1 - ey0) * (ex1 - ex0)));                      \
+            cells[(size_t)cy * nx + cx] = v;                                         \
+            lo = v < lo ? v : lo;                                                    \
+            hi = v > hi ? v : hi;                                                    \
+        }                                                                            \
+    }                                                                                \
+    *min_value = lo;                                                                 \
+    *max_value = hi;                                                                 \
+}
+
+#define MIP_ROUND(v) lrint(v)
+#define MIP_KEEP(v)  (v)
+
+DEFINE_DOWNSAMPLE(downsampleInt8,   signed char, MIP_ROUND)
+DEFINE_DOWNSAMPLE(downsampleInt16,  short,       MIP_ROUND)
+DEFINE_DOWNSAMPLE(downsampleFloat,  float,       MIP_KEEP)
+DEFINE_DOWNSAMPLE(downsampleDouble, double,      MIP_KEEP)
+
+/* ------------------------------------------------------------------------- */
+
+// coarsest level that still has more than one cell
+int mipMaxLevel(int width, int height)
+{
+    const int n = width > height ? width : height;
+    int level = 0;
+
+    while (level < FRAME_MAX_LEVEL && (1 << (level + 1)) < n)
+    {
+        ++level;
+    }
+
+    return level;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the view the server starts with, see frame_view
+void mipFullView(frame_view* view, int width, int height)
+{
+    view->id = 0;
+    view->level = 0;
+    view->x = 0;
+    view->y = 0;
+    view->nx = width;
+    view->ny = height;
+    view->channels = 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// limits a requested view to the levels and cells of the image;
+// returns 0 if nothing of it is left
+int mipClipView(frame_view* view, int width, int height)
+{
+    int f, cells_x, cells_y;
+
+    if (view->level < 0 || view->level > mipMaxLevel(width, height))
+    {
+        return 0;
+    }
+
+    f = 1 << view->level;
+    cells_x = (width + f - 1) / f;
+    cells_y = (height + f - 1) / f;
+
+    if (view->x < 0) { view->nx += view->x; view->x = 0; }
+    if (view->y < 0) { view->ny += view->y; view->y = 0; }
+    if (view->x + view->nx > cells_x) view->nx = cells_x - view->x;
+    if (view->y + view->ny > cells_y) view->ny = cells_y - view->y;
+
+    return view->nx > 0 && view->ny > 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// writes the cells of the view owned by the block (see frameViewBlockCells)
+// row-major to out; min_value > max_value if the block owns no cell
+void mipDownsample(int element_type, const char* block, const frame_block* block_geometry,
+                   const frame_view* view, const frame_block* cells, char* out,
+                   double* min_value, double* max_value)
+{
+    const int f = 1 << view->level;
+    const int x0 = cells->offset_x * f - block_geometry->offset_x;
+    const int y0 = cells->offset_y * f - block_geometry->offset_y;
+    const int nx = block_geometry->nx;
+    const int ny = block_geometry->ny;
+
+    switch (element_type)
+    {
+    case IMAGE_TYPE_INT8:   downsampleInt8(block, nx, ny, f, x0, y0, cells->nx, cells->ny, out, min_value, max_value); break;
+    case IMAGE_TYPE_INT16:  downsampleInt16(block, nx, ny, f, x0, y0, cells->nx, cells->ny, out, min_value, max_value); break;
+    case IMAGE_TYPE_FLOAT:  downsampleFloat(block, nx, ny, f, x0, y0, cells->nx, cells->ny, out, min_value, max_value); break;
+    case IMAGE_TYPE_DOUBLE: downsampleDouble(block, nx, ny, f, x0, y0, cells->nx, cells->ny, out, min_value, max_value); break;
+    default:
+        *min_value = DBL_MAX;
+        *max_value = -DBL_MAX;
+        break;
+    }
+}
@@ -0,0 +1,29 @@
+/**************************************************************************//**
+ * @file mip.h
+ * @brief Downsampled levels of the image
+ *
+ * This file declares the functions to produce the cells of a view, a
+ * region of a downsampled level of the image requested by the client, from
+ * the elements of a block. Every process downsamples its own block, so the
+ * image never has to be collected at full resolution for a coarse view.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef MIP_H
+#define MIP_H
+
+#include "mpi_protocol.h"
+
+/* ------------------------------------------------------------------------- */
+
+int  mipMaxLevel(int width, int height);
+void mipFullView(frame_view* view, int width, int height);
+int  mipClipView(frame_view* view, int width, int height);
+void mipDownsample(int element_type, const char* block, const frame_block* block_geometry,
+                   const frame_view* view, const frame_block* cells, char* out,
+                   double* min_value, double* max_value);
+
+#endif // MIP_H
@@ -3,7 +3,51 @@ CONFIG += console c++11
 CONFIG -= app_bundle
 CONFIG -= qt
 
-SOURCES += main.c
+SOURCES += main.c \
+    decomposition.c \
+    image.c \
+    sendpool.c \
+    delta.c \
+    mip.c \
+    subscribers.c \
+    recorder.c \
+    probes.c \
+    ../common/frame_memory.c
+
+HEADERS += decomposition.h \
+    image.h \
+    sendpool.h \
+    delta.h \
+    mip.h \
+    subscribers.h \
+    recorder.h \
+    probes.h \
+    ../common/mpi_protocol.h \
+    ../common/frame_recording.h \
+    ../common/latency_histogram.h \
+    ../common/frame_memory.h
+
+INCLUDEPATH += ../common
+
+include(../common/frame_codec.pri)
+
+# clients are accepted on a helper thread
+unix: LIBS += -lpthread
+
+# the conversion loops are vectorized with OpenMP SIMD, which needs no
+# runtime; without trapping math the compiler may also vectorize their
+# floating point comparisons
+unix|win32-g++: QMAKE_CFLAGS += -fopenmp-simd -fno-trapping-math
+
+# add CONFIG+=openmp to the qmake call to compute with several threads per
+# process (--threads)
+openmp {
+    win32-msvc*: QMAKE_CFLAGS += -openmp
+    else {
+        QMAKE_CFLAGS += -fopenmp
+        QMAKE_LFLAGS += -fopenmp
+    }
+}
 
 # MPI Settings
 QMAKE_CXX = mpicxx
@@ -0,0 +1,381 @@
+/**************************************************************************//**
+ * @file probes.c
+ * @brief Time series of probes sampled by the server
+ *
+ * This file implements the probe sampler. The statistics of a step are
+ * kept in a ring as partial results that reduce with MPI_MAX (the negated
+ * minimum and the maximum) and MPI_SUM (sum, sum of squares and the number
+ * of elements), so a batch of steps takes two reductions whatever its
+ * length. All processes sample the same steps and drop the same ones when
+ * the ring is full, as they only depend on the times of the send
+ * opportunities, which all processes agree on.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "probes.h"
+
+#define PROBE_EXTREMA 2         // -min, max
+#define PROBE_SUMS    3         // sum, sum of squares, count
+
+/* ------------------------------------------------------------------------- */
+
+static int clampInt(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// adds the value of an element to the statistics
+static void addValue(double v, double* lo, double* hi, double* sum, double* sq, double* count)
+{
+    *lo = v < *lo ? v : *lo;
+    *hi = v > *hi ? v : *hi;
+    *sum += v;
+    *sq += v * v;
+    *count += 1.0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// moves the probe into the image and orders the corners of a rectangle;
+// returns 0 if the probe is of an unknown type or channel
+int probeClip(frame_probe* probe, int width, int height, int num_channels)
+{
+    if (probe->type < FRAME_PROBE_POINT || probe->type > FRAME_PROBE_RECT ||
+        probe->channel < 0 || probe->channel >= num_channels)
+    {
+        return 0;
+    }
+
+    probe->x0 = clampInt(probe->x0, 0, width - 1);
+    probe->y0 = clampInt(probe->y0, 0, height - 1);
+    probe->x1 = clampInt(probe->x1, 0, width - 1);
+    probe->y1 = clampInt(probe->y1, 0, height - 1);
+
+    if (probe->type == FRAME_PROBE_POINT)
+    {
+        probe->x1 = probe->x0;
+        probe->y1 = probe->y0;
+    }
+    else if (probe->type == FRAME_PROBE_RECT)
+    {
+        const int x0 = probe->x0 < probe->x1 ? probe->x0 : probe->x1;
+        const int y0 = probe->y0 < probe->y1 ? probe->y0 : probe->y1;
+
+        probe->x1 = probe->x0 + probe->x1 - x0;
+        probe->y1 = probe->y0 + probe->y1 - y0;
+        probe->x0 = x0;
+        probe->y0 = y0;
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// capacity is limited to the steps a probe data message may hold; the
+// root also gets the buffers the batches are reduced to
+int probeSamplerCreate(probe_sampler* s, double interval, int capacity, int root)
+{
+    const size_t values = (size_t)capacity * PROBE_TABLE_SIZE;
+
+    memset(s, 0, sizeof(*s));
+
+    if (!(interval > 0.0) || capacity < 1 || capacity > FRAME_PROBE_MAX_STEPS)
+    {
+        printf("Invalid probe interval %g or capacity %d!\n", interval, capacity); fflush(stdout);
+        return 0;
+    }
+
+    s->interval = interval;
+    s->capacity = capacity;
+    s->requests[0] = MPI_REQUEST_NULL;
+    s->requests[1] = MPI_REQUEST_NULL;
+
+    s->extrema = (double*)malloc(sizeof(double) * PROBE_EXTREMA * values);
+    s->sums = (double*)malloc(sizeof(double) * PROBE_SUMS * values);
+    s->send_extrema = (double*)malloc(sizeof(double) * PROBE_EXTREMA * values);
+    s->send_sums = (double*)malloc(sizeof(double) * PROBE_SUMS * values);
+    if (root)
+    {
+        s->recv_extrema = (double*)malloc(sizeof(double) * PROBE_EXTREMA * values);
+        s->recv_sums = (double*)malloc(sizeof(double) * PROBE_SUMS * values);
+    }
+
+    if (!s->extrema || !s->sums || !s->send_extrema || !s->send_sums ||
+        (root && (!s->recv_extrema || !s->recv_sums)))
+    {
+        printf("Failed to allocate probe sampler!\n"); fflush(stdout);
+        probeSamplerDestroy(s);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// completes the reduction in flight, which involves all processes
+void probeSamplerDestroy(probe_sampler* s)
+{
+    if (s->in_flight)
+    {
+        MPI_Waitall(2, s->requests, MPI_STATUSES_IGNORE);
+        s->in_flight = 0;
+    }
+
+    free(s->extrema);
+    free(s->sums);
+    free(s->send_extrema);
+    free(s->send_sums);
+    free(s->recv_extrema);
+    free(s->recv_sums);
+    s->extrema = 0;
+    s->sums = 0;
+    s->send_extrema = 0;
+    s->send_sums = 0;
+    s->recv_extrema = 0;
+    s->recv_sums = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// samples the probes of table from first_step on; the steps kept so far
+// belong to other probes and are dropped
+void probeSamplerReset(probe_sampler* s, const probe_table* table, int first_step)
+{
+    s->table = *table;
+    s->first = first_step;
+    s->next = first_step;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// samples step s->next of the probes within the block; factors[c] is the
+// factor of channel c between the planes (nx*ny values of the block each)
+// and the physical values of the step. Returns 0 if the ring is full.
+int probeSamplerAdd(probe_sampler* s, const double* planes, const frame_block* block, const double* factors)
+{
+    const int x_end = block->offset_x + block->nx;
+    const int y_end = block->offset_y + block->ny;
+    const size_t ring = (size_t)(s->next % s->capacity) * s->table.num_probes;
+    int p;
+
+    if (s->next - s->first >= s->capacity)
+    {
+        return 0;
+    }
+
+    for (p = 0; p < s->table.num_probes; ++p)
+    {
+        const frame_probe* probe = &s->table.probes[p];
+        const double* plane = planes + (size_t)probe->channel * block->nx * block->ny;
+        const double factor = factors[probe->channel];
+        double* extrema = s->extrema + (ring + p) * PROBE_EXTREMA;
+        double* sums = s->sums + (ring + p) * PROBE_SUMS;
+        double lo = DBL_MAX, hi = -DBL_MAX, sum = 0.0, sq = 0.0, count = 0.0;
+        int x, y;
+
+        if (probe->type == FRAME_PROBE_RECT)
+        {
+            const int x0 = probe->x0 > block->offset_x ? probe->x0 : block->offset_x;
+            const int y0 = probe->y0 > block->offset_y ? probe->y0 : block->offset_y;
+            const int x1 = probe->x1 < x_end - 1 ? probe->x1 : x_end - 1;
+            const int y1 = probe->y1 < y_end - 1 ? probe->y1 : y_end - 1;
+
+            for (y = y0; y <= y1; ++y)
+            {
+                const double* row = plane + (size_t)(y - block->offset_y) * block->nx - block->offset_x;
+                for (x = x0; x <= x1; ++x)
+                {
+                    addValue(factor * row[x], &lo, &hi, &sum, &sq, &count);
+                }
+            }
+        }
+        else
+        {
+            // the elements nearest to the line, one per column or row
+            const int dx = probe->x1 - probe->x0;
+            const int dy = probe->y1 - probe->y0;
+            const int n = (abs(dx) > abs(dy) ? abs(dx) : abs(dy)) + 1;
+            int i;
+
+            for (i = 0; i < n; ++i)
+            {
+                x = n > 1 ? probe->x0 + (int)lrint((double)i * dx / (n - 1)) : probe->x0;
+                y = n > 1 ? probe->y0 + (int)lrint((double)i * dy / (n - 1)) : probe->y0;
+                if (x >= block->offset_x && x < x_end && y >= block->offset_y && y < y_end)
+                {
+                    addValue(factor * plane[(size_t)(y - block->offset_y) * block->nx + x - block->offset_x],
+                             &lo, &hi, &sum, &sq, &count);
+                }
+            }
+        }
+
+        extrema[0] = -lo;
+        extrema[1] = hi;
+        sums[0] = sum;
+        sums[1] = sq;
+        sums[2] = count;
+    }
+
+    ++s->next;
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// drops the oldest steps kept, so that the steps up to last_step fit
+void probeSamplerLimit(probe_sampler* s, int last_step)
+{
+    const int first = last_step - s->capacity + 1;
+
+    if (first > s->first)
+    {
+        s->steps_dropped += first - s->first;
+        s->first = first;
+        if (s->next < first)
+        {
+            s->next = first;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// posts the reduction of the steps up to last_step, which have to be
+// sampled, to root (collective over comm); the previous one has to be
+// complete
+void probeSamplerPost(probe_sampler* s, int last_step, int root, MPI_Comm comm)
+{
+    const int num_probes = s->table.num_probes;
+    const int steps = last_step - s->first + 1;
+    int step;
+
+    if (num_probes == 0 || steps <= 0)
+    {
+        return;
+    }
+
+    // the ring may wrap, the reductions need contiguous buffers
+    for (step = 0; step < steps; ++step)
+    {
+        const size_t ring = (size_t)((s->first + step) % s->capacity) * num_probes;
+        const size_t batch = (size_t)step * num_probes;
+
+        memcpy(s->send_extrema + batch * PROBE_EXTREMA, s->extrema + ring * PROBE_EXTREMA,
+               sizeof(double) * PROBE_EXTREMA * num_probes);
+        memcpy(s->send_sums + batch * PROBE_SUMS, s->sums + ring * PROBE_SUMS,
+               sizeof(double) * PROBE_SUMS * num_probes);
+    }
+
+    MPI_Ireduce(s->send_extrema, s->recv_extrema, steps * num_probes * PROBE_EXTREMA, MPI_DOUBLE, MPI_MAX,
+                root, comm, &s->requests[0]);
+    MPI_Ireduce(s->send_sums, s->recv_sums, steps * num_probes * PROBE_SUMS, MPI_DOUBLE, MPI_SUM,
+                root, comm, &s->requests[1]);
+
+    s->batch_table = s->table;
+    s->batch_first = s->first;
+    s->batch_steps = steps;
+    s->in_flight = 1;
+    s->first = last_step + 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns 1 once the reduction of the batch completed, then the root may
+// put the messages together; waits for it if wait is set
+int probeSamplerTest(probe_sampler* s, int wait)
+{
+    int done = 1;
+
+    if (!s->in_flight)
+    {
+        return 0;
+    }
+
+    if (wait)
+    {
+        MPI_Waitall(2, s->requests, MPI_STATUSES_IGNORE);
+    }
+    else
+    {
+        MPI_Testall(2, s->requests, &done, MPI_STATUSES_IGNORE);
+    }
+
+    if (done)
+    {
+        s->in_flight = 0;
+    }
+
+    return done;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// root only: writes the probe data message of the batch reduced last for
+// the client with the given connection id; returns its size, 0 if the
+// client has no probes
+int probeSamplerMessage(const probe_sampler* s, int owner, char* message)
+{
+    const probe_table* table = &s->batch_table;
+    frame_probe_header* header = (frame_probe_header*)message;
+    frame_probe_stats* stats = (frame_probe_stats*)(message + sizeof(frame_probe_header));
+    int probes[FRAME_MAX_PROBES];
+    int num_probes = 0;
+    int p, step;
+
+    for (p = 0; p < table->num_probes && num_probes < FRAME_MAX_PROBES; ++p)
+    {
+        if (table->owner[p] == owner)
+        {
+            probes[num_probes++] = p;
+        }
+    }
+
+    if (num_probes == 0 || s->batch_steps == 0)
+    {
+        return 0;
+    }
+
+    header->request = table->request[probes[0]];
+    header->num_probes = num_probes;
+    header->first_step = s->batch_first;
+    header->num_steps = s->batch_steps;
+    header->interval = s->interval;
+    header->post_time = MPI_Wtime();
+
+    for (step = 0; step < s->batch_steps; ++step)
+    {
+        for (p = 0; p < num_probes; ++p)
+        {
+            const size_t i = (size_t)step * table->num_probes + probes[p];
+            const double* extrema = s->recv_extrema + i * PROBE_EXTREMA;
+            const double* sums = s->recv_sums + i * PROBE_SUMS;
+            frame_probe_stats* out = &stats[step * num_probes + p];
+
+            if (sums[2] > 0.0)
+            {
+                out->min_value = -extrema[0];
+                out->max_value = extrema[1];
+                out->mean = sums[0] / sums[2];
+                out->rms = sqrt(sums[1] / sums[2]);
+            }
+            else
+            {
+                memset(out, 0, sizeof(*out));
+            }
+        }
+    }
+
+    return frameProbeMessageSize(num_probes, s->batch_steps);
+}
@@ -0,0 +1,73 @@
+/**************************************************************************//**
+ * @file probes.h
+ * @brief Time series of probes sampled by the server
+ *
+ * This file declares the probe table, the probes all clients registered,
+ * and the sampler, which samples them at steps of a fixed interval. Every
+ * process samples its own block and the statistics of the steps since the
+ * last send opportunity are reduced on the root in one go, so the probes
+ * are sampled far more often than frames are sent while the processes
+ * still only meet at the send opportunities.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <mpi.h>
+#include "mpi_protocol.h"
+
+// defaults, may be changed at runtime
+#define PROBE_INTERVAL 0.001
+
+// probes of all clients together
+#define PROBE_TABLE_SIZE (4 * FRAME_MAX_PROBES)
+
+typedef struct
+{
+    int id;                     // changes whenever the probes change
+    int num_probes;
+    frame_probe probes[PROBE_TABLE_SIZE];
+    int owner[PROBE_TABLE_SIZE];    // connection id of the client that registered the probe
+    int request[PROBE_TABLE_SIZE];  // id of its request
+} probe_table;
+
+typedef struct
+{
+    double interval;            // seconds between two steps
+    int capacity;               // steps kept until they are reduced
+    probe_table table;          // probes sampled
+    int first;                  // oldest step not reduced yet
+    int next;                   // step sampled next
+    double* extrema;            // ring of capacity steps: -min, max per probe
+    double* sums;               // ring of capacity steps: sum, sum of squares, count per probe
+    // batch of steps reduced last, or in flight
+    probe_table batch_table;
+    int batch_first;
+    int batch_steps;
+    int in_flight;              // the reduction of the batch has not completed yet
+    double* send_extrema;
+    double* send_sums;
+    double* recv_extrema;       // root only
+    double* recv_sums;
+    MPI_Request requests[2];
+    // counters
+    int steps_dropped;          // not sampled, as the ring was full
+} probe_sampler;
+
+/* ------------------------------------------------------------------------- */
+
+int  probeClip(frame_probe* probe, int width, int height, int num_channels);
+int  probeSamplerCreate(probe_sampler* s, double interval, int capacity, int root);
+void probeSamplerDestroy(probe_sampler* s);
+void probeSamplerReset(probe_sampler* s, const probe_table* table, int first_step);
+int  probeSamplerAdd(probe_sampler* s, const double* planes, const frame_block* block, const double* factors);
+void probeSamplerLimit(probe_sampler* s, int last_step);
+void probeSamplerPost(probe_sampler* s, int last_step, int root, MPI_Comm comm);
+int  probeSamplerTest(probe_sampler* s, int wait);
+int  probeSamplerMessage(const probe_sampler* s, int owner, char* message);
+
+#endif // PROBES_H
@@ -0,0 +1,259 @@
+/**************************************************************************//**
+ * @file recorder.c
+ * @brief Recording of the computed frames
+ *
+ * This file implements the frame recorder. The file view of every process
+ * selects the rows of its block within the image of a chunk (and the
+ * record on rank 0) and repeats every chunk_size bytes, so the data one
+ * process writes for consecutive frames is contiguous in the view and
+ * frame k starts at k times its size there. MPI-IO scatters it into the
+ * chunks. The block is copied into one of FRAME_RECORDER_BUFFERS staging
+ * buffers before MPI_File_iwrite_at, as the compute loop overwrites it
+ * while the write is in flight; the loop only waits if the file system
+ * falls behind by that many frames. Rank 0 writes the record of a frame
+ * separately, with the next frame, once the range of the whole image has
+ * been reduced.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "recorder.h"
+#include "image.h"
+
+/* ------------------------------------------------------------------------- */
+
+static void freeRecorder(frame_recorder* r)
+{
+    int i;
+
+    if (r->filetype != MPI_DATATYPE_NULL)
+    {
+        MPI_Type_free(&r->filetype);
+    }
+    for (i = 0; i < FRAME_RECORDER_BUFFERS; ++i)
+    {
+        free(r->buffers[i]);
+        r->buffers[i] = 0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// completes the range reduction of the last frame, rank 0 writes its record
+static void writeRecord(frame_recorder* r)
+{
+    if (r->range_request == MPI_REQUEST_NULL)
+    {
+        return;
+    }
+
+    // posted with the last frame, which is long computed
+    MPI_Wait(&r->range_request, MPI_STATUS_IGNORE);
+
+    if (r->rank == 0)
+    {
+        if (MPI_Wait(&r->record_request, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+        {
+            ++r->failed;
+        }
+
+        r->record = r->pending;
+        r->record.min_value = -r->image_range[0];
+        r->record.max_value = r->image_range[1];
+
+        if (MPI_File_iwrite_at(r->file, (MPI_Offset)r->record.frame * (r->record_bytes + r->block_bytes),
+                               &r->record, FRAME_RECORD_SIZE, MPI_BYTE, &r->record_request) != MPI_SUCCESS)
+        {
+            r->record_request = MPI_REQUEST_NULL;
+            ++r->failed;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// collective over comm, every process passes its block of the decomposition
+int frameRecorderOpen(frame_recorder* r, const char* file_name, const domain_decomposition* d,
+                      int element_type, double scale, MPI_Comm comm)
+{
+    const int element_size = imageElementSize(element_type);
+    const MPI_Offset image_bytes = (MPI_Offset)element_size * d->global_nx * d->global_ny;
+    int sizes[2], subsizes[2], starts[2];
+    int blocklengths[2] = { FRAME_RECORD_SIZE, 1 };
+    MPI_Aint displs[2] = { 0, FRAME_RECORD_SIZE };
+    MPI_Datatype types[2] = { MPI_BYTE, MPI_DATATYPE_NULL };
+    MPI_Datatype block_type, chunk_type;
+    int first, i, ok = 1, all_ok;
+
+    memset(r, 0, sizeof(*r));
+    r->file = MPI_FILE_NULL;
+    r->comm = comm;
+    r->filetype = MPI_DATATYPE_NULL;
+    r->range_request = MPI_REQUEST_NULL;
+    r->record_request = MPI_REQUEST_NULL;
+    MPI_Comm_rank(comm, &r->rank);
+    r->record_bytes = (r->rank == 0) ? FRAME_RECORD_SIZE : 0;
+    r->block_bytes = element_size * d->nx * d->ny;
+
+    memcpy(r->header.magic, FRAME_RECORDING_MAGIC, sizeof(r->header.magic));
+    r->header.version = FRAME_RECORDING_VERSION;
+    r->header.width = d->global_nx;
+    r->header.height = d->global_ny;
+    r->header.element_type = element_type;
+    r->header.num_frames = 0;
+    r->header.scale = scale;
+    r->header.data_offset = FRAME_RECORDING_ALIGNMENT;
+    r->header.chunk_size = (FRAME_RECORD_SIZE + image_bytes + FRAME_RECORDING_ALIGNMENT - 1) /
+                           FRAME_RECORDING_ALIGNMENT * FRAME_RECORDING_ALIGNMENT;
+
+    for (i = 0; i < FRAME_RECORDER_BUFFERS; ++i)
+    {
+        r->requests[i] = MPI_REQUEST_NULL;
+        r->buffers[i] = (char*)malloc(r->block_bytes);
+        ok = ok && r->buffers[i];
+    }
+
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok)
+    {
+        if (r->rank == 0)
+        {
+            printf("Failed to allocate frame recorder!\n"); fflush(stdout);
+        }
+        freeRecorder(r);
+        return 0;
+    }
+
+    if (MPI_File_open(comm, (char*)file_name, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &r->file) != MPI_SUCCESS)
+    {
+        if (r->rank == 0)
+        {
+            printf("Failed to open recording %s!\n", file_name); fflush(stdout);
+        }
+        r->file = MPI_FILE_NULL;
+        freeRecorder(r);
+        return 0;
+    }
+
+    // an older, longer recording must not leave chunks behind
+    MPI_File_set_size(r->file, 0);
+
+    if (r->rank == 0)
+    {
+        MPI_File_write_at(r->file, 0, &r->header, sizeof(r->header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    // the rows of the own block within the image, in bytes
+    sizes[0] = d->global_ny;
+    sizes[1] = d->global_nx * element_size;
+    subsizes[0] = d->ny;
+    subsizes[1] = d->nx * element_size;
+    starts[0] = d->offset_y;
+    starts[1] = d->offset_x * element_size;
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_BYTE, &block_type);
+
+    // preceded by the record on rank 0, repeated every chunk
+    types[1] = block_type;
+    first = (r->rank == 0) ? 0 : 1;
+    MPI_Type_create_struct(2 - first, blocklengths + first, displs + first, types + first, &chunk_type);
+    MPI_Type_create_resized(chunk_type, 0, (MPI_Aint)r->header.chunk_size, &r->filetype);
+    MPI_Type_commit(&r->filetype);
+    MPI_Type_free(&chunk_type);
+    MPI_Type_free(&block_type);
+
+    MPI_File_set_view(r->file, r->header.data_offset, MPI_BYTE, r->filetype, "native", MPI_INFO_NULL);
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// collective over comm, called with the block of the process and its range
+void frameRecorderWrite(frame_recorder* r, const char* block, int sequence, double time,
+                        double min_value, double max_value)
+{
+    char* buffer = r->buffers[r->current];
+    const double wait_start = MPI_Wtime();
+
+    // the staging buffer may still be written from FRAME_RECORDER_BUFFERS frames ago
+    if (MPI_Wait(&r->requests[r->current], MPI_STATUS_IGNORE) != MPI_SUCCESS)
+    {
+        ++r->failed;
+    }
+    writeRecord(r);
+    r->write_wait += MPI_Wtime() - wait_start;
+
+    memcpy(buffer, block, r->block_bytes);
+
+    // the block follows the record in the view of rank 0
+    if (MPI_File_iwrite_at(r->file, (MPI_Offset)r->num_frames * (r->record_bytes + r->block_bytes) + r->record_bytes,
+                           buffer, r->block_bytes, MPI_BYTE, &r->requests[r->current]) != MPI_SUCCESS)
+    {
+        r->requests[r->current] = MPI_REQUEST_NULL;
+        ++r->failed;
+    }
+
+    // range of the whole image from the ranges of the blocks
+    r->pending.frame = r->num_frames;
+    r->pending.sequence = sequence;
+    r->pending.time = time;
+    r->range[0] = -min_value;
+    r->range[1] = max_value;
+    MPI_Ireduce(r->range, r->image_range, 2, MPI_DOUBLE, MPI_MAX, 0, r->comm, &r->range_request);
+
+    r->current = (r->current + 1) % FRAME_RECORDER_BUFFERS;
+    ++r->num_frames;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// completes the writes and stores the number of frames (collective over comm)
+void frameRecorderClose(frame_recorder* r)
+{
+    int i, failed = 0;
+
+    if (r->file == MPI_FILE_NULL)
+    {
+        return;
+    }
+
+    writeRecord(r);
+    if (MPI_Wait(&r->record_request, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+    {
+        ++r->failed;
+    }
+    for (i = 0; i < FRAME_RECORDER_BUFFERS; ++i)
+    {
+        if (MPI_Wait(&r->requests[i], MPI_STATUS_IGNORE) != MPI_SUCCESS)
+        {
+            ++r->failed;
+        }
+    }
+
+    MPI_Reduce(&r->failed, &failed, 1, MPI_INT, MPI_SUM, 0, r->comm);
+
+    // back to a plain byte view for the header
+    MPI_File_set_view(r->file, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+
+    if (r->rank == 0)
+    {
+        r->header.num_frames = r->num_frames;
+        MPI_File_write_at(r->file, 0, &r->header, sizeof(r->header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+        printf("Recorded %d frames (%.1f MB), waited %.3f s for writes", r->num_frames,
+               (double)r->num_frames * r->header.chunk_size / (1024.0 * 1024.0), r->write_wait);
+        if (failed > 0)
+        {
+            printf(", %d writes failed!", failed);
+        }
+        printf("\n"); fflush(stdout);
+    }
+
+    MPI_File_close(&r->file);
+    freeRecorder(r);
+}
@@ -0,0 +1,60 @@
+/**************************************************************************//**
+ * @file recorder.h
+ * @brief Recording of the computed frames
+ *
+ * This file declares the frame recorder, which writes the whole image of
+ * every frame at full resolution into a file that the visualization can
+ * replay (see frame_recording.h). Every process writes its own block with
+ * MPI-IO, so the image is never collected for recording; the writes and
+ * the reduction of the range are non-blocking and overlap with computing
+ * the next frames.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <mpi.h>
+#include "decomposition.h"
+#include "frame_recording.h"
+
+// writes in flight per process, the block is copied before writing
+#define FRAME_RECORDER_BUFFERS 2
+
+typedef struct
+{
+    MPI_File file;
+    MPI_Comm comm;
+    int rank;
+    MPI_Datatype filetype;      // the parts of a chunk written by this process
+    int record_bytes;           // FRAME_RECORD_SIZE on rank 0, else 0
+    int block_bytes;
+    char* buffers[FRAME_RECORDER_BUFFERS];  // blocks
+    MPI_Request requests[FRAME_RECORDER_BUFFERS];
+    int current;
+    // the record of the last frame is written once its range is reduced
+    frame_record pending;       // of the last frame, without the range
+    frame_record record;        // rank 0, being written
+    double range[2];            // -min, max of the own block
+    double image_range[2];      // of the whole image, rank 0
+    MPI_Request range_request;
+    MPI_Request record_request; // rank 0
+    frame_recording_header header;
+    // counters
+    int num_frames;
+    int failed;                 // writes that could not be posted or failed
+    double write_wait;          // seconds spent waiting for previous writes
+} frame_recorder;
+
+/* ------------------------------------------------------------------------- */
+
+int  frameRecorderOpen(frame_recorder* r, const char* file_name, const domain_decomposition* d,
+                       int element_type, double scale, MPI_Comm comm);
+void frameRecorderWrite(frame_recorder* r, const char* block, int sequence, double time,
+                        double min_value, double max_value);
+void frameRecorderClose(frame_recorder* r);
+
+#endif // RECORDER_H
@@ -0,0 +1,614 @@
+/**************************************************************************//**
+ * @file sendpool.c
+ * @brief Pool of asynchronous send buffers
+ *
+ * This file implements the shared send buffer pool and the send queues of
+ * the clients. A buffer is free while nobody holds a reference to it; the
+ * producer holds one from sendPoolAcquire until sendPoolRelease and every
+ * queue one while the frame waits for or is in flight on one of its send
+ * requests. A posted send cannot be taken back reliably (MPI_Cancel of a
+ * send may or may not succeed), so dropping the oldest frame means replacing
+ * the queued frame that has not been posted yet. For this purpose the
+ * OLDEST policy never posts more than num_buffers - 1 sends per queue and
+ * keeps the last one to stage the latest frame, which is posted by
+ * sendQueueProgress as soon as a send completed. A buffer is never written
+ * while any of its sends is in flight, its post time stamp thus tells when
+ * the first send of it was posted.
+ *
+ * With a window a request first is the MPI_Rput of a frame into a receive
+ * buffer of the client and then the send of its notice, which limits the
+ * frames in flight to the buffers the client gave back as well. Once the
+ * put completed locally, the flush only waits for the client to confirm
+ * data already transferred, so the notice never overtakes the frame; the
+ * buffer is released when the notice went, just like that of a sent frame.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sendpool.h"
+#include "frame_memory.h"
+
+/* ------------------------------------------------------------------------- */
+
+static void postBuffer(send_queue* queue, send_pool* pool, int slot, int index)
+{
+    const double now = MPI_Wtime();
+
+    if (pool->stamp_offset >= 0 && pool->in_flight[index] == 0)
+    {
+        const double stamp = now + pool->clock_offset;
+        memcpy(pool->buffers[index] + pool->stamp_offset, &stamp, sizeof(stamp));
+    }
+    latencyHistogramAdd(&pool->queue_latency, now - pool->submit_times[index]);
+    queue->post_times[slot] = now;
+
+    if (queue->win != MPI_WIN_NULL)
+    {
+        frame_put_notice* notice = &queue->notices[slot];
+        notice->slot = queue->next_slot;
+        notice->bytes = pool->counts[index];
+
+        // the notice follows in finishRequest
+        MPI_Rput(pool->buffers[index], notice->bytes, MPI_BYTE, queue->target,
+                 queue->displacement + notice->slot * queue->slot_bytes, notice->bytes, MPI_BYTE, queue->win,
+                 &queue->requests[slot]);
+        queue->putting[slot] = 1;
+
+        queue->next_slot = (queue->next_slot + 1) % queue->slot_count;
+        --queue->credits;
+    }
+    else
+    {
+        MPI_Isend(pool->buffers[index], pool->counts[index], MPI_BYTE, queue->dest, queue->tag, queue->comm, &queue->requests[slot]);
+    }
+    queue->posted[slot] = index;
+    ++pool->in_flight[index];
+    ++queue->num_posted;
+    ++queue->sent;
+    ++pool->sent;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// return the index of an unused send request of the queue or -1
+static int findSlot(const send_queue* queue)
+{
+    int slot;
+
+    for (slot = 0; slot < queue->max_posted; ++slot)
+    {
+        if (queue->posted[slot] < 0)
+        {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns 1 if a frame offered now may be posted right away
+static int canPost(const send_queue* queue)
+{
+    return queue->num_posted < queue->max_posted && (queue->win == MPI_WIN_NULL || queue->credits > 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// count the receive buffers the client gave back, blocks until there is
+// one if wait is set
+static void takeCredits(send_queue* queue, int wait)
+{
+    int done = 0;
+
+    if (queue->credit_request == MPI_REQUEST_NULL)
+    {
+        return;
+    }
+
+    if (wait)
+    {
+        MPI_Wait(&queue->credit_request, MPI_STATUS_IGNORE);
+        done = 1;
+    }
+    else
+    {
+        MPI_Test(&queue->credit_request, &done, MPI_STATUS_IGNORE);
+    }
+
+    while (done)
+    {
+        ++queue->credits;
+        MPI_Start(&queue->credit_request);
+        MPI_Test(&queue->credit_request, &done, MPI_STATUS_IGNORE);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// post the queued buffer if the policy allows more sends in flight
+static void postQueued(send_queue* queue, send_pool* pool)
+{
+    if (queue->queued >= 0 && canPost(queue))
+    {
+        postBuffer(queue, pool, findSlot(queue), queue->queued);
+        queue->queued = -1;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void completeSlot(send_queue* queue, send_pool* pool, int slot, double now)
+{
+    const int index = queue->posted[slot];
+
+    latencyHistogramAdd(&pool->send_latency, now - queue->post_times[slot]);
+    --pool->in_flight[index];
+    sendPoolRelease(pool, index);
+    queue->posted[slot] = -1;
+    --queue->num_posted;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the request of slot completed: send the notice of a frame put, or
+// release the buffer
+static void finishRequest(send_queue* queue, send_pool* pool, int slot, double now)
+{
+    if (queue->putting[slot])
+    {
+        queue->putting[slot] = 0;
+        MPI_Win_flush(queue->target, queue->win);
+        MPI_Isend(&queue->notices[slot], FRAME_PUT_NOTICE_INTS, MPI_INT, queue->dest, queue->tag, queue->comm,
+                  &queue->requests[slot]);
+        return;
+    }
+
+    completeSlot(queue, pool, slot, now);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// max_buffers has to cover the buffers all queues may hold plus the one
+// the producer writes to
+int sendPoolCreate(send_pool* pool, int max_buffers, size_t buffer_size)
+{
+    memset(pool, 0, sizeof(*pool));
+
+    pool->max_buffers = max_buffers;
+    pool->buffer_size = buffer_size;
+    pool->stamp_offset = -1;
+
+    pool->buffers = (char**)calloc(max_buffers, sizeof(char*));
+    pool->refs = (int*)calloc(max_buffers, sizeof(int));
+    pool->in_flight = (int*)calloc(max_buffers, sizeof(int));
+    pool->submit_times = (double*)calloc(max_buffers, sizeof(double));
+    pool->counts = (int*)calloc(max_buffers, sizeof(int));
+
+    if (!pool->buffers || !pool->refs || !pool->in_flight || !pool->submit_times || !pool->counts)
+    {
+        printf("Failed to allocate a pool of %d send buffers!\n", max_buffers); fflush(stdout);
+        sendPoolDestroy(pool);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void sendPoolDestroy(send_pool* pool)
+{
+    int i;
+
+    for (i = 0; i < pool->num_buffers; ++i)
+    {
+        frameMemoryFree(pool->buffers[i]);
+    }
+    free(pool->buffers);
+    free(pool->refs);
+    free(pool->in_flight);
+    free(pool->submit_times);
+    free(pool->counts);
+    pool->buffers = 0;
+    pool->refs = 0;
+    pool->in_flight = 0;
+    pool->submit_times = 0;
+    pool->counts = 0;
+    pool->num_buffers = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// return the index of a free buffer the next frame may be written to,
+// allocating one if all are held, or -1 if the frame has to be dropped;
+// the caller holds a reference until sendPoolRelease
+int sendPoolAcquire(send_pool* pool)
+{
+    int index;
+
+    for (index = 0; index < pool->num_buffers; ++index)
+    {
+        if (pool->refs[index] == 0)
+        {
+            pool->refs[index] = 1;
+            return index;
+        }
+    }
+
+    if (pool->num_buffers < pool->max_buffers)
+    {
+        index = pool->num_buffers;
+        pool->buffers[index] = (char*)frameMemoryAlloc(pool->buffer_size, pool->memory_flags);
+
+        if (pool->buffers[index])
+        {
+            ++pool->num_buffers;
+            pool->refs[index] = 1;
+            return index;
+        }
+
+        printf("Failed to allocate send buffer of %lu bytes!\n", (unsigned long)pool->buffer_size); fflush(stdout);
+    }
+
+    ++pool->dropped;
+    return -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+char* sendPoolBuffer(const send_pool* pool, int index)
+{
+    return pool->buffers[index];
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the acquired buffer holds a message of count bytes, ready to be offered
+void sendPoolSubmit(send_pool* pool, int index, int count)
+{
+    pool->counts[index] = count;
+    pool->submit_times[index] = MPI_Wtime();
+}
+
+/* ------------------------------------------------------------------------- */
+
+void sendPoolRelease(send_pool* pool, int index)
+{
+    --pool->refs[index];
+}
+
+/* ------------------------------------------------------------------------- */
+
+int sendQueueCreate(send_queue* queue, int num_buffers, send_drop_policy policy,
+                    int dest, int tag, MPI_Comm comm)
+{
+    int slot;
+
+    memset(queue, 0, sizeof(*queue));
+
+    // OLDEST needs a staging buffer besides the one in flight
+    const int min_buffers = (policy == SEND_DROP_OLDEST) ? 2 : 1;
+    if (num_buffers < min_buffers)
+    {
+        printf("Using %d send buffers instead of %d for policy '%s'\n",
+               min_buffers, num_buffers, sendPoolPolicyToString(policy)); fflush(stdout);
+        num_buffers = min_buffers;
+    }
+
+    queue->policy = policy;
+    queue->max_posted = (policy == SEND_DROP_OLDEST) ? num_buffers - 1 : num_buffers;
+    queue->queued = -1;
+    queue->dest = dest;
+    queue->tag = tag;
+    queue->comm = comm;
+    queue->win = MPI_WIN_NULL;
+    queue->credit_request = MPI_REQUEST_NULL;
+
+    queue->posted = (int*)malloc(sizeof(int) * queue->max_posted);
+    queue->requests = (MPI_Request*)malloc(sizeof(MPI_Request) * queue->max_posted);
+    queue->post_times = (double*)calloc(queue->max_posted, sizeof(double));
+    queue->notices = (frame_put_notice*)calloc(queue->max_posted, sizeof(frame_put_notice));
+    queue->putting = (int*)calloc(queue->max_posted, sizeof(int));
+
+    if (!queue->posted || !queue->requests || !queue->post_times || !queue->notices || !queue->putting)
+    {
+        printf("Failed to allocate %d send requests!\n", queue->max_posted); fflush(stdout);
+        sendQueueDestroy(queue);
+        return 0;
+    }
+
+    for (slot = 0; slot < queue->max_posted; ++slot)
+    {
+        queue->posted[slot] = -1;
+        queue->requests[slot] = MPI_REQUEST_NULL;
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void sendQueueDestroy(send_queue* queue)
+{
+    free(queue->posted);
+    free(queue->requests);
+    free(queue->post_times);
+    free(queue->notices);
+    free(queue->putting);
+    queue->posted = 0;
+    queue->requests = 0;
+    queue->post_times = 0;
+    queue->notices = 0;
+    queue->putting = 0;
+    queue->max_posted = 0;
+    queue->num_posted = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// put the frames into the receive buffers slots describes, of rank target in
+// win, in which a passive target epoch is open; the client gives them back
+// on the queue's comm with credit_tag. Returns 0 if a frame of the pool may
+// not fit
+int sendQueueSetWindow(send_queue* queue, MPI_Win win, int target, const frame_window_slots* slots, int credit_tag)
+{
+    if (slots->slot_count <= 0 || slots->slot_bytes <= 0)
+    {
+        return 0;
+    }
+
+    queue->win = win;
+    queue->target = target;
+    queue->displacement = slots->displacement;
+    queue->slot_bytes = slots->slot_bytes;
+    queue->slot_count = slots->slot_count;
+    queue->next_slot = 0;
+    queue->credits = slots->slot_count;
+
+    MPI_Recv_init(&queue->credit_message, 1, MPI_INT, queue->dest, credit_tag, queue->comm, &queue->credit_request);
+    MPI_Start(&queue->credit_request);
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// number of pool buffers the queue holds at most
+int sendQueueBuffers(const send_queue* queue)
+{
+    return queue->max_posted + (queue->policy == SEND_DROP_OLDEST ? 1 : 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns 0 if the queue would discard a frame offered now
+int sendQueueAccepts(const send_queue* queue)
+{
+    return queue->policy != SEND_DROP_NEWEST || canPost(queue);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns the pool buffer a frame offered now would replace, or -1
+int sendQueueReplaces(const send_queue* queue)
+{
+    return (queue->policy == SEND_DROP_OLDEST && !canPost(queue)) ? queue->queued : -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// hand the submitted buffer to the queue, which posts its send if the
+// policy allows; returns 1 if the queue took the frame, 0 if it dropped it
+int sendQueueOffer(send_queue* queue, send_pool* pool, int index)
+{
+    int slot;
+
+    takeCredits(queue, 0);
+
+    if (canPost(queue))
+    {
+        ++pool->refs[index];
+        postBuffer(queue, pool, findSlot(queue), index);
+        return 1;
+    }
+
+    switch (queue->policy)
+    {
+    case SEND_DROP_OLDEST:
+        // overwrite the frame that is still waiting for a send
+        if (queue->queued >= 0)
+        {
+            sendPoolRelease(pool, queue->queued);
+            ++queue->dropped;
+            ++pool->dropped;
+        }
+        ++pool->refs[index];
+        queue->queued = index;
+        return 1;
+    case SEND_BLOCK:
+        // a completed put still has to send its notice
+        while (queue->num_posted >= queue->max_posted)
+        {
+            MPI_Waitany(queue->max_posted, queue->requests, &slot, MPI_STATUS_IGNORE);
+            if (slot == MPI_UNDEFINED)
+            {
+                break;
+            }
+            finishRequest(queue, pool, slot, MPI_Wtime());
+        }
+        if (queue->num_posted >= queue->max_posted)
+        {
+            break;
+        }
+        if (!canPost(queue))
+        {
+            // wait for the client to give back a receive buffer
+            takeCredits(queue, 1);
+            if (!canPost(queue))
+            {
+                break;
+            }
+        }
+        ++pool->refs[index];
+        postBuffer(queue, pool, findSlot(queue), index);
+        return 1;
+    case SEND_DROP_NEWEST:
+    default:
+        break;
+    }
+
+    ++queue->dropped;
+    ++pool->dropped;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// release completed sends and post a queued frame, never blocks
+void sendQueueProgress(send_queue* queue, send_pool* pool)
+{
+    int slot;
+
+    takeCredits(queue, 0);
+
+    if (queue->num_posted == 0 && queue->queued < 0)
+    {
+        return;
+    }
+
+    for (slot = 0; slot < queue->max_posted; ++slot)
+    {
+        if (queue->posted[slot] >= 0)
+        {
+            int done = 0;
+            MPI_Test(&queue->requests[slot], &done, MPI_STATUS_IGNORE);
+
+            if (done)
+            {
+                finishRequest(queue, pool, slot, MPI_Wtime());
+            }
+        }
+    }
+
+    postQueued(queue, pool);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// wait until all frames handed to the queue have been sent
+void sendQueueFlush(send_queue* queue, send_pool* pool)
+{
+    int slot;
+
+    while (queue->num_posted > 0 || queue->queued >= 0)
+    {
+        MPI_Waitall(queue->max_posted, queue->requests, MPI_STATUSES_IGNORE);
+        const double now = MPI_Wtime();
+
+        for (slot = 0; slot < queue->max_posted; ++slot)
+        {
+            if (queue->posted[slot] >= 0)
+            {
+                finishRequest(queue, pool, slot, now);
+            }
+        }
+
+        if (queue->queued >= 0 && !canPost(queue))
+        {
+            // wait for the client to give back a receive buffer
+            takeCredits(queue, 1);
+        }
+        postQueued(queue, pool);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// give up all pending sends, e.g. when the client has gone
+void sendQueueCancel(send_queue* queue, send_pool* pool)
+{
+    int slot;
+
+    for (slot = 0; slot < queue->max_posted; ++slot)
+    {
+        // the send may still read its buffer until the request completed,
+        // a put cannot be cancelled but completes without the client
+        if (queue->requests[slot] != MPI_REQUEST_NULL)
+        {
+            if (!queue->putting[slot])
+            {
+                MPI_Cancel(&queue->requests[slot]);
+            }
+            MPI_Wait(&queue->requests[slot], MPI_STATUS_IGNORE);
+            queue->putting[slot] = 0;
+        }
+        if (queue->posted[slot] >= 0)
+        {
+            --pool->in_flight[queue->posted[slot]];
+            sendPoolRelease(pool, queue->posted[slot]);
+            queue->posted[slot] = -1;
+        }
+    }
+
+    if (queue->queued >= 0)
+    {
+        sendPoolRelease(pool, queue->queued);
+        queue->queued = -1;
+    }
+
+    if (queue->credit_request != MPI_REQUEST_NULL)
+    {
+        MPI_Cancel(&queue->credit_request);
+        MPI_Wait(&queue->credit_request, MPI_STATUS_IGNORE);
+        MPI_Request_free(&queue->credit_request);
+    }
+
+    queue->num_posted = 0;
+    queue->win = MPI_WIN_NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int sendPoolPolicyFromString(const char* name, send_drop_policy* policy)
+{
+    if (strcmp(name, "oldest") == 0)
+    {
+        *policy = SEND_DROP_OLDEST;
+        return 1;
+    }
+    else if (strcmp(name, "newest") == 0)
+    {
+        *policy = SEND_DROP_NEWEST;
+        return 1;
+    }
+    else if (strcmp(name, "block") == 0)
+    {
+        *policy = SEND_BLOCK;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+const char* sendPoolPolicyToString(send_drop_policy policy)
+{
+    switch (policy)
+    {
+    case SEND_DROP_NEWEST:
+        return "newest";
+    case SEND_BLOCK:
+        return "block";
+    case SEND_DROP_OLDEST:
+    default:
+        return "oldest";
+    }
+}
@@ -0,0 +1,111 @@
+/**************************************************************************//**
+ * @file sendpool.h
+ * @brief Pool of asynchronous send buffers
+ *
+ * This file declares a pool of send buffers shared by all clients and a
+ * send queue per client. A frame is written once into a buffer of the pool
+ * and offered to the queue of every client, which sends it without
+ * blocking or drops it according to its own policy.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef SENDPOOL_H
+#define SENDPOOL_H
+
+#include <stddef.h>
+#include <mpi.h>
+#include "mpi_protocol.h"
+#include "latency_histogram.h"
+
+// default number of send buffers per client, may be changed at runtime
+#define SEND_POOL_BUFFERS 3
+
+typedef enum
+{
+    SEND_DROP_OLDEST = 0,       // replace the oldest frame not yet sent
+    SEND_DROP_NEWEST = 1,       // discard the new frame
+    SEND_BLOCK       = 2        // wait until an in-flight send completed
+} send_drop_policy;
+
+typedef struct
+{
+    int max_buffers;            // the pool grows on demand up to this number of buffers
+    int num_buffers;            // buffers allocated so far
+    size_t buffer_size;         // bytes per buffer
+    char** buffers;             // allocated one by one
+    int* refs;                  // producer and send queues holding the buffer, 0: free
+    int* in_flight;             // posted sends of the buffer not yet complete
+    double* submit_times;       // MPI_Wtime of sendPoolSubmit per buffer
+    int* counts;                // bytes to send per buffer, messages may differ in size
+    // if >= 0, the time of posting is written as double at this byte offset
+    // of the buffer (plus clock_offset) right before its first send is posted
+    int stamp_offset;
+    double clock_offset;
+    int memory_flags;           // FRAME_MEMORY_* of the buffers
+    // counters of all queues
+    int sent;                   // send requests posted
+    int dropped;                // frames discarded or replaced before being sent
+    latency_histogram queue_latency;    // submit until posted
+    latency_histogram send_latency;     // posted until complete
+} send_pool;
+
+typedef struct
+{
+    send_drop_policy policy;
+    int max_posted;             // OLDEST keeps one buffer back to stage the latest frame
+    int* posted;                // pool buffer of each send request, -1 if unused
+    MPI_Request* requests;
+    double* post_times;         // MPI_Wtime of MPI_Isend per request
+    int num_posted;
+    int queued;                 // pool buffer waiting for a send request, -1 if none
+    // destination of the sends
+    int dest;
+    int tag;
+    MPI_Comm comm;
+    // one-sided transport, unless win is MPI_WIN_NULL: frames are put into
+    // the receive buffers of the client in ring order, a notice per send
+    // request tells it which one once the put completed
+    MPI_Win win;
+    int target;                 // rank of the client in the group of win
+    MPI_Aint displacement;      // of its first receive buffer
+    MPI_Aint slot_bytes;
+    int slot_count;
+    int next_slot;
+    int credits;                // receive buffers that may be written
+    int credit_message;
+    MPI_Request credit_request; // persistent receive of the buffers the client gives back
+    frame_put_notice* notices;
+    int* putting;               // the request is the put, the notice is not sent yet
+    // counters
+    int sent;
+    int dropped;
+} send_queue;
+
+/* ------------------------------------------------------------------------- */
+
+int   sendPoolCreate(send_pool* pool, int max_buffers, size_t buffer_size);
+void  sendPoolDestroy(send_pool* pool);
+int   sendPoolAcquire(send_pool* pool);
+char* sendPoolBuffer(const send_pool* pool, int index);
+void  sendPoolSubmit(send_pool* pool, int index, int count);
+void  sendPoolRelease(send_pool* pool, int index);
+
+int   sendQueueCreate(send_queue* queue, int num_buffers, send_drop_policy policy,
+                      int dest, int tag, MPI_Comm comm);
+void  sendQueueDestroy(send_queue* queue);
+int   sendQueueSetWindow(send_queue* queue, MPI_Win win, int target, const frame_window_slots* slots, int credit_tag);
+int   sendQueueBuffers(const send_queue* queue);
+int   sendQueueAccepts(const send_queue* queue);
+int   sendQueueReplaces(const send_queue* queue);
+int   sendQueueOffer(send_queue* queue, send_pool* pool, int index);
+void  sendQueueProgress(send_queue* queue, send_pool* pool);
+void  sendQueueFlush(send_queue* queue, send_pool* pool);
+void  sendQueueCancel(send_queue* queue, send_pool* pool);
+
+int   sendPoolPolicyFromString(const char* name, send_drop_policy* policy);
+const char* sendPoolPolicyToString(send_drop_policy policy);
+
+#endif // SENDPOOL_H
@@ -0,0 +1,533 @@
+/**************************************************************************//**
+ * @file subscribers.c
+ * @brief Clients receiving the frames of the server
+ *
+ * This file implements the acceptor and the subscribers. MPI_Comm_accept is
+ * collective over the server group and blocks until a client connects, so
+ * the helper thread of every process of the group calls it on a duplicate
+ * of the group; the helper of the root greets the client before it counts
+ * as accepted. The root decides when the helpers accept and whether they
+ * keep a connection, so they always take part in the same calls, and the
+ * compute loop learns from it how many clients have been accepted; every
+ * process takes as many connections from its helper. To stop the helpers
+ * the root connects to its own port, the helpers recognize the connection
+ * and disconnect from it.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "subscribers.h"
+
+/* ------------------------------------------------------------------------- */
+
+#if defined (_WIN32) || defined (_WIN64)
+static void lockAcceptor(subscriber_acceptor* a)   { EnterCriticalSection(&a->mutex); }
+static void unlockAcceptor(subscriber_acceptor* a) { LeaveCriticalSection(&a->mutex); }
+static void waitAcceptor(subscriber_acceptor* a)   { SleepConditionVariableCS(&a->changed, &a->mutex, INFINITE); }
+static void wakeAcceptor(subscriber_acceptor* a)   { WakeAllConditionVariable(&a->changed); }
+#else
+static void lockAcceptor(subscriber_acceptor* a)   { pthread_mutex_lock(&a->mutex); }
+static void unlockAcceptor(subscriber_acceptor* a) { pthread_mutex_unlock(&a->mutex); }
+static void waitAcceptor(subscriber_acceptor* a)   { pthread_cond_wait(&a->changed, &a->mutex); }
+static void wakeAcceptor(subscriber_acceptor* a)   { pthread_cond_broadcast(&a->changed); }
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+#define ACCEPTED_CLIENT 0      // added for the compute loop
+#define ACCEPTED_LATE   1      // a client that connected while the acceptor stopped
+#define ACCEPTED_WAKER  2      // the root itself, waking the helpers
+
+// returns 1 if the calling process is the remote group of comm
+static int isSelfConnection(MPI_Comm comm)
+{
+    MPI_Group remote, self;
+    int result = MPI_UNEQUAL;
+
+    MPI_Comm_remote_group(comm, &remote);
+    MPI_Comm_group(MPI_COMM_SELF, &self);
+    MPI_Group_compare(remote, self, &result);
+    MPI_Group_free(&remote);
+    MPI_Group_free(&self);
+
+    return result == MPI_IDENT;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// accept and greet one client (collective over the server group);
+// returns 1 if a connection was added, 0 if not and -1 if the helpers
+// should stop accepting
+static int acceptClient(subscriber_acceptor* a)
+{
+    MPI_Comm comm = MPI_COMM_NULL;
+    int accepted = ACCEPTED_CLIENT;
+
+    // port_name is only significant at the root
+    if (a->local_rank == 0)
+    {
+        printf("Waiting for intercomm ...\n"); fflush(stdout);
+    }
+    MPI_Comm_accept(a->port_name, MPI_INFO_NULL, 0, a->local_comm, &comm);
+
+    if (comm == MPI_COMM_NULL)
+    {
+        printf("Error: no intercommunicator!\n"); fflush(stdout);
+        lockAcceptor(a);
+        a->accepting = 0;
+        unlockAcceptor(a);
+        return -1;
+    }
+
+    // the root decides for all helpers, their stop flags may not be set yet
+    if (a->local_rank == 0)
+    {
+        lockAcceptor(a);
+        a->accepting = 0;
+        if (a->stop)
+        {
+            accepted = (a->waking && isSelfConnection(comm)) ? ACCEPTED_WAKER : ACCEPTED_LATE;
+        }
+        unlockAcceptor(a);
+    }
+    MPI_Bcast(&accepted, 1, MPI_INT, 0, a->local_comm);
+
+    if (accepted == ACCEPTED_WAKER)
+    {
+        MPI_Comm_disconnect(&comm);
+        return -1;
+    }
+    if (accepted == ACCEPTED_LATE)
+    {
+        // the client waits for a handshake in vain, the server group may
+        // already be finalizing
+        MPI_Comm_free(&comm);
+        return 0;
+    }
+
+    if (a->local_rank == 0)
+    {
+        printf("Intercomm accepted\n"); fflush(stdout);
+
+        if (a->greet)
+        {
+            a->greet(comm, a->context);
+        }
+    }
+
+    lockAcceptor(a);
+    a->accepted[a->num_accepted % MAX_SUBSCRIBERS] = comm;
+    ++a->num_accepted;
+    wakeAcceptor(a);
+    unlockAcceptor(a);
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// helper thread: accept clients while there is a free slot
+#if defined (_WIN32) || defined (_WIN64)
+static DWORD WINAPI acceptLoop(LPVOID arg)
+#else
+static void* acceptLoop(void* arg)
+#endif
+{
+    subscriber_acceptor* a = (subscriber_acceptor*)arg;
+
+    for (;;)
+    {
+        int accept = 0;
+
+        if (a->local_rank == 0)
+        {
+            lockAcceptor(a);
+            while (!a->stop && a->num_accepted - a->num_released >= MAX_SUBSCRIBERS)
+            {
+                waitAcceptor(a);
+            }
+            // once stopped only the root waking the helpers connects
+            accept = !a->stop || a->waking;
+            a->accepting = accept;
+            unlockAcceptor(a);
+        }
+        MPI_Bcast(&accept, 1, MPI_INT, 0, a->local_comm);
+
+        if (!accept || acceptClient(a) < 0)
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// root of the server group: connects to its own port from the calling
+// thread, which ends the MPI_Comm_accept of the helpers (needs
+// MPI_THREAD_MULTIPLE like the helpers themselves)
+static void wakeHelpers(subscriber_acceptor* a)
+{
+    MPI_Comm comm;
+
+    if (MPI_Comm_connect(a->port_name, MPI_INFO_NULL, 0, MPI_COMM_SELF, &comm) == MPI_SUCCESS)
+    {
+        MPI_Comm_disconnect(&comm);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// collective over local_comm, threaded has to be the same on all its
+// processes; without a helper thread clients are only accepted by
+// subscriberAcceptorWait
+void subscriberAcceptorStart(subscriber_acceptor* acceptor, const char* port_name, MPI_Comm local_comm,
+                            int threaded, subscriber_greeting greet, void* context)
+{
+    memset(acceptor, 0, sizeof(*acceptor));
+
+    acceptor->port_name = port_name;
+    acceptor->threaded = threaded;
+    acceptor->greet = greet;
+    acceptor->context = context;
+    MPI_Comm_dup(local_comm, &acceptor->local_comm);
+    MPI_Comm_rank(local_comm, &acceptor->local_rank);
+
+#if defined (_WIN32) || defined (_WIN64)
+    InitializeCriticalSection(&acceptor->mutex);
+    InitializeConditionVariable(&acceptor->changed);
+
+    if (threaded)
+    {
+        acceptor->thread = CreateThread(NULL, 0, acceptLoop, acceptor, 0, NULL);
+        if (!acceptor->thread)
+        {
+            printf("Failed to start the accept thread\n"); fflush(stdout);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+    }
+#else
+    pthread_mutex_init(&acceptor->mutex, NULL);
+    pthread_cond_init(&acceptor->changed, NULL);
+
+    // the helper threads of the other processes would wait in MPI_Comm_accept
+    if (threaded && pthread_create(&acceptor->thread, NULL, acceptLoop, acceptor) != 0)
+    {
+        printf("Failed to start the accept thread\n"); fflush(stdout);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+// blocks until count clients have been accepted in total
+// (collective over the server group without a helper thread)
+void subscriberAcceptorWait(subscriber_acceptor* acceptor, int count)
+{
+    if (!acceptor->threaded)
+    {
+        while (acceptor->num_accepted < count && acceptor->num_accepted - acceptor->num_released < MAX_SUBSCRIBERS)
+        {
+            if (acceptClient(acceptor) < 0)
+            {
+                break;
+            }
+        }
+        return;
+    }
+
+    lockAcceptor(acceptor);
+    while (!acceptor->stop && acceptor->num_accepted < count)
+    {
+        waitAcceptor(acceptor);
+    }
+    unlockAcceptor(acceptor);
+}
+
+/* ------------------------------------------------------------------------- */
+
+int subscriberAcceptorCount(subscriber_acceptor* acceptor)
+{
+    int count;
+
+    lockAcceptor(acceptor);
+    count = acceptor->num_accepted;
+    unlockAcceptor(acceptor);
+
+    return count;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns the oldest connection not yet taken, waits for the helper thread
+// if it has not finished accepting it on this process yet
+MPI_Comm subscriberAcceptorTake(subscriber_acceptor* acceptor)
+{
+    MPI_Comm comm;
+
+    lockAcceptor(acceptor);
+    while (acceptor->num_taken == acceptor->num_accepted)
+    {
+        waitAcceptor(acceptor);
+    }
+    comm = acceptor->accepted[acceptor->num_taken % MAX_SUBSCRIBERS];
+    ++acceptor->num_taken;
+    unlockAcceptor(acceptor);
+
+    return comm;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// a taken connection has been closed, its slot may be used again
+void subscriberAcceptorRelease(subscriber_acceptor* acceptor)
+{
+    lockAcceptor(acceptor);
+    ++acceptor->num_released;
+    wakeAcceptor(acceptor);
+    unlockAcceptor(acceptor);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// stops accepting, joins the helper threads and closes the port
+// (collective over the server group)
+void subscriberAcceptorStop(subscriber_acceptor* acceptor)
+{
+    lockAcceptor(acceptor);
+    acceptor->stop = 1;
+    acceptor->waking = acceptor->accepting;
+    wakeAcceptor(acceptor);
+    unlockAcceptor(acceptor);
+
+    if (acceptor->threaded)
+    {
+        // the helpers are inside MPI_Comm_accept if the one of the root is
+        if (acceptor->local_rank == 0 && acceptor->waking)
+        {
+            wakeHelpers(acceptor);
+        }
+
+#if defined (_WIN32) || defined (_WIN64)
+        WaitForSingleObject(acceptor->thread, INFINITE);
+        CloseHandle(acceptor->thread);
+#else
+        pthread_join(acceptor->thread, NULL);
+#endif
+    }
+
+    if (acceptor->local_rank == 0)
+    {
+        MPI_Close_port(acceptor->port_name);
+        printf("Port closed\n"); fflush(stdout);
+    }
+
+    MPI_Comm_free(&acceptor->local_comm);
+#if !defined (_WIN32) && !defined (_WIN64)
+    pthread_mutex_destroy(&acceptor->mutex);
+    pthread_cond_destroy(&acceptor->changed);
+#else
+    DeleteCriticalSection(&acceptor->mutex);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+// sets up the subscriber of an accepted client; num_tiles > 0 if the
+// frames are delta encoded
+int subscriberOpen(subscriber* s, MPI_Comm comm, int id, int local_rank, const frame_view* view,
+                   int send_buffers, send_drop_policy policy, int num_tiles)
+{
+    memset(s, 0, sizeof(*s));
+
+    s->comm = comm;
+    s->id = id;
+    s->view = *view;
+    s->quit_request = MPI_REQUEST_NULL;
+    s->quit_message = -1;
+    s->probe_request = MPI_REQUEST_NULL;
+    s->window_comm = MPI_COMM_NULL;
+    s->window = MPI_WIN_NULL;
+
+    if (!sendQueueCreate(&s->queue, send_buffers, policy, 0, MPI_TAG_IMAGE_DATA, comm))
+    {
+        return 0;
+    }
+
+    if (num_tiles > 0)
+    {
+        s->missed_tiles = (char*)calloc(num_tiles, 1);
+        if (!s->missed_tiles)
+        {
+            sendQueueDestroy(&s->queue);
+            return 0;
+        }
+    }
+
+    if (local_rank == 0)
+    {
+        s->probe_message = (char*)malloc(frameProbeMessageSize(FRAME_MAX_PROBES, FRAME_PROBE_MAX_STEPS));
+        if (!s->probe_message)
+        {
+            sendQueueDestroy(&s->queue);
+            free(s->missed_tiles);
+            return 0;
+        }
+    }
+
+    // the client only talks to the root of the server group, wait for a quit message
+    if (local_rank == 0 &&
+        MPI_Irecv(&s->quit_message, 1, MPI_INT, 0, MPI_TAG_MESSAGE_QUIT, comm, &s->quit_request) != MPI_SUCCESS)
+    {
+        printf("MPI_Irecv communication failed!\n"); fflush(stdout);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// FRAME_TRANSPORT_PUT: sets up the window on the receive buffers of the
+// client, see mpi_protocol.h (collective over the server group and the
+// client); returns 1 if the frames are put into it, 0 if they are sent
+int subscriberOpenWindow(subscriber* s, size_t message_bytes)
+{
+    frame_window_slots slots;
+    int created, all_created = 0, usable, all_usable = 0;
+    int size;
+
+    MPI_Intercomm_merge(s->comm, 0, &s->window_comm);
+    MPI_Comm_set_errhandler(s->window_comm, MPI_ERRORS_RETURN);
+    MPI_Comm_size(s->window_comm, &size);
+
+    // the server exposes nothing
+    created = MPI_Win_create(NULL, 0, 1, MPI_INFO_NULL, s->window_comm, &s->window) == MPI_SUCCESS;
+    if (!created)
+    {
+        s->window = MPI_WIN_NULL;
+    }
+    MPI_Allreduce(&created, &all_created, 1, MPI_INT, MPI_MIN, s->window_comm);
+
+    if (all_created)
+    {
+        MPI_Recv(&slots, sizeof(slots), MPI_BYTE, 0, MPI_TAG_WINDOW, s->comm, MPI_STATUS_IGNORE);
+        usable = slots.slot_count > 0 && slots.slot_bytes >= (MPI_Aint)message_bytes;
+
+        MPI_Allreduce(&usable, &all_usable, 1, MPI_INT, MPI_MIN, s->window_comm);
+        if (all_usable)
+        {
+            MPI_Win_lock_all(MPI_MODE_NOCHECK, s->window);
+            // the client is the last rank of the merged communicator
+            sendQueueSetWindow(&s->queue, s->window, size - 1, &slots, MPI_TAG_IMAGE_CREDIT);
+            return 1;
+        }
+    }
+
+    // a window that was created everywhere is freed collectively, one that
+    // some process could not create only where it exists
+    if (s->window != MPI_WIN_NULL)
+    {
+        MPI_Win_free(&s->window);
+    }
+    s->window = MPI_WIN_NULL;
+    MPI_Comm_free(&s->window_comm);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// root of the server group only; returns 1 if the client is alive, 0 if it
+// sent the quit message and -1 if the communication failed
+int subscriberPollQuit(subscriber* s)
+{
+    int flag = 0;
+
+    if (s->quit_request == MPI_REQUEST_NULL)
+    {
+        return 1;
+    }
+
+    if (MPI_Test(&s->quit_request, &flag, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+    {
+        printf("MPI_Test communication failed!\n"); fflush(stdout);
+        return -1;
+    }
+
+    if (flag)
+    {
+        printf("Received disconnect message from client program %d\n", s->id); fflush(stdout);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// gives up the pending sends and, if disconnect is set, disconnects from
+// the client (collective over the server group)
+void subscriberClose(subscriber* s, send_pool* pool, int disconnect)
+{
+    int local_rank = 0;
+
+    if (s->comm == MPI_COMM_NULL)
+    {
+        return;
+    }
+
+    if (s->queue.num_posted > 0)
+    {
+        printf("Cancelling %d image data sends!\n", s->queue.num_posted); fflush(stdout);
+    }
+    sendQueueCancel(&s->queue, pool);
+    // wait for the cancelled requests, their buffers are freed below
+    if (s->quit_request != MPI_REQUEST_NULL)
+    {
+        MPI_Cancel(&s->quit_request);
+        MPI_Wait(&s->quit_request, MPI_STATUS_IGNORE);
+    }
+    if (s->probe_request != MPI_REQUEST_NULL)
+    {
+        MPI_Cancel(&s->probe_request);
+        MPI_Wait(&s->probe_request, MPI_STATUS_IGNORE);
+    }
+
+    if (disconnect)
+    {
+        MPI_Comm_rank(s->comm, &local_rank);
+        if (local_rank == 0)
+        {
+            printf("Disconnecting client program %d ...\n", s->id); fflush(stdout);
+        }
+        if (s->window != MPI_WIN_NULL)
+        {
+            MPI_Win_unlock_all(s->window);
+            MPI_Win_free(&s->window);
+            MPI_Comm_free(&s->window_comm);
+        }
+        MPI_Comm_disconnect(&s->comm);
+
+        if (local_rank == 0)
+        {
+            printf("Disconnected\n"); fflush(stdout);
+        }
+    }
+
+    sendQueueDestroy(&s->queue);
+    free(s->missed_tiles);
+    free(s->probe_message);
+    s->missed_tiles = 0;
+    s->probe_message = 0;
+    s->window = MPI_WIN_NULL;
+    s->window_comm = MPI_COMM_NULL;
+    s->comm = MPI_COMM_NULL;
+}
@@ -0,0 +1,99 @@
+/**************************************************************************//**
+ * @file subscribers.h
+ * @brief Clients receiving the frames of the server
+ *
+ * This file declares the acceptor, which keeps accepting connections of
+ * clients on the open port while the server computes, and the subscriber,
+ * the state the server keeps per connected client. The acceptor runs
+ * MPI_Comm_accept on a helper thread if MPI supports MPI_THREAD_MULTIPLE;
+ * otherwise clients are only accepted while the server waits for them. The
+ * compute loop takes the accepted connections at a point all processes of
+ * the server group agree on. The root of the server group also sends the
+ * probe data of every client. A subscriber may hold a window on the
+ * receive buffers of its client, the frames are then put into those.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef SUBSCRIBERS_H
+#define SUBSCRIBERS_H
+
+#include <mpi.h>
+#if defined (_WIN32) || defined (_WIN64)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "mpi_protocol.h"
+#include "sendpool.h"
+
+// clients connected at the same time, fits the bit masks of the loop
+#define MAX_SUBSCRIBERS 16
+
+// called on the root of the server group for every accepted client before
+// it is handed to the compute loop, e.g. to send the handshake
+typedef void (*subscriber_greeting)(MPI_Comm comm, void* context);
+
+typedef struct
+{
+    const char* port_name;      // significant at the root of the server group
+    MPI_Comm local_comm;        // server side group, own duplicate of the helper thread
+    int local_rank;
+    int threaded;               // accept on a helper thread
+    subscriber_greeting greet;
+    void* context;
+    MPI_Comm accepted[MAX_SUBSCRIBERS]; // ring of connections not yet taken
+    int num_accepted;           // counts all connections accepted
+    int num_taken;
+    int num_released;           // connections the compute loop has closed
+    int accepting;              // the helper thread is inside MPI_Comm_accept (root of the server group)
+    int waking;                 // the root connects to its own port to wake the helpers
+    int stop;
+#if defined (_WIN32) || defined (_WIN64)
+    CRITICAL_SECTION mutex;
+    CONDITION_VARIABLE changed;
+    HANDLE thread;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_t thread;
+#endif
+} subscriber_acceptor;
+
+typedef struct
+{
+    MPI_Comm comm;              // intercomm to the client, MPI_COMM_NULL if the slot is free
+    int id;                     // number of the connection
+    send_queue queue;
+    frame_view view;            // latest view the client asked for (root of the server group)
+    MPI_Request quit_request;   // root of the server group
+    int quit_message;
+    char* missed_tiles;         // delta encoded tiles of messages the client did not get
+    frame_probe_request probes; // latest probes the client registered (root of the server group)
+    char* probe_message;        // probe data being sent (root of the server group)
+    MPI_Request probe_request;
+    int probe_messages;         // probe data messages sent
+    int probe_dropped;          // and dropped, as the client had not received the previous one
+    MPI_Comm window_comm;       // intercomm merged with the client, MPI_COMM_NULL without a window
+    MPI_Win window;             // receive buffers of the client, MPI_WIN_NULL if frames are sent
+} subscriber;
+
+/* ------------------------------------------------------------------------- */
+
+void    subscriberAcceptorStart(subscriber_acceptor* acceptor, const char* port_name, MPI_Comm local_comm,
+                                int threaded, subscriber_greeting greet, void* context);
+void    subscriberAcceptorWait(subscriber_acceptor* acceptor, int count);
+int     subscriberAcceptorCount(subscriber_acceptor* acceptor);
+MPI_Comm subscriberAcceptorTake(subscriber_acceptor* acceptor);
+void    subscriberAcceptorRelease(subscriber_acceptor* acceptor);
+void    subscriberAcceptorStop(subscriber_acceptor* acceptor);
+
+int     subscriberOpen(subscriber* s, MPI_Comm comm, int id, int local_rank, const frame_view* view,
+                       int send_buffers, send_drop_policy policy, int num_tiles);
+int     subscriberOpenWindow(subscriber* s, size_t message_bytes);
+int     subscriberPollQuit(subscriber* s);
+void    subscriberClose(subscriber* s, send_pool* pool, int disconnect);
+
+#endif // SUBSCRIBERS_H
@@ -0,0 +1,71 @@
+/**************************************************************************//**
+ * @file framedecode.h
+ * @brief Conversion of image elements into color map cells
+ *
+ * This file contains the functions that write elements as the server
+ * stores them (see mpi_protocol.h) into the cells of a color map, shared
+ * by the receiver and the replay of recordings. Integer and float elements
+ * are stored in the color map as they are, with the scale of the handshake
+ * as the cell scale, so decoding them is a copy; only doubles are scaled
+ * into the cells.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef FRAMEDECODE_H
+#define FRAMEDECODE_H
+
+#include <cstddef>
+#include <cstring>
+#include "mpi_protocol.h"
+#include "qcustomplot.h"
+
+// the cell type the color map stores elements of elementType as, with a cell
+// scale of 1/scale
+inline QCPColorMapData::CellType frameCellType(int elementType)
+{
+    switch (elementType)
+    {
+    case IMAGE_TYPE_INT8:
+        return QCPColorMapData::ctInt8;
+    case IMAGE_TYPE_INT16:
+        return QCPColorMapData::ctInt16;
+    case IMAGE_TYPE_FLOAT:
+        return QCPColorMapData::ctFloat;
+    default:
+        return QCPColorMapData::ctDouble;
+    }
+}
+
+// writes nx*ny received elements (rows stride elements apart) into a frame
+// of cells of frameCellType(elementType) at (x0, y0)
+inline void decodeRect(int elementType, const char *data, int stride, int width, double scale, void *frame, int x0, int y0, int nx, int ny)
+{
+    if (elementType == IMAGE_TYPE_DOUBLE)
+    {
+        // ctDouble cells have no scale of their own
+        const double factor = 1.0/scale;
+        for (int y=0; y<ny; ++y)
+        {
+            const double *src = reinterpret_cast<const double*>(data) + size_t(y)*stride;
+            double *dst = static_cast<double*>(frame) + size_t(y0+y)*width + x0;
+            for (int x=0; x<nx; ++x)
+            {
+                dst[x] = src[x]*factor;
+            }
+        }
+        return;
+    }
+
+    const size_t elementSize = imageElementSize(elementType);
+    const size_t rowBytes = nx*elementSize;
+    for (int y=0; y<ny; ++y)
+    {
+        memcpy(static_cast<char*>(frame) + ((size_t(y0+y)*width + x0)*elementSize),
+               data + size_t(y)*stride*elementSize, rowBytes);
+    }
+}
+
+#endif // FRAMEDECODE_H
@@ -0,0 +1,1755 @@
+/**************************************************************************//**
+ * @file framereceiver.cpp
+ * @brief MPI receiver thread
+ *
+ * This file implements the client side of the MPI server-client
+ * intercommunicator in a dedicated thread. The blocks of the server are
+ * received into rings of receive buffers and decoded into a triple buffer
+ * of frames, whose latest frame the GUI thread takes.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+#include <QFile>
+#include <QTextStream>
+#include "framereceiver.h"
+#include "framedecode.h"
+#include "frame_memory.h"
+#include "qcustomplot.h"
+
+namespace {
+
+// the whole image at level 0 of the first channel, which the server starts out with
+frame_view fullView(const frame_handshake &handshake)
+{
+    const frame_view view = { 0, 0, 0, 0, handshake.width, handshake.height, 1 };
+    return view;
+}
+
+// physical range of the elements of a channel of a message
+FrameRange headerRange(const frame_header &header, int channel, double scale)
+{
+    FrameRange range = { DBL_MAX, -DBL_MAX };
+    const double minValue = header.min_value[channel];
+    const double maxValue = header.max_value[channel];
+    if (minValue <= maxValue)
+    {
+        range.lower = qMin(minValue/scale, maxValue/scale);
+        range.upper = qMax(minValue/scale, maxValue/scale);
+    }
+    return range;
+}
+
+// the channels of a bit mask in ascending order; returns their number
+int channelList(int channels, int *list)
+{
+    int n = 0;
+    for (int c=0; c<FRAME_MAX_CHANNELS; ++c)
+    {
+        if (channels & (1 << c))
+        {
+            list[n++] = c;
+        }
+    }
+    return n;
+}
+
+// bytes of the payload of an uncompressed message of all channels: the
+// tile table of delta messages and the elements
+size_t payloadSize(const frame_block &block, const frame_handshake &handshake)
+{
+    const int deltaTile = handshake.delta_tile;
+    const int tileTable = deltaTile > 0 ?
+          frameTileTableSize(frameTileCount(block.nx, deltaTile)*frameTileCount(block.ny, deltaTile)*handshake.num_channels) : 0;
+    return tileTable + size_t(block.nx)*block.ny*imageElementSize(handshake.element_type)*handshake.num_channels;
+}
+
+// receive buffers hold the header and the payload, which may grow by
+// compressing, keep consecutive buffers aligned
+size_t slotSize(const frame_block &block, const frame_handshake &handshake, const frame_codec &codec)
+{
+    size_t payload = payloadSize(block, handshake);
+    if (frameCodecIsActive(&codec))
+    {
+        payload = frameCodecBound(payload, handshake.max_segments);
+    }
+    return (FRAME_HEADER_SIZE + payload + 7) & ~size_t(7);
+}
+
+} // namespace
+
+FrameReceiver::FrameReceiver(const QString &serviceName, const QString &portFileName, int slotCount, QObject *parent) :
+    QThread(parent),
+    mServiceName(serviceName),
+    mPortFileName(portFileName),
+    mIntercomm(MPI_COMM_NULL),
+    mConnected(0),
+    mReconnect(false),
+    mpiError(MPI_SUCCESS),
+    mClockOffset(0.0),
+    mSlotCount(qMax(2, slotCount)),
+    mMemory(0),
+    mSlotData(0),
+    mWindowComm(MPI_COMM_NULL),
+    mWindow(MPI_WIN_NULL),
+    mCurrentData(0),
+    mBlocksInView(0),
+    mUpdatedBlocks(0),
+    mReceivedBlocks(0),
+    mSkippedBlocks(0),
+    mReceivedBytes(0),
+    mReceiveCheck("FrameReceiver::completeBlock"),
+    mPublishCheck("FrameReceiver::publishFrame"),
+    mViewRequests(0),
+    mSentProbeRequest(0),
+    mReadyValid(false),
+    mPolling(false),
+    mBlockCount(0),
+    mStopRequested(0),
+    mViewRequested(0),
+    mProbesRequested(0),
+    mHandshakeOk(false)
+{
+    memset(&mHandshake, 0, sizeof(mHandshake));
+    memset(&mCodec, 0, sizeof(mCodec));
+    memset(&mStatistics, 0, sizeof(mStatistics));
+    memset(&mBackTiming, 0, sizeof(mBackTiming));
+    memset(&mReadyTiming, 0, sizeof(mReadyTiming));
+    memset(&mView, 0, sizeof(mView));
+    mBackView = mReadyView = mFrontView = mRequestedView = mView;
+    memset(&mRequestedProbes, 0, sizeof(mRequestedProbes));
+    mProbeMessage.resize(frameProbeMessageSize(FRAME_MAX_PROBES, FRAME_PROBE_MAX_STEPS));
+    mProbeSamples.reserve(FRAME_PROBE_BACKLOG);
+}
+
+/* ------------------------------------------------------------------------- */
+
+FrameReceiver::~FrameReceiver()
+{
+    stop();
+    frameCodecRelease(&mCodec);
+    frameMemoryFree(mSlotData);
+    delete[] mCurrentData;
+    for (int c=0; c<mBack.size(); ++c)
+    {
+        QCPColorMapData::freeCells(frameCellType(mHandshake.element_type), mBack.at(c));
+        QCPColorMapData::freeCells(frameCellType(mHandshake.element_type), mReady.at(c));
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// blocks until the thread has connected and received the handshake
+bool FrameReceiver::waitForHandshake()
+{
+    mHandshakeDone.acquire();
+    mHandshakeDone.release(); // let later calls return immediately
+    return mHandshakeOk;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// initialFrame is the color map of the first channel, whose content the
+// other two frames of the triple buffer start out with; its cells are of
+// frameCellType. The other channels start out as zeros.
+void FrameReceiver::startReceiving(QCPColorMapData *initialFrame)
+{
+    if (mHandshakeOk)
+    {
+        const QCPColorMapData::CellType cellType = frameCellType(mHandshake.element_type);
+        const int n = mHandshake.width*mHandshake.height;
+        const size_t bytes = size_t(n)*QCPColorMapData::cellTypeSize(cellType);
+        const int numChannels = mHandshake.num_channels;
+        const FrameRange empty = { DBL_MAX, -DBL_MAX };
+        mBack.resize(numChannels);
+        mReady.resize(numChannels);
+        for (int c=0; c<numChannels; ++c)
+        {
+            mBack[c] = QCPColorMapData::allocateCells(cellType, n);
+            mReady[c] = QCPColorMapData::allocateCells(cellType, n);
+            if (c == 0)
+            {
+                memcpy(mBack[c], initialFrame->rawCells(), bytes);
+                memcpy(mReady[c], initialFrame->rawCells(), bytes);
+            }
+            else
+            {
+                memset(mBack[c], 0, bytes);
+                memset(mReady[c], 0, bytes);
+            }
+        }
+        mBackRanges.fill(empty, numChannels);
+        mReadyRanges.fill(empty, numChannels);
+        mTileVersions.fill(0, mTiles.size()*numChannels);
+        mBlockUpdated.fill(0, mFrameBlocks.size());
+        mBackVersions = mReadyVersions = mFrontVersions = mTileVersions;
+        // the initial frame is a frame of the full view
+        mBlockView.fill(0, mFrameBlocks.size());
+        mBlocksInView = mFrameBlocks.size();
+        // the only time the data range is found by going through a frame
+        mBlockRanges.fill(empty, mFrameBlocks.size()*numChannels);
+        for (int i=0; i<mFrameBlocks.size(); ++i)
+        {
+            const frame_block &block = mFrameBlocks.at(i);
+            FrameRange range = { DBL_MAX, -DBL_MAX };
+            for (int y=block.offset_y; y<block.offset_y+block.ny; ++y)
+            {
+                for (int x=block.offset_x; x<block.offset_x+block.nx; ++x)
+                {
+                    const double value = initialFrame->cell(x, y);
+                    range.lower = qMin(range.lower, value);
+                    range.upper = qMax(range.upper, value);
+                }
+            }
+            mBlockRanges[i*numChannels] = range;
+        }
+    }
+    mStartReceiving.release();
+}
+
+/* ------------------------------------------------------------------------- */
+
+// exchanges the arrays of the channels of the ready frame with the arrays
+// of the color maps, cmdata[c] holding channel c; these take the size of
+// the view of the frame (see frameView), the maps of channels the view
+// does not hold are left alone. changedCells, an array of count vectors
+// if given, receives the cell rectangles per channel that differ from the
+// previous frame, none for the channels left alone;
+// returns false if there is no new frame
+bool FrameReceiver::exchangeFrame(QCPColorMapData *const *cmdata, int count, FrameTiming *timing, QVector<QRect> *changedCells)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        const int numChannels = qMin(count, mHandshake.num_channels);
+        if (!mReadyValid)
+        {
+            return false;
+        }
+        // nothing is exchanged unless every channel can be, the arrays and
+        // their versions have to stay together
+        if (mReadyView.nx <= 0 || mReadyView.ny <= 0)
+        {
+            return false;
+        }
+        for (int c=0; c<numChannels; ++c)
+        {
+            if ((mReadyView.channels & (1 << c)) &&
+                (cmdata[c]->cellType() != frameCellType(mHandshake.element_type) || !mReady.at(c)))
+            {
+                return false;
+            }
+        }
+        // only frames of the full view keep track of their tiles, the view
+        // names the channels, so the same view holds the same ones
+        const bool fullView = mReadyView.id == mFrontView.id && frameViewIsFull(&mReadyView, mHandshake.width, mHandshake.height);
+        const int numTiles = mTiles.size();
+        for (int c=0; c<count; ++c)
+        {
+            QVector<QRect> &changed = changedCells ? changedCells[c] : mChangedCells;
+            changed.resize(0); // unlike clear, keeps the capacity with any Qt 5
+            if (c >= numChannels || !(mReadyView.channels & (1 << c)))
+            {
+                continue;
+            }
+            // the color map holds the front array, so it only colorizes the
+            // tiles that changed
+            QCPColorMapData *data = cmdata[c];
+            const bool tracked = fullView && data->keySize() == mReadyView.nx && data->valueSize() == mReadyView.ny;
+            if (!tracked)
+            {
+                changed.append(QRect(0, 0, mReadyView.nx, mReadyView.ny));
+            }
+            else for (int i=0; i<numTiles; ++i)
+            {
+                if (mReadyVersions.at(c*numTiles+i) != mFrontVersions.at(c*numTiles+i))
+                {
+                    const FrameTile &tile = mTiles.at(i);
+                    const frame_block &block = mFrameBlocks.at(tile.block);
+                    changed.append(QRect(block.offset_x+tile.x, block.offset_y+tile.y, tile.nx, tile.ny));
+                }
+            }
+            // cannot fail after the checks above
+            mReady[c] = tracked ? data->swapRawCells(mReady.at(c), changed, false) :
+                                  data->swapRawCells(mReady.at(c), mReadyView.nx, mReadyView.ny, false);
+            std::swap_ranges(mReadyVersions.begin()+c*numTiles, mReadyVersions.begin()+(c+1)*numTiles,
+                             mFrontVersions.begin()+c*numTiles);
+            if (mReadyRanges.at(c).lower <= mReadyRanges.at(c).upper)
+            {
+                data->setDataBounds(QCPRange(mReadyRanges.at(c).lower, mReadyRanges.at(c).upper));
+            }
+        }
+        qSwap(mReadyView, mFrontView);
+        mReadyValid = false;
+        if (timing)
+        {
+            *timing = mReadyTiming;
+        }
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the GUI fetches the frames with exchangeFrame on a timer from now on;
+// frameReady is not emitted meanwhile, which saves the queued event it
+// takes for every frame
+void FrameReceiver::startPolling()
+{
+    QMutexLocker locker(&mMutex);
+    mPolling = true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// frameReady is emitted again for the next frame; returns false and keeps
+// polling if a frame is ready already, as no signal would announce it
+bool FrameReceiver::stopPolling()
+{
+    QMutexLocker locker(&mMutex);
+    if (mReadyValid)
+    {
+        return false;
+    }
+    mPolling = false;
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// asks the server for the cells of a region of a downsampled level; the id
+// of view is assigned here, frames of the view follow after a few frames
+// of the previous one
+void FrameReceiver::requestView(const frame_view &view)
+{
+    QMutexLocker locker(&mMutex);
+    mRequestedView = view;
+    mRequestedView.id = ++mViewRequests;
+    mViewRequested.storeRelease(1);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// registers probes with the server, replacing those registered before; the
+// server clips them to the image and leaves out those it cannot sample,
+// samples of probe i refer to probes[i] unless the server did so
+void FrameReceiver::requestProbes(const QVector<frame_probe> &probes)
+{
+    QMutexLocker locker(&mMutex);
+    mRequestedProbes.num_probes = qMin(probes.size(), FRAME_MAX_PROBES);
+    for (int i=0; i<mRequestedProbes.num_probes; ++i)
+    {
+        mRequestedProbes.probes[i] = probes.at(i);
+    }
+    ++mRequestedProbes.id;
+    mProbesRequested.storeRelease(1);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// hands the probe samples received since the last call over in the order
+// of their steps; returns false if there are none. The vectors are
+// swapped, so neither allocates once both have grown.
+bool FrameReceiver::takeProbeSamples(QVector<ProbeSample> *samples)
+{
+    samples->resize(0);
+    QMutexLocker locker(&mMutex);
+    if (mProbeSamples.isEmpty())
+    {
+        return false;
+    }
+    mProbeSamples.swap(*samples);
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int FrameReceiver::numBlocks()
+{
+    QMutexLocker locker(&mMutex);
+    return mBlockCount;
+}
+
+/* ------------------------------------------------------------------------- */
+
+FrameStatistics FrameReceiver::statistics()
+{
+    QMutexLocker locker(&mMutex);
+    return mStatistics;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// latency of the server, network and decode stages
+PipelineLatency FrameReceiver::latency()
+{
+    QMutexLocker locker(&mMutex);
+    return mLatency;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// disconnects from the server, finalizes MPI and waits for the thread
+void FrameReceiver::stop()
+{
+    if (!mStopRequested.testAndSetOrdered(0, 1))
+    {
+        return;
+    }
+    mStartReceiving.release();
+    wait();
+}
+
+/* ------------------------------------------------------------------------- */
+
+// all MPI calls of the client are made by this thread (MPI_THREAD_FUNNELED);
+// when the server closes the connection, a server is looked for again every
+// FRAME_RECONNECT_INTERVAL_MS
+void FrameReceiver::run()
+{
+    int provided = MPI_THREAD_SINGLE;
+    mpiError = MPI_Init_thread(0, 0, MPI_THREAD_FUNNELED, &provided);
+
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to initialize MPI" << std::endl << std::flush;
+        mHandshakeDone.release();
+        return;
+    }
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+        std::cerr << "MPI does not support MPI_THREAD_FUNNELED, provided level is " << provided << std::endl << std::flush;
+    }
+
+    // looking up a name or connecting to a port that is gone must not be fatal
+    MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
+    MPI_Comm_set_errhandler(MPI_COMM_SELF, MPI_ERRORS_RETURN);
+
+    mHandshakeOk = connectToServer();
+    mReconnect = mHandshakeOk;
+    mHandshakeDone.release();
+
+    mStartReceiving.acquire();
+
+    if (mConnected && !mStopRequested.loadAcquire())
+    {
+        postReceives();
+    }
+
+    // MPI must be finalized by this thread, so it stays until the GUI quits
+    QElapsedTimer reconnectTimer;
+    while (!mStopRequested.loadAcquire())
+    {
+        if (mConnected)
+        {
+            if (!receiveMessages())
+            {
+                QThread::usleep(100); // nothing to do, don't spin
+            }
+            if (!mConnected)
+            {
+                emit disconnected();
+                reconnectTimer.start();
+            }
+        }
+        else if (mReconnect && reconnectTimer.elapsed() >= FRAME_RECONNECT_INTERVAL_MS)
+        {
+            if (reconnectToServer())
+            {
+                emit reconnected();
+            }
+            reconnectTimer.start();
+        }
+        else
+        {
+            QThread::msleep(10);
+        }
+    }
+
+    if (mConnected)
+    {
+        disconnectFromServer();
+    }
+
+    // memory of MPI_Alloc_mem has to go before MPI_Finalize
+    frameMemoryFree(mSlotData);
+    mSlotData = 0;
+
+    std::cout << "Finalizing MPI ..." << std::endl << std::flush;
+    mpiError = MPI_Finalize();
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to finalize MPI" << std::endl << std::flush;
+    }
+    std::cout << "MPI finalized" << std::endl << std::flush;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the port the server published under the service name, or the one in the
+// port file; empty if there is no server
+QString FrameReceiver::lookupPortName()
+{
+    if (!mServiceName.isEmpty())
+    {
+        char portName[MPI_MAX_PORT_NAME] = { 0 };
+        if (MPI_Lookup_name(mServiceName.toStdString().c_str(), MPI_INFO_NULL, portName) == MPI_SUCCESS)
+        {
+            return QString(portName);
+        }
+    }
+
+    QString portName;
+    QFile inputFile(mPortFileName);
+    if (inputFile.open(QIODevice::ReadOnly))
+    {
+        QTextStream in(&inputFile);
+        if (!in.atEnd())
+        {
+            portName = in.readLine();
+        }
+        inputFile.close();
+    }
+    return portName;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool FrameReceiver::connectToServer()
+{
+    const QString portName = lookupPortName();
+    if (portName.isEmpty())
+    {
+        // keep quiet while waiting for a server to reconnect to
+        if (!mReconnect)
+        {
+            std::cerr << "No server found, neither as '" << mServiceName.toStdString() << "' nor in "
+                      << mPortFileName.toStdString() << std::endl << std::flush;
+        }
+        return false;
+    }
+
+    // must only be called after the MPI_Comm_accept call has been made by the MPI job acting as the server
+    mpiError = MPI_Comm_connect(portName.toStdString().c_str(), MPI_INFO_NULL, 0, MPI_COMM_SELF, &mIntercomm);
+
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to connected to mpi port" << std::endl << std::flush;
+        mIntercomm = MPI_COMM_NULL;
+        return false;
+    }
+
+    mConnected = 1;
+
+    if (!receiveHandshake())
+    {
+        disconnectFromServer();
+        return false;
+    }
+
+    setupTiles();
+    {
+        QMutexLocker locker(&mMutex);
+        mBlockCount = mFrameBlocks.size();
+    }
+
+    // mSlotCount receive buffers per block, one after the other
+    size_t slotBytes = 0;
+    for (int i=0; i<mFrameBlocks.size(); ++i)
+    {
+        slotBytes += slotSize(mFrameBlocks.at(i), mHandshake, mCodec) * mSlotCount;
+    }
+    frameMemoryFree(mSlotData);
+    mSlotData = static_cast<char*>(frameMemoryAlloc(slotBytes, mMemory));
+    if (!mSlotData)
+    {
+        std::cerr << "Failed to allocate " << slotBytes << " bytes of receive buffers" << std::endl << std::flush;
+        disconnectFromServer();
+        return false;
+    }
+    if (!mReconnect && mMemory != 0)
+    {
+        char granted[32], asked[32];
+        std::cout << "Receive buffers: " << frameMemoryToString(frameMemoryFlags(mSlotData), granted, sizeof(granted))
+                  << " memory (asked for " << frameMemoryToString(mMemory, asked, sizeof(asked)) << ")" << std::endl << std::flush;
+    }
+    mSlots.resize(mFrameBlocks.size()*mSlotCount);
+    char *slot = mSlotData;
+    for (int i=0; i<mSlots.size(); ++i)
+    {
+        const frame_block &block = mFrameBlocks.at(i/mSlotCount);
+        mSlots[i] = slot;
+        slot += slotSize(block, mHandshake, mCodec);
+    }
+
+    if (mHandshake.transport == FRAME_TRANSPORT_PUT)
+    {
+        openWindow(slotBytes);
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// connects to the server found now, which has to compute the image the
+// color map was set up for; frames start over from the full view, whose
+// first frame is decoded as a whole
+bool FrameReceiver::reconnectToServer()
+{
+    // the GUI does not look at the tiles and blocks while there is no frame ready
+    {
+        QMutexLocker locker(&mMutex);
+        mReadyValid = false;
+    }
+
+    if (!connectToServer())
+    {
+        return false;
+    }
+
+    const FrameRange empty = { DBL_MAX, -DBL_MAX };
+    const int numVersions = mTiles.size()*mHandshake.num_channels;
+    mTileVersions.fill(0, numVersions);
+    mBackVersions.fill(-1, numVersions);
+    mBlockUpdated.fill(0, mFrameBlocks.size());
+    mUpdatedBlocks = 0;
+    mBlockView.fill(-1, mFrameBlocks.size());
+    mBlocksInView = 0;
+    mBlockRanges.fill(empty, mFrameBlocks.size()*mHandshake.num_channels);
+    mBlockLatency.reset();
+    mReceiveCheck.reset(); // the buffers are sized for the new server
+    mPublishCheck.reset();
+    {
+        QMutexLocker locker(&mMutex);
+        mReadyVersions.fill(-1, numVersions);
+        mFrontVersions.fill(-1, numVersions);
+        // the GUI still shows the view it asked the previous server for
+        if (mViewRequests > 0)
+        {
+            mViewRequested.storeRelease(1);
+        }
+        if (mRequestedProbes.id > 0)
+        {
+            mProbesRequested.storeRelease(1);
+        }
+    }
+
+    postReceives();
+    std::cout << "Reconnected to server" << std::endl << std::flush;
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the frames of the triple buffer hold one array per channel, of cells in
+// the element type of the color map (see framedecode.h); with delta
+// encoding or a codec the messages are applied to a copy of every block in
+// the received element type, of which only the changed tiles are decoded
+void FrameReceiver::setupTiles()
+{
+    const int elementSize = imageElementSize(mHandshake.element_type);
+    size_t currentBytes = 0;
+
+    mTiles.clear();
+    delete[] mCurrentData;
+    mCurrentData = 0;
+    mCurrentBlocks.clear();
+    mBlockFirstTile.resize(mFrameBlocks.size()+1);
+    for (int i=0; i<mFrameBlocks.size(); ++i)
+    {
+        const frame_block &block = mFrameBlocks.at(i);
+        const int tileSize = mHandshake.delta_tile > 0 ? mHandshake.delta_tile : qMax(block.nx, block.ny);
+        mBlockFirstTile[i] = mTiles.size();
+        for (int y=0; y<block.ny; y+=tileSize)
+        {
+            for (int x=0; x<block.nx; x+=tileSize)
+            {
+                const FrameTile tile = { i, x, y, qMin(tileSize, block.nx-x), qMin(tileSize, block.ny-y) };
+                mTiles.append(tile);
+            }
+        }
+        currentBytes += size_t(block.nx)*block.ny*elementSize*mHandshake.num_channels;
+    }
+    mBlockFirstTile[mFrameBlocks.size()] = mTiles.size();
+
+    // delta messages only hold parts of a block and compressed messages
+    // cannot be decoded in place, keep the whole blocks
+    if (mHandshake.delta_tile > 0 || frameCodecIsActive(&mCodec))
+    {
+        mCurrentData = new char[currentBytes];
+        memset(mCurrentData, 0, currentBytes);
+        mCurrentBlocks.resize(mFrameBlocks.size());
+        char *current = mCurrentData;
+        for (int i=0; i<mFrameBlocks.size(); ++i)
+        {
+            mCurrentBlocks[i] = current;
+            current += size_t(mFrameBlocks.at(i).nx)*mFrameBlocks.at(i).ny*elementSize*mHandshake.num_channels;
+        }
+    }
+
+    // whether a message needs the buffers of decompressMessage depends on
+    // the channels of the view, so they are there before the first one
+    if (frameCodecIsActive(&mCodec))
+    {
+        size_t largestBytes = 0;
+        for (int i=0; i<mFrameBlocks.size(); ++i)
+        {
+            largestBytes = qMax(largestBytes, payloadSize(mFrameBlocks.at(i), mHandshake));
+        }
+        mCodecPayload.resize(int(largestBytes));
+        mCodecSegment.resize(int(largestBytes));
+        mCodecScratch.resize(int(frameCodecScratchSize(largestBytes)));
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool FrameReceiver::receiveHandshake()
+{
+    frame_handshake remoteHandshake;
+    mpiError = MPI_Recv(&remoteHandshake, sizeof(remoteHandshake), MPI_BYTE, 0, MPI_TAG_HANDSHAKE, mIntercomm, MPI_STATUS_IGNORE);
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to receive handshake" << std::endl << std::flush;
+        return false;
+    }
+
+    int remoteSize = 0;
+    MPI_Comm_remote_size(mIntercomm, &remoteSize);
+
+    if (remoteHandshake.version != MPI_PROTOCOL_VERSION)
+    {
+        std::cerr << "Server uses protocol version " << remoteHandshake.version
+                  << ", expected " << MPI_PROTOCOL_VERSION << std::endl << std::flush;
+        return false;
+    }
+    if (remoteHandshake.width < 1 || remoteHandshake.height < 1 ||
+        imageElementSize(remoteHandshake.element_type) == 0 || remoteHandshake.scale == 0.0 || remoteHandshake.delta_tile < 0 ||
+        remoteHandshake.num_blocks < 1 || remoteHandshake.num_blocks > remoteSize ||
+        remoteHandshake.max_segments < 1 || remoteHandshake.max_segments > remoteHandshake.width*remoteHandshake.height ||
+        remoteHandshake.max_level < 0 || remoteHandshake.max_level > FRAME_MAX_LEVEL ||
+        remoteHandshake.num_channels < 1 || remoteHandshake.num_channels > FRAME_MAX_CHANNELS ||
+        ((remoteHandshake.codec_flags & FRAME_CODEC_QUANTIZE) && !(remoteHandshake.quantize_step > 0.0)))
+    {
+        std::cerr << "Unexpected handshake: " << remoteHandshake.width << "x" << remoteHandshake.height
+                  << ", element type " << remoteHandshake.element_type
+                  << ", " << remoteHandshake.num_blocks << " blocks" << std::endl << std::flush;
+        return false;
+    }
+    if (!frameCodecIsAvailable(remoteHandshake.codec))
+    {
+        std::cerr << "Server uses codec " << frameCodecToString(remoteHandshake.codec)
+                  << " (" << remoteHandshake.codec << "), which is not available" << std::endl << std::flush;
+        return false;
+    }
+
+    mFrameBlocks.resize(remoteHandshake.num_blocks);
+    mpiError = MPI_Recv(mFrameBlocks.data(), FRAME_BLOCK_INTS*remoteHandshake.num_blocks, MPI_INT, 0, MPI_TAG_HANDSHAKE, mIntercomm, MPI_STATUS_IGNORE);
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to receive frame blocks" << std::endl << std::flush;
+        mFrameBlocks.clear();
+        return false;
+    }
+
+    for (int i=0; i<mFrameBlocks.size(); ++i)
+    {
+        const frame_block &block = mFrameBlocks.at(i);
+        if (block.offset_x < 0 || block.offset_y < 0 || block.nx < 1 || block.ny < 1 ||
+            block.offset_x+block.nx > remoteHandshake.width || block.offset_y+block.ny > remoteHandshake.height)
+        {
+            std::cerr << "Block " << i << " exceeds the image" << std::endl << std::flush;
+            mFrameBlocks.clear();
+            return false;
+        }
+    }
+
+    if (!synchronizeClock())
+    {
+        mFrameBlocks.clear();
+        return false;
+    }
+
+    // the color maps hold the cells of the image of the first server
+    if (mReconnect && (remoteHandshake.width != mHandshake.width || remoteHandshake.height != mHandshake.height ||
+                       remoteHandshake.element_type != mHandshake.element_type || remoteHandshake.scale != mHandshake.scale ||
+                       remoteHandshake.num_channels != mHandshake.num_channels))
+    {
+        std::cerr << "Server computes a different image (" << remoteHandshake.width << "x" << remoteHandshake.height
+                  << ", element type " << remoteHandshake.element_type << ", " << remoteHandshake.num_channels
+                  << " channel(s)), not reconnecting" << std::endl << std::flush;
+        mFrameBlocks.clear();
+        mReconnect = false;
+        return false;
+    }
+
+    mHandshake = remoteHandshake;
+    for (int c=0; c<FRAME_MAX_CHANNELS; ++c)
+    {
+        mHandshake.channel_names[c][FRAME_CHANNEL_NAME_LENGTH-1] = '\0';
+    }
+    mCodec.codec = mHandshake.codec;
+    mCodec.flags = mHandshake.codec_flags;
+    mCodec.element_type = mHandshake.element_type;
+    mCodec.quantize_step = mHandshake.quantize_step;
+    mView = fullView(mHandshake);
+    if (!mReconnect)
+    {
+        mBackView = mReadyView = mFrontView = mView;
+    }
+
+    std::cout << "Receiving " << mHandshake.width << "x" << mHandshake.height << " image of element type "
+              << mHandshake.element_type << " with " << mHandshake.num_channels << " channel(s) in "
+              << mFrameBlocks.size() << " block(s) per frame ("
+              << (mHandshake.mode == FRAME_MODE_DIRECT ? "direct" : "gather") << " mode";
+    if (mHandshake.delta_tile > 0)
+    {
+        std::cout << ", delta encoded in tiles of " << mHandshake.delta_tile;
+    }
+    if (frameCodecIsActive(&mCodec))
+    {
+        std::cout << ", codec " << frameCodecToString(mCodec.codec);
+        if (mCodec.flags & FRAME_CODEC_SHUFFLE)
+        {
+            std::cout << " with shuffle";
+        }
+        if (mCodec.flags & FRAME_CODEC_QUANTIZE)
+        {
+            std::cout << ", quantized to " << mCodec.quantize_step;
+        }
+    }
+    std::cout << ")" << std::endl << std::flush;
+
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// estimates mClockOffset from a few round trips to server rank 0
+bool FrameReceiver::synchronizeClock()
+{
+    double bestRoundTrip = -1.0;
+
+    for (int i=0; i<FRAME_CLOCK_SYNC_ROUNDS; ++i)
+    {
+        double sent = pipelineClock();
+        double serverTime = 0.0;
+        mpiError = MPI_Send(&sent, 1, MPI_DOUBLE, 0, MPI_TAG_HANDSHAKE, mIntercomm);
+        if (mpiError == MPI_SUCCESS)
+        {
+            mpiError = MPI_Recv(&serverTime, 1, MPI_DOUBLE, 0, MPI_TAG_HANDSHAKE, mIntercomm, MPI_STATUS_IGNORE);
+        }
+        if (mpiError != MPI_SUCCESS)
+        {
+            std::cerr << "Failed to synchronize clock with server" << std::endl << std::flush;
+            return false;
+        }
+        const double received = pipelineClock();
+
+        // the shortest round trip bounds the offset most tightly
+        if (bestRoundTrip < 0.0 || received-sent < bestRoundTrip)
+        {
+            bestRoundTrip = received-sent;
+            mClockOffset = serverTime - 0.5*(sent+received);
+        }
+    }
+
+    std::cout << "Server clock offset " << mClockOffset << " s, round trip "
+              << bestRoundTrip*1e6 << " us" << std::endl << std::flush;
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void FrameReceiver::disconnectFromServer()
+{
+    if (!mConnected)
+    {
+        return;
+    }
+
+    std::cout << "Sending disconnect message to server program" << std::endl << std::flush;
+    int message_type = 1;
+    mpiError = MPI_Ssend(&message_type, 1, MPI_INT, 0, MPI_TAG_MESSAGE_QUIT, mIntercomm);
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to send disconnect message" << std::endl << std::flush;
+    }
+
+    freeReceives();
+    closeWindow();
+
+    std::cout << "Disconnecting ..." << std::endl << std::flush;
+    mpiError = MPI_Comm_disconnect(&mIntercomm);
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed disconnect comm" << std::endl << std::flush;
+    }
+    mConnected = 0;
+    std::cout << "Disconnected" << std::endl << std::flush;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the server went away without a quit message, e.g. it crashed or was
+// killed; nothing collective can be called with it anymore, so the
+// receives are freed and the communicators dropped locally. A window
+// cannot be freed without the server, its handle is dropped as well, the
+// receive buffers are replaced on reconnecting anyway
+void FrameReceiver::loseServer()
+{
+    std::cerr << "Lost the connection to the server" << std::endl << std::flush;
+    freeReceives();
+    mWindow = MPI_WIN_NULL;
+    if (mWindowComm != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&mWindowComm);
+    }
+    MPI_Comm_free(&mIntercomm);
+    mConnected = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// FRAME_TRANSPORT_PUT: exposes the receive buffers of slotBytes bytes in a
+// window the server group puts the blocks into, see mpi_protocol.h; the
+// blocks are received as usual if the window cannot be set up
+void FrameReceiver::openWindow(size_t slotBytes)
+{
+    int created, allCreated = 0, usable = 1, allUsable = 0;
+
+    // the server group comes first, which leaves the client the last rank
+    mpiError = MPI_Intercomm_merge(mIntercomm, 1, &mWindowComm);
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to merge the intercomm, receiving the blocks" << std::endl << std::flush;
+        mWindowComm = MPI_COMM_NULL;
+        return;
+    }
+    MPI_Comm_set_errhandler(mWindowComm, MPI_ERRORS_RETURN);
+
+    created = MPI_Win_create(mSlotData, MPI_Aint(slotBytes), 1, MPI_INFO_NULL, mWindowComm, &mWindow) == MPI_SUCCESS;
+    if (!created)
+    {
+        mWindow = MPI_WIN_NULL;
+    }
+    MPI_Allreduce(&created, &allCreated, 1, MPI_INT, MPI_MIN, mWindowComm);
+
+    if (allCreated)
+    {
+        // every server rank learns where the slots of its block are
+        for (int i=0; i<mFrameBlocks.size(); ++i)
+        {
+            frame_window_slots layout;
+            memset(&layout, 0, sizeof(layout));
+            layout.displacement = MPI_Aint(mSlots.at(i*mSlotCount) - mSlotData);
+            layout.slot_bytes = MPI_Aint(slotSize(mFrameBlocks.at(i), mHandshake, mCodec));
+            layout.slot_count = mSlotCount;
+            MPI_Send(&layout, sizeof(layout), MPI_BYTE, i, MPI_TAG_WINDOW, mIntercomm);
+        }
+
+        MPI_Allreduce(&usable, &allUsable, 1, MPI_INT, MPI_MIN, mWindowComm);
+        if (allUsable)
+        {
+            MPI_Win_lock_all(MPI_MODE_NOCHECK, mWindow);
+            std::cout << "The server puts the blocks into the receive buffers" << std::endl << std::flush;
+            return;
+        }
+    }
+
+    // a window that was created everywhere is freed collectively, one that
+    // some process could not create only where it exists
+    if (mWindow != MPI_WIN_NULL)
+    {
+        MPI_Win_free(&mWindow);
+    }
+    mWindow = MPI_WIN_NULL;
+    MPI_Comm_free(&mWindowComm);
+    std::cout << "No window for the receive buffers, receiving the blocks" << std::endl << std::flush;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// collective with the server group, after the receives were freed
+void FrameReceiver::closeWindow()
+{
+    if (mWindow != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(mWindow);
+        MPI_Win_free(&mWindow);
+    }
+    if (mWindowComm != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&mWindowComm);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// every block has a ring of receive buffers whose persistent requests stay
+// posted, so a block is never cancelled and the newest copy received wins;
+// the buffers hold the worst case of the codec, so MPI_Get_count gives the
+// size of a message. With a window the requests receive the notices of
+// the messages put into the buffers instead
+void FrameReceiver::postReceives()
+{
+    mRequests.fill(MPI_REQUEST_NULL, mSlots.size());
+    mNotices.resize(mWindow != MPI_WIN_NULL ? mSlots.size() : 0);
+    for (int i=0; i<mSlots.size(); ++i)
+    {
+        const int block = i/mSlotCount;
+        if (mWindow != MPI_WIN_NULL)
+        {
+            // the notice of a message put into the slot
+            MPI_Recv_init(&mNotices[i], FRAME_PUT_NOTICE_INTS, MPI_INT, block, MPI_TAG_IMAGE_DATA, mIntercomm, &mRequests[i]);
+            continue;
+        }
+        const int bytes = int(slotSize(mFrameBlocks.at(block), mHandshake, mCodec));
+        MPI_Recv_init(mSlots[i], bytes, MPI_BYTE, block, MPI_TAG_IMAGE_DATA, mIntercomm, &mRequests[i]);
+    }
+    mNextSlot.fill(0, mFrameBlocks.size());
+    mHeldSlot.fill(-1, mFrameBlocks.size());
+
+    // receives from one server rank are matched in the order they are posted,
+    // so the slots of a block complete in ring order
+    MPI_Startall(mRequests.size(), mRequests.data());
+}
+
+/* ------------------------------------------------------------------------- */
+
+void FrameReceiver::freeReceives()
+{
+    for (int i=0; i<mRequests.size(); ++i)
+    {
+        if (mRequests[i] == MPI_REQUEST_NULL)
+        {
+            continue;
+        }
+        // only the posted receives are still active, the held slots are not
+        if (mHeldSlot.at(i/mSlotCount) != i%mSlotCount)
+        {
+            MPI_Cancel(&mRequests[i]);
+            MPI_Wait(&mRequests[i], MPI_STATUS_IGNORE);
+        }
+        MPI_Request_free(&mRequests[i]);
+    }
+    mRequests.clear();
+}
+
+/* ------------------------------------------------------------------------- */
+
+// posts the receive of a slot again, with a window the server may then
+// write the slot again
+void FrameReceiver::postSlot(int block, int slot)
+{
+    MPI_Start(&mRequests[block*mSlotCount+slot]);
+    if (mWindow != MPI_WIN_NULL)
+    {
+        int credit = slot;
+        MPI_Send(&credit, 1, MPI_INT, block, MPI_TAG_IMAGE_CREDIT, mIntercomm);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// makes MPI progress once; returns false if nothing happened
+bool FrameReceiver::receiveMessages()
+{
+    bool active = false;
+
+    if (mViewRequested.loadAcquire())
+    {
+        sendViewRequest();
+        active = true;
+    }
+    if (mProbesRequested.loadAcquire())
+    {
+        sendProbeRequest();
+        active = true;
+    }
+
+    for (int block=0; block<mFrameBlocks.size(); ++block)
+    {
+        for (int n=0; n<mSlotCount; ++n)
+        {
+            const int slot = mNextSlot[block];
+            int flag = 0;
+            MPI_Status blockStatus;
+            if (MPI_Test(&mRequests[block*mSlotCount+slot], &flag, &blockStatus) != MPI_SUCCESS)
+            {
+                loseServer();
+                return true;
+            }
+            if (!flag)
+            {
+                break;
+            }
+            int bytes = 0;
+            bool valid = true;
+            if (mWindow != MPI_WIN_NULL)
+            {
+                // the server writes the slots in the order the receives complete in,
+                // so the notice names this slot
+                const frame_put_notice &notice = mNotices.at(block*mSlotCount+slot);
+                bytes = notice.bytes;
+                valid = notice.slot == slot && bytes > 0 &&
+                        size_t(bytes) <= slotSize(mFrameBlocks.at(block), mHandshake, mCodec);
+                if (!valid)
+                {
+                    // the slot is still held and given back in ring order, like
+                    // that of an invalid message
+                    std::cerr << "Ignoring put notice of block " << block << " for slot " << notice.slot
+                              << " with " << bytes << " bytes" << std::endl << std::flush;
+                }
+                MPI_Win_sync(mWindow);
+            }
+            else
+            {
+                MPI_Get_count(&blockStatus, MPI_BYTE, &bytes);
+            }
+
+            // the newer block wins, the slot of the previous one is posted again
+            if (mHeldSlot[block] >= 0)
+            {
+                postSlot(block, mHeldSlot[block]);
+            }
+            mHeldSlot[block] = slot;
+            mNextSlot[block] = (slot+1) % mSlotCount;
+            if (valid)
+            {
+                mReceiveCheck.begin();
+                completeBlock(block, bytes);
+                mReceiveCheck.end();
+            }
+            active = true;
+        }
+    }
+
+    // probe data is small and comes from server rank 0 only
+    MPI_Status status;
+    int messageAvailable = 0;
+    if (MPI_Iprobe(0, MPI_TAG_PROBE_DATA, mIntercomm, &messageAvailable, &status) != MPI_SUCCESS)
+    {
+        loseServer();
+        return true;
+    }
+    if (messageAvailable)
+    {
+        receiveProbeData(status);
+        active = true;
+    }
+
+    // image data is matched by the posted receives, only look for the quit message
+    messageAvailable = 0;
+    if (MPI_Iprobe(MPI_ANY_SOURCE, MPI_TAG_MESSAGE_QUIT, mIntercomm, &messageAvailable, &status) != MPI_SUCCESS)
+    {
+        loseServer();
+        return true;
+    }
+
+    if (messageAvailable)
+    {
+        int message = -1;
+        MPI_Recv(&message, 1, MPI_INT, status.MPI_SOURCE, status.MPI_TAG, mIntercomm, MPI_STATUS_IGNORE);
+
+        // close connections
+        std::cout << "Received disconnect message from server program" << std::endl << std::flush;
+        std::cout << "Canceling requests ..." << std::endl << std::flush;
+        freeReceives();
+        closeWindow();
+        std::cout << "Disconnecting ..." << std::endl << std::flush;
+        MPI_Comm_disconnect(&mIntercomm);
+        std::cout << "Disconnected" << std::endl << std::flush;
+        mConnected = 0;
+        return true;
+    }
+
+    // publish once every block has been updated, or when the frame gets too
+    // old; a new view has to be complete first
+    if (mConnected && mUpdatedBlocks > 0 && mBlocksInView == mFrameBlocks.size() &&
+        (mUpdatedBlocks == mFrameBlocks.size() || mPublishTimer.elapsed() >= FRAME_PUBLISH_INTERVAL_MS))
+    {
+        publishFrame();
+    }
+
+    return active;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// sends the latest view request of the GUI to server rank 0
+void FrameReceiver::sendViewRequest()
+{
+    frame_view view;
+    {
+        QMutexLocker locker(&mMutex);
+        view = mRequestedView;
+        mViewRequested.storeRelease(0);
+    }
+    mpiError = MPI_Send(&view, FRAME_VIEW_INTS, MPI_INT, 0, MPI_TAG_VIEW_REQUEST, mIntercomm);
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to send view request" << std::endl << std::flush;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// sends the latest probes of the GUI to server rank 0
+void FrameReceiver::sendProbeRequest()
+{
+    frame_probe_request request;
+    {
+        QMutexLocker locker(&mMutex);
+        request = mRequestedProbes;
+        mProbesRequested.storeRelease(0);
+    }
+    mpiError = MPI_Send(&request, FRAME_PROBE_REQUEST_INTS, MPI_INT, 0, MPI_TAG_PROBE_REQUEST, mIntercomm);
+    if (mpiError != MPI_SUCCESS)
+    {
+        std::cerr << "Failed to send probe request" << std::endl << std::flush;
+        return;
+    }
+    mSentProbeRequest = request.id;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// takes the steps of a probe data message; the steps of probes registered
+// before the latest request are of no interest anymore
+void FrameReceiver::receiveProbeData(const MPI_Status &status)
+{
+    int bytes = 0;
+    MPI_Get_count(&status, MPI_BYTE, &bytes);
+    if (bytes > mProbeMessage.size())
+    {
+        // cannot be a message of this protocol version, but it has to be received
+        mProbeMessage.resize(bytes);
+    }
+    mpiError = MPI_Recv(mProbeMessage.data(), mProbeMessage.size(), MPI_BYTE, 0, MPI_TAG_PROBE_DATA, mIntercomm, MPI_STATUS_IGNORE);
+
+    frame_probe_header header;
+    memcpy(&header, mProbeMessage.constData(), sizeof(header));
+    if (mpiError != MPI_SUCCESS || header.request != mSentProbeRequest ||
+        header.num_probes < 1 || header.num_probes > FRAME_MAX_PROBES || header.num_steps < 1 ||
+        bytes != frameProbeMessageSize(header.num_probes, header.num_steps))
+    {
+        return;
+    }
+
+    const frame_probe_stats *stats = reinterpret_cast<const frame_probe_stats*>(mProbeMessage.constData() + sizeof(header));
+    const int count = header.num_steps*header.num_probes;
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&mMutex);
+        wasEmpty = mProbeSamples.isEmpty();
+        // the GUI did not keep up, the oldest samples go
+        const int excess = mProbeSamples.size() + count - FRAME_PROBE_BACKLOG;
+        if (excess > 0)
+        {
+            mProbeSamples.remove(0, qMin(excess, mProbeSamples.size()));
+        }
+        for (int i=qMax(0, count-FRAME_PROBE_BACKLOG); i<count; ++i)
+        {
+            ProbeSample sample;
+            sample.probe = i % header.num_probes;
+            sample.time = (header.first_step + i/header.num_probes)*header.interval;
+            sample.stats = stats[i];
+            mProbeSamples.append(sample);
+        }
+    }
+    // the GUI takes all samples at once, one signal is enough until then
+    if (wasEmpty)
+    {
+        emit probesReady();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool FrameReceiver::isValidView(const frame_view &view) const
+{
+    if (view.level < 0 || view.level > mHandshake.max_level)
+    {
+        return false;
+    }
+    if (view.channels == 0 || (view.channels & ~frameAllChannels(mHandshake.num_channels)))
+    {
+        return false;
+    }
+    const int f = 1 << view.level;
+    const int cellsX = (mHandshake.width+f-1)/f;
+    const int cellsY = (mHandshake.height+f-1)/f;
+    return view.x >= 0 && view.y >= 0 && view.nx >= 1 && view.ny >= 1 &&
+           view.x+view.nx <= cellsX && view.y+view.ny <= cellsY;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// cells of the current view a block owns, in cells of the level; the
+// block itself for the full view
+frame_block FrameReceiver::viewCells(int block) const
+{
+    return frameViewBlockCells(&mView, &mFrameBlocks.at(block));
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the elements (or cells of the current view) of a channel of the current
+// view a block holds: in place of the channel in the current block, or
+// within the planes of the held receive buffer
+const char *FrameReceiver::channelData(int block, int channel) const
+{
+    const frame_block &b = mFrameBlocks.at(block);
+    const int elementSize = imageElementSize(mHandshake.element_type);
+    if (!mCurrentBlocks.isEmpty())
+    {
+        return mCurrentBlocks.at(block) + size_t(channel)*b.nx*b.ny*elementSize;
+    }
+    const frame_block cells = viewCells(block);
+    const int index = frameChannelCount(mView.channels & ((1 << channel) - 1));
+    return mSlots.at(block*mSlotCount+mHeldSlot.at(block)) + FRAME_HEADER_SIZE +
+           size_t(index)*cells.nx*cells.ny*elementSize;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// every message names the view it holds; messages of an older view are
+// dropped, and a frame of a new view is only published once every block
+// has sent its cells of it, so the previous frame stays on display; the
+// latency of the server and network stages is recorded per block
+void FrameReceiver::completeBlock(int block, int bytes)
+{
+    const double received = pipelineClock() + mClockOffset;
+    const char *data = mSlots.at(block*mSlotCount+mHeldSlot.at(block));
+    frame_header header;
+    memcpy(&header, data, sizeof(header));
+    mReceivedBytes += bytes;
+
+    if (header.view.id != mView.id)
+    {
+        // sent before the server switched to the current view
+        if (header.view.id < mView.id)
+        {
+            // the receive buffer holding the cells of the current view was posted again
+            if (mCurrentBlocks.isEmpty() && mBlockView[block] == mView.id)
+            {
+                mBlockView[block] = -1;
+                --mBlocksInView;
+            }
+            ++mSkippedBlocks;
+            return;
+        }
+        if (!isValidView(header.view))
+        {
+            std::cerr << "Ignoring image data message of block " << block << " with invalid view" << std::endl << std::flush;
+            return;
+        }
+        // the frame of the previous view being collected is abandoned
+        mView = header.view;
+        mBlocksInView = 0;
+        mBlockUpdated.fill(0);
+        mUpdatedBlocks = 0;
+    }
+
+    const frame_block cells = viewCells(block);
+    bool valid;
+    if (cells.nx == 0 || cells.ny == 0)
+    {
+        valid = header.block == block && bytes == FRAME_HEADER_SIZE; // the block owns no cell of the view
+    }
+    else
+    {
+        valid = frameCodecIsActive(&mCodec) ?
+              decompressMessage(block, header, data + FRAME_HEADER_SIZE, bytes - FRAME_HEADER_SIZE) :
+              applyMessage(block, header, data + FRAME_HEADER_SIZE, bytes - FRAME_HEADER_SIZE);
+    }
+    if (!valid)
+    {
+        std::cerr << "Ignoring invalid image data message of block " << block << std::endl << std::flush;
+        return;
+    }
+    if (mBlockView[block] != mView.id)
+    {
+        mBlockView[block] = mView.id;
+        ++mBlocksInView;
+    }
+    for (int c=0; c<mHandshake.num_channels; ++c)
+    {
+        if (mView.channels & (1 << c))
+        {
+            mBlockRanges[block*mHandshake.num_channels+c] = headerRange(header, c, mHandshake.scale);
+        }
+    }
+
+    mBlockLatency.add(PipelineLatency::stCompute, header.compute_time);
+    if (mHandshake.mode == FRAME_MODE_GATHER)
+    {
+        mBlockLatency.add(PipelineLatency::stGather, header.gather_time);
+    }
+    if (mHandshake.delta_tile > 0 || frameCodecIsActive(&mCodec))
+    {
+        mBlockLatency.add(PipelineLatency::stEncode, header.encode_time);
+    }
+    mBlockLatency.add(PipelineLatency::stQueue, header.post_time - header.compute_start - header.compute_time
+                                                - header.gather_time - header.encode_time);
+    mBlockLatency.add(PipelineLatency::stNetwork, received - header.post_time);
+
+    ++mReceivedBlocks;
+
+    if (mBlockUpdated[block])
+    {
+        ++mSkippedBlocks; // the previous copy was never published
+    }
+    else
+    {
+        if (mUpdatedBlocks == 0)
+        {
+            mPublishTimer.start();
+        }
+        mBlockUpdated[block] = 1;
+        ++mUpdatedBlocks;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// bumps the versions of the tiles the message updates, of every channel
+// of the view; with delta encoding the tiles are copied to the current
+// block as they have to be applied in order; returns false if the message
+// does not match the block
+bool FrameReceiver::applyMessage(int block, const frame_header &header, const char *payload, int payloadBytes)
+{
+    const int firstTile = mBlockFirstTile.at(block);
+    const int numTiles = mBlockFirstTile.at(block+1) - firstTile;
+    const int allTiles = mTiles.size();
+    const frame_block cells = viewCells(block);
+    const int elementSize = imageElementSize(mHandshake.element_type);
+    const size_t cellBytes = size_t(cells.nx)*cells.ny*elementSize;
+    int channels[FRAME_MAX_CHANNELS];
+    const int numChannels = channelList(mView.channels, channels);
+
+    if (header.block != block || payloadBytes < 0)
+    {
+        return false;
+    }
+
+    // the held receive buffer is decoded directly
+    if (mCurrentBlocks.isEmpty())
+    {
+        if (header.encoding != FRAME_ENCODING_FULL || size_t(payloadBytes) < cellBytes*numChannels)
+        {
+            return false;
+        }
+        for (int i=0; i<numChannels; ++i)
+        {
+            ++mTileVersions[channels[i]*allTiles+firstTile];
+        }
+        return true;
+    }
+
+    const frame_block &b = mFrameBlocks.at(block);
+    const size_t rowBytes = size_t(b.nx)*elementSize;
+    const size_t planeBytes = rowBytes*b.ny;
+    char *current = mCurrentBlocks.at(block);
+
+    // the cells of a view other than the full one are kept in place of the block
+    if (header.encoding == FRAME_ENCODING_FULL)
+    {
+        if (size_t(payloadBytes) < cellBytes*numChannels)
+        {
+            return false;
+        }
+        for (int i=0; i<numChannels; ++i)
+        {
+            memcpy(current + channels[i]*planeBytes, payload + i*cellBytes, cellBytes);
+            for (int t=0; t<numTiles; ++t)
+            {
+                ++mTileVersions[channels[i]*allTiles+firstTile+t];
+            }
+        }
+        return true;
+    }
+
+    // delta encoded messages are only sent for the full view
+    if (header.encoding != FRAME_ENCODING_TILES || header.num_tiles < 0 || header.num_tiles > numTiles*numChannels ||
+        frameTileTableSize(header.num_tiles) > payloadBytes ||
+        !frameViewIsFull(&mView, mHandshake.width, mHandshake.height))
+    {
+        return false;
+    }
+
+    const int *indices = reinterpret_cast<const int*>(payload);
+    size_t offset = frameTileTableSize(header.num_tiles);
+    for (int i=0; i<header.num_tiles; ++i)
+    {
+        if (indices[i] < 0 || indices[i] >= numTiles*numChannels)
+        {
+            return false;
+        }
+        // tile t of the n-th channel of the view
+        const int channel = channels[indices[i]/numTiles];
+        const int t = indices[i]%numTiles;
+        const FrameTile &tile = mTiles.at(firstTile+t);
+        const size_t tileRowBytes = size_t(tile.nx)*elementSize;
+        if (offset + tileRowBytes*tile.ny > size_t(payloadBytes))
+        {
+            return false;
+        }
+        char *dst = current + channel*planeBytes + (size_t(tile.y)*b.nx + tile.x)*elementSize;
+        for (int y=0; y<tile.ny; ++y)
+        {
+            memcpy(dst + y*rowBytes, payload + offset, tileRowBytes);
+            offset += tileRowBytes;
+        }
+        ++mTileVersions[channel*allTiles+firstTile+t];
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// undoes the codec stage: segments holding a rectangle of the block (of
+// the cells of the block for a downsampled view), of every channel of the
+// view one after the other, are decompressed into the current block, the
+// payload of a delta encoded message is decompressed and applied;
+// returns false if the message is corrupt
+bool FrameReceiver::decompressMessage(int block, const frame_header &header, const char *payload, int payloadBytes)
+{
+    const double decompressStart = pipelineClock();
+    const frame_block b = viewCells(block);
+    const int elementSize = imageElementSize(mHandshake.element_type);
+    const size_t rowBytes = size_t(b.nx)*elementSize;
+    const size_t planeBytes = size_t(mFrameBlocks.at(block).nx)*mFrameBlocks.at(block).ny*elementSize;
+    char *current = mCurrentBlocks.at(block);
+    int channels[FRAME_MAX_CHANNELS];
+    const int numChannels = channelList(mView.channels, channels);
+    // the buffers are sized in setupTiles, or grow to the largest payload
+    // of the block at once
+    const size_t largestBytes = payloadSize(mFrameBlocks.at(block), mHandshake);
+
+    if (header.block != block || payloadBytes < 0)
+    {
+        return false;
+    }
+    // nothing is decoded into the current block unless the whole table fits it
+    const int numSegments = frameCodecCheckSegments(&mCodec, payload, payloadBytes, mHandshake.max_segments, header.encoding,
+                                                    b.nx, b.ny, numChannels, largestBytes);
+    if (numSegments == 0)
+    {
+        return false;
+    }
+
+    const frame_segment *segments = reinterpret_cast<const frame_segment*>(payload + 2*sizeof(int));
+    size_t offset = frameSegmentTableSize(numSegments);
+    for (int i=0; i<numSegments; ++i)
+    {
+        const frame_segment &segment = segments[i];
+        if (size_t(mCodecScratch.size()) < frameCodecScratchSize(segment.raw_bytes))
+        {
+            mCodecScratch.resize(int(frameCodecScratchSize(qMax(largestBytes, size_t(segment.raw_bytes)))));
+        }
+
+        if (segment.nx == 0)
+        {
+            // the whole payload of a delta encoded message
+            if (mCodecPayload.size() < segment.raw_bytes)
+            {
+                mCodecPayload.resize(int(largestBytes));
+            }
+            if (!frameCodecDecode(&mCodec, &segment, payload + offset, mCodecPayload.data(), mCodecScratch.data()))
+            {
+                return false;
+            }
+            mBlockLatency.add(PipelineLatency::stDecompress, pipelineClock()-decompressStart);
+            return applyMessage(block, header, mCodecPayload.constData(), segment.raw_bytes);
+        }
+
+        // rows of a single channel as wide as the block are decompressed in place
+        const size_t segmentBytes = size_t(segment.nx)*segment.ny*elementSize; // of one channel
+        const size_t segmentOffset = (size_t(segment.offset_y)*b.nx + segment.offset_x)*elementSize;
+        const bool inPlace = segment.nx == b.nx && numChannels == 1;
+        if (!inPlace && mCodecSegment.size() < segment.raw_bytes)
+        {
+            mCodecSegment.resize(int(largestBytes));
+        }
+        if (!frameCodecDecode(&mCodec, &segment, payload + offset,
+                              inPlace ? current + channels[0]*planeBytes + segmentOffset : mCodecSegment.data(),
+                              mCodecScratch.data()))
+        {
+            return false;
+        }
+        if (!inPlace)
+        {
+            const size_t segmentRowBytes = size_t(segment.nx)*elementSize;
+            for (int c=0; c<numChannels; ++c)
+            {
+                char *dst = current + channels[c]*planeBytes + segmentOffset;
+                const char *src = mCodecSegment.constData() + c*segmentBytes;
+                for (int y=0; y<segment.ny; ++y)
+                {
+                    memcpy(dst + y*rowBytes, src + y*segmentRowBytes, segmentRowBytes);
+                }
+            }
+        }
+
+        offset += (size_t(segment.compressed_bytes) + 7) & ~size_t(7);
+    }
+    mBlockLatency.add(PipelineLatency::stDecompress, pipelineClock()-decompressStart);
+
+    const int firstTile = mBlockFirstTile.at(block);
+    for (int c=0; c<numChannels; ++c)
+    {
+        for (int i=firstTile; i<mBlockFirstTile.at(block+1); ++i)
+        {
+            ++mTileVersions[channels[c]*mTiles.size()+i];
+        }
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void FrameReceiver::decodeTile(void *frame, int channel, int tileIndex)
+{
+    const FrameTile &tile = mTiles.at(tileIndex);
+    const frame_block &b = mFrameBlocks.at(tile.block);
+    const int elementSize = imageElementSize(mHandshake.element_type);
+    const char *data = channelData(tile.block, channel) + (size_t(tile.y)*b.nx + tile.x)*elementSize;
+    const int width = mHandshake.width;
+    const double scale = mHandshake.scale;
+    const int x0 = b.offset_x + tile.x;
+    const int y0 = b.offset_y + tile.y;
+
+    decodeRect(mHandshake.element_type, data, b.nx, width, scale, frame, x0, y0, tile.nx, tile.ny);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// decodes the cells of a channel of the current view a block owns into a
+// frame of the view
+void FrameReceiver::decodeViewCells(void *frame, int channel, int block)
+{
+    const frame_block cells = viewCells(block);
+    if (cells.nx == 0 || cells.ny == 0)
+    {
+        return;
+    }
+
+    decodeRect(mHandshake.element_type, channelData(block, channel), cells.nx, mView.nx, mHandshake.scale, frame,
+               cells.offset_x-mView.x, cells.offset_y-mView.y, cells.nx, cells.ny);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the data range of the frame is the union of the ranges in the headers of
+// its blocks; the frame is swapped with the ready buffer, whose arrays the
+// GUI exchanges with those of its color maps
+void FrameReceiver::publishFrame()
+{
+    mPublishCheck.begin();
+
+    // the frame is as old as the oldest block updated for it
+    mBackTiming.sequence = -1;
+    for (int block=0; block<mFrameBlocks.size(); ++block)
+    {
+        if (mBlockUpdated[block])
+        {
+            frame_header header;
+            memcpy(&header, mSlots.at(block*mSlotCount+mHeldSlot.at(block)), sizeof(header));
+            const double computeStart = header.compute_start - mClockOffset;
+            if (mBackTiming.sequence < 0 || computeStart < mBackTiming.computeStart)
+            {
+                mBackTiming.computeStart = computeStart;
+            }
+            mBackTiming.sequence = qMax(mBackTiming.sequence, header.sequence);
+        }
+    }
+
+    // bring every tile of the channels of the view in the back buffer up to
+    // date; the back buffer was last written two frames ago, so this also
+    // catches up on tiles that were received in the meantime
+    const double decodeStart = pipelineClock();
+    const int numChannels = mHandshake.num_channels;
+    const int numTiles = mTiles.size();
+    if (mBackView.id != mView.id)
+    {
+        mBackVersions.fill(-1); // the back buffer holds another view
+        mBackView = mView;
+    }
+    for (int c=0; c<numChannels; ++c)
+    {
+        if (!(mView.channels & (1 << c)))
+        {
+            continue;
+        }
+        if (frameViewIsFull(&mView, mHandshake.width, mHandshake.height))
+        {
+            for (int tile=0; tile<numTiles; ++tile)
+            {
+                if (mBackVersions[c*numTiles+tile] == mTileVersions[c*numTiles+tile])
+                {
+                    continue;
+                }
+                decodeTile(mBack[c], c, tile);
+                mBackVersions[c*numTiles+tile] = mTileVersions[c*numTiles+tile];
+            }
+        }
+        else
+        {
+            // views are small, they are decoded as a whole
+            for (int block=0; block<mFrameBlocks.size(); ++block)
+            {
+                decodeViewCells(mBack[c], c, block);
+            }
+        }
+    }
+    mBlockLatency.add(PipelineLatency::stDecode, pipelineClock()-decodeStart);
+
+    // every block holds a message of the view, their ranges make up the frame's
+    for (int c=0; c<numChannels; ++c)
+    {
+        FrameRange &range = mBackRanges[c];
+        range.lower = DBL_MAX;
+        range.upper = -DBL_MAX;
+        for (int block=0; block<mFrameBlocks.size(); ++block)
+        {
+            range.lower = qMin(range.lower, mBlockRanges.at(block*numChannels+c).lower);
+            range.upper = qMax(range.upper, mBlockRanges.at(block*numChannels+c).upper);
+        }
+    }
+
+    mBlockUpdated.fill(0);
+    mUpdatedBlocks = 0;
+
+    bool notify = false;
+    {
+        QMutexLocker locker(&mMutex);
+        mBack.swap(mReady);
+        mBackVersions.swap(mReadyVersions);
+        qSwap(mBackView, mReadyView);
+        mBackRanges.swap(mReadyRanges);
+        mBackTiming.published = pipelineClock();
+        qSwap(mBackTiming, mReadyTiming);
+        mLatency.merge(mBlockLatency);
+        // unless the GUI polls or has not fetched the previous frame yet, which is replaced
+        notify = !mReadyValid && !mPolling;
+        mReadyValid = true;
+        ++mStatistics.publishedFrames;
+        mStatistics.receivedBlocks = mReceivedBlocks;
+        mStatistics.skippedBlocks = mSkippedBlocks;
+        mStatistics.receivedBytes = mReceivedBytes;
+    }
+    mBlockLatency.reset();
+    mPublishCheck.end(); // the queued signal is left out, Qt allocates its event
+
+    if (notify)
+    {
+        emit frameReady();
+    }
+}
@@ -0,0 +1,235 @@
+/**************************************************************************//**
+ * @file framereceiver.h
+ * @brief MPI receiver thread
+ *
+ * This file contains the class declaration for the FrameReceiver class.
+ * The receiver thread owns the intercommunicator to the server and decodes
+ * the image blocks into a triple buffer of frames, so that MPI progress and
+ * rendering never wait for each other. If the server goes away, it looks
+ * for a server computing the same image and reconnects.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef FRAMERECEIVER_H
+#define FRAMERECEIVER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QString>
+#include <QRect>
+#include <mpi.h>
+#include "mpi_protocol.h"
+#include "frame_codec.h"
+#include "pipelinelatency.h"
+#include "allocationcount.h"
+
+class QCPColorMapData;
+
+// publish an incomplete frame at the latest this long after its first block arrived
+#define FRAME_PUBLISH_INTERVAL_MS 10
+
+// default number of receive buffers per block, at least 2
+#define FRAME_RECEIVE_SLOTS 3
+
+// look for a server this often after the connection was closed
+#define FRAME_RECONNECT_INTERVAL_MS 1000
+
+// probe samples kept until the GUI takes them, older ones are dropped
+#define FRAME_PROBE_BACKLOG 16384
+
+// counters since the first connection was established
+struct FrameStatistics
+{
+    int receivedBlocks;     // completed block receives
+    int skippedBlocks;      // received blocks replaced by a newer one before being published
+    int publishedFrames;    // frames handed over to the GUI
+    qint64 receivedBytes;   // size of all received image data messages
+};
+
+// part of a block that is decoded as a whole: the delta tiles of the block,
+// or the whole block if the server does not use delta encoding
+struct FrameTile
+{
+    int block;
+    int x;                  // position within the block
+    int y;
+    int nx;
+    int ny;
+};
+
+// range of physical values, lower > upper if empty
+struct FrameRange
+{
+    double lower;
+    double upper;
+};
+
+// statistics of a probe at a step of the server
+struct ProbeSample
+{
+    int probe;              // index into the probes requested
+    double time;            // seconds since the server started computing
+    frame_probe_stats stats;
+};
+
+// timing of a published frame, in pipelineClock() time
+struct FrameTiming
+{
+    int sequence;           // newest server frame number contained in the frame
+    double computeStart;    // server started computing the oldest block updated for this frame
+    double published;       // frame was handed over to the GUI
+};
+
+class FrameReceiver : public QThread
+{
+    Q_OBJECT
+
+public:
+    FrameReceiver(const QString &serviceName, const QString &portFileName, int slotCount = FRAME_RECEIVE_SLOTS, QObject *parent = 0);
+    ~FrameReceiver();
+
+    void setMemory(int flags) { mMemory = flags; } // FRAME_MEMORY_* of the receive buffers, before start
+
+    // GUI thread interface
+    bool waitForHandshake();
+    const frame_handshake &handshake() const { return mHandshake; }
+    int numBlocks();
+    int numChannels() const { return mHandshake.num_channels; }
+    void startReceiving(QCPColorMapData *initialFrame);
+    bool exchangeFrame(QCPColorMapData *const *cmdata, int count, FrameTiming *timing = 0, QVector<QRect> *changedCells = 0);
+    bool exchangeFrame(QCPColorMapData *cmdata, FrameTiming *timing = 0, QVector<QRect> *changedCells = 0)
+        { return exchangeFrame(&cmdata, 1, timing, changedCells); }
+    void startPolling();
+    bool stopPolling();
+    frame_view frameView() const { return mFrontView; }
+    void requestView(const frame_view &view);
+    void requestProbes(const QVector<frame_probe> &probes);
+    bool takeProbeSamples(QVector<ProbeSample> *samples);
+    FrameStatistics statistics();
+    PipelineLatency latency();
+    void stop();
+
+signals:
+    void frameReady();      // a new frame can be fetched with exchangeFrame
+    void probesReady();     // probe samples can be taken with takeProbeSamples
+    void disconnected();    // the server closed the connection
+    void reconnected();     // connected to a server again, frames follow
+
+protected:
+    virtual void run();
+
+private:
+    QString lookupPortName();
+    bool connectToServer();
+    bool reconnectToServer();
+    bool receiveHandshake();
+    bool synchronizeClock();
+    void setupTiles();
+    void disconnectFromServer();
+    void loseServer();
+    void openWindow(size_t slotBytes);
+    void closeWindow();
+    void postReceives();
+    void freeReceives();
+    void postSlot(int block, int slot);
+    bool receiveMessages();
+    void sendViewRequest();
+    void sendProbeRequest();
+    void receiveProbeData(const MPI_Status &status);
+    bool isValidView(const frame_view &view) const;
+    frame_block viewCells(int block) const;
+    const char *channelData(int block, int channel) const;
+    void completeBlock(int block, int bytes);
+    bool applyMessage(int block, const frame_header &header, const char *payload, int payloadBytes);
+    bool decompressMessage(int block, const frame_header &header, const char *payload, int payloadBytes);
+    void decodeTile(void *frame, int channel, int tile);
+    void decodeViewCells(void *frame, int channel, int block);
+    void publishFrame();
+
+private:
+    // owned by the receiver thread
+    QString mServiceName;                       // the server publishes its port under this name
+    QString mPortFileName;                      // or writes it to this file
+    MPI_Comm mIntercomm;
+    int mConnected;
+    bool mReconnect;                            // the image of the first server was received, look for it again
+    int mpiError;
+    frame_handshake mHandshake;
+    double mClockOffset;                        // server time = pipelineClock() + mClockOffset
+    frame_codec mCodec;
+    QVector<frame_block> mFrameBlocks;          // block i is sent by server rank i
+    int mSlotCount;                             // receive buffers per block
+    int mMemory;                                // FRAME_MEMORY_* asked for
+    char *mSlotData;                            // memory of all receive buffers, of frameMemoryAlloc
+    MPI_Comm mWindowComm;                       // intercomm merged with the server group, if a window is used
+    MPI_Win mWindow;                            // the receive buffers the server puts blocks into, or MPI_WIN_NULL
+    QVector<frame_put_notice> mNotices;         // persistent receive per slot names the message put into it
+    QVector<char*> mSlots;                      // slot s of block i is mSlots[i*mSlotCount+s]
+    QVector<MPI_Request> mRequests;             // persistent receive per slot
+    QVector<int> mNextSlot;                     // oldest posted slot per block
+    QVector<int> mHeldSlot;                     // slot with the latest block, not posted, or -1
+    QVector<FrameTile> mTiles;                  // tiles of block i are mBlockFirstTile[i] .. mBlockFirstTile[i+1]-1
+    QVector<int> mBlockFirstTile;
+    QVector<int> mTileVersions;                 // updates per tile, of tile t of channel c at c*mTiles.size()+t
+    char *mCurrentData;                         // delta encoding or codec: all blocks as received so far
+    QVector<char*> mCurrentBlocks;              // the planes of all channels of a block one after the other
+    QVector<char> mCodecPayload;                // decompressed payload of a delta encoded message
+    QVector<char> mCodecSegment;                // decompressed rectangle narrower than its block
+    QVector<char> mCodecScratch;
+    frame_view mView;                           // newest view the server sent messages of
+    QVector<int> mBlockView;                    // id of the view each block holds
+    int mBlocksInView;                          // blocks holding mView
+    QVector<FrameRange> mBlockRanges;           // data range of the message applied last, of channel c of block i at i*channels+c
+    QVector<char> mBlockUpdated;                // block received since the last publish
+    int mUpdatedBlocks;
+    int mReceivedBlocks;
+    int mSkippedBlocks;
+    qint64 mReceivedBytes;
+    QElapsedTimer mPublishTimer;                // started by the first block of a frame
+    QVector<char> mProbeMessage;                // probe data as received
+    QVector<void*> mBack;                       // frame being decoded, per channel cells of frameCellType
+    QVector<int> mBackVersions;                 // tile versions decoded into mBack
+    frame_view mBackView;
+    QVector<FrameRange> mBackRanges;            // per channel
+    FrameTiming mBackTiming;
+    PipelineLatency mBlockLatency;              // collected since the last publish
+    AllocationCheck mReceiveCheck;              // debug builds: completing a received block
+    AllocationCheck mPublishCheck;              // debug builds: decoding and publishing a frame
+
+    // shared with the GUI thread, protected by mMutex
+    QMutex mMutex;
+    QVector<void*> mReady;                      // latest complete frame
+    QVector<int> mReadyVersions;
+    frame_view mReadyView;
+    QVector<FrameRange> mReadyRanges;
+    FrameTiming mReadyTiming;
+    QVector<int> mFrontVersions;                // frame currently displayed by the color maps
+    frame_view mFrontView;
+    frame_view mRequestedView;                  // not sent yet if mViewRequested is set
+    int mViewRequests;
+    frame_probe_request mRequestedProbes;       // not sent yet if mProbesRequested is set
+    int mSentProbeRequest;                      // id of the probe request sent last
+    QVector<ProbeSample> mProbeSamples;         // received, not taken yet
+    bool mReadyValid;                           // mReady holds a frame not yet fetched
+    bool mPolling;                              // the GUI fetches frames on a timer, frameReady is not emitted
+    QVector<QRect> mChangedCells;               // exchangeFrame keeps the capacity between frames
+    FrameStatistics mStatistics;
+    PipelineLatency mLatency;
+    int mBlockCount;                            // blocks per frame of the current server
+
+    QSemaphore mHandshakeDone;
+    QSemaphore mStartReceiving;
+    QAtomicInt mStopRequested;
+    QAtomicInt mViewRequested;
+    QAtomicInt mProbesRequested;
+    bool mHandshakeOk;
+};
+
+#endif // FRAMERECEIVER_H
@@ -0,0 +1,183 @@
+/**************************************************************************//**
+ * @file framereplay.cpp
+ * @brief Replay of frame recordings
+ *
+ * This file implements the replay of recordings. The file is mapped as a
+ * whole; the operating system pages in the chunks as they are decoded, so
+ * opening even a recording larger than the memory only touches the records
+ * at the start of every chunk, which make up the time index. The elements
+ * of a frame are read from the page cache exactly once, as decodeRect
+ * copies them into the spare array, which holds the elements as they were
+ * recorded unless they are doubles. A recording that was interrupted
+ * carries no frame count; it is replayed up to the last complete chunk.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <cstring>
+#include <algorithm>
+#include "framereplay.h"
+#include "framedecode.h"
+#include "qcustomplot.h"
+
+FrameReplay::FrameReplay(const QString &fileName) :
+    mFile(fileName),
+    mData(0),
+    mSpare(0)
+{
+    memset(&mHeader, 0, sizeof(mHeader));
+}
+
+/* ------------------------------------------------------------------------- */
+
+FrameReplay::~FrameReplay()
+{
+    if (mData)
+    {
+        mFile.unmap(mData);
+    }
+    QCPColorMapData::freeCells(frameCellType(mHeader.element_type), mSpare);
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool FrameReplay::open()
+{
+    if (!mFile.open(QIODevice::ReadOnly))
+    {
+        mError = mFile.errorString();
+        return false;
+    }
+
+    const qint64 fileSize = mFile.size();
+    if (fileSize < qint64(sizeof(mHeader)))
+    {
+        mError = "not a frame recording";
+        return false;
+    }
+
+    mData = mFile.map(0, fileSize);
+    if (!mData)
+    {
+        mError = mFile.errorString();
+        return false;
+    }
+
+    memcpy(&mHeader, mData, sizeof(mHeader));
+    if (memcmp(mHeader.magic, FRAME_RECORDING_MAGIC, sizeof(mHeader.magic)) != 0)
+    {
+        mError = "not a frame recording";
+        return false;
+    }
+    if (mHeader.version != FRAME_RECORDING_VERSION)
+    {
+        mError = QString("recording version %1, expected %2").arg(mHeader.version).arg(FRAME_RECORDING_VERSION);
+        return false;
+    }
+
+    const qint64 frameBytes = FRAME_RECORD_SIZE + qint64(imageElementSize(mHeader.element_type))*mHeader.width*mHeader.height;
+    if (mHeader.width < 1 || mHeader.height < 1 || imageElementSize(mHeader.element_type) == 0 || mHeader.scale == 0.0 ||
+        mHeader.data_offset < qint64(sizeof(mHeader)) || mHeader.chunk_size < frameBytes)
+    {
+        mError = "invalid recording header";
+        return false;
+    }
+
+    // the last chunk ends with its elements, without padding
+    qint64 frameCount = fileSize >= mHeader.data_offset + frameBytes ?
+                        (fileSize - mHeader.data_offset - frameBytes)/mHeader.chunk_size + 1 : 0;
+    if (mHeader.num_frames > 0)
+    {
+        frameCount = qMin(frameCount, qint64(mHeader.num_frames));
+    }
+
+    // the index: a chunk that does not know its position was not written completely
+    mTimes.reserve(int(frameCount));
+    for (int frame=0; frame<frameCount; ++frame)
+    {
+        const frame_record *r = record(frame);
+        if (r->frame != frame)
+        {
+            break;
+        }
+        mTimes.append(r->time - record(0)->time);
+    }
+    if (mTimes.isEmpty())
+    {
+        mError = "the recording holds no frames";
+        return false;
+    }
+
+    mSpare = QCPColorMapData::allocateCells(frameCellType(mHeader.element_type), mHeader.width*mHeader.height);
+    if (!mSpare)
+    {
+        mError = "out of memory for the frame";
+        return false;
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+frame_handshake FrameReplay::handshake() const
+{
+    frame_handshake h;
+    memset(&h, 0, sizeof(h));
+    h.version = MPI_PROTOCOL_VERSION;
+    h.mode = FRAME_MODE_GATHER;
+    h.width = mHeader.width;
+    h.height = mHeader.height;
+    h.element_type = mHeader.element_type;
+    h.tiles_x = 1;
+    h.tiles_y = 1;
+    h.num_blocks = 1;
+    h.num_channels = 1; // recordings hold the first channel only
+    h.scale = mHeader.scale;
+    return h;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int FrameReplay::frameAt(double time) const
+{
+    const int frame = int(std::upper_bound(mTimes.constBegin(), mTimes.constEnd(), time) - mTimes.constBegin()) - 1;
+    return qMax(0, frame);
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool FrameReplay::exchangeFrame(int frame, QCPColorMapData *cmdata)
+{
+    if (frame < 0 || frame >= mTimes.size() || cmdata->cellType() != frameCellType(mHeader.element_type))
+    {
+        return false;
+    }
+
+    const frame_record *r = record(frame);
+    decodeRect(mHeader.element_type, reinterpret_cast<const char*>(r) + FRAME_RECORD_SIZE, mHeader.width,
+               mHeader.width, mHeader.scale, mSpare, 0, 0, mHeader.width, mHeader.height);
+
+    void *displayed = cmdata->swapRawCells(mSpare, mHeader.width, mHeader.height, false);
+    if (!displayed)
+    {
+        return false;
+    }
+    mSpare = displayed;
+
+    // the range was recorded along with the frame, no pass over the cells
+    if (r->min_value <= r->max_value)
+    {
+        cmdata->setDataBounds(QCPRange(qMin(r->min_value/mHeader.scale, r->max_value/mHeader.scale),
+                                       qMax(r->min_value/mHeader.scale, r->max_value/mHeader.scale)));
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+const frame_record *FrameReplay::record(int frame) const
+{
+    return reinterpret_cast<const frame_record*>(mData + mHeader.data_offset + qint64(frame)*mHeader.chunk_size);
+}
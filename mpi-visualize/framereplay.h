@@ -0,0 +1,66 @@
+/**************************************************************************//**
+ * @file framereplay.h
+ * @brief Replay of frame recordings
+ *
+ * This file contains the class declaration for the FrameReplay class. A
+ * replay memory-maps a recording the server wrote with --record (see
+ * frame_recording.h) and indexes the time stamps of its frames, so any
+ * frame can be shown right away, at any speed and in any order. Frames
+ * are decoded from the mapped file straight into the array that is then
+ * swapped into the color map.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef FRAMEREPLAY_H
+#define FRAMEREPLAY_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include "mpi_protocol.h"
+#include "frame_recording.h"
+
+class QCPColorMapData;
+
+class FrameReplay
+{
+public:
+    explicit FrameReplay(const QString &fileName);
+    ~FrameReplay();
+
+    // maps the file and indexes its frames; see errorString if it fails
+    bool open();
+    QString errorString() const { return mError; }
+
+    // geometry of the recording, as a server in gather mode would announce it
+    frame_handshake handshake() const;
+
+    int frameCount() const { return mTimes.size(); }
+    // seconds from the first frame of the recording to frame
+    double frameTime(int frame) const { return mTimes.at(frame); }
+    double duration() const { return mTimes.isEmpty() ? 0.0 : mTimes.last(); }
+    // the last frame recorded at or before time
+    int frameAt(double time) const;
+    int sequence(int frame) const { return record(frame)->sequence; }
+
+    // decodes frame into the spare array and exchanges it with the array of
+    // the color map, which has the size of the image and cells of
+    // frameCellType; the data bounds are set from the recorded range
+    bool exchangeFrame(int frame, QCPColorMapData *cmdata);
+
+private:
+    const frame_record *record(int frame) const;
+
+private:
+    QFile mFile;
+    uchar *mData;                   // the whole file, mapped read-only
+    frame_recording_header mHeader;
+    QVector<double> mTimes;         // per complete frame, relative to the first one
+    void *mSpare;                   // width*height cells, swapped with the color map
+    QString mError;
+};
+
+#endif // FRAMEREPLAY_H
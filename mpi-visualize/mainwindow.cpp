@@ -3,28 +3,237 @@
  * @brief Main window and MPI client setup
  *
  * This file demonstrate the client side setup for an MPI server-client
- * intercommunicator using MPI_Comm_connect. Data is exchanged using
- * non-blocking MPI_Isend and MPI_Irecv.
+ * intercommunicator using MPI_Comm_connect. Connecting and receiving is
+ * done by a FrameReceiver thread; the main window shows the latest frame
+ * it decoded in a color map per channel, plots the probes sampled by the
+ * server and may replay a recording instead.
  * @author Daniel Queteschiner
  * @date June 2019
  *//*
  * Copyright (c) 2019 Daniel Queteschiner.
  *****************************************************************************/
 
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QToolBar>
+#include <QAction>
+#include <QSlider>
+#include <QComboBox>
+#include <QLabel>
+#include <QFileInfo>
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "framedecode.h"
+#include "frame_memory.h"
+
+namespace {
+
+// distance of neighbouring elements of the image in plot coordinates
+double elementSpacing(int size)
+{
+    return (IMAGE_COORD_UPPER-IMAGE_COORD_LOWER)/qMax(1, size-1);
+}
+
+// first and last element of the image an axis range covers (in part);
+// returns false if the range is beside the image
+bool visibleElements(const QCPRange &range, int size, int *first, int *last)
+{
+    const double lower = (range.lower-IMAGE_COORD_LOWER)/elementSpacing(size);
+    const double upper = (range.upper-IMAGE_COORD_LOWER)/elementSpacing(size);
+    if (upper < -0.5 || lower > size-0.5)
+    {
+        return false;
+    }
+    *first = qFloor(qBound(0.0, lower+0.5, size-1.0));
+    *last = qFloor(qBound(0.0, upper+0.5, size-1.0));
+    return true;
+}
+
+// plot coordinates of the centers of the first and the last of count cells
+// of a level; a cell is centered on the elements it averages
+QCPRange cellRange(int first, int count, int level, int size)
+{
+    const int f = 1 << level;
+    const double lower = IMAGE_COORD_LOWER + elementSpacing(size)*(first*f + 0.5*(f-1));
+    const double upper = IMAGE_COORD_LOWER + elementSpacing(size)*((first+count-1)*f + 0.5*(f-1));
+    return QCPRange(lower, upper);
+}
+
+// data range without the percent lowest and highest cells, estimated from
+// a histogram of a sample of the cells
+QCPRange clippedRange(QCPColorMapData *data, double percent)
+{
+    const QCPRange bounds = data->dataBounds();
+    const int keySize = data->keySize();
+    const int n = keySize*data->valueSize();
+    if (n == 0 || !(bounds.size() > 0.0))
+    {
+        return bounds;
+    }
+
+    int histogram[RANGE_BINS] = { 0 };
+    const double binsPerValue = RANGE_BINS/bounds.size();
+    const int stride = qMax(1, n/RANGE_SAMPLES) | 1; // odd, so it does not follow a column
+    int samples = 0;
+    for (int i=0; i<n; i+=stride)
+    {
+        ++histogram[qBound(0, int((data->cell(i%keySize, i/keySize)-bounds.lower)*binsPerValue), RANGE_BINS-1)];
+        ++samples;
+    }
+
+    const int clip = int(samples*percent/100.0);
+    // first bins from either end whose cumulated count exceeds the clipped cells
+    int lowerBin = 0;
+    int lowerCount = histogram[0];
+    while (lowerBin < RANGE_BINS-1 && lowerCount <= clip)
+    {
+        lowerCount += histogram[++lowerBin];
+    }
+    int upperBin = RANGE_BINS-1;
+    int upperCount = histogram[upperBin];
+    while (upperBin > lowerBin && upperCount <= clip)
+    {
+        upperCount += histogram[--upperBin];
+    }
+    return QCPRange(bounds.lower + lowerBin/binsPerValue, bounds.lower + (upperBin+1)/binsPerValue);
+}
+
+// reads a probe given as point:x,y, line:x0,y0,x1,y1 or rect:x0,y0,x1,y1
+// in elements of the image, optionally followed by :channel
+bool parseProbe(const QString &spec, frame_probe *probe)
+{
+    const QStringList parts = spec.split(':');
+    if (parts.size() < 2 || parts.size() > 3)
+    {
+        return false;
+    }
+    memset(probe, 0, sizeof(*probe));
+    int numCoords = 4;
+    if (parts.at(0) == "point")
+    {
+        probe->type = FRAME_PROBE_POINT;
+        numCoords = 2;
+    }
+    else if (parts.at(0) == "line")
+    {
+        probe->type = FRAME_PROBE_LINE;
+    }
+    else if (parts.at(0) == "rect")
+    {
+        probe->type = FRAME_PROBE_RECT;
+    }
+    else
+    {
+        return false;
+    }
+
+    const QStringList coords = parts.at(1).split(',');
+    if (coords.size() != numCoords)
+    {
+        return false;
+    }
+    int values[4];
+    for (int i=0; i<numCoords; ++i)
+    {
+        bool ok = false;
+        values[i] = coords.at(i).toInt(&ok);
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    probe->x0 = probe->x1 = values[0];
+    probe->y0 = probe->y1 = values[1];
+    if (numCoords == 4)
+    {
+        probe->x1 = values[2];
+        probe->y1 = values[3];
+    }
+
+    bool ok = true;
+    if (parts.size() == 3)
+    {
+        probe->channel = parts.at(2).toInt(&ok);
+    }
+    return ok && probe->channel >= 0 && probe->channel < FRAME_MAX_CHANNELS;
+}
+
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    receiver(0),
+    latency_overlay(0),
+    probe_rect(0),
+    view_timer(0),
+    render_timer(0),
+    render_check("MainWindow::renderSlot"),
+    status_timer(0),
+    replay(0),
+    replay_timer(0),
+    replay_play_action(0),
+    replay_slider(0),
+    replay_speeds(0),
+    replay_label(0)
 {
     ui->setupUi(this);
     setGeometry(400, 250, 542, 390);
 
-    intercomm = MPI_COMM_NULL;
-    request_image_data = MPI_REQUEST_NULL;
-    connected = 0;
+    colorize_threads = 1;
+    receive_slots = FRAME_RECEIVE_SLOTS;
+    receive_memory = 0;
+    show_overlay = true;
+    request_views = true;
+    use_opengl = false;
+    auto_range = false;
+    clip_percent = 0.0;
+    render_rate = 0.0;
+    last_render = 0.0;
+    idle_renders = 0;
+    status_frames = 0;
+    status_changed_cells = 0;
+    replay_speed = 1.0;
+    replay_time = 0.0;
+    replay_clock = 0.0;
+    replay_overlay_clock = 0.0;
+    replay_frame = -1;
+    replay_playing = false;
+    shown_channels = 0;
+    service_name = MPI_SERVICE_NAME;
+
+    parseArguments();
+
+    // defaults until the server sends the handshake
+    memset(&handshake, 0, sizeof(handshake));
+    handshake.version = MPI_PROTOCOL_VERSION;
+    handshake.mode = FRAME_MODE_GATHER;
+    handshake.width = DEFAULT_SIZE_X;
+    handshake.height = DEFAULT_SIZE_Y;
+    handshake.element_type = IMAGE_TYPE_INT16;
+    handshake.scale = 32767.0;
+    handshake.num_channels = 1;
+    memset(&requested_view, 0, sizeof(requested_view));
+
+    // a recording takes the place of the server
+    if (!replay_file.isEmpty())
+    {
+        replay = new FrameReplay(replay_file);
+        if (replay->open())
+        {
+            handshake = replay->handshake();
+        }
+        else
+        {
+            std::cerr << "Failed to open recording " << replay_file.toStdString() << ": "
+                      << replay->errorString().toStdString() << std::endl << std::flush;
+            delete replay;
+            replay = 0;
+        }
+    }
 
 #if defined (_WIN32) || defined (_WIN64)
     QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
@@ -36,95 +245,275 @@ MainWindow::MainWindow(QWidget *parent) :
     QString fileName("/tmp/mpiportname.txt");
 #endif
 
-    QFile inputFile(fileName);
-    if (inputFile.open(QIODevice::ReadOnly))
+    if (replay_file.isEmpty())
     {
-        QTextStream in(&inputFile);
-        if (!in.atEnd())
-        {
-            port_name = in.readLine();
-        }
-        inputFile.close();
+        // the receiver thread makes all MPI calls, starting with MPI_Init_thread
+        receiver = new FrameReceiver(service_name, fileName, receive_slots, this);
+        receiver->setMemory(receive_memory);
+        connect(receiver, SIGNAL(frameReady()), this, SLOT(frameReadySlot()));
+        connect(receiver, SIGNAL(disconnected()), this, SLOT(serverDisconnectedSlot()));
+        connect(receiver, SIGNAL(reconnected()), this, SLOT(serverReconnectedSlot()));
+        receiver->start();
 
-        mpiError = MPI_Init(0,0);
-
-        if (mpiError != MPI_SUCCESS)
+        if (receiver->waitForHandshake())
         {
-            std::cerr << "Failed to initialize MPI" << std::endl << std::flush;
+            handshake = receiver->handshake();
         }
         else
         {
-            // must only be called after the MPI_Comm_accept call has been made by the MPI job acting as the server
-            mpiError = MPI_Comm_connect(port_name.toStdString().c_str(), MPI_INFO_NULL, 0, MPI_COMM_SELF, &intercomm);
-
-            if (mpiError != MPI_SUCCESS)
-            {
-                std::cerr << "Failed to connected to mpi port" << std::endl << std::flush;
-            }
-            else
-            {
-                connected = 1;
-            }
+            // nothing to receive, the color map keeps its defaults
+            receiver->stop();
+            delete receiver;
+            receiver = 0;
+        }
+    }
+    // the server starts out sending the full view of the first channel
+    requested_view.nx = handshake.width;
+    requested_view.ny = handshake.height;
+    requested_view.channels = 1;
+    displayed_view = requested_view;
+    shown_channels &= frameAllChannels(handshake.num_channels);
+    if (shown_channels == 0)
+    {
+        shown_channels = frameAllChannels(handshake.num_channels);
+    }
+    // only a server samples probes, and only of the channels it computes
+    for (int i=probes.size()-1; i>=0; --i)
+    {
+        if (!receiver || probes.at(i).channel >= handshake.num_channels)
+        {
+            std::cerr << "Ignoring probe " << probe_names.at(i).toStdString() << std::endl << std::flush;
+            probes.remove(i);
+            probe_names.removeAt(i);
         }
     }
-
-    image_data = new image_datatype[SIZE_X * SIZE_Y];
 
     setupColorMapDemo(ui->customPlot);
     setWindowTitle("QCustomPlot: " + demoName);
     statusBar()->clearMessage();
-    ui->customPlot->replot();}
+    ui->customPlot->replot();
+
+    if (render_rate <= 0.0)
+    {
+        const QScreen *screen = QGuiApplication::primaryScreen();
+        render_rate = (screen && screen->refreshRate() > 0.0) ? screen->refreshRate() : DEFAULT_RENDER_RATE;
+    }
+
+    if (receiver)
+    {
+        // a running timer fires without registering again, unlike a single shot one restarted per frame
+        render_timer = new QTimer(this);
+        render_timer->setTimerType(Qt::PreciseTimer);
+        render_timer->setInterval(qMax(1, qRound(1000.0/render_rate)));
+        connect(render_timer, SIGNAL(timeout()), this, SLOT(renderSlot()));
+
+        status_timer = new QTimer(this);
+        status_timer->setInterval(STATUS_INTERVAL_MS);
+        connect(status_timer, SIGNAL(timeout()), this, SLOT(statusSlot()));
+        status_timer->start();
+
+        receiver->startReceiving(color_maps.at(0)->data());
+
+        view_timer = new QTimer(this);
+        view_timer->setSingleShot(true);
+        view_timer->setInterval(VIEW_REQUEST_DELAY_MS);
+        connect(view_timer, SIGNAL(timeout()), this, SLOT(requestViewSlot()));
+        connect(ui->customPlot->xAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(viewChangedSlot()));
+        connect(ui->customPlot->yAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(viewChangedSlot()));
+        view_timer->start();
+
+        if (handshake.num_channels > 1)
+        {
+            setupChannels();
+        }
+
+        if (!probes.isEmpty())
+        {
+            connect(receiver, SIGNAL(probesReady()), this, SLOT(probesReadySlot()));
+            receiver->requestProbes(probes);
+        }
+    }
+
+    if (replay)
+    {
+        setupReplay();
+    }
+}
 
 /* ------------------------------------------------------------------------- */
 
 MainWindow::~MainWindow()
 {
-    int initialized = 0;
-    MPI_Initialized(&initialized);
-
-    if (initialized)
+    if (receiver)
     {
-        if (connected)
+        receiver->stop(); // disconnects from the server and finalizes MPI
+
+        if (!stats_file.isEmpty())
         {
-            std::cout << "Sending disconnect message to server program" << std::endl << std::flush;
-            int message_type = 1;
-            mpiError = MPI_Ssend(&message_type, 1, MPI_INT, 0, MPI_TAG_MESSAGE_QUIT, intercomm);
-            if (mpiError != MPI_SUCCESS)
+            PipelineLatency total = receiver->latency();
+            total.merge(latency);
+            if (total.writeFile(stats_file))
             {
-                std::cerr << "Failed to send disconnect message" << std::endl << std::flush;
+                std::cout << "Latency statistics written to " << stats_file.toStdString() << std::endl << std::flush;
             }
-
-            receivePendingMessages();
-
-            std::cout << "Disconnecting ..." << std::endl << std::flush;
-            mpiError = MPI_Comm_disconnect(&intercomm);
-            if (mpiError != MPI_SUCCESS)
+            else
             {
-                std::cerr << "Failed disconnect comm" << std::endl << std::flush;
+                std::cerr << "Failed to write latency statistics to " << stats_file.toStdString() << std::endl << std::flush;
             }
-            connected = 0;
-            std::cout << "Disconnected" << std::endl << std::flush;
-        }
-        std::cout << "Finalizing MPI ..." << std::endl << std::flush;
-        mpiError = MPI_Finalize();
-        if (mpiError != MPI_SUCCESS)
-        {
-            std::cerr << "Failed to finalize MPI" << std::endl << std::flush;
         }
-        std::cout << "MPI finalized" << std::endl << std::flush;
     }
+    delete replay;
     delete ui;
-    delete[] image_data;
 }
 
 /* ------------------------------------------------------------------------- */
 
-void MainWindow::receivePendingMessages()
+void MainWindow::parseArguments()
 {
-    if (request_image_data != MPI_REQUEST_NULL)
+    const QStringList arguments = QCoreApplication::arguments();
+
+    for (int i=1; i<arguments.size(); ++i)
     {
-        MPI_Cancel(&request_image_data);
-        MPI_Request_free(&request_image_data);
+        if (arguments.at(i) == "--threads" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const int threads = arguments.at(++i).toInt(&ok);
+            if (ok && threads >= 0)
+            {
+                colorize_threads = threads;
+            }
+            else
+            {
+                std::cerr << "Invalid thread count " << arguments.at(i).toStdString() << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--receives" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const int slots = arguments.at(++i).toInt(&ok);
+            if (ok && slots >= 2)
+            {
+                receive_slots = slots;
+            }
+            else
+            {
+                std::cerr << "Invalid number of receives " << arguments.at(i).toStdString() << ", need at least 2" << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--memory" && i+1 < arguments.size())
+        {
+            if (!frameMemoryFromString(arguments.at(++i).toStdString().c_str(), &receive_memory))
+            {
+                std::cerr << "Unknown memory " << arguments.at(i).toStdString() << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--stats" && i+1 < arguments.size())
+        {
+            stats_file = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--no-overlay")
+        {
+            show_overlay = false;
+        }
+        else if (arguments.at(i) == "--full-resolution")
+        {
+            request_views = false;
+        }
+        else if (arguments.at(i) == "--max-fps" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const double rate = arguments.at(++i).toDouble(&ok);
+            if (ok && rate > 0.0)
+            {
+                render_rate = rate;
+            }
+            else
+            {
+                std::cerr << "Invalid frame rate " << arguments.at(i).toStdString() << ", need a positive number" << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--opengl")
+        {
+            use_opengl = true;
+        }
+        else if (arguments.at(i) == "--auto-range")
+        {
+            auto_range = true;
+        }
+        else if (arguments.at(i) == "--clip" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const double percent = arguments.at(++i).toDouble(&ok);
+            if (ok && percent >= 0.0 && percent < 50.0)
+            {
+                auto_range = true;
+                clip_percent = percent;
+            }
+            else
+            {
+                std::cerr << "Invalid clip percentage " << arguments.at(i).toStdString() << ", need 0 <= p < 50" << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--service" && i+1 < arguments.size())
+        {
+            service_name = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--channels" && i+1 < arguments.size())
+        {
+            // comma separated list of the channels shown at the start
+            const QStringList channels = arguments.at(++i).split(',');
+            for (int j=0; j<channels.size(); ++j)
+            {
+                bool ok = false;
+                const int channel = channels.at(j).toInt(&ok);
+                if (ok && channel >= 0 && channel < FRAME_MAX_CHANNELS)
+                {
+                    shown_channels |= 1 << channel;
+                }
+                else
+                {
+                    std::cerr << "Invalid channel " << channels.at(j).toStdString() << ", need 0 <= c < " << FRAME_MAX_CHANNELS << std::endl << std::flush;
+                }
+            }
+        }
+        else if (arguments.at(i) == "--probe" && i+1 < arguments.size())
+        {
+            frame_probe probe;
+            if (probes.size() >= FRAME_MAX_PROBES)
+            {
+                std::cerr << "Ignoring probe " << arguments.at(++i).toStdString() << ", at most " << FRAME_MAX_PROBES << " probes" << std::endl << std::flush;
+            }
+            else if (parseProbe(arguments.at(++i), &probe))
+            {
+                probes.append(probe);
+                probe_names.append(arguments.at(i));
+            }
+            else
+            {
+                std::cerr << "Invalid probe " << arguments.at(i).toStdString() << ", need point:x,y, line:x0,y0,x1,y1 or rect:x0,y0,x1,y1, optionally followed by :channel" << std::endl << std::flush;
+            }
+        }
+        else if (arguments.at(i) == "--replay" && i+1 < arguments.size())
+        {
+            replay_file = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--replay-speed" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const double speed = arguments.at(++i).toDouble(&ok);
+            if (ok && speed > 0.0)
+            {
+                replay_speed = speed;
+            }
+            else
+            {
+                std::cerr << "Invalid replay speed " << arguments.at(i).toStdString() << ", need a positive number" << std::endl << std::flush;
+            }
+        }
+        else
+        {
+            std::cerr << "Ignoring unknown argument " << arguments.at(i).toStdString() << std::endl << std::flush;
+        }
     }
 }
 
@@ -137,192 +526,824 @@ void MainWindow::setupColorMapDemo(QCustomPlot *customPlot)
   // configure axis rect
   // this will also allow rescaling the color scale by dragging/zooming
   customPlot->setInteractions(QCP::iRangeDrag|QCP::iRangeZoom);
-  customPlot->axisRect()->setupFullAxesBox(true);
-  customPlot->xAxis->setLabel("x");
-  customPlot->yAxis->setLabel("y");
-
-  // set up the QCPColorMap:
-  QCPColorMap *colorMap = new QCPColorMap(customPlot->xAxis, customPlot->yAxis);
-  int nx = SIZE_X;
-  int ny = SIZE_Y;
-  // set the color map to have nx * ny data points
-  colorMap->data()->setSize(nx, ny);
-  // span the coordinate range -4..4 in both key (x) and value (y) dimensions
-  colorMap->data()->setRange(QCPRange(-4, 4), QCPRange(-4, 4));
-
-  // assign some data, by accessing the QCPColorMapData instance of the color map:
-  double x, y, z;
-  for (int xIndex=0; xIndex<nx; ++xIndex)
+  // a buffer of its own lets a new frame redraw the maps without the axes and the color scales:
+  customPlot->addLayer("map", customPlot->layer("main"), QCustomPlot::limBelow);
+  customPlot->layer("map")->setMode(QCPLayer::lmBuffered);
+  if (use_opengl)
+  {
+    // needs QCustomPlot compiled with OpenGL support (qmake CONFIG+=opengl)
+    customPlot->setOpenGl(true);
+  }
+  // make sure the axis rects and color scales synchronize their bottom and top margins (so they line up):
+  QCPMarginGroup *marginGroup = new QCPMarginGroup(customPlot);
+
+  int nx = handshake.width;
+  int ny = handshake.height;
+  const int numChannels = qMax(1, handshake.num_channels);
+  changed_cells.resize(numChannels);
+  for (int c=0; c<numChannels; ++c)
   {
-    for (int yIndex=0; yIndex<ny; ++yIndex)
+    // every channel gets an axis rect with a color scale to its right;
+    // the first one takes the axis rect the plot starts out with
+    QCPLayoutGrid *panel = new QCPLayoutGrid;
+    QCPAxisRect *axisRect = customPlot->axisRect();
+    if (c == 0)
+    {
+      customPlot->plotLayout()->take(axisRect);
+      customPlot->plotLayout()->simplify();
+      customPlot->plotLayout()->addElement(0, 0, panel);
+    }
+    else
     {
-      colorMap->data()->cellToCoord(xIndex, yIndex, &x, &y);
-      double r = 3*qSqrt(x*x+y*y)+1e-2;
-      z = 2*x*(qCos(r+2)/r-qSin(r+2)/r);
-      colorMap->data()->setCell(xIndex, yIndex, z);
+      axisRect = new QCPAxisRect(customPlot);
+      customPlot->plotLayout()->addElement(0, c, panel);
     }
+    panel->addElement(0, 0, axisRect);
+    axisRect->setupFullAxesBox(true);
+    axisRect->axis(QCPAxis::atBottom)->setLabel("x");
+    axisRect->axis(QCPAxis::atLeft)->setLabel("y");
+
+    // set up the QCPColorMap:
+    TimedColorMap *colorMap = new TimedColorMap(axisRect->axis(QCPAxis::atBottom), axisRect->axis(QCPAxis::atLeft));
+    // set the color map to have nx * ny data points
+    colorMap->data()->setSize(nx, ny);
+    // stored as the server sends them, e.g. 16 bit integers instead of doubles
+    colorMap->data()->setCellType(frameCellType(handshake.element_type), 1.0/handshake.scale);
+    // span the coordinate range -4..4 in both key (x) and value (y) dimensions
+    colorMap->data()->setRange(QCPRange(IMAGE_COORD_LOWER, IMAGE_COORD_UPPER), QCPRange(IMAGE_COORD_LOWER, IMAGE_COORD_UPPER));
+
+    // assign some data, by accessing the QCPColorMapData instance of the color map:
+    if (c == 0)
+    {
+      double x, y, z;
+      for (int xIndex=0; xIndex<nx; ++xIndex)
+      {
+        for (int yIndex=0; yIndex<ny; ++yIndex)
+        {
+          colorMap->data()->cellToCoord(xIndex, yIndex, &x, &y);
+          double r = 3*qSqrt(x*x+y*y)+1e-2;
+          z = 2*x*(qCos(r+2)/r-qSin(r+2)/r);
+          colorMap->data()->setCell(xIndex, yIndex, z);
+        }
+      }
+    }
+    colorMap->setInterpolate(false);
+    colorMap->setColorizeThreadCount(colorize_threads);
+    colorMap->setLayer("map");
+    colorMap->setOpenGlColorize(use_opengl);
+
+    // add a color scale:
+    QCPColorScale *colorScale = new QCPColorScale(customPlot);
+    // add it to the right of the axis rect
+    panel->addElement(0, 1, colorScale);
+    // scale shall be vertical bar with tick/axis labels right (actually atRight is already the default)
+    colorScale->setType(QCPAxis::atRight);
+    // associate the color map with the color scale
+    colorMap->setColorScale(colorScale);
+    colorScale->axis()->setLabel(numChannels > 1 ? QString::fromLatin1(handshake.channel_names[c]) :
+                                                   QString("Magnetic Field Strength"));
+
+    // set the color gradient of the color map to one of the presets:
+    colorMap->setGradient(QCPColorGradient::gpPolar);
+    // we could have also created a QCPColorGradient instance and added own colors to
+    // the gradient, see the documentation of QCPColorGradient for what's possible.
+
+    // rescale the data dimension (color) such that all data points
+    // lie in the span visualized by the color gradient:
+    colorMap->rescaleDataRange();
+
+    axisRect->setMarginGroup(QCP::msBottom|QCP::msTop, marginGroup);
+    colorScale->setMarginGroup(QCP::msBottom|QCP::msTop, marginGroup);
+
+    // all channels show the same region, dragging or zooming one moves the others
+    if (c > 0)
+    {
+      connect(customPlot->xAxis, SIGNAL(rangeChanged(QCPRange)), axisRect->axis(QCPAxis::atBottom), SLOT(setRange(QCPRange)));
+      connect(axisRect->axis(QCPAxis::atBottom), SIGNAL(rangeChanged(QCPRange)), customPlot->xAxis, SLOT(setRange(QCPRange)));
+      connect(customPlot->yAxis, SIGNAL(rangeChanged(QCPRange)), axisRect->axis(QCPAxis::atLeft), SLOT(setRange(QCPRange)));
+      connect(axisRect->axis(QCPAxis::atLeft), SIGNAL(rangeChanged(QCPRange)), customPlot->yAxis, SLOT(setRange(QCPRange)));
+    }
+
+    color_maps.append(colorMap);
+    channel_data.append(colorMap->data());
+    channel_panels.append(panel);
   }
-  colorMap->setInterpolate(false);
-
-  // add a color scale:
-  QCPColorScale *colorScale = new QCPColorScale(customPlot);
-  // add it to the right of the main axis rect
-  customPlot->plotLayout()->addElement(0, 1, colorScale);
-  // scale shall be vertical bar with tick/axis labels right (actually atRight is already the default)
-  colorScale->setType(QCPAxis::atRight);
-  // associate the color map with the color scale
-  colorMap->setColorScale(colorScale);
-  colorScale->axis()->setLabel("Magnetic Field Strength");
-
-  // set the color gradient of the color map to one of the presets:
-  colorMap->setGradient(QCPColorGradient::gpPolar);
-  // we could have also created a QCPColorGradient instance and added own colors to
-  // the gradient, see the documentation of QCPColorGradient for what's possible.
-
-  // rescale the data dimension (color) such that all data points
-  // lie in the span visualized by the color gradient:
-  colorMap->rescaleDataRange();
-
-  // make sure the axis rect and color scale synchronize their bottom and top margins (so they line up):
-  QCPMarginGroup *marginGroup = new QCPMarginGroup(customPlot);
-  customPlot->axisRect()->setMarginGroup(QCP::msBottom|QCP::msTop, marginGroup);
-  colorScale->setMarginGroup(QCP::msBottom|QCP::msTop, marginGroup);
 
   // rescale the key (x) and value (y) axes so the whole color map is visible:
   customPlot->rescaleAxes();
 
-  // setup a timer that repeatedly calls MainWindow::realtimeDataSlot
-  connect(&dataTimer, SIGNAL(timeout()), this, SLOT(realtimeDataSlot()));
-  dataTimer.start(5); // Interval 0 means to refresh as fast as possible
+  // the probes get an axis rect to the right of the channels, on a buffered
+  // layer of its own so that new samples do not redraw the maps:
+  if (!probes.isEmpty())
+  {
+    customPlot->addLayer("probes", customPlot->layer("overlay"), QCustomPlot::limBelow);
+    customPlot->layer("probes")->setMode(QCPLayer::lmBuffered);
+    probe_rect = new QCPAxisRect(customPlot);
+    probe_rect->setLayer("probes");
+    probe_rect->setRangeDrag(0);
+    probe_rect->setRangeZoom(0);
+    probe_rect->axis(QCPAxis::atBottom)->setLabel("t (s)");
+    probe_rect->axis(QCPAxis::atLeft)->setLabel("mean");
+    probe_rect->axis(QCPAxis::atBottom)->setRange(0.0, PROBE_PLOT_SECONDS);
+    for (int i=0; i<probe_rect->axes().size(); ++i)
+    {
+      probe_rect->axes().at(i)->setLayer("probes");
+      probe_rect->axes().at(i)->grid()->setLayer("probes");
+    }
+    probe_rect->setMarginGroup(QCP::msBottom|QCP::msTop, marginGroup);
+
+    QCPLegend *legend = new QCPLegend;
+    probe_rect->insetLayout()->addElement(legend, Qt::AlignTop|Qt::AlignRight);
+    legend->setLayer("probes");
+    legend->setBrush(QBrush(QColor(255, 255, 255, 200)));
+    for (int i=0; i<probes.size(); ++i)
+    {
+      QCPGraph *graph = customPlot->addGraph(probe_rect->axis(QCPAxis::atBottom), probe_rect->axis(QCPAxis::atLeft));
+      graph->setLayer("probes");
+      graph->setName(probe_names.at(i));
+      graph->setPen(QPen(QColor::fromHsv(360*i/probes.size(), 255, 200)));
+      graph->removeFromLegend(customPlot->legend);
+      graph->addToLegend(legend);
+      probe_graphs.append(graph);
+    }
+  }
+
+  // compact latency overlay in the top left corner of the axis rect:
+  if (show_overlay)
+  {
+    latency_overlay = new QCPItemText(customPlot);
+    latency_overlay->setLayer("overlay"); // buffered, updated without redrawing the map
+    latency_overlay->setClipToAxisRect(true);
+    latency_overlay->position->setType(QCPItemPosition::ptAxisRectRatio);
+    latency_overlay->position->setCoords(0.01, 0.01);
+    latency_overlay->setPositionAlignment(Qt::AlignLeft|Qt::AlignTop);
+    latency_overlay->setTextAlignment(Qt::AlignLeft);
+    QFont overlayFont("Monospace", 7);
+    overlayFont.setStyleHint(QFont::TypeWriter);
+    latency_overlay->setFont(overlayFont);
+    latency_overlay->setBrush(QBrush(QColor(255, 255, 255, 200)));
+    latency_overlay->setPadding(QMargins(3, 2, 3, 2));
+    latency_overlay->setText("waiting for frames");
+  }
+  layoutChannels();
 }
 
 /* ------------------------------------------------------------------------- */
 
-void MainWindow::realtimeDataSlot()
+// puts the panels of the channels shown side by side and hides the others;
+// the latency overlay sits in the first one
+void MainWindow::layoutChannels()
 {
-    static QTime time(QTime::currentTime());
-    double key = time.elapsed()/1000.0; // time elapsed since start of demo, in seconds
-    const int nx = SIZE_X;
-    const int ny = SIZE_Y;
-    static double maxvalue = -100000.;
-    static double minvalue =  100000.;
-    static int recvFrameCount=0;
-    static int totalRecvFrameCount=0;
-    static int skippedRecvFrame=0;
+    QCPLayoutGrid *plotLayout = ui->customPlot->plotLayout();
+    for (int c=0; c<channel_panels.size(); ++c)
+    {
+        if (channel_panels.at(c)->layout() == plotLayout)
+        {
+            plotLayout->take(channel_panels.at(c));
+        }
+    }
+    if (probe_rect && probe_rect->layout() == plotLayout)
+    {
+        plotLayout->take(probe_rect);
+    }
+    plotLayout->simplify();
 
-    int initialized = 1;
-    MPI_Initialized(&initialized);
+    int column = 0;
+    QCPAxisRect *firstRect = 0;
+    for (int c=0; c<channel_panels.size(); ++c)
+    {
+        const bool shown = (shown_channels & (1 << c)) != 0;
+        if (shown)
+        {
+            plotLayout->addElement(0, column++, channel_panels.at(c));
+            if (!firstRect)
+            {
+                firstRect = color_maps.at(c)->keyAxis()->axisRect();
+            }
+        }
+        // the maps are drawn by their layer, not by the layout
+        channel_panels.at(c)->setVisible(shown);
+        color_maps.at(c)->setVisible(shown);
+    }
+    if (latency_overlay && firstRect)
+    {
+        latency_overlay->setClipAxisRect(firstRect);
+        latency_overlay->position->setAxisRect(firstRect);
+    }
+    // the probe graph always comes last
+    if (probe_rect)
+    {
+        plotLayout->addElement(0, column, probe_rect);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
 
+// adds a switch per channel to the toolbar, named as in the handshake
+void MainWindow::setupChannels()
+{
+    QToolBar *toolBar = ui->mainToolBar;
+    for (int c=0; c<handshake.num_channels; ++c)
+    {
+        QAction *action = toolBar->addAction(QString::fromLatin1(handshake.channel_names[c]), this, SLOT(channelsChangedSlot()));
+        action->setCheckable(true);
+        action->setChecked((shown_channels & (1 << c)) != 0);
+        channel_actions.append(action);
+    }
+}
 
-    if (initialized && connected)
+/* ------------------------------------------------------------------------- */
+
+// a channel was switched on or off; at least one stays on
+void MainWindow::channelsChangedSlot()
+{
+    int channels = 0;
+    for (int c=0; c<channel_actions.size(); ++c)
     {
-        int flag = 0;
-        if (request_image_data != MPI_REQUEST_NULL)
+        if (channel_actions.at(c)->isChecked())
         {
-            MPI_Test(&request_image_data, &flag, MPI_STATUS_IGNORE);
+            channels |= 1 << c;
         }
+    }
+    if (channels == 0)
+    {
+        QAction *action = qobject_cast<QAction *>(sender());
+        if (action)
+        {
+            action->setChecked(true);
+        }
+        return;
+    }
+    shown_channels = channels;
+    layoutChannels();
+    ui->customPlot->replot();
+    viewChangedSlot();
+}
 
-        if (flag) // received image_data
+/* ------------------------------------------------------------------------- */
+
+// appends the probe samples received to the graphs and scrolls them to the
+// latest step; unless the value axis has to follow, only the layer of the
+// graphs is redrawn
+void MainWindow::probesReadySlot()
+{
+    if (!receiver->takeProbeSamples(&probe_samples))
+    {
+        return;
+    }
+
+    double latest = -1.0;
+    for (int i=0; i<probe_samples.size(); ++i)
+    {
+        const ProbeSample &sample = probe_samples.at(i);
+        if (sample.probe < probe_graphs.size())
         {
-            request_image_data = MPI_REQUEST_NULL;
-            ++recvFrameCount;
-            ++totalRecvFrameCount;
+            probe_graphs.at(sample.probe)->addData(sample.time, sample.stats.mean);
+            latest = qMax(latest, sample.time);
+        }
+    }
+    if (latest < 0.0)
+    {
+        return;
+    }
 
-            {
-                // get pointer to color map:
-                QCPColorMap *colorMap = qobject_cast<QCPColorMap *>(ui->customPlot->plottable());
-                QCPColorMapData *cmdata = colorMap->data();
-                for (int xIndex=0; xIndex<nx; ++xIndex)
-                {
-                    for (int yIndex=0; yIndex<ny; ++yIndex)
-                    {
-                        cmdata->setCell(xIndex, yIndex, image_data[xIndex+nx*yIndex]/IMAGE_DATA_SCALE);
+    QCPAxis *valueAxis = probe_rect->axis(QCPAxis::atLeft);
+    const QCPRange shownRange = valueAxis->range();
+    bool haveRange = false;
+    QCPRange dataRange;
+    for (int i=0; i<probe_graphs.size(); ++i)
+    {
+        probe_graphs.at(i)->data()->removeBefore(latest - PROBE_PLOT_SECONDS);
+        bool found = false;
+        const QCPRange range = probe_graphs.at(i)->getValueRange(found);
+        if (found)
+        {
+            dataRange = haveRange ? QCPRange(qMin(dataRange.lower, range.lower), qMax(dataRange.upper, range.upper)) : range;
+            haveRange = true;
+        }
+    }
+    probe_rect->axis(QCPAxis::atBottom)->setRange(qMax(0.0, latest - PROBE_PLOT_SECONDS), qMax(PROBE_PLOT_SECONDS, latest));
 
-                        if(image_data[xIndex+nx*yIndex] > maxvalue) maxvalue = image_data[xIndex+nx*yIndex];
-                        else if(image_data[xIndex+nx*yIndex] < minvalue) minvalue = image_data[xIndex+nx*yIndex];
-                    }
-                }
-            }
+    // the value axis follows once the data leaves it or fills less than half of it
+    if (haveRange && (dataRange.lower < shownRange.lower || dataRange.upper > shownRange.upper ||
+                      2.0*dataRange.size() < shownRange.size()))
+    {
+        const double margin = qMax(0.05*dataRange.size(), 1e-6);
+        valueAxis->setRange(dataRange.lower - margin, dataRange.upper + margin);
+        ui->customPlot->replot(QCustomPlot::rpQueuedRefresh); // the tick labels may take another width
+    }
+    else
+    {
+        probe_rect->layer()->replot();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the first frame after a pause is rendered right away, or once a refresh
+// interval has passed since the last one; from then on the render timer
+// polls the receiver for frames, which emits no signal meanwhile. Frames
+// arriving faster replace each other in the receiver
+void MainWindow::frameReadySlot()
+{
+    if (render_timer->isActive())
+    {
+        return;
+    }
+    receiver->startPolling();
+    idle_renders = 0;
+    render_timer->start();
+    if (pipelineClock()-last_render >= 1.0/render_rate)
+    {
+        renderSlot();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// fetches the latest frame and replots it; nothing in here allocates once
+// the buffers have the size of the frames, except for the painting by Qt
+void MainWindow::renderSlot()
+{
+    FrameTiming timing;
+    const double fetched = pipelineClock();
+    render_check.begin();
+    if (!receiver->exchangeFrame(channel_data.constData(), channel_data.size(), &timing, changed_cells.data()))
+    {
+        // the frames stopped, wait for frameReady again
+        if (++idle_renders >= RENDER_IDLE_SECONDS*render_rate && receiver->stopPolling())
+        {
+            render_timer->stop();
         }
+        return;
+    }
+    idle_renders = 0;
+    last_render = fetched;
+    latency.add(PipelineLatency::stHandover, fetched-timing.published);
 
-        MPI_Status status;
-        int messageAvailable = 0;
-        do
+    // the cells of a new view cover another region of the plot
+    const frame_view view = receiver->frameView();
+    const bool newView = view.id != displayed_view.id;
+    bool dataRangeChanged = false;
+    bool changed = false;
+    for (int c=0; c<color_maps.size(); ++c)
+    {
+        if (!(view.channels & (1 << c)))
         {
-            messageAvailable = 0;
-            if (MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, intercomm, &messageAvailable, &status) != MPI_SUCCESS)
-            {
-                std::cerr << "Error probing for MPI message!" << std::endl << std::flush;
-                MPI_Abort(intercomm, -11);
-            }
+            continue;
+        }
+        TimedColorMap *colorMap = color_maps.at(c);
+        if (newView)
+        {
+            colorMap->data()->setRange(cellRange(view.x, view.nx, view.level, handshake.width),
+                                       cellRange(view.y, view.ny, view.level, handshake.height));
+            colorMap->resetAllocationCheck();
+        }
 
-            if (messageAvailable)
-            {
-                if (status.MPI_TAG == MPI_TAG_IMAGE_DATA)
-                {
-                    if (request_image_data != MPI_REQUEST_NULL)
-                    {
-                        if(1)//(totalRecvFrameCount+skippedRecvFrame)%2==0)
-                        {
-                            ++skippedRecvFrame;
-                            MPI_Cancel(&request_image_data);
-                            MPI_Request_free(&request_image_data);
-                        }
-                        else
-                        {
-                            MPI_Wait(&request_image_data, &status);
-                        }
-                        request_image_data = MPI_REQUEST_NULL;
-                    }
-                    MPI_Irecv(image_data, SIZE_X*SIZE_Y, MPI_IMAGE_DATATYPE, 0, MPI_TAG_IMAGE_DATA, intercomm, &request_image_data);
-                }
-                else // if (status.MPI_TAG == MPI_TAG_MESSAGE_QUIT)
-                {
-                    int message = -1;
-                    MPI_Recv(&message, 1, MPI_INT, 0, MPI_TAG_MESSAGE_QUIT, intercomm, MPI_STATUS_IGNORE);
-                    {
-                        // close connections
-                        std::cout << "Received disconnect message from server program" << std::endl << std::flush;
-                        if (request_image_data != MPI_REQUEST_NULL)
-                        {
-                            std::cout << "Canceling request ..." << std::endl << std::flush;
-                            MPI_Cancel(&request_image_data);
-                            MPI_Request_free(&request_image_data);
-                        }
-                        std::cout << "Disconnecting ..." << std::endl << std::flush;
-                        MPI_Comm_disconnect(&intercomm);
-                        std::cout << "Disconnected" << std::endl << std::flush;
-                        connected = 0;
-                    }
-                }
-            }
-        } while(messageAvailable && connected);
+        // the data bounds come with the frame, following them costs no pass over the cells
+        const QVector<QRect> &changedCells = changed_cells.at(c);
+        if (auto_range && !changedCells.isEmpty())
+        {
+            const QCPRange dataRange = colorMap->dataRange();
+            colorMap->setDataRange(clip_percent > 0.0 ? clippedRange(colorMap->data(), clip_percent) :
+                                                        colorMap->data()->dataBounds());
+            dataRangeChanged |= colorMap->dataRange() != dataRange;
+        }
+
+        // with delta encoding a frame may not change anything
+        for (int i=0; i<changedCells.size(); ++i)
+        {
+            status_changed_cells += qint64(changedCells.at(i).width())*changedCells.at(i).height();
+        }
+        changed |= !changedCells.isEmpty();
+    }
+    if (newView)
+    {
+        displayed_view = view;
+        render_check.reset();
+    }
+    render_check.end();
+    if (!changed)
+    {
+        return;
     }
 
-    ui->customPlot->replot();
+    const double replotted = replotColorMaps(dataRangeChanged);
+    latency.add(PipelineLatency::stEndToEnd, replotted-timing.computeStart);
+    ++status_frames;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// shows the rates averaged since the last call; off the frame path, as
+// formatting the text and painting the status bar allocate
+void MainWindow::statusSlot()
+{
+    static double lastStatus = pipelineClock();
+    static int lastReceivedBlocks = 0;
+    static qint64 lastReceivedBytes = 0;
+    const double now = pipelineClock();
+    const double seconds = now-lastStatus;
+
+    if (status_frames > 0 && seconds > 0.0)
+    {
+        const int numBlocks = qMax(1, receiver->numBlocks());
+        const FrameStatistics stats = receiver->statistics();
+        // the bounds of the first channel received
+        int first = 0;
+        while (first < color_maps.size()-1 && !(displayed_view.channels & (1 << first)))
+        {
+            ++first;
+        }
+        const QCPRange dataBounds = color_maps.at(first)->data()->dataBounds();
+        const double cells = double(displayed_view.nx)*displayed_view.ny*qMax(1, frameChannelCount(displayed_view.channels));
+        const double changedPercent = 100.0*status_changed_cells/(status_frames*cells);
+        char status[256];
+        snprintf(status, sizeof(status),
+                 "%.0f FPS, %.0f rFPS, %.1f MB/s, changed %.0f%%, Total Data points: %d, Frame: %d, rFrames: %d, skipped %d, Min: %g, Max: %g, Blocks: %d",
+                 status_frames/seconds,
+                 (stats.receivedBlocks-lastReceivedBlocks)/seconds/numBlocks,
+                 (stats.receivedBytes-lastReceivedBytes)/seconds*1e-6,
+                 changedPercent,
+                 displayed_view.nx*displayed_view.ny,
+                 status_frames,
+                 stats.receivedBlocks/numBlocks,
+                 stats.skippedBlocks,
+                 dataBounds.lower,
+                 dataBounds.upper,
+                 numBlocks);
+        ui->statusBar->showMessage(QString::fromLatin1(status), 0);
+        lastReceivedBlocks = stats.receivedBlocks;
+        lastReceivedBytes = stats.receivedBytes;
+
+        updateLatencyOverlay();
+    }
+    lastStatus = now;
+    status_frames = 0;
+    status_changed_cells = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// redraws the plot after the cells of the color maps changed and records
+// the colorize and replot times; returns the pipelineClock when done
+double MainWindow::replotColorMaps(bool dataRangeChanged)
+{
+    // the color scales show the data ranges, otherwise only the maps changed
+    const double replotStart = pipelineClock();
+    if (dataRangeChanged)
+    {
+        ui->customPlot->replot(QCustomPlot::rpQueuedRefresh);
+    }
+    else
+    {
+        color_maps.at(0)->layer()->replot(); // all maps share the layer
+    }
+    const double replotted = pipelineClock();
+    double colorizeTime = -1.0;
+    for (int c=0; c<color_maps.size(); ++c)
+    {
+        const double t = color_maps.at(c)->takeColorizeTime();
+        if (t >= 0.0)
+        {
+            colorizeTime = qMax(0.0, colorizeTime) + t;
+        }
+    }
+    if (colorizeTime >= 0.0)
+    {
+        latency.add(PipelineLatency::stColorize, colorizeTime);
+    }
+    latency.add(PipelineLatency::stReplot, replotted-replotStart-qMax(0.0, colorizeTime));
+    return replotted;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// shows the latency percentiles since the start
+void MainWindow::updateLatencyOverlay()
+{
+    if (!latency_overlay)
+    {
+        return;
+    }
+
+    // a replay only measures the stages of the GUI thread
+    PipelineLatency total = receiver ? receiver->latency() : PipelineLatency();
+    total.merge(latency);
+    latency_overlay->setText(total.overlayText());
+    latency_overlay->layer()->replot();
+}
+
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::resizeEvent(QResizeEvent *event)
+{
+    QMainWindow::resizeEvent(event);
+    viewChangedSlot();
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the axes or the plot size changed, request a view once they settle
+void MainWindow::viewChangedSlot()
+{
+    if (view_timer)
+    {
+        view_timer->start();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// requests the visible region plus a margin, at the coarsest level that
+// still has a cell per pixel
+void MainWindow::requestViewSlot()
+{
+    if (!receiver)
+    {
+        return;
+    }
+
+    // the axes of all channels show the same region, measure the first one shown
+    int first = 0;
+    while (first < color_maps.size()-1 && !(shown_channels & (1 << first)))
+    {
+        ++first;
+    }
+    const QCPAxis *xAxis = color_maps.at(first)->keyAxis();
+    const QCPAxis *yAxis = color_maps.at(first)->valueAxis();
+    const QCPAxisRect *axisRect = xAxis->axisRect();
+    int x0, x1, y0, y1;
+    if (!request_views)
+    {
+        x0 = 0;
+        x1 = handshake.width-1;
+        y0 = 0;
+        y1 = handshake.height-1;
+    }
+    else if (!visibleElements(xAxis->range(), handshake.width, &x0, &x1) ||
+             !visibleElements(yAxis->range(), handshake.height, &y0, &y1))
+    {
+        return;
+    }
+
+    // elements per pixel along the axis showing them larger
+    const double density = qMin(double(x1-x0+1)/qMax(1, axisRect->width()),
+                                double(y1-y0+1)/qMax(1, axisRect->height()));
+    int level = 0;
+    while (request_views && level < handshake.max_level && (2 << level) <= density)
+    {
+        ++level;
+    }
 
-    // calculate frames per second:
-    static double lastFpsKey = 0;
-    static int frameCount = 0;
-    ++frameCount;
+    // a margin of a quarter of the visible region on every side keeps
+    // dragging from showing empty space right away
+    const int marginX = request_views ? (x1-x0+1)/4 : 0;
+    const int marginY = request_views ? (y1-y0+1)/4 : 0;
+    x0 = qMax(0, x0-marginX);
+    x1 = qMin(handshake.width-1, x1+marginX);
+    y0 = qMax(0, y0-marginY);
+    y1 = qMin(handshake.height-1, y1+marginY);
 
-    if (key-lastFpsKey > 2) // average fps over 2 seconds
+    frame_view view;
+    view.id = 0;
+    view.level = level;
+    view.x = x0 >> level;
+    view.y = y0 >> level;
+    view.nx = (x1 >> level) - view.x + 1;
+    view.ny = (y1 >> level) - view.y + 1;
+    view.channels = shown_channels;
+
+    if (view.level == requested_view.level && view.x == requested_view.x && view.y == requested_view.y &&
+        view.nx == requested_view.nx && view.ny == requested_view.ny && view.channels == requested_view.channels)
     {
-        ui->statusBar->showMessage(
-              QString("%1 FPS, %2 rFPS, Total Data points: %3, Frame: %4, rFrames: %5, skipped %6, Min: %7, Max: %8")
-              //.arg(port_name)
-              .arg(frameCount/(key-lastFpsKey), 0, 'f', 0)
-              .arg(recvFrameCount/(key-lastFpsKey), 0, 'f', 0)
-              .arg(nx*ny)
-              .arg(frameCount)
-              .arg(totalRecvFrameCount)
-              .arg(skippedRecvFrame)
-              .arg(minvalue)
-              .arg(maxvalue)
-              , 0);
-        lastFpsKey = key;
-        frameCount = 0;
-        recvFrameCount = 0;
+        return;
     }
+    requested_view = view;
+    receiver->requestView(view);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void TimedColorMap::updateMapImage()
+{
+    allocationCheck.begin();
+    const double start = pipelineClock();
+    QCPColorMap::updateMapImage();
+    colorizeTime = pipelineClock()-start;
+    allocationCheck.end();
 }
 
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::serverDisconnectedSlot()
+{
+    ui->statusBar->showMessage("Disconnected from server, waiting for it to return", 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::serverReconnectedSlot()
+{
+    render_check.reset(); // the frames may take another size
+    for (int c=0; c<color_maps.size(); ++c)
+    {
+        color_maps.at(c)->resetAllocationCheck();
+    }
+    // the time of the probes starts over with the new server
+    for (int i=0; i<probe_graphs.size(); ++i)
+    {
+        probe_graphs.at(i)->data()->clear();
+    }
+    if (probe_rect)
+    {
+        probe_rect->axis(QCPAxis::atBottom)->setRange(0.0, PROBE_PLOT_SECONDS);
+    }
+    ui->statusBar->showMessage("Reconnected to server", 2000);
+}
+
+/* ------------------------------------------------------------------------- */
+
+// adds the replay controls to the toolbar and starts playing
+void MainWindow::setupReplay()
+{
+    QToolBar *toolBar = ui->mainToolBar;
+
+    replay_play_action = toolBar->addAction("Pause", this, SLOT(playPauseSlot()));
+    replay_play_action->setShortcut(Qt::Key_Space);
+    QAction *stepBack = toolBar->addAction("<", this, SLOT(stepBackSlot()));
+    stepBack->setShortcut(Qt::Key_Left);
+    stepBack->setToolTip("Previous frame");
+    QAction *stepForward = toolBar->addAction(">", this, SLOT(stepForwardSlot()));
+    stepForward->setShortcut(Qt::Key_Right);
+    stepForward->setToolTip("Next frame");
+
+    replay_slider = new QSlider(Qt::Horizontal, toolBar);
+    replay_slider->setRange(0, replay->frameCount()-1);
+    replay_slider->setMinimumWidth(200);
+    toolBar->addWidget(replay_slider);
+    connect(replay_slider, SIGNAL(valueChanged(int)), this, SLOT(seekSlot(int)));
+
+    // the speed given on the command line is offered along with the presets
+    const double speeds[] = REPLAY_SPEEDS;
+    replay_speeds = new QComboBox(toolBar);
+    for (size_t i=0; i<sizeof(speeds)/sizeof(speeds[0]); ++i)
+    {
+        replay_speeds->addItem(QString("%1x").arg(speeds[i]), speeds[i]);
+    }
+    int speedIndex = replay_speeds->findData(replay_speed);
+    if (speedIndex < 0)
+    {
+        speedIndex = 0;
+        while (speedIndex < replay_speeds->count() && replay_speeds->itemData(speedIndex).toDouble() < replay_speed)
+        {
+            ++speedIndex;
+        }
+        replay_speeds->insertItem(speedIndex, QString("%1x").arg(replay_speed), replay_speed);
+    }
+    replay_speeds->setCurrentIndex(speedIndex);
+    toolBar->addWidget(replay_speeds);
+    connect(replay_speeds, SIGNAL(currentIndexChanged(int)), this, SLOT(replaySpeedSlot(int)));
+
+    replay_label = new QLabel(toolBar);
+    toolBar->addWidget(replay_label);
+
+    replay_timer = new QTimer(this);
+    replay_timer->setTimerType(Qt::PreciseTimer);
+    replay_timer->setInterval(qMax(1, qRound(1000.0/render_rate)));
+    connect(replay_timer, SIGNAL(timeout()), this, SLOT(replayTickSlot()));
+
+    setWindowTitle("QCustomPlot: " + demoName + " - " + QFileInfo(replay_file).fileName());
+    showReplayFrame(0);
+    setReplayPlaying(true);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::setReplayPlaying(bool playing)
+{
+    // playing at the end starts over
+    if (playing && replay_frame == replay->frameCount()-1)
+    {
+        replay_time = 0.0;
+        showReplayFrame(0);
+    }
+
+    replay_playing = playing;
+    replay_clock = pipelineClock();
+    replay_play_action->setText(playing ? "Pause" : "Play");
+    if (playing)
+    {
+        replay_timer->start();
+    }
+    else
+    {
+        replay_timer->stop();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// advances the position by the time since the last tick times the speed
+// and shows the frame recorded there, skipping the frames in between
+void MainWindow::replayTickSlot()
+{
+    const double now = pipelineClock();
+    replay_time += (now-replay_clock)*replay_speed;
+    replay_clock = now;
+
+    const bool atEnd = replay_time >= replay->duration();
+    if (atEnd)
+    {
+        replay_time = replay->duration();
+    }
+    showReplayFrame(replay->frameAt(replay_time));
+    if (atEnd)
+    {
+        setReplayPlaying(false);
+    }
+
+    if (now-replay_overlay_clock > 2.0)
+    {
+        replay_overlay_clock = now;
+        updateLatencyOverlay();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::playPauseSlot()
+{
+    setReplayPlaying(!replay_playing);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::stepBackSlot()
+{
+    setReplayPlaying(false);
+    replay_slider->setValue(qMax(0, replay_frame-1));
+}
+
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::stepForwardSlot()
+{
+    setReplayPlaying(false);
+    replay_slider->setValue(qMin(replay->frameCount()-1, replay_frame+1));
+}
+
+/* ------------------------------------------------------------------------- */
+
+// the slider was moved, playing continues from there
+void MainWindow::seekSlot(int frame)
+{
+    replay_time = replay->frameTime(frame);
+    replay_clock = pipelineClock();
+    showReplayFrame(frame);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void MainWindow::replaySpeedSlot(int index)
+{
+    replay_speed = replay_speeds->itemData(index).toDouble();
+}
+
+/* ------------------------------------------------------------------------- */
+
+// decodes the frame from the recording into the color map and replots
+void MainWindow::showReplayFrame(int frame)
+{
+    if (frame == replay_frame)
+    {
+        return;
+    }
+
+    TimedColorMap *colorMap = color_maps.at(0); // recordings hold the first channel
+    const double decodeStart = pipelineClock();
+    if (!replay->exchangeFrame(frame, colorMap->data()))
+    {
+        return;
+    }
+    latency.add(PipelineLatency::stDecode, pipelineClock()-decodeStart);
+    replay_frame = frame;
+
+    const QCPRange dataRange = colorMap->dataRange();
+    if (auto_range)
+    {
+        colorMap->setDataRange(clip_percent > 0.0 ? clippedRange(colorMap->data(), clip_percent) :
+                                                    colorMap->data()->dataBounds());
+    }
+    replotColorMaps(colorMap->dataRange() != dataRange);
+
+    // the slider follows without seeking again
+    const bool blocked = replay_slider->blockSignals(true);
+    replay_slider->setValue(frame);
+    replay_slider->blockSignals(blocked);
+    replay_label->setText(QString(" frame %1 / %2, %3 s / %4 s ")
+                          .arg(frame+1)
+                          .arg(replay->frameCount())
+                          .arg(replay->frameTime(frame), 0, 'f', 2)
+                          .arg(replay->duration(), 0, 'f', 2));
+}
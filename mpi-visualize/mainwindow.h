@@ -13,24 +13,68 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTimer>
-#include <mpi.h>
 #include "qcustomplot.h"
+#include "framereceiver.h"
+#include "framereplay.h"
 
-typedef short image_datatype;           // char // short // double
-#define IMAGE_DATA_SCALE 32767.0        // (127.) // (32767) // (1.0)
-#define MPI_IMAGE_DATATYPE MPI_SHORT    // MPI_SHORT // MPI_SHORT // MPI_DOUBLE
+class QSlider;
+class QComboBox;
+class QLabel;
 
-#define SIZE_X 512
-#define SIZE_Y 512
+// image size used until a server announces its own in the handshake
+#define DEFAULT_SIZE_X 512
+#define DEFAULT_SIZE_Y 512
 
-#define MPI_TAG_MESSAGE_QUIT 0
-#define MPI_TAG_IMAGE_DATA   1
+// plot coordinates of the centers of the first and the last element of the image
+#define IMAGE_COORD_LOWER -4.0
+#define IMAGE_COORD_UPPER  4.0
+
+// view requests wait this long for the axes to stop moving
+#define VIEW_REQUEST_DELAY_MS 100
+
+// render rate if the screen does not report its refresh rate
+#define DEFAULT_RENDER_RATE 60.0
+
+// the render timer keeps polling for frames until none arrived for this long
+#define RENDER_IDLE_SECONDS 0.5
+
+// frame rates and latencies are shown this often
+#define STATUS_INTERVAL_MS 2000
+
+// replay speeds offered, in recorded seconds per second (--replay)
+#define REPLAY_SPEEDS { 0.25, 1.0, 4.0, 16.0, 64.0, 256.0 }
+
+// cells sampled and histogram bins used to clip the color range (--clip)
+#define RANGE_SAMPLES 4096
+#define RANGE_BINS 256
+
+// the probe graph shows this many seconds of server time (--probe)
+#define PROBE_PLOT_SECONDS 10.0
 
 namespace Ui {
 class MainWindow;
 }
 
+// color map that measures how long converting the data into the image takes
+class TimedColorMap : public QCPColorMap
+{
+public:
+    TimedColorMap(QCPAxis *keyAxis, QCPAxis *valueAxis) :
+        QCPColorMap(keyAxis, valueAxis), colorizeTime(-1.0), allocationCheck("QCPColorMap::updateMapImage") {}
+
+    // seconds spent in the last updateMapImage, -1 if not called since the last reset
+    double takeColorizeTime() { const double t = colorizeTime; colorizeTime = -1.0; return t; }
+    // the map image takes another size, e.g. for a new view
+    void resetAllocationCheck() { allocationCheck.reset(); }
+
+protected:
+    virtual void updateMapImage() Q_DECL_OVERRIDE;
+
+private:
+    double colorizeTime;
+    AllocationCheck allocationCheck;        // debug builds: colorizing allocates nothing
+};
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -42,21 +86,87 @@ public:
     void setupColorMapDemo(QCustomPlot *customPlot);
 
 private slots:
-    void realtimeDataSlot();
+    void frameReadySlot();
+    void renderSlot();
+    void statusSlot();
+    void serverDisconnectedSlot();
+    void serverReconnectedSlot();
+    void viewChangedSlot();
+    void requestViewSlot();
+    void channelsChangedSlot();
+    void probesReadySlot();
+    void replayTickSlot();
+    void playPauseSlot();
+    void stepBackSlot();
+    void stepForwardSlot();
+    void seekSlot(int frame);
+    void replaySpeedSlot(int index);
+
+protected:
+    virtual void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
 
 private:
-    void receivePendingMessages();
+    void parseArguments();
+    void updateLatencyOverlay();
+    double replotColorMaps(bool dataRangeChanged);
+    void setupChannels();
+    void layoutChannels();
+    void setupReplay();
+    void setReplayPlaying(bool playing);
+    void showReplayFrame(int frame);
 
 private:
     Ui::MainWindow *ui;
     QString demoName;
-    QTimer dataTimer;
-    image_datatype *image_data;
-    MPI_Comm intercomm;
-    MPI_Request request_image_data;
-    QString port_name;
-    int connected;
-    int mpiError;
+    FrameReceiver *receiver;                    // 0 if there is no server port to connect to
+    frame_handshake handshake;                  // copy of the server's handshake, or defaults
+    QString service_name;                       // name the server published its port under
+    int colorize_threads;                       // QCPColorMap::setColorizeThreadCount, 0 = all cores
+    int receive_slots;                          // posted receives per server block
+    int receive_memory;                         // FRAME_MEMORY_* of the receive buffers
+    PipelineLatency latency;                    // stages measured on the GUI thread
+    QString stats_file;                         // latency histograms are written here on exit
+    bool show_overlay;
+    QCPItemText *latency_overlay;
+    QVector<TimedColorMap *> color_maps;        // one per channel of the image
+    QVector<QCPColorMapData *> channel_data;    // their data, as exchangeFrame takes it
+    QVector<QCPLayoutGrid *> channel_panels;    // axis rect and color scale of every channel
+    QVector<QAction *> channel_actions;         // toolbar: switch channels on and off, if there are several
+    int shown_channels;                         // bit mask of the channels shown and requested, 0 = all
+    QVector<QVector<QRect> > changed_cells;     // cells of the last frame that differ from the one before, per channel
+    QVector<frame_probe> probes;                // sampled by the server, plotted beside the color maps
+    QStringList probe_names;                    // as given on the command line
+    QCPAxisRect *probe_rect;                    // 0 without probes
+    QVector<QCPGraph *> probe_graphs;           // mean of every probe over time
+    QVector<ProbeSample> probe_samples;         // taken from the receiver, kept to reuse the memory
+    bool request_views;                         // fetch the visible region at screen resolution only
+    bool use_opengl;                            // paint with OpenGL and colorize the map on the GPU
+    bool auto_range;                            // the color scale follows the data of every frame
+    double clip_percent;                        // auto_range leaves out this share of cells at either end
+    QTimer *view_timer;
+    QTimer *render_timer;                       // polls for frames once per refresh interval while they arrive
+    double render_rate;                         // frames rendered per second at most, 0 = screen refresh rate
+    double last_render;                         // pipelineClock of the last rendered frame
+    int idle_renders;                           // render timeouts without a frame in a row
+    AllocationCheck render_check;               // debug builds: fetching a frame allocates nothing
+    QTimer *status_timer;                       // shows the frame rates and latencies
+    int status_frames;                          // frames rendered since the status was last shown
+    qint64 status_changed_cells;                // cells changed in these frames
+    frame_view requested_view;
+    frame_view displayed_view;                  // view of the frame in the color map
+    QString replay_file;                        // recording to replay instead of connecting to a server
+    FrameReplay *replay;                        // 0 unless a recording is replayed
+    double replay_speed;                        // recorded seconds replayed per second
+    double replay_time;                         // position in the recording, seconds since its first frame
+    double replay_clock;                        // pipelineClock when replay_time was last advanced
+    double replay_overlay_clock;                // pipelineClock when the overlay was last updated
+    int replay_frame;                           // frame in the color map, -1 before the first one
+    bool replay_playing;
+    QTimer *replay_timer;                       // advances the replay at the render rate
+    QAction *replay_play_action;
+    QSlider *replay_slider;
+    QComboBox *replay_speeds;
+    QLabel *replay_label;
 };
 
 #endif // MAINWINDOW_H
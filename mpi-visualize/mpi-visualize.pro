@@ -14,10 +14,41 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    qcustomplot.cpp
+    framereceiver.cpp \
+    framereplay.cpp \
+    pipelinelatency.cpp \
+    qcustomplot.cpp \
+    ../common/frame_memory.c
 
 HEADERS  += mainwindow.h \
-    qcustomplot.h
+    framereceiver.h \
+    framereplay.h \
+    framedecode.h \
+    pipelinelatency.h \
+    qcustomplot.h \
+    ../common/mpi_protocol.h \
+    ../common/frame_recording.h \
+    ../common/latency_histogram.h \
+    ../common/allocationcount.h \
+    ../common/frame_memory.h
+
+INCLUDEPATH += ../common
+
+include(../common/frame_codec.pri)
+
+# add CONFIG+=opengl to the qmake call to build QCustomPlot with OpenGL
+# support, which --opengl needs to colorize the map on the GPU
+opengl {
+    DEFINES += QCUSTOMPLOT_USE_OPENGL
+    win32: LIBS += -lopengl32
+}
+
+# debug builds count the heap allocations and warn when the frame path
+# still allocates once it has warmed up
+CONFIG(debug, debug|release) {
+    DEFINES += FRAME_ALLOCATION_CHECK
+    SOURCES += ../common/allocationcount.cpp
+}
 
 FORMS    += mainwindow.ui
 
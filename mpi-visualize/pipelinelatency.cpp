@@ -0,0 +1,104 @@
+/**************************************************************************//**
+ * @file pipelinelatency.cpp
+ * @brief Latency histograms of the frame pipeline
+ *
+ * This file implements the PipelineLatency class. The stages of the server
+ * are taken from the frame_header of the received blocks, the others are
+ * measured by the receiver thread and the main window.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <QElapsedTimer>
+#include <QFile>
+#include "pipelinelatency.h"
+
+namespace {
+
+struct PipelineClock
+{
+    PipelineClock() { timer.start(); }
+    QElapsedTimer timer;
+};
+
+Q_GLOBAL_STATIC(PipelineClock, pipelineClockInstance)
+
+const char *const stageNames[PipelineLatency::stageCount] =
+{
+    "compute", "gather", "encode", "queue", "network", "decompress", "decode", "handover", "colorize", "replot", "end_to_end"
+};
+
+} // namespace
+
+/* ------------------------------------------------------------------------- */
+
+double pipelineClock()
+{
+    return pipelineClockInstance()->timer.nsecsElapsed()*1e-9;
+}
+
+/* ------------------------------------------------------------------------- */
+
+PipelineLatency::PipelineLatency()
+{
+    reset();
+}
+
+/* ------------------------------------------------------------------------- */
+
+void PipelineLatency::merge(const PipelineLatency &other)
+{
+    for (int i=0; i<stageCount; ++i)
+    {
+        latencyHistogramMerge(&mHistograms[i], &other.mHistograms[i]);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void PipelineLatency::reset()
+{
+    for (int i=0; i<stageCount; ++i)
+    {
+        latencyHistogramReset(&mHistograms[i]);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+const char *PipelineLatency::stageName(Stage stage)
+{
+    return stageNames[stage];
+}
+
+/* ------------------------------------------------------------------------- */
+
+// one line per stage with samples: name, p50, p99 and max in milliseconds
+QString PipelineLatency::overlayText() const
+{
+    QString text("stage        p50     p99     max [ms]");
+    for (int i=0; i<stageCount; ++i)
+    {
+        const latency_histogram &h = mHistograms[i];
+        if (h.count == 0)
+        {
+            continue;
+        }
+        text += QString("\n%1 %2 %3 %4")
+                .arg(stageNames[i], -10)
+                .arg(1e3*latencyHistogramPercentile(&h, 0.50), 7, 'f', 2)
+                .arg(1e3*latencyHistogramPercentile(&h, 0.99), 7, 'f', 2)
+                .arg(1e3*h.max, 7, 'f', 2);
+    }
+    return text;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// CSV, or JSON if the file name ends with .json
+bool PipelineLatency::writeFile(const QString &fileName) const
+{
+    return latencyHistogramWriteFile(QFile::encodeName(fileName).constData(), stageNames, mHistograms, stageCount) != 0;
+}
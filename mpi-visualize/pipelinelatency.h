@@ -0,0 +1,57 @@
+/**************************************************************************//**
+ * @file pipelinelatency.h
+ * @brief Latency histograms of the frame pipeline
+ *
+ * This file contains the class declaration for the PipelineLatency class,
+ * which holds one latency histogram per stage a frame passes from the
+ * computation on the server until it is shown by the client.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#ifndef PIPELINELATENCY_H
+#define PIPELINELATENCY_H
+
+#include <QString>
+#include "latency_histogram.h"
+
+// monotonic time of the client in seconds, may be called from any thread
+double pipelineClock();
+
+class PipelineLatency
+{
+public:
+    enum Stage
+    {
+        stCompute,      // server: computing the block
+        stGather,       // server: gathering and assembling the image (gather mode)
+        stEncode,       // server: delta encoding and compression
+        stQueue,        // server: computed until the send was posted
+        stNetwork,      // send posted until the receive completed on the client
+        stDecompress,   // undoing the codec stage of a received message
+        stDecode,       // converting the received tiles into a frame
+        stHandover,     // frame published until fetched by the GUI thread
+        stColorize,     // QCPColorMap::updateMapImage
+        stReplot,       // QCustomPlot::replot without colorizing
+        stEndToEnd,     // computing started until the frame has been replotted
+        stageCount
+    };
+
+    PipelineLatency();
+
+    void add(Stage stage, double seconds) { latencyHistogramAdd(&mHistograms[stage], seconds); }
+    void merge(const PipelineLatency &other);
+    void reset();
+    const latency_histogram &histogram(Stage stage) const { return mHistograms[stage]; }
+
+    static const char *stageName(Stage stage);
+    QString overlayText() const;
+    bool writeFile(const QString &fileName) const;
+
+private:
+    latency_histogram mHistograms[stageCount];
+};
+
+#endif // PIPELINELATENCY_H
@@ -1181,7 +1181,7 @@ void QCPLayer::replot()
       mParentPlot->update();
     } else
       qDebug() << Q_FUNC_INFO << "no valid paint buffer associated with this layer";
-  } else if (mMode == lmLogical)
+  } else // logical layer, or the other buffers are invalidated and need redrawing as well
     mParentPlot->replot();
 }
 
@@ -15748,6 +15748,313 @@ void QCustomPlot::toPainter(QCPPainter *painter, int width, int height)
 /* including file 'src/colorgradient.cpp', size 25342                        */
 /* commit ce344b3f96a62e5f652585e55f1ae7c7883cd45b 2018-06-25 01:03:39 +0200 */
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////// QCPColorGradient SIMD kernels
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* SIMD implementations of the inner loops of QCPColorGradient::colorize. A kernel is picked once at
+   runtime depending on the instruction sets supported by the CPU (AVX2, SSE4.1 or NEON). Every
+   kernel performs exactly the same double/float operations in the same order as the scalar loops
+   in QCPColorGradient::colorize, so the results are identical bit for bit. The x86 kernels are
+   compiled with per-function target attributes, so no special compiler flags are required. In the
+   logarithmic case only the logarithm itself is evaluated per lane with qLn, everything else is
+   vectorized.
+*/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define QCP_COLORIZE_X86
+#  define QCP_TARGET(isa) __attribute__((target(isa)))
+#  include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define QCP_COLORIZE_X86
+#  define QCP_TARGET(isa)
+#  include <immintrin.h>
+#  include <intrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  define QCP_COLORIZE_NEON
+#  include <arm_neon.h>
+#endif
+
+namespace {
+
+struct QCPColorizeArgs
+{
+  const double *data;
+  const unsigned char *alpha; // 0 if there is no alpha map
+  QRgb *scanLine;
+  int n;
+  int dataIndexFactor;
+  const QRgb *colorBuffer;
+  int levelCount;
+  double lower;               // range.lower
+  double posToIndexFactor;    // linear: (levelCount-1)/range.size()
+  double logRange;            // logarithmic: qLn(range.upper/range.lower)
+  bool logarithmic;
+  bool periodic;
+};
+
+// returns the number of leading pixels that were colorized, the caller does the remainder
+typedef int (*QCPColorizeKernel)(const QCPColorizeArgs &args);
+
+#ifdef QCP_COLORIZE_X86
+
+QCP_TARGET("sse4.1")
+__m128d qcpColorizePositionSse41(const QCPColorizeArgs &args, const double *p)
+{
+  const int stride = args.dataIndexFactor;
+  __m128d pos = _mm_set_pd(p[stride], p[0]);
+  if (args.logarithmic)
+  {
+    double quotient[2];
+    _mm_storeu_pd(quotient, _mm_div_pd(pos, _mm_set1_pd(args.lower)));
+    pos = _mm_set_pd(qLn(quotient[1]), qLn(quotient[0]));
+    return _mm_mul_pd(_mm_div_pd(pos, _mm_set1_pd(args.logRange)), _mm_set1_pd(args.levelCount-1));
+  }
+  return _mm_mul_pd(_mm_sub_pd(pos, _mm_set1_pd(args.lower)), _mm_set1_pd(args.posToIndexFactor));
+}
+
+QCP_TARGET("sse4.1")
+__m128i qcpColorizePremultiplySse41(__m128i rgb, __m128i alpha)
+{
+  const __m128i byteMask = _mm_set1_epi32(0xff);
+  const __m128 alphaF = _mm_div_ps(_mm_cvtepi32_ps(alpha), _mm_set1_ps(255.0f));
+  const __m128i r = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgb, 16), byteMask)), alphaF));
+  const __m128i g = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgb, 8), byteMask)), alphaF));
+  const __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(rgb, byteMask)), alphaF));
+  const __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(rgb, 24)), alphaF));
+  const __m128i premultiplied = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(a, 24), _mm_slli_epi32(r, 16)),
+                                             _mm_or_si128(_mm_slli_epi32(g, 8), b));
+  return _mm_blendv_epi8(premultiplied, rgb, _mm_cmpeq_epi32(alpha, _mm_set1_epi32(255)));
+}
+
+QCP_TARGET("sse4.1")
+int qcpColorizeSse41(const QCPColorizeArgs &args)
+{
+  const int count = args.n & ~3;
+  const int stride = args.dataIndexFactor;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i levelCount = _mm_set1_epi32(args.levelCount);
+  const __m128i maxIndex = _mm_set1_epi32(args.levelCount-1);
+  const __m128d levelCountD = _mm_set1_pd(args.levelCount);
+  int indices[4];
+  for (int i=0; i<count; i+=4)
+  {
+    const __m128d posLow = qcpColorizePositionSse41(args, args.data+stride*i);
+    const __m128d posHigh = qcpColorizePositionSse41(args, args.data+stride*(i+2));
+    __m128i index = _mm_unpacklo_epi64(_mm_cvttpd_epi32(posLow), _mm_cvttpd_epi32(posHigh));
+    if (args.periodic)
+    {
+      // integer remainder like operator%, the quotient is exact in double precision
+      const __m128i quotient = _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(index), levelCountD)),
+                                                  _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(index, 8)), levelCountD)));
+      index = _mm_sub_epi32(index, _mm_mullo_epi32(quotient, levelCount));
+      index = _mm_add_epi32(index, _mm_and_si128(_mm_cmplt_epi32(index, zero), levelCount));
+    } else
+      index = _mm_min_epi32(_mm_max_epi32(index, zero), maxIndex);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), index);
+    __m128i rgb = _mm_set_epi32(args.colorBuffer[indices[3]], args.colorBuffer[indices[2]], args.colorBuffer[indices[1]], args.colorBuffer[indices[0]]);
+    if (args.alpha)
+    {
+      const unsigned char *a = args.alpha+stride*i;
+      rgb = qcpColorizePremultiplySse41(rgb, _mm_set_epi32(a[3*stride], a[2*stride], a[stride], a[0]));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(args.scanLine+i), rgb);
+  }
+  return count;
+}
+
+QCP_TARGET("avx2")
+__m256d qcpColorizePositionAvx2(const QCPColorizeArgs &args, const double *p)
+{
+  const int stride = args.dataIndexFactor;
+  __m256d pos = stride == 1 ? _mm256_loadu_pd(p) : _mm256_set_pd(p[3*stride], p[2*stride], p[stride], p[0]);
+  if (args.logarithmic)
+  {
+    double quotient[4];
+    _mm256_storeu_pd(quotient, _mm256_div_pd(pos, _mm256_set1_pd(args.lower)));
+    pos = _mm256_set_pd(qLn(quotient[3]), qLn(quotient[2]), qLn(quotient[1]), qLn(quotient[0]));
+    return _mm256_mul_pd(_mm256_div_pd(pos, _mm256_set1_pd(args.logRange)), _mm256_set1_pd(args.levelCount-1));
+  }
+  return _mm256_mul_pd(_mm256_sub_pd(pos, _mm256_set1_pd(args.lower)), _mm256_set1_pd(args.posToIndexFactor));
+}
+
+QCP_TARGET("avx2")
+__m256i qcpColorizePremultiplyAvx2(__m256i rgb, __m256i alpha)
+{
+  const __m256i byteMask = _mm256_set1_epi32(0xff);
+  const __m256 alphaF = _mm256_div_ps(_mm256_cvtepi32_ps(alpha), _mm256_set1_ps(255.0f));
+  const __m256i r = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(rgb, 16), byteMask)), alphaF));
+  const __m256i g = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(rgb, 8), byteMask)), alphaF));
+  const __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(rgb, byteMask)), alphaF));
+  const __m256i a = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(rgb, 24)), alphaF));
+  const __m256i premultiplied = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(a, 24), _mm256_slli_epi32(r, 16)),
+                                                _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+  return _mm256_blendv_epi8(premultiplied, rgb, _mm256_cmpeq_epi32(alpha, _mm256_set1_epi32(255)));
+}
+
+QCP_TARGET("avx2")
+int qcpColorizeAvx2(const QCPColorizeArgs &args)
+{
+  const int count = args.n & ~7;
+  const int stride = args.dataIndexFactor;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i levelCount = _mm256_set1_epi32(args.levelCount);
+  const __m256i maxIndex = _mm256_set1_epi32(args.levelCount-1);
+  const __m256d levelCountD = _mm256_set1_pd(args.levelCount);
+  for (int i=0; i<count; i+=8)
+  {
+    const __m256d posLow = qcpColorizePositionAvx2(args, args.data+stride*i);
+    const __m256d posHigh = qcpColorizePositionAvx2(args, args.data+stride*(i+4));
+    __m256i index = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(posLow)), _mm256_cvttpd_epi32(posHigh), 1);
+    if (args.periodic)
+    {
+      // integer remainder like operator%, the quotient is exact in double precision
+      const __m256i quotient = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(index)), levelCountD))),
+                                                       _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(index, 1)), levelCountD)), 1);
+      index = _mm256_sub_epi32(index, _mm256_mullo_epi32(quotient, levelCount));
+      index = _mm256_add_epi32(index, _mm256_and_si256(_mm256_cmpgt_epi32(zero, index), levelCount));
+    } else
+      index = _mm256_min_epi32(_mm256_max_epi32(index, zero), maxIndex);
+    __m256i rgb = _mm256_i32gather_epi32(reinterpret_cast<const int*>(args.colorBuffer), index, 4);
+    if (args.alpha)
+    {
+      const unsigned char *a = args.alpha+stride*i;
+      const __m256i alpha = stride == 1 ? _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a)))
+                                        : _mm256_set_epi32(a[7*stride], a[6*stride], a[5*stride], a[4*stride], a[3*stride], a[2*stride], a[stride], a[0]);
+      rgb = qcpColorizePremultiplyAvx2(rgb, alpha);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(args.scanLine+i), rgb);
+  }
+  return count;
+}
+
+#endif // QCP_COLORIZE_X86
+
+#ifdef QCP_COLORIZE_NEON
+
+float64x2_t qcpColorizePositionNeon(const QCPColorizeArgs &args, const double *p)
+{
+  const int stride = args.dataIndexFactor;
+  const double values[2] = { p[0], p[stride] };
+  float64x2_t pos = vld1q_f64(values);
+  if (args.logarithmic)
+  {
+    double quotient[2];
+    vst1q_f64(quotient, vdivq_f64(pos, vdupq_n_f64(args.lower)));
+    quotient[0] = qLn(quotient[0]);
+    quotient[1] = qLn(quotient[1]);
+    return vmulq_f64(vdivq_f64(vld1q_f64(quotient), vdupq_n_f64(args.logRange)), vdupq_n_f64(args.levelCount-1));
+  }
+  return vmulq_f64(vsubq_f64(pos, vdupq_n_f64(args.lower)), vdupq_n_f64(args.posToIndexFactor));
+}
+
+// same saturating conversion as the scalar double to int conversion on this architecture
+int32x4_t qcpColorizeTruncateNeon(float64x2_t low, float64x2_t high)
+{
+  return vcombine_s32(vqmovn_s64(vcvtq_s64_f64(low)), vqmovn_s64(vcvtq_s64_f64(high)));
+}
+
+uint32x4_t qcpColorizePremultiplyNeon(uint32x4_t rgb, uint32x4_t alpha)
+{
+  const uint32x4_t byteMask = vdupq_n_u32(0xff);
+  const float32x4_t alphaF = vdivq_f32(vcvtq_f32_u32(alpha), vdupq_n_f32(255.0f));
+  const uint32x4_t r = vreinterpretq_u32_s32(vcvtq_s32_f32(vmulq_f32(vcvtq_f32_u32(vandq_u32(vshrq_n_u32(rgb, 16), byteMask)), alphaF)));
+  const uint32x4_t g = vreinterpretq_u32_s32(vcvtq_s32_f32(vmulq_f32(vcvtq_f32_u32(vandq_u32(vshrq_n_u32(rgb, 8), byteMask)), alphaF)));
+  const uint32x4_t b = vreinterpretq_u32_s32(vcvtq_s32_f32(vmulq_f32(vcvtq_f32_u32(vandq_u32(rgb, byteMask)), alphaF)));
+  const uint32x4_t a = vreinterpretq_u32_s32(vcvtq_s32_f32(vmulq_f32(vcvtq_f32_u32(vshrq_n_u32(rgb, 24)), alphaF)));
+  const uint32x4_t premultiplied = vorrq_u32(vorrq_u32(vshlq_n_u32(a, 24), vshlq_n_u32(r, 16)), vorrq_u32(vshlq_n_u32(g, 8), b));
+  return vbslq_u32(vceqq_u32(alpha, vdupq_n_u32(255)), rgb, premultiplied);
+}
+
+int qcpColorizeNeon(const QCPColorizeArgs &args)
+{
+  const int count = args.n & ~3;
+  const int stride = args.dataIndexFactor;
+  const int32x4_t zero = vdupq_n_s32(0);
+  const int32x4_t levelCount = vdupq_n_s32(args.levelCount);
+  const int32x4_t maxIndex = vdupq_n_s32(args.levelCount-1);
+  const float64x2_t levelCountD = vdupq_n_f64(args.levelCount);
+  int indices[4];
+  QRgb colors[4];
+  for (int i=0; i<count; i+=4)
+  {
+    int32x4_t index = qcpColorizeTruncateNeon(qcpColorizePositionNeon(args, args.data+stride*i),
+                                              qcpColorizePositionNeon(args, args.data+stride*(i+2)));
+    if (args.periodic)
+    {
+      // integer remainder like operator%, the quotient is exact in double precision
+      const int32x4_t quotient = qcpColorizeTruncateNeon(vdivq_f64(vcvtq_f64_s64(vmovl_s32(vget_low_s32(index))), levelCountD),
+                                                         vdivq_f64(vcvtq_f64_s64(vmovl_s32(vget_high_s32(index))), levelCountD));
+      index = vsubq_s32(index, vmulq_s32(quotient, levelCount));
+      index = vaddq_s32(index, vandq_s32(vreinterpretq_s32_u32(vcltq_s32(index, zero)), levelCount));
+    } else
+      index = vminq_s32(vmaxq_s32(index, zero), maxIndex);
+    vst1q_s32(indices, index);
+    for (int k=0; k<4; ++k)
+      colors[k] = args.colorBuffer[indices[k]];
+    uint32x4_t rgb = vld1q_u32(colors);
+    if (args.alpha)
+    {
+      const unsigned char *a = args.alpha+stride*i;
+      const uint32_t alphas[4] = { a[0], a[stride], a[2*stride], a[3*stride] };
+      rgb = qcpColorizePremultiplyNeon(rgb, vld1q_u32(alphas));
+    }
+    vst1q_u32(args.scanLine+i, rgb);
+  }
+  return count;
+}
+
+#endif // QCP_COLORIZE_NEON
+
+QCPColorizeKernel qcpSelectColorizeKernel()
+{
+#if defined(QCP_COLORIZE_X86)
+  bool sse41 = false, avx2 = false;
+#  if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+  __cpuid(info, 1);
+  sse41 = (info[2] & (1<<19)) != 0;
+  const bool osUsesAvx = (info[2] & (1<<27)) && (info[2] & (1<<28)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, AVX, XMM/YMM state enabled
+  if (osUsesAvx && maxLeaf >= 7)
+  {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1<<5)) != 0;
+  }
+#  else
+  __builtin_cpu_init();
+  sse41 = __builtin_cpu_supports("sse4.1");
+  avx2 = __builtin_cpu_supports("avx2");
+#  endif
+  if (avx2)
+    return qcpColorizeAvx2;
+  if (sse41)
+    return qcpColorizeSse41;
+#elif defined(QCP_COLORIZE_NEON)
+  return qcpColorizeNeon;
+#endif
+  return 0;
+}
+
+QCPColorizeKernel qcpColorizeKernel()
+{
+  static const QCPColorizeKernel kernel = qcpSelectColorizeKernel();
+  return kernel;
+}
+
+/* Runs the best available SIMD kernel on the leading pixels and returns their number, so the
+   scalar loop only has to handle the remainder. Returns 0 if SIMD is unavailable or disabled. */
+int qcpColorizeSimd(const QCPColorizeArgs &args)
+{
+  const QCPColorizeKernel kernel = qcpColorizeKernel();
+  if (!kernel || !QCPColorGradient::simdEnabled() || args.levelCount < 2)
+    return 0;
+  return kernel(args);
+}
+
+} // anonymous namespace
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////// QCPColorGradient
@@ -15791,7 +16098,12 @@ QCPColorGradient::QCPColorGradient() :
   mLevelCount(350),
   mColorInterpolation(ciRGB),
   mPeriodic(false),
-  mColorBufferInvalidated(true)
+  mColorBufferInvalidated(true),
+  mCellColorBufferBits(0),
+  mCellColorBufferScale(1),
+  mCellColorBufferOffset(0),
+  mCellColorBufferLogarithmic(false),
+  mCellColorBufferPeriodic(false)
 {
   mColorBuffer.fill(qRgb(0, 0, 0), mLevelCount);
 }
@@ -15806,7 +16118,12 @@ QCPColorGradient::QCPColorGradient(GradientPreset preset) :
   mLevelCount(350),
   mColorInterpolation(ciRGB),
   mPeriodic(false),
-  mColorBufferInvalidated(true)
+  mColorBufferInvalidated(true),
+  mCellColorBufferBits(0),
+  mCellColorBufferScale(1),
+  mCellColorBufferOffset(0),
+  mCellColorBufferLogarithmic(false),
+  mCellColorBufferPeriodic(false)
 {
   mColorBuffer.fill(qRgb(0, 0, 0), mLevelCount);
   loadPreset(preset);
@@ -15940,12 +16257,17 @@ void QCPColorGradient::colorize(const double *data, const QCPRange &range, QRgb
   if (mColorBufferInvalidated)
     updateColorBuffer();
   
+  // the SIMD kernels colorize the leading pixels, the loops below handle the remainder
+  const QCPColorizeArgs simdArgs = {data, 0, scanLine, n, dataIndexFactor, mColorBuffer.constData(), mLevelCount, range.lower,
+                                    (mLevelCount-1)/range.size(), logarithmic ? qLn(range.upper/range.lower) : 0, logarithmic, mPeriodic};
+  const int simdCount = qcpColorizeSimd(simdArgs);
+  
   if (!logarithmic)
   {
     const double posToIndexFactor = (mLevelCount-1)/range.size();
     if (mPeriodic)
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
         int index = (int)((data[dataIndexFactor*i]-range.lower)*posToIndexFactor) % mLevelCount;
         if (index < 0)
@@ -15954,7 +16276,7 @@ void QCPColorGradient::colorize(const double *data, const QCPRange &range, QRgb
       }
     } else
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
         int index = (data[dataIndexFactor*i]-range.lower)*posToIndexFactor;
         if (index < 0)
@@ -15966,20 +16288,21 @@ void QCPColorGradient::colorize(const double *data, const QCPRange &range, QRgb
     }
   } else // logarithmic == true
   {
+    const double logRange = qLn(range.upper/range.lower); // only the logarithm of the data is taken per cell
     if (mPeriodic)
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
-        int index = (int)(qLn(data[dataIndexFactor*i]/range.lower)/qLn(range.upper/range.lower)*(mLevelCount-1)) % mLevelCount;
+        int index = (int)(qLn(data[dataIndexFactor*i]/range.lower)/logRange*(mLevelCount-1)) % mLevelCount;
         if (index < 0)
           index += mLevelCount;
         scanLine[i] = mColorBuffer.at(index);
       }
     } else
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
-        int index = qLn(data[dataIndexFactor*i]/range.lower)/qLn(range.upper/range.lower)*(mLevelCount-1);
+        int index = qLn(data[dataIndexFactor*i]/range.lower)/logRange*(mLevelCount-1);
         if (index < 0)
           index = 0;
         else if (index >= mLevelCount)
@@ -16019,12 +16342,17 @@ void QCPColorGradient::colorize(const double *data, const unsigned char *alpha,
   if (mColorBufferInvalidated)
     updateColorBuffer();
   
+  // the SIMD kernels colorize the leading pixels, the loops below handle the remainder
+  const QCPColorizeArgs simdArgs = {data, alpha, scanLine, n, dataIndexFactor, mColorBuffer.constData(), mLevelCount, range.lower,
+                                    (mLevelCount-1)/range.size(), logarithmic ? qLn(range.upper/range.lower) : 0, logarithmic, mPeriodic};
+  const int simdCount = qcpColorizeSimd(simdArgs);
+  
   if (!logarithmic)
   {
     const double posToIndexFactor = (mLevelCount-1)/range.size();
     if (mPeriodic)
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
         int index = (int)((data[dataIndexFactor*i]-range.lower)*posToIndexFactor) % mLevelCount;
         if (index < 0)
@@ -16041,7 +16369,7 @@ void QCPColorGradient::colorize(const double *data, const unsigned char *alpha,
       }
     } else
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
         int index = (data[dataIndexFactor*i]-range.lower)*posToIndexFactor;
         if (index < 0)
@@ -16061,11 +16389,12 @@ void QCPColorGradient::colorize(const double *data, const unsigned char *alpha,
     }
   } else // logarithmic == true
   {
+    const double logRange = qLn(range.upper/range.lower); // only the logarithm of the data is taken per cell
     if (mPeriodic)
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
-        int index = (int)(qLn(data[dataIndexFactor*i]/range.lower)/qLn(range.upper/range.lower)*(mLevelCount-1)) % mLevelCount;
+        int index = (int)(qLn(data[dataIndexFactor*i]/range.lower)/logRange*(mLevelCount-1)) % mLevelCount;
         if (index < 0)
           index += mLevelCount;
         if (alpha[dataIndexFactor*i] == 255)
@@ -16080,9 +16409,9 @@ void QCPColorGradient::colorize(const double *data, const unsigned char *alpha,
       }
     } else
     {
-      for (int i=0; i<n; ++i)
+      for (int i=simdCount; i<n; ++i)
       {
-        int index = qLn(data[dataIndexFactor*i]/range.lower)/qLn(range.upper/range.lower)*(mLevelCount-1);
+        int index = qLn(data[dataIndexFactor*i]/range.lower)/logRange*(mLevelCount-1);
         if (index < 0)
           index = 0;
         else if (index >= mLevelCount)
@@ -16101,6 +16430,93 @@ void QCPColorGradient::colorize(const double *data, const unsigned char *alpha,
   }
 }
 
+/*! \overload
+
+  Colorizes \a n elements of a float array like the double overloads, the value of an element
+  being <tt>data[i]*scale+offset</tt>. \a alpha may be 0 if there is no alpha map.
+  
+  The elements are converted in chunks that stay in the cache, so this takes the same SIMD
+  kernels as colorizing doubles.
+*/
+void QCPColorGradient::colorize(const float *data, const unsigned char *alpha, const QCPRange &range, double scale, double offset, QRgb *scanLine, int n, int dataIndexFactor, bool logarithmic)
+{
+  if (!data)
+  {
+    qDebug() << Q_FUNC_INFO << "null pointer given as data";
+    return;
+  }
+  if (!scanLine)
+  {
+    qDebug() << Q_FUNC_INFO << "null pointer given as scanLine";
+    return;
+  }
+  
+  const int chunkSize = 256;
+  double values[chunkSize];
+  unsigned char alphas[chunkSize];
+  for (int begin=0; begin<n; begin+=chunkSize)
+  {
+    const int count = qMin(chunkSize, n-begin);
+    const float *chunk = data+begin*dataIndexFactor;
+    for (int i=0; i<count; ++i)
+      values[i] = chunk[i*dataIndexFactor]*scale+offset;
+    if (alpha)
+    {
+      const unsigned char *alphaChunk = alpha+begin*dataIndexFactor;
+      for (int i=0; i<count; ++i)
+        alphas[i] = alphaChunk[i*dataIndexFactor];
+      colorize(values, alphas, range, scanLine+begin, count, 1, logarithmic);
+    } else
+      colorize(values, range, scanLine+begin, count, 1, logarithmic);
+  }
+}
+
+/*! \overload
+
+  Colorizes \a n elements of an array of 16 bit integers, the value of an element being
+  <tt>data[i]*scale+offset</tt>. \a alpha may be 0 if there is no alpha map.
+  
+  The colors of all 65536 possible elements are computed once for \a range, \a scale, \a offset
+  and \a logarithmic, so colorizing an element only takes a table lookup, also with a logarithmic
+  scale. The table is built anew whenever one of them, the levels or the color stops change.
+*/
+void QCPColorGradient::colorize(const qint16 *data, const unsigned char *alpha, const QCPRange &range, double scale, double offset, QRgb *scanLine, int n, int dataIndexFactor, bool logarithmic)
+{
+  if (!data)
+  {
+    qDebug() << Q_FUNC_INFO << "null pointer given as data";
+    return;
+  }
+  if (!scanLine)
+  {
+    qDebug() << Q_FUNC_INFO << "null pointer given as scanLine";
+    return;
+  }
+  updateCellColorBuffer(16, range, scale, offset, logarithmic);
+  colorizeCells(data, alpha, mCellColorBuffer.constData()+32768, scanLine, n, dataIndexFactor);
+}
+
+/*! \overload
+
+  Colorizes \a n elements of an array of 8 bit integers with a table of the colors of all 256
+  possible elements, like the overload for 16 bit integers.
+*/
+void QCPColorGradient::colorize(const qint8 *data, const unsigned char *alpha, const QCPRange &range, double scale, double offset, QRgb *scanLine, int n, int dataIndexFactor, bool logarithmic)
+{
+  if (!data)
+  {
+    qDebug() << Q_FUNC_INFO << "null pointer given as data";
+    return;
+  }
+  if (!scanLine)
+  {
+    qDebug() << Q_FUNC_INFO << "null pointer given as scanLine";
+    return;
+  }
+  updateCellColorBuffer(8, range, scale, offset, logarithmic);
+  colorizeCells(data, alpha, mCellColorBuffer.constData()+128, scanLine, n, dataIndexFactor);
+}
+
 /*! \internal
 
   This method is used to colorize a single data value given in \a position, to colors. The data
@@ -16275,6 +16691,41 @@ QCPColorGradient QCPColorGradient::inverted() const
   return result;
 }
 
+bool QCPColorGradient::mSimdEnabled = true;
+
+/*!
+  Sets whether \ref colorize may use the SIMD kernels for the instruction set reported by \ref
+  simdInstructionSet. This setting is global for all color gradients and enabled by default. The
+  output of \ref colorize is identical either way, so disabling is only useful for comparing the
+  performance with the scalar implementation.
+*/
+void QCPColorGradient::setSimdEnabled(bool enabled)
+{
+  mSimdEnabled = enabled;
+}
+
+/*!
+  Returns the name of the SIMD instruction set that \ref colorize uses on this CPU ("AVX2",
+  "SSE4.1" or "NEON"), or "none" if only the scalar implementation is available.
+
+  \see setSimdEnabled
+*/
+QString QCPColorGradient::simdInstructionSet()
+{
+  const QCPColorizeKernel kernel = qcpColorizeKernel();
+#if defined(QCP_COLORIZE_X86)
+  if (kernel == qcpColorizeAvx2)
+    return QLatin1String("AVX2");
+  if (kernel == qcpColorizeSse41)
+    return QLatin1String("SSE4.1");
+#elif defined(QCP_COLORIZE_NEON)
+  if (kernel == qcpColorizeNeon)
+    return QLatin1String("NEON");
+#endif
+  Q_UNUSED(kernel)
+  return QLatin1String("none");
+}
+
 /*! \internal
   
   Returns true if the color gradient uses transparency, i.e. if any of the configured color stops
@@ -16393,6 +16844,75 @@ void QCPColorGradient::updateColorBuffer()
     mColorBuffer.fill(qRgb(0, 0, 0));
   }
   mColorBufferInvalidated = false;
+  mCellColorBufferBits = 0; // the element colors are taken from the levels
+}
+
+/*! \internal
+
+  Fills the table of the colors of all elements of a \a bits wide signed integer type for
+  colorizing cells that map to values as <tt>element*scale+offset</tt>, unless it is up to date
+  already. Element \c e has its color at index <tt>e+2^(bits-1)</tt>. The values are colorized
+  with \ref colorize, so an element gets exactly the color its value would get as a double.
+  
+  QCPColorMap calls this before colorizing in several threads, which then only read the table.
+*/
+void QCPColorGradient::updateCellColorBuffer(int bits, const QCPRange &range, double scale, double offset, bool logarithmic)
+{
+  if (mColorBufferInvalidated)
+    updateColorBuffer();
+  if (bits == mCellColorBufferBits && range == mCellColorBufferRange && scale == mCellColorBufferScale &&
+      offset == mCellColorBufferOffset && logarithmic == mCellColorBufferLogarithmic && mPeriodic == mCellColorBufferPeriodic)
+    return;
+  
+  // the values of the elements are colorized like cells of doubles, in chunks:
+  const int count = 1 << bits;
+  const int lowest = -count/2;
+  mCellColorBuffer.resize(count);
+  QRgb *colors = mCellColorBuffer.data();
+  const int chunkSize = 256;
+  double values[chunkSize];
+  for (int begin=0; begin<count; begin+=chunkSize)
+  {
+    const int chunkCount = qMin(chunkSize, count-begin);
+    for (int i=0; i<chunkCount; ++i)
+      values[i] = (lowest+begin+i)*scale+offset;
+    colorize(values, range, colors+begin, chunkCount, 1, logarithmic);
+  }
+  mCellColorBufferBits = bits;
+  mCellColorBufferRange = range;
+  mCellColorBufferScale = scale;
+  mCellColorBufferOffset = offset;
+  mCellColorBufferLogarithmic = logarithmic;
+  mCellColorBufferPeriodic = mPeriodic;
+}
+
+/*! \internal
+
+  Colorizes \a n integer elements of \a data with the color table \a colors, which is indexed by
+  the element, and applies \a alpha if it isn't 0.
+*/
+template <class T>
+void QCPColorGradient::colorizeCells(const T *data, const unsigned char *alpha, const QRgb *colors, QRgb *scanLine, int n, int dataIndexFactor)
+{
+  if (!alpha)
+  {
+    for (int i=0; i<n; ++i)
+      scanLine[i] = colors[data[dataIndexFactor*i]];
+  } else
+  {
+    for (int i=0; i<n; ++i)
+    {
+      const QRgb rgb = colors[data[dataIndexFactor*i]];
+      if (alpha[dataIndexFactor*i] == 255)
+      {
+        scanLine[i] = rgb;
+      } else
+      {
+        const float alphaF = alpha[dataIndexFactor*i]/255.0f;
+        scanLine[i] = qRgba(qRed(rgb)*alphaF, qGreen(rgb)*alphaF, qBlue(rgb)*alphaF, qAlpha(rgb)*alphaF);
+      }
+    }
+  }
 }
 /* end of 'src/colorgradient.cpp' */
 
@@ -24997,6 +25517,25 @@ QVector<QLineF> QCPStatisticalBox::getWhiskerBarLines(QCPStatisticalBoxDataConta
 /* including file 'src/plottables/plottable-colormap.cpp', size 47881        */
 /* commit ce344b3f96a62e5f652585e55f1ae7c7883cd45b 2018-06-25 01:03:39 +0200 */
 
+namespace {
+
+/* Returns the minimum and maximum of the count elements in cells via lower and upper. */
+template <class C>
+void qcpCellBounds(const C *cells, int count, double *lower, double *upper)
+{
+  C minCell = cells[0];
+  C maxCell = cells[0];
+  for (int i=1; i<count; ++i)
+  {
+    minCell = cells[i] < minCell ? cells[i] : minCell;
+    maxCell = cells[i] > maxCell ? cells[i] : maxCell;
+  }
+  *lower = minCell;
+  *upper = maxCell;
+}
+
+} // anonymous namespace
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////// QCPColorMapData
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -25032,6 +25571,18 @@ QVector<QLineF> QCPStatisticalBox::getWhiskerBarLines(QCPStatisticalBoxDataConta
   true current minimum and maximum. The method QCPColorMap::rescaleDataRange offers a convenience
   parameter \a recalculateDataBounds which may be set to true to automatically call \ref
   recalculateDataBounds internally.
+  
+  The cells changed since the color map was last drawn are tracked as a list of rectangles: \ref
+  setCell, \ref setData and \ref setAlpha mark a single cell, \ref setCells marks its region and
+  an overload of \ref swapRawData marks the cells passed with it. QCPColorMap then colorizes only
+  these cells instead of the whole map, as long as nothing else (e.g. the data range or the
+  gradient) changed. All other modifications mark the whole map.
+  
+  The cells are stored as doubles by default. Data that is produced with less precision, e.g. as
+  16 bit integers, can be stored as it is with \ref setCellType, along with a scale and an offset
+  that turn the elements into values. This takes a fraction of the memory, and QCPColorMap
+  colorizes integer elements with a table that holds the color of every possible element, so the
+  values are never computed. \ref swapRawCells exchanges arrays of any cell type.
 */
 
 /* start of documentation of inline functions */
@@ -25042,6 +25593,58 @@ QVector<QLineF> QCPStatisticalBox::getWhiskerBarLines(QCPStatisticalBoxDataConta
   one of the dimensions is 0 (see \ref setSize).
 */
 
+/*! \fn void QCPColorMapData::setDataBounds(const QCPRange &bounds)
+  
+  Sets the buffered minimum and maximum data values to \a bounds without going through the data.
+  This is useful if the range of the data is known anyway, e.g. because the producer of the data
+  tracked it, and saves the pass over all cells of \ref recalculateDataBounds. The caller is
+  responsible for \a bounds actually containing the data, QCPColorMap::rescaleDataRange uses them
+  as they are.
+  
+  \see dataBounds
+*/
+
+/*! \fn const double *QCPColorMapData::rawData() const
+  
+  Returns a pointer to the internal data array. The cell with indices \a keyIndex and \a
+  valueIndex is stored at <tt>valueIndex*keySize()+keyIndex</tt>.
+  
+  Returns 0 if the cells are not stored as doubles (see \ref setCellType), use \ref rawCells then.
+  
+  \see setCells, swapRawData
+*/
+
+/*! \fn const void *QCPColorMapData::rawCells() const
+  
+  Returns a pointer to the internal array of elements of the \ref cellType, in the same order as
+  \ref rawData.
+  
+  \see swapRawCells
+*/
+
+/*! \fn CellType QCPColorMapData::cellType() const
+  
+  Returns the type the cells are stored as.
+  
+  \see setCellType, cellScale, cellOffset
+*/
+
+/*! \fn double QCPColorMapData::cellScale() const
+  
+  Returns the factor the elements are multiplied with to get the values of the cells. Always 1 for
+  \ref ctDouble.
+  
+  \see setCellType
+*/
+
+/*! \fn double QCPColorMapData::cellOffset() const
+  
+  Returns the offset added to the scaled elements to get the values of the cells. Always 0 for
+  \ref ctDouble.
+  
+  \see setCellType
+*/
+
 /* end of documentation of inline functions */
 
 /*!
@@ -25057,7 +25660,10 @@ QCPColorMapData::QCPColorMapData(int keySize, int valueSize, const QCPRange &key
   mKeyRange(keyRange),
   mValueRange(valueRange),
   mIsEmpty(true),
-  mData(0),
+  mCellType(ctDouble),
+  mCellScale(1),
+  mCellOffset(0),
+  mCells(0),
   mAlpha(0),
   mDataModified(true)
 {
@@ -25067,8 +25673,7 @@ QCPColorMapData::QCPColorMapData(int keySize, int valueSize, const QCPRange &key
 
 QCPColorMapData::~QCPColorMapData()
 {
-  if (mData)
-    delete[] mData;
+  freeCells(mCellType, mCells);
   if (mAlpha)
     delete[] mAlpha;
 }
@@ -25080,7 +25685,10 @@ QCPColorMapData::QCPColorMapData(const QCPColorMapData &other) :
   mKeySize(0),
   mValueSize(0),
   mIsEmpty(true),
-  mData(0),
+  mCellType(ctDouble),
+  mCellScale(1),
+  mCellOffset(0),
+  mCells(0),
   mAlpha(0),
   mDataModified(true)
 {
@@ -25088,8 +25696,8 @@ QCPColorMapData::QCPColorMapData(const QCPColorMapData &other) :
 }
 
 /*!
-  Overwrites this color map data instance with the data stored in \a other. The alpha map state is
-  transferred, too.
+  Overwrites this color map data instance with the data stored in \a other. The alpha map state
+  and the cell type are transferred, too.
 */
 QCPColorMapData &QCPColorMapData::operator=(const QCPColorMapData &other)
 {
@@ -25099,18 +25707,29 @@ QCPColorMapData &QCPColorMapData::operator=(const QCPColorMapData &other)
     const int valueSize = other.valueSize();
     if (!other.mAlpha && mAlpha)
       clearAlpha();
+    if (other.mCellType != mCellType) // the cells are reallocated by setSize below
+    {
+      freeCells(mCellType, mCells);
+      mCells = 0;
+      mKeySize = 0;
+      mValueSize = 0;
+      mIsEmpty = true;
+      mCellType = other.mCellType;
+    }
+    mCellScale = other.mCellScale;
+    mCellOffset = other.mCellOffset;
     setSize(keySize, valueSize);
     if (other.mAlpha && !mAlpha)
       createAlpha(false);
     setRange(other.keyRange(), other.valueRange());
     if (!isEmpty())
     {
-      memcpy(mData, other.mData, sizeof(mData[0])*keySize*valueSize);
+      memcpy(mCells, other.mCells, size_t(cellTypeSize(mCellType))*keySize*valueSize);
       if (mAlpha)
         memcpy(mAlpha, other.mAlpha, sizeof(mAlpha[0])*keySize*valueSize);
     }
     mDataBounds = other.mDataBounds;
-    mDataModified = true;
+    setAllModified();
   }
   return *this;
 }
@@ -25121,7 +25740,7 @@ double QCPColorMapData::data(double key, double value)
   int keyCell = (key-mKeyRange.lower)/(mKeyRange.upper-mKeyRange.lower)*(mKeySize-1)+0.5;
   int valueCell = (value-mValueRange.lower)/(mValueRange.upper-mValueRange.lower)*(mValueSize-1)+0.5;
   if (keyCell >= 0 && keyCell < mKeySize && valueCell >= 0 && valueCell < mValueSize)
-    return mData[valueCell*mKeySize + keyCell];
+    return cellValue(valueCell*mKeySize + keyCell);
   else
     return 0;
 }
@@ -25130,7 +25749,7 @@ double QCPColorMapData::data(double key, double value)
 double QCPColorMapData::cell(int keyIndex, int valueIndex)
 {
   if (keyIndex >= 0 && keyIndex < mKeySize && valueIndex >= 0 && valueIndex < mValueSize)
-    return mData[valueIndex*mKeySize + keyIndex];
+    return cellValue(valueIndex*mKeySize + keyIndex);
   else
     return 0;
 }
@@ -25169,29 +25788,22 @@ void QCPColorMapData::setSize(int keySize, int valueSize)
   {
     mKeySize = keySize;
     mValueSize = valueSize;
-    if (mData)
-      delete[] mData;
+    freeCells(mCellType, mCells);
     mIsEmpty = mKeySize == 0 || mValueSize == 0;
     if (!mIsEmpty)
     {
-#ifdef __EXCEPTIONS
-      try { // 2D arrays get memory intensive fast. So if the allocation fails, at least output debug message
-#endif
-      mData = new double[mKeySize*mValueSize];
-#ifdef __EXCEPTIONS
-      } catch (...) { mData = 0; }
-#endif
-      if (mData)
+      mCells = allocateCells(mCellType, mKeySize*mValueSize);
+      if (mCells)
         fill(0);
       else
         qDebug() << Q_FUNC_INFO << "out of memory for data dimensions "<< mKeySize << "*" << mValueSize;
     } else
-      mData = 0;
+      mCells = 0;
     
     if (mAlpha) // if we had an alpha map, recreate it with new size
       createAlpha();
     
-    mDataModified = true;
+    setAllModified();
   }
 }
 
@@ -25271,6 +25883,59 @@ void QCPColorMapData::setValueRange(const QCPRange &valueRange)
   mValueRange = valueRange;
 }
 
+/*!
+  Sets the type the cells are stored as to \a type. The value of a cell is then its element times
+  \a scale plus \a offset; values that are set are transformed the other way and, for the integer
+  types, rounded to the nearest element and saturated. \a scale and \a offset are ignored for \ref
+  ctDouble.
+  
+  Storing the data with the precision it was produced with saves memory and memory bandwidth: a
+  map of 16 bit integers takes a quarter of the memory of one of doubles. If for example the data
+  are 16 bit integers that represent values between -1 and 1, set the cell type with
+  <tt>setCellType(ctInt16, 1.0/32767.0)</tt> and copy the elements in with \ref swapRawCells.
+  
+  The current cells are converted to the new type, which loses precision if it has fewer bits.
+  The data bounds are recalculated.
+  
+  \see cellType, rawCells
+*/
+void QCPColorMapData::setCellType(CellType type, double scale, double offset)
+{
+  if (type == ctDouble)
+  {
+    scale = 1;
+    offset = 0;
+  }
+  if (scale == 0)
+  {
+    qDebug() << Q_FUNC_INFO << "scale must not be zero";
+    return;
+  }
+  if (type == mCellType && scale == mCellScale && offset == mCellOffset)
+    return;
+  
+  void *cells = 0;
+  if (!isEmpty())
+  {
+    const int dataCount = mValueSize*mKeySize;
+    cells = allocateCells(type, dataCount);
+    if (!cells)
+    {
+      qDebug() << Q_FUNC_INFO << "out of memory for data dimensions "<< mKeySize << "*" << mValueSize;
+      return;
+    }
+    for (int i=0; i<dataCount; ++i)
+      setElement(type, cells, i, (cellValue(i)-offset)/scale);
+  }
+  freeCells(mCellType, mCells);
+  mCells = cells;
+  mCellType = type;
+  mCellScale = scale;
+  mCellOffset = offset;
+  recalculateDataBounds();
+  setAllModified();
+}
+
 /*!
   Sets the data of the cell, which lies at the plot coordinates given by \a key and \a value, to \a
   z.
@@ -25289,12 +25954,13 @@ void QCPColorMapData::setData(double key, double value, double z)
   int valueCell = (value-mValueRange.lower)/(mValueRange.upper-mValueRange.lower)*(mValueSize-1)+0.5;
   if (keyCell >= 0 && keyCell < mKeySize && valueCell >= 0 && valueCell < mValueSize)
   {
-    mData[valueCell*mKeySize + keyCell] = z;
+    setCellValue(valueCell*mKeySize + keyCell, z);
+    z = cellValue(valueCell*mKeySize + keyCell); // as stored, e.g. rounded to an integer element
     if (z < mDataBounds.lower)
       mDataBounds.lower = z;
     if (z > mDataBounds.upper)
       mDataBounds.upper = z;
-     mDataModified = true;
+    addModifiedCells(QRect(keyCell, valueCell, 1, 1));
   }
 }
 
@@ -25313,12 +25979,13 @@ void QCPColorMapData::setCell(int keyIndex, int valueIndex, double z)
 {
   if (keyIndex >= 0 && keyIndex < mKeySize && valueIndex >= 0 && valueIndex < mValueSize)
   {
-    mData[valueIndex*mKeySize + keyIndex] = z;
+    setCellValue(valueIndex*mKeySize + keyIndex, z);
+    z = cellValue(valueIndex*mKeySize + keyIndex); // as stored, e.g. rounded to an integer element
     if (z < mDataBounds.lower)
       mDataBounds.lower = z;
     if (z > mDataBounds.upper)
       mDataBounds.upper = z;
-     mDataModified = true;
+    addModifiedCells(QRect(keyIndex, valueIndex, 1, 1));
   } else
     qDebug() << Q_FUNC_INFO << "index out of bounds:" << keyIndex << valueIndex;
 }
@@ -25342,45 +26009,181 @@ void QCPColorMapData::setAlpha(int keyIndex, int valueIndex, unsigned char alpha
 {
   if (keyIndex >= 0 && keyIndex < mKeySize && valueIndex >= 0 && valueIndex < mValueSize)
   {
-    if (mAlpha || createAlpha())
+    if (mAlpha)
+    {
+      mAlpha[valueIndex*mKeySize + keyIndex] = alpha;
+      addModifiedCells(QRect(keyIndex, valueIndex, 1, 1));
+    } else if (createAlpha())
     {
       mAlpha[valueIndex*mKeySize + keyIndex] = alpha;
-      mDataModified = true;
+      setAllModified(); // the map is colorized with alpha from now on
     }
   } else
     qDebug() << Q_FUNC_INFO << "index out of bounds:" << keyIndex << valueIndex;
 }
 
 /*!
-  Goes through the data and updates the buffered minimum and maximum data values.
-  
-  Calling this method is only advised if you are about to call \ref QCPColorMap::rescaleDataRange
-  and can not guarantee that the cells holding the maximum or minimum data haven't been overwritten
-  with a smaller or larger value respectively, since the buffered maximum/minimum values have been
-  updated the last time. Why this is the case is explained in the class description (\ref
-  QCPColorMapData).
-  
-  Note that the method \ref QCPColorMap::rescaleDataRange provides a parameter \a
-  recalculateDataBounds for convenience. Setting this to true will call this method for you, before
-  doing the rescale.
+  Replaces the internal data array with \a data without copying and returns the previous array.
+
+  \a data must hold keySize*valueSize values in the internal row-major order (see \ref setCells),
+  and must have been allocated with <tt>new double[]</tt>. The color map data takes ownership of \a
+  data, while ownership of the returned array passes to the caller, who may for example fill it
+  with the next frame and swap it back in. This way the data of a color map can be exchanged at the
+  cost of a pointer assignment.
+
+  If \a recalculateDataBounds is true, the data bounds are updated with \ref
+  recalculateDataBounds, otherwise they are left unchanged.
+
+  Returns 0 (and leaves the color map unchanged) if the color map is empty, \a data is 0 or the
+  cells are not stored as doubles (see \ref swapRawCells for the other cell types).
+
+  \see rawData, setCells
 */
-void QCPColorMapData::recalculateDataBounds()
+double *QCPColorMapData::swapRawData(double *data, bool recalculateDataBounds)
 {
-  if (mKeySize > 0 && mValueSize > 0)
-  {
-    double minHeight = mData[0];
-    double maxHeight = mData[0];
-    const int dataCount = mValueSize*mKeySize;
-    for (int i=0; i<dataCount; ++i)
-    {
-      if (mData[i] > maxHeight)
-        maxHeight = mData[i];
-      if (mData[i] < minHeight)
-        minHeight = mData[i];
-    }
-    mDataBounds.lower = minHeight;
-    mDataBounds.upper = maxHeight;
-  }
+  if (mCellType != ctDouble || isEmpty())
+    return 0;
+  return static_cast<double*>(swapRawCells(data, mKeySize, mValueSize, recalculateDataBounds));
+}
+
+/*! \overload
+
+  Replaces the internal data array with \a data and changes the size of the data map to \a keySize
+  times \a valueSize cells at the same time, without reallocating. \a data must hold that many
+  values. This allows to swap in data of a different resolution, e.g. a zoomed region. The alpha
+  map, if any, is freed since it no longer matches the cells.
+
+  Returns 0 (and leaves the color map unchanged) if the new size is empty or \a data is 0.
+
+  \see setSize
+*/
+double *QCPColorMapData::swapRawData(double *data, int keySize, int valueSize, bool recalculateDataBounds)
+{
+  if (mCellType != ctDouble)
+    return 0;
+  return static_cast<double*>(swapRawCells(data, keySize, valueSize, recalculateDataBounds));
+}
+
+/*! \overload
+
+  Replaces the internal data array with \a data like \ref swapRawData(double *data, bool
+  recalculateDataBounds), but only the cells in \a changedCells are marked as modified. The
+  rectangles are given in cell indices, x being the key index and y the value index. The caller
+  guarantees that all other cells of \a data hold the same values as the current array, e.g.
+  because both are kept up to date from the same stream of tile updates. The color map then only
+  colorizes the changed cells the next time it is drawn.
+
+  If \a changedCells is empty, the data is exchanged without marking anything.
+
+  \see setCells
+*/
+double *QCPColorMapData::swapRawData(double *data, const QVector<QRect> &changedCells, bool recalculateDataBounds)
+{
+  if (mCellType != ctDouble)
+    return 0;
+  return static_cast<double*>(swapRawCells(data, changedCells, recalculateDataBounds));
+}
+
+/*!
+  Replaces the internal array with \a cells without copying, changes the size of the data map to
+  \a keySize times \a valueSize cells and returns the previous array. This is \ref
+  swapRawData(double *data, int keySize, int valueSize, bool recalculateDataBounds) for any cell
+  type: \a cells must hold that many elements of the \ref cellType and must have been allocated
+  with \ref allocateCells. The returned array is freed with \ref freeCells. If the color map held
+  no array yet, a new uninitialized one of the new size is returned instead.
+
+  Returns 0 (and leaves the color map unchanged) only if \a cells was not installed: the new size
+  is empty, \a cells is 0 or no array could be allocated to return.
+
+  \see rawCells, setCellType
+*/
+void *QCPColorMapData::swapRawCells(void *cells, int keySize, int valueSize, bool recalculateDataBounds)
+{
+  if (!cells || keySize <= 0 || valueSize <= 0)
+    return 0;
+  
+  void *previous = mCells;
+  if (!previous)
+  {
+    previous = allocateCells(mCellType, keySize*valueSize);
+    if (!previous)
+      return 0;
+  }
+  if (keySize != mKeySize || valueSize != mValueSize)
+  {
+    clearAlpha();
+    mKeySize = keySize;
+    mValueSize = valueSize;
+    mIsEmpty = false;
+  }
+  mCells = cells;
+  if (recalculateDataBounds)
+    this->recalculateDataBounds();
+  setAllModified();
+  return previous;
+}
+
+/*! \overload
+
+  Replaces the internal array with \a cells, but only marks the cells in \a changedCells as
+  modified, see \ref swapRawData(double *data, const QVector<QRect> &changedCells, bool
+  recalculateDataBounds). Returns 0 only if \a cells was not installed, like the other overload.
+*/
+void *QCPColorMapData::swapRawCells(void *cells, const QVector<QRect> &changedCells, bool recalculateDataBounds)
+{
+  if (!cells || isEmpty())
+    return 0;
+  
+  void *previous = mCells;
+  if (!previous)
+  {
+    previous = allocateCells(mCellType, mKeySize*mValueSize);
+    if (!previous)
+      return 0;
+  }
+  mCells = cells;
+  if (recalculateDataBounds)
+    this->recalculateDataBounds();
+  for (int i=0; i<changedCells.size(); ++i)
+    addModifiedCells(changedCells.at(i));
+  return previous;
+}
+
+/*!
+  Goes through the data and updates the buffered minimum and maximum data values.
+  
+  Calling this method is only advised if you are about to call \ref QCPColorMap::rescaleDataRange
+  and can not guarantee that the cells holding the maximum or minimum data haven't been overwritten
+  with a smaller or larger value respectively, since the buffered maximum/minimum values have been
+  updated the last time. Why this is the case is explained in the class description (\ref
+  QCPColorMapData).
+  
+  Note that the method \ref QCPColorMap::rescaleDataRange provides a parameter \a
+  recalculateDataBounds for convenience. Setting this to true will call this method for you, before
+  doing the rescale.
+*/
+void QCPColorMapData::recalculateDataBounds()
+{
+  if (mKeySize > 0 && mValueSize > 0)
+  {
+    double minHeight = 0;
+    double maxHeight = 0;
+    const int dataCount = mValueSize*mKeySize;
+    switch (mCellType)
+    {
+      case ctDouble: qcpCellBounds(static_cast<const double*>(mCells), dataCount, &minHeight, &maxHeight); break;
+      case ctFloat: qcpCellBounds(static_cast<const float*>(mCells), dataCount, &minHeight, &maxHeight); break;
+      case ctInt16: qcpCellBounds(static_cast<const qint16*>(mCells), dataCount, &minHeight, &maxHeight); break;
+      case ctInt8: qcpCellBounds(static_cast<const qint8*>(mCells), dataCount, &minHeight, &maxHeight); break;
+    }
+    // the bounds of the elements, transformed to values:
+    minHeight = minHeight*mCellScale+mCellOffset;
+    maxHeight = maxHeight*mCellScale+mCellOffset;
+    if (minHeight > maxHeight)
+      qSwap(minHeight, maxHeight);
+    mDataBounds.lower = minHeight;
+    mDataBounds.upper = maxHeight;
+  }
 }
 
 /*!
@@ -25402,7 +26205,7 @@ void QCPColorMapData::clearAlpha()
   {
     delete[] mAlpha;
     mAlpha = 0;
-    mDataModified = true;
+    setAllModified();
   }
 }
 
@@ -25411,11 +26214,14 @@ void QCPColorMapData::clearAlpha()
 */
 void QCPColorMapData::fill(double z)
 {
-  const int dataCount = mValueSize*mKeySize;
-  for (int i=0; i<dataCount; ++i)
-    mData[i] = z;
-  mDataBounds = QCPRange(z, z);
-  mDataModified = true;
+  switch (mCellType)
+  {
+    case ctDouble: fillCells<double>(z); break;
+    case ctFloat: fillCells<float>(z); break;
+    case ctInt16: fillCells<qint16>(z); break;
+    case ctInt8: fillCells<qint8>(z); break;
+  }
+  setAllModified();
 }
 
 /*!
@@ -25434,7 +26240,7 @@ void QCPColorMapData::fillAlpha(unsigned char alpha)
     const int dataCount = mValueSize*mKeySize;
     for (int i=0; i<dataCount; ++i)
       mAlpha[i] = alpha;
-    mDataModified = true;
+    setAllModified();
   }
 }
 
@@ -25486,6 +26292,158 @@ void QCPColorMapData::cellToCoord(int keyIndex, int valueIndex, double *key, dou
     *value = valueIndex/(double)(mValueSize-1)*(mValueRange.upper-mValueRange.lower)+mValueRange.lower;
 }
 
+/*! \internal
+
+  Adds \a cells (x being the key index, y the value index) to the modified cells. Cells next to
+  the last rectangle in the same rows are merged into it, so a row written cell by cell with \ref
+  setCell stays one rectangle. If the list grows long, it is replaced by its bounding rectangle,
+  or by the whole map if the rectangles cover most of it anyway: colorizing that in one pass is
+  then cheaper than going through the rectangles.
+*/
+void QCPColorMapData::addModifiedCells(const QRect &cells)
+{
+  const QRect clipped = cells & QRect(0, 0, mKeySize, mValueSize);
+  if (clipped.isEmpty())
+    return;
+  if (mDataModified && mModifiedCells.isEmpty()) // the whole map is modified already
+    return;
+  mDataModified = true;
+  
+  if (!mModifiedCells.isEmpty())
+  {
+    QRect &last = mModifiedCells.last();
+    if (last.contains(clipped))
+      return;
+    if (last.top() == clipped.top() && last.bottom() == clipped.bottom() && clipped.left() <= last.right()+1 && clipped.right() >= last.left()-1)
+    {
+      last = last.united(clipped);
+      return;
+    }
+  }
+  mModifiedCells.append(clipped);
+  
+  if (mModifiedCells.size() > 64)
+  {
+    qint64 area = 0;
+    QRect bounds = mModifiedCells.first();
+    for (int i=0; i<mModifiedCells.size(); ++i)
+    {
+      area += qint64(mModifiedCells.at(i).width())*mModifiedCells.at(i).height();
+      bounds = bounds.united(mModifiedCells.at(i));
+    }
+    mModifiedCells.resize(0);
+    if (area*2 <= qint64(mKeySize)*mValueSize)
+      mModifiedCells.append(bounds);
+  }
+}
+
+/*!
+  Returns the size in bytes of an element of the cell type \a type.
+  
+  \see setCellType
+*/
+int QCPColorMapData::cellTypeSize(CellType type)
+{
+  switch (type)
+  {
+    case ctDouble: return sizeof(double);
+    case ctFloat: return sizeof(float);
+    case ctInt16: return sizeof(qint16);
+    case ctInt8: return sizeof(qint8);
+  }
+  return 0;
+}
+
+/*!
+  Allocates an array of \a count elements of the cell type \a type, as \ref swapRawCells expects
+  it. The elements are not initialized. Returns 0 if the memory could not be allocated.
+  
+  \see freeCells
+*/
+void *QCPColorMapData::allocateCells(CellType type, int count)
+{
+  void *cells = 0;
+#ifdef __EXCEPTIONS
+  try { // 2D arrays get memory intensive fast. So if the allocation fails, at least output debug message
+#endif
+  switch (type)
+  {
+    case ctDouble: cells = new double[count]; break;
+    case ctFloat: cells = new float[count]; break;
+    case ctInt16: cells = new qint16[count]; break;
+    case ctInt8: cells = new qint8[count]; break;
+  }
+#ifdef __EXCEPTIONS
+  } catch (...) { cells = 0; }
+#endif
+  return cells;
+}
+
+/*!
+  Frees \a cells, an array of elements of the cell type \a type allocated with \ref
+  allocateCells (or returned by \ref swapRawCells). \a cells may be 0.
+*/
+void QCPColorMapData::freeCells(CellType type, void *cells)
+{
+  switch (type)
+  {
+    case ctDouble: delete[] static_cast<double*>(cells); break;
+    case ctFloat: delete[] static_cast<float*>(cells); break;
+    case ctInt16: delete[] static_cast<qint16*>(cells); break;
+    case ctInt8: delete[] static_cast<qint8*>(cells); break;
+  }
+}
+
+/*! \internal
+
+  Returns the element \a index of \a cells, which holds elements of the cell type \a type.
+*/
+double QCPColorMapData::element(CellType type, const void *cells, int index)
+{
+  switch (type)
+  {
+    case ctDouble: return static_cast<const double*>(cells)[index];
+    case ctFloat: return static_cast<const float*>(cells)[index];
+    case ctInt16: return static_cast<const qint16*>(cells)[index];
+    case ctInt8: return static_cast<const qint8*>(cells)[index];
+  }
+  return 0;
+}
+
+/*! \internal
+
+  Sets the element \a index of \a cells, which holds elements of the cell type \a type, to \a
+  element, rounded and saturated for the integer types.
+*/
+void QCPColorMapData::setElement(CellType type, void *cells, int index, double element)
+{
+  switch (type)
+  {
+    case ctDouble: toCell(element, static_cast<double*>(cells)[index]); break;
+    case ctFloat: toCell(element, static_cast<float*>(cells)[index]); break;
+    case ctInt16: toCell(element, static_cast<qint16*>(cells)[index]); break;
+    case ctInt8: toCell(element, static_cast<qint8*>(cells)[index]); break;
+  }
+}
+
+/*! \internal
+
+  Sets all cells, which are elements of the type \a C, to the value \a z and the data bounds to
+  the value as it is stored.
+*/
+template <class C>
+void QCPColorMapData::fillCells(double z)
+{
+  C cell;
+  toCell((z-mCellOffset)/mCellScale, cell);
+  C *cells = static_cast<C*>(mCells);
+  const int dataCount = mValueSize*mKeySize;
+  for (int i=0; i<dataCount; ++i)
+    cells[i] = cell;
+  z = cell*mCellScale+mCellOffset;
+  mDataBounds = QCPRange(z, z);
+}
+
 /*! \internal
 
   Allocates the internal alpha map with the current data map key/value size and, if \a
@@ -25655,12 +26613,20 @@ QCPColorMap::QCPColorMap(QCPAxis *keyAxis, QCPAxis *valueAxis) :
   mGradient(QCPColorGradient::gpCold),
   mInterpolate(true),
   mTightBoundary(false),
-  mMapImageInvalidated(true)
+  mColorizeThreadCount(1),
+  mOpenGlColorize(false),
+  mMirroredX(false),
+  mMirroredY(false),
+  mMapImageInvalidated(true),
+  mGlRenderer(0)
 {
 }
 
 QCPColorMap::~QCPColorMap()
 {
+#ifdef QCP_OPENGL_FBO
+  delete mGlRenderer;
+#endif
   delete mMapData;
 }
 
@@ -25777,6 +26743,40 @@ void QCPColorMap::setTightBoundary(bool enabled)
   mTightBoundary = enabled;
 }
 
+/*!
+  Sets the number of threads that convert the data into the map image when it needs to be updated.
+  The scanlines of the image are then split into \a count stripes, one of which is colorized by the
+  calling (GUI) thread while the others are handed to a persistent worker pool that is shared by
+  all color maps. If \a count is 0, QThread::idealThreadCount() is used.
+
+  The default is 1, which colorizes all scanlines serially in the calling thread. The resulting
+  image is the same in either case.
+*/
+void QCPColorMap::setColorizeThreadCount(int count)
+{
+  mColorizeThreadCount = qMax(0, count);
+}
+
+/*!
+  Sets whether the map is colorized on the GPU when the plot is painted with OpenGL (\ref
+  QCustomPlot::setOpenGl). The cells are then uploaded as a texture whenever the data was
+  modified and a shader looks up the colors of the gradient, which also interpolates between
+  the cells if \ref setInterpolate is enabled. Changes of the data range, scale type or gradient
+  don't require to colorize the map image anew in this case.
+  
+  The map is colorized as usual if the plot isn't painted with OpenGL, when it is exported (e.g.
+  to PDF), if it has an alpha map or if the OpenGL context doesn't support the shaders (OpenGL
+  3.0 or OpenGL ES 3.0 are needed). The cells are converted to single precision for the texture,
+  so data ranges that are much smaller than the values themselves may show differences. This
+  has no effect if QCustomPlot was compiled without OpenGL support (\c QCUSTOMPLOT_USE_OPENGL).
+  
+  The default is false.
+*/
+void QCPColorMap::setOpenGlColorize(bool enabled)
+{
+  mOpenGlColorize = enabled;
+}
+
 /*!
   Associates the color scale \a colorScale with this color map.
   
@@ -25947,6 +26947,155 @@ QCPRange QCPColorMap::getValueRange(bool &foundRange, QCP::SignDomain inSignDoma
   return result;
 }
 
+namespace {
+
+/* Describes the conversion of the color map data into the map image, shared by all stripes of
+   scanlines colorized by QCPColorMap::updateMapImage. */
+struct QCPColorMapImageJob
+{
+  QCPColorGradient *gradient; // the color buffer must be up to date, so colorize() only reads
+  QCPRange dataRange;
+  bool logarithmic;
+  const void *cells;          // elements of cellType, value = element*cellScale+cellOffset
+  QCPColorMapData::CellType cellType;
+  double cellScale;
+  double cellOffset;
+  const unsigned char *alpha;
+  int lineCount;
+  int rowCount;
+  int lineStep;               // offset between the first cells of two consecutive lines
+  int dataIndexFactor;        // offset between two cells of one line
+  int spanBegin;              // the cells of each line that are colorized
+  int spanCount;
+  uchar *bits;                // image the lines are colorized into
+  int bytesPerLine;
+  uchar *oversampledBits;     // 0, or the image the lines are replicated into afterwards
+  int oversampledBytesPerLine;
+  int xOversampling;
+  int yOversampling;
+};
+
+void qcpColorizeMapImageLines(const QCPColorMapImageJob &job, int beginLine, int endLine)
+{
+  for (int line=beginLine; line<endLine; ++line)
+  {
+    const int y = job.lineCount-1-line; // invert scanline index because QImage counts scanlines from top, but our vertical index counts from bottom (mathematical coordinate system)
+    const int dataIndex = line*job.lineStep+job.spanBegin*job.dataIndexFactor;
+    QRgb *pixels = reinterpret_cast<QRgb*>(job.bits+y*job.bytesPerLine)+job.spanBegin;
+    const unsigned char *alpha = job.alpha ? job.alpha+dataIndex : 0;
+    switch (job.cellType)
+    {
+      case QCPColorMapData::ctDouble:
+      {
+        const double *data = static_cast<const double*>(job.cells)+dataIndex;
+        if (alpha)
+          job.gradient->colorize(data, alpha, job.dataRange, pixels, job.spanCount, job.dataIndexFactor, job.logarithmic);
+        else
+          job.gradient->colorize(data, job.dataRange, pixels, job.spanCount, job.dataIndexFactor, job.logarithmic);
+        break;
+      }
+      case QCPColorMapData::ctFloat:
+        job.gradient->colorize(static_cast<const float*>(job.cells)+dataIndex, alpha, job.dataRange, job.cellScale, job.cellOffset, pixels, job.spanCount, job.dataIndexFactor, job.logarithmic);
+        break;
+      case QCPColorMapData::ctInt16:
+        job.gradient->colorize(static_cast<const qint16*>(job.cells)+dataIndex, alpha, job.dataRange, job.cellScale, job.cellOffset, pixels, job.spanCount, job.dataIndexFactor, job.logarithmic);
+        break;
+      case QCPColorMapData::ctInt8:
+        job.gradient->colorize(static_cast<const qint8*>(job.cells)+dataIndex, alpha, job.dataRange, job.cellScale, job.cellOffset, pixels, job.spanCount, job.dataIndexFactor, job.logarithmic);
+        break;
+    }
+    
+    if (job.oversampledBits)
+    {
+      // same result as QImage::scaled with Qt::FastTransformation for integer factors:
+      QRgb *target = reinterpret_cast<QRgb*>(job.oversampledBits+y*job.yOversampling*job.oversampledBytesPerLine)+job.spanBegin*job.xOversampling;
+      for (int i=0; i<job.spanCount; ++i)
+      {
+        for (int k=0; k<job.xOversampling; ++k)
+          target[i*job.xOversampling+k] = pixels[i];
+      }
+      for (int k=1; k<job.yOversampling; ++k)
+        memcpy(reinterpret_cast<QRgb*>(job.oversampledBits+(y*job.yOversampling+k)*job.oversampledBytesPerLine)+job.spanBegin*job.xOversampling,
+               target, job.spanCount*job.xOversampling*sizeof(QRgb));
+    }
+  }
+}
+
+/* Colorizes one stripe; the runnables are owned by QCPColorMapStripes and reused for every
+   replot, so they are not deleted by the thread pool. */
+class QCPColorMapImageRunnable : public QRunnable
+{
+public:
+  explicit QCPColorMapImageRunnable(QSemaphore *finished) :
+    mBeginLine(0), mEndLine(0), mFinished(finished) { setAutoDelete(false); }
+  void setLines(const QCPColorMapImageJob &job, int beginLine, int endLine)
+  {
+    mJob = job;
+    mBeginLine = beginLine;
+    mEndLine = endLine;
+  }
+  virtual void run() Q_DECL_OVERRIDE
+  {
+    qcpColorizeMapImageLines(mJob, mBeginLine, mEndLine);
+    mFinished->release();
+  }
+  
+private:
+  QCPColorMapImageJob mJob;
+  int mBeginLine, mEndLine;
+  QSemaphore *mFinished;
+};
+
+/* The runnables of the stripes and the semaphore they release, kept so that colorizing in
+   parallel doesn't allocate anything once as many stripes have been handed out before. Maps are
+   only colorized by the GUI thread, one at a time. */
+struct QCPColorMapStripes
+{
+  QSemaphore finished;
+  QVector<QCPColorMapImageRunnable*> runnables;
+  ~QCPColorMapStripes() { qDeleteAll(runnables); }
+};
+
+Q_GLOBAL_STATIC(QThreadPool, qcpColorMapThreadPoolInstance)
+Q_GLOBAL_STATIC(QCPColorMapStripes, qcpColorMapStripesInstance)
+
+/* The worker threads are kept alive until the application exits, so they don't have to be
+   restarted for every replot. */
+QThreadPool *qcpColorMapThreadPool()
+{
+  QThreadPool *pool = qcpColorMapThreadPoolInstance();
+  pool->setExpiryTimeout(-1);
+  return pool;
+}
+
+/* Colorizes the lines beginLine to endLine-1 of job in up to threadCount stripes, the first one in
+   the calling thread. */
+void qcpColorizeMapImageStripes(const QCPColorMapImageJob &job, int beginLine, int endLine, int threadCount)
+{
+  const int lineCount = endLine-beginLine;
+  const int stripeCount = qMax(1, qMin(threadCount, lineCount));
+  if (stripeCount > 1)
+  {
+    QThreadPool *pool = qcpColorMapThreadPool();
+    if (pool->maxThreadCount() < stripeCount-1)
+      pool->setMaxThreadCount(stripeCount-1);
+    QCPColorMapStripes *stripes = qcpColorMapStripesInstance();
+    while (stripes->runnables.size() < stripeCount-1)
+      stripes->runnables.append(new QCPColorMapImageRunnable(&stripes->finished));
+    for (int stripe=1; stripe<stripeCount; ++stripe)
+    {
+      QCPColorMapImageRunnable *runnable = stripes->runnables.at(stripe-1);
+      runnable->setLines(job, beginLine+stripe*lineCount/stripeCount, beginLine+(stripe+1)*lineCount/stripeCount);
+      pool->start(runnable);
+    }
+    qcpColorizeMapImageLines(job, beginLine, beginLine+lineCount/stripeCount);
+    stripes->finished.acquire(stripeCount-1);
+  } else
+    qcpColorizeMapImageLines(job, beginLine, endLine);
+}
+
+} // anonymous namespace
+
 /*! \internal
   
   Updates the internal map image buffer by going through the internal \ref QCPColorMapData and
@@ -25960,6 +27109,21 @@ QCPRange QCPColorMap::getValueRange(bool &foundRange, QCP::SignDomain inSignDoma
   QPainter::drawImage bug which makes inner pixel boundaries jitter when stretch-drawing images
   without smooth transform enabled. Accordingly, oversampling isn't performed if \ref
   setInterpolate is true.
+  
+  The oversampled image is filled in place while the lines are colorized, by replicating every
+  pixel of the undersampled image (nearest neighbour), so neither image is allocated again as long
+  as the size of the map stays the same.
+  
+  If more than one thread is configured with \ref setColorizeThreadCount, the scanlines are
+  colorized (and oversampled) in parallel stripes.
+  
+  If only some cells of the data were modified (see \ref QCPColorMapData) and the map image is
+  otherwise still valid, only the spans of the scanlines covering these cells are colorized and
+  oversampled again.
+  
+  Cells that are not stored as doubles (see \ref QCPColorMapData::setCellType) are colorized from
+  their elements; for the integer types the gradient's table of the colors of all elements is
+  brought up to date here, before any thread reads it.
 */
 void QCPColorMap::updateMapImage()
 {
@@ -25972,12 +27136,20 @@ void QCPColorMap::updateMapImage()
   const int valueSize = mMapData->valueSize();
   int keyOversamplingFactor = mInterpolate ? 1 : (int)(1.0+100.0/(double)keySize); // make mMapImage have at least size 100, factor becomes 1 if size > 200 or interpolation is on
   int valueOversamplingFactor = mInterpolate ? 1 : (int)(1.0+100.0/(double)valueSize); // make mMapImage have at least size 100, factor becomes 1 if size > 200 or interpolation is on
+  const bool oversampled = keyOversamplingFactor > 1 || valueOversamplingFactor > 1;
+  // only the modified cells need to be colorized if the rest of the image is still valid:
+  bool partial = !mMapImageInvalidated && mMapData->mDataModified && !mMapData->mModifiedCells.isEmpty();
   
   // resize mMapImage to correct dimensions including possible oversampling factors, according to key/value axes orientation:
   if (keyAxis->orientation() == Qt::Horizontal && (mMapImage.width() != keySize*keyOversamplingFactor || mMapImage.height() != valueSize*valueOversamplingFactor))
+  {
     mMapImage = QImage(QSize(keySize*keyOversamplingFactor, valueSize*valueOversamplingFactor), format);
-  else if (keyAxis->orientation() == Qt::Vertical && (mMapImage.width() != valueSize*valueOversamplingFactor || mMapImage.height() != keySize*keyOversamplingFactor))
+    partial = false;
+  } else if (keyAxis->orientation() == Qt::Vertical && (mMapImage.width() != valueSize*valueOversamplingFactor || mMapImage.height() != keySize*keyOversamplingFactor))
+  {
     mMapImage = QImage(QSize(valueSize*valueOversamplingFactor, keySize*keyOversamplingFactor), format);
+    partial = false;
+  }
   
   if (mMapImage.isNull())
   {
@@ -25987,22 +27159,75 @@ void QCPColorMap::updateMapImage()
   } else
   {
     QImage *localMapImage = &mMapImage; // this is the image on which the colorization operates. Either the final mMapImage, or if we need oversampling, mUndersampledMapImage
-    if (keyOversamplingFactor > 1 || valueOversamplingFactor > 1)
+    if (oversampled)
     {
       // resize undersampled map image to actual key/value cell sizes:
       if (keyAxis->orientation() == Qt::Horizontal && (mUndersampledMapImage.width() != keySize || mUndersampledMapImage.height() != valueSize))
+      {
         mUndersampledMapImage = QImage(QSize(keySize, valueSize), format);
-      else if (keyAxis->orientation() == Qt::Vertical && (mUndersampledMapImage.width() != valueSize || mUndersampledMapImage.height() != keySize))
+        partial = false;
+      } else if (keyAxis->orientation() == Qt::Vertical && (mUndersampledMapImage.width() != valueSize || mUndersampledMapImage.height() != keySize))
+      {
         mUndersampledMapImage = QImage(QSize(valueSize, keySize), format);
+        partial = false;
+      }
       localMapImage = &mUndersampledMapImage; // make the colorization run on the undersampled image
     } else if (!mUndersampledMapImage.isNull())
       mUndersampledMapImage = QImage(); // don't need oversampling mechanism anymore (map size has changed) but mUndersampledMapImage still has nonzero size, free it
     
-    const double *rawData = mMapData->mData;
+    const double *rawData = mMapData->rawData(); // 0 unless the cells are doubles
     const unsigned char *rawAlpha = mMapData->mAlpha;
-    if (keyAxis->orientation() == Qt::Horizontal)
+    const int threadCount = mColorizeThreadCount > 0 ? mColorizeThreadCount : QThread::idealThreadCount();
+    const int lineCount = keyAxis->orientation() == Qt::Horizontal ? valueSize : keySize;
+    const bool parallel = threadCount > 1 && lineCount > 1;
+    const QCPColorMapData::CellType cellType = mMapData->cellType();
+    if (partial || parallel || oversampled || !rawData)
+    {
+      if (mGradient.mColorBufferInvalidated)
+        mGradient.updateColorBuffer(); // workers must not update the shared color buffer concurrently
+      if (cellType == QCPColorMapData::ctInt16 || cellType == QCPColorMapData::ctInt8) // same for the element colors
+        mGradient.updateCellColorBuffer(cellType == QCPColorMapData::ctInt16 ? 16 : 8, mDataRange, mMapData->cellScale(), mMapData->cellOffset(), mDataScaleType==QCPAxis::stLogarithmic);
+      QCPColorMapImageJob job;
+      job.gradient = &mGradient;
+      job.dataRange = mDataRange;
+      job.logarithmic = mDataScaleType==QCPAxis::stLogarithmic;
+      job.cells = mMapData->rawCells();
+      job.cellType = cellType;
+      job.cellScale = mMapData->cellScale();
+      job.cellOffset = mMapData->cellOffset();
+      job.alpha = rawAlpha;
+      job.lineCount = lineCount;
+      job.rowCount = keyAxis->orientation() == Qt::Horizontal ? keySize : valueSize;
+      job.lineStep = keyAxis->orientation() == Qt::Horizontal ? keySize : 1;
+      job.dataIndexFactor = keyAxis->orientation() == Qt::Horizontal ? 1 : keySize;
+      job.spanBegin = 0;
+      job.spanCount = job.rowCount;
+      job.bits = localMapImage->bits(); // detaches here, scanLine() must not be called from the worker threads
+      job.bytesPerLine = localMapImage->bytesPerLine();
+      job.oversampledBits = oversampled ? mMapImage.bits() : 0;
+      job.oversampledBytesPerLine = mMapImage.bytesPerLine();
+      job.xOversampling = keyAxis->orientation() == Qt::Horizontal ? keyOversamplingFactor : valueOversamplingFactor;
+      job.yOversampling = keyAxis->orientation() == Qt::Horizontal ? valueOversamplingFactor : keyOversamplingFactor;
+      
+      if (partial)
+      {
+        // the lines of a cell rect are its rows with a horizontal key axis, else its columns:
+        const QVector<QRect> &cells = mMapData->mModifiedCells;
+        for (int i=0; i<cells.size(); ++i)
+        {
+          const QRect &rect = cells.at(i);
+          const bool horizontal = keyAxis->orientation() == Qt::Horizontal;
+          const int beginLine = horizontal ? rect.top() : rect.left();
+          const int endLine = horizontal ? rect.bottom()+1 : rect.right()+1;
+          job.spanBegin = horizontal ? rect.left() : rect.top();
+          job.spanCount = horizontal ? rect.width() : rect.height();
+          // small rects are not worth waking the worker threads for
+          qcpColorizeMapImageStripes(job, beginLine, endLine, rect.width()*rect.height() >= 65536 ? threadCount : 1);
+        }
+      } else
+        qcpColorizeMapImageStripes(job, 0, lineCount, threadCount);
+    } else if (keyAxis->orientation() == Qt::Horizontal)
     {
-      const int lineCount = valueSize;
       const int rowCount = keySize;
       for (int line=0; line<lineCount; ++line)
       {
@@ -26014,7 +27239,6 @@ void QCPColorMap::updateMapImage()
       }
     } else // keyAxis->orientation() == Qt::Vertical
     {
-      const int lineCount = keySize;
       const int rowCount = valueSize;
       for (int line=0; line<lineCount; ++line)
       {
@@ -26025,17 +27249,10 @@ void QCPColorMap::updateMapImage()
           mGradient.colorize(rawData+line, mDataRange, pixels, rowCount, lineCount, mDataScaleType==QCPAxis::stLogarithmic);
       }
     }
-    
-    if (keyOversamplingFactor > 1 || valueOversamplingFactor > 1)
-    {
-      if (keyAxis->orientation() == Qt::Horizontal)
-        mMapImage = mUndersampledMapImage.scaled(keySize*keyOversamplingFactor, valueSize*valueOversamplingFactor, Qt::IgnoreAspectRatio, Qt::FastTransformation);
-      else
-        mMapImage = mUndersampledMapImage.scaled(valueSize*valueOversamplingFactor, keySize*keyOversamplingFactor, Qt::IgnoreAspectRatio, Qt::FastTransformation);
-    }
   }
-  mMapData->mDataModified = false;
+  mMapData->clearModified();
   mMapImageInvalidated = false;
+  mMirroredX = mMirroredY = false;
 }
 
 /* inherits documentation from base class */
@@ -26045,11 +27262,18 @@ void QCPColorMap::draw(QCPPainter *painter)
   if (!mKeyAxis || !mValueAxis) return;
   applyDefaultAntialiasingHint(painter);
   
+  // use buffer if painting vectorized (PDF):
+  const bool useBuffer = painter->modes().testFlag(QCPPainter::pmVectorized);
+  const QRectF imageRect = mapImageRect();
+  const bool mirrorX = (keyAxis()->orientation() == Qt::Horizontal ? keyAxis() : valueAxis())->rangeReversed();
+  const bool mirrorY = (valueAxis()->orientation() == Qt::Vertical ? valueAxis() : keyAxis())->rangeReversed();
+  
+  if (mOpenGlColorize && !useBuffer && drawOpenGl(painter, imageRect, mirrorX, mirrorY))
+    return;
+  
   if (mMapData->mDataModified || mMapImageInvalidated)
     updateMapImage();
   
-  // use buffer if painting vectorized (PDF):
-  const bool useBuffer = painter->modes().testFlag(QCPPainter::pmVectorized);
   QCPPainter *localPainter = painter; // will be redirected to paint on mapBuffer if painting vectorized
   QRectF mapBufferTarget; // the rect in absolute widget coordinates where the visible map portion/buffer will end up in
   QPixmap mapBuffer;
@@ -26064,9 +27288,38 @@ void QCPColorMap::draw(QCPPainter *painter)
     localPainter->translate(-mapBufferTarget.topLeft());
   }
   
+  const bool smoothBackup = localPainter->renderHints().testFlag(QPainter::SmoothPixmapTransform);
+  localPainter->setRenderHint(QPainter::SmoothPixmapTransform, mInterpolate);
+  QRegion clipBackup;
+  if (mTightBoundary)
+  {
+    clipBackup = localPainter->clipRegion();
+    QRectF tightClipRect = QRectF(coordsToPixels(mMapData->keyRange().lower, mMapData->valueRange().lower),
+                                  coordsToPixels(mMapData->keyRange().upper, mMapData->valueRange().upper)).normalized();
+    localPainter->setClipRect(tightClipRect, Qt::IntersectClip);
+  }
+  localPainter->drawImage(imageRect, mirrorX || mirrorY ? mirroredMapImage(mirrorX, mirrorY) : mMapImage);
+  if (mTightBoundary)
+    localPainter->setClipRegion(clipBackup);
+  localPainter->setRenderHint(QPainter::SmoothPixmapTransform, smoothBackup);
+  
+  if (useBuffer) // localPainter painted to mapBuffer, so now draw buffer with original painter
+  {
+    delete localPainter;
+    painter->drawPixmap(mapBufferTarget.toRect(), mapBuffer);
+  }
+}
+
+/*! \internal
+  
+  Returns the rect in pixels the map image covers, i.e. the rect spanned by the key and value
+  range of the data, extended by the outer halves of the bordering cells (cells are centered on
+  the map range boundary).
+*/
+QRectF QCPColorMap::mapImageRect() const
+{
   QRectF imageRect = QRectF(coordsToPixels(mMapData->keyRange().lower, mMapData->valueRange().lower),
                             coordsToPixels(mMapData->keyRange().upper, mMapData->valueRange().upper)).normalized();
-  // extend imageRect to contain outer halves/quarters of bordering/cornering pixels (cells are centered on map range boundary):
   double halfCellWidth = 0; // in pixels
   double halfCellHeight = 0; // in pixels
   if (keyAxis()->orientation() == Qt::Horizontal)
@@ -26082,29 +27335,441 @@ void QCPColorMap::draw(QCPPainter *painter)
     if (mMapData->valueSize() > 1)
       halfCellWidth = 0.5*imageRect.width()/(double)(mMapData->valueSize()-1);
   }
-  imageRect.adjust(-halfCellWidth, -halfCellHeight, halfCellWidth, halfCellHeight);
-  const bool mirrorX = (keyAxis()->orientation() == Qt::Horizontal ? keyAxis() : valueAxis())->rangeReversed();
-  const bool mirrorY = (valueAxis()->orientation() == Qt::Vertical ? valueAxis() : keyAxis())->rangeReversed();
-  const bool smoothBackup = localPainter->renderHints().testFlag(QPainter::SmoothPixmapTransform);
-  localPainter->setRenderHint(QPainter::SmoothPixmapTransform, mInterpolate);
-  QRegion clipBackup;
-  if (mTightBoundary)
+  return imageRect.adjusted(-halfCellWidth, -halfCellHeight, halfCellWidth, halfCellHeight);
+}
+
+/*! \internal
+  
+  Returns the map image mirrored horizontally if \a mirrorX and vertically if \a mirrorY is
+  true, as it is drawn with reversed axes. Unlike QImage::mirrored, this keeps the mirrored image
+  between replots: it is only mirrored again after the map image was updated or the axes were
+  reversed differently, and into the same buffer while the size stays the same.
+*/
+const QImage &QCPColorMap::mirroredMapImage(bool mirrorX, bool mirrorY)
+{
+  if (mirrorX == mMirroredX && mirrorY == mMirroredY)
+    return mMirroredMapImage;
+  
+  if (mMirroredMapImage.size() != mMapImage.size() || mMirroredMapImage.format() != mMapImage.format())
+    mMirroredMapImage = QImage(mMapImage.size(), mMapImage.format());
+  const int width = mMapImage.width();
+  const int height = mMapImage.height();
+  for (int y=0; y<height; ++y)
   {
-    clipBackup = localPainter->clipRegion();
-    QRectF tightClipRect = QRectF(coordsToPixels(mMapData->keyRange().lower, mMapData->valueRange().lower),
-                                  coordsToPixels(mMapData->keyRange().upper, mMapData->valueRange().upper)).normalized();
-    localPainter->setClipRect(tightClipRect, Qt::IntersectClip);
+    const QRgb *source = reinterpret_cast<const QRgb*>(mMapImage.constScanLine(y));
+    QRgb *target = reinterpret_cast<QRgb*>(mMirroredMapImage.scanLine(mirrorY ? height-1-y : y));
+    if (mirrorX)
+    {
+      for (int x=0; x<width; ++x)
+        target[width-1-x] = source[x];
+    } else
+      memcpy(target, source, width*sizeof(QRgb));
   }
-  localPainter->drawImage(imageRect, mMapImage.mirrored(mirrorX, mirrorY));
-  if (mTightBoundary)
-    localPainter->setClipRegion(clipBackup);
-  localPainter->setRenderHint(QPainter::SmoothPixmapTransform, smoothBackup);
+  mMirroredX = mirrorX;
+  mMirroredY = mirrorY;
+  return mMirroredMapImage;
+}
+
+#ifdef QCP_OPENGL_FBO
+#ifndef GL_RED
+#  define GL_RED 0x1903
+#endif
+#ifndef GL_R32F
+#  define GL_R32F 0x822E
+#endif
+
+namespace {
+
+/* Writes the values of count cells with elements of the type C to the texture staging buffer. */
+template <class C>
+void qcpCellsToFloat(const C *cells, int count, double scale, double offset, float *staging)
+{
+  for (int i=0; i<count; ++i)
+    staging[i] = cells[i]*scale+offset;
+}
+
+} // anonymous namespace
+
+/*! \internal
+  \class QCPColorMapGlRenderer
+  
+  Colorizes the data of a \ref QCPColorMap on the GPU, see \ref QCPColorMap::setOpenGlColorize.
+  The cells are kept in a single channel float texture and the color buffer of the gradient in a
+  lookup texture. A fragment shader maps each pixel of the map image to its cell and looks up its
+  color with the same index arithmetic as \ref QCPColorGradient::colorize, so changing the data
+  range or scale type only changes uniforms. The textures are only uploaded again if the data or
+  the gradient was modified.
+  
+  The resources belong to the OpenGL context of the first draw; if the context changes (e.g.
+  because OpenGL was switched off and on again), they are created anew in the new context.
+*/
+class QCPColorMapGlRenderer : protected QOpenGLFunctions
+{
+public:
+  struct Parameters
+  {
+    QRectF imageRect;       // map image in device pixels
+    QRectF clipRect;        // in device pixels
+    QCPRange dataRange;
+    bool logarithmic;
+    bool interpolate;
+    bool transposed;        // key axis is vertical
+    bool mirrorX, mirrorY;
+  };
+  
+  QCPColorMapGlRenderer();
+  ~QCPColorMapGlRenderer();
+  
+  bool draw(QOpenGLContext *context, bool paintFlipped, const QCPColorMapData *data, bool dataModified,
+            const QCPColorGradient &gradient, const QVector<QRgb> &colorBuffer, const Parameters &parameters);
+  
+private:
+  QPointer<QOpenGLContext> mContext;
+  QOpenGLShaderProgram *mProgram;
+  QOpenGLVertexArrayObject *mVertexArray;
+  GLuint mDataTexture, mLutTexture;
+  int mKeySize, mValueSize;
+  QCPColorGradient mLutGradient; // the gradient whose color buffer is in the lookup texture
+  bool mLutValid;
+  bool mFailed;                  // shaders could not be built in mContext
+  QVector<float> mStaging;
+  QVector<uchar> mLut;
+  
+  bool initialize(QOpenGLContext *context);
+  void release();
+};
+
+QCPColorMapGlRenderer::QCPColorMapGlRenderer() :
+  mProgram(0),
+  mVertexArray(0),
+  mDataTexture(0),
+  mLutTexture(0),
+  mKeySize(0),
+  mValueSize(0),
+  mLutValid(false),
+  mFailed(false)
+{
+}
+
+QCPColorMapGlRenderer::~QCPColorMapGlRenderer()
+{
+  if (mContext)
+  {
+    if (QOpenGLContext::currentContext() != mContext.data())
+      mContext.data()->makeCurrent(mContext.data()->surface());
+    if (mDataTexture)
+      glDeleteTextures(1, &mDataTexture);
+    if (mLutTexture)
+      glDeleteTextures(1, &mLutTexture);
+  }
+  release();
+}
+
+/*! \internal
   
-  if (useBuffer) // localPainter painted to mapBuffer, so now draw buffer with original painter
+  Drops the shader program and forgets the textures. The texture names are only deleted by the
+  destructor, since the context they were created in is either current there or already gone.
+*/
+void QCPColorMapGlRenderer::release()
+{
+  delete mVertexArray;
+  mVertexArray = 0;
+  delete mProgram;
+  mProgram = 0;
+  mDataTexture = 0;
+  mLutTexture = 0;
+  mKeySize = 0;
+  mValueSize = 0;
+  mLutValid = false;
+}
+
+/*! \internal
+  
+  Builds the shader program and creates the textures in \a context unless that was already done.
+  Returns false if the context doesn't support the shaders (OpenGL 3.0 or OpenGL ES 3.0 are
+  needed for integer texel fetches and float textures).
+*/
+bool QCPColorMapGlRenderer::initialize(QOpenGLContext *context)
+{
+  if (context != mContext.data())
   {
-    delete localPainter;
-    painter->drawPixmap(mapBufferTarget.toRect(), mapBuffer);
+    release();
+    mContext = context;
+    mFailed = false;
+  }
+  if (mProgram)
+    return true;
+  if (mFailed)
+    return false;
+  mFailed = true;
+  
+  const QSurfaceFormat format = context->format();
+  if (format.version() < qMakePair(3, 0))
+    return false;
+  initializeOpenGLFunctions();
+  
+  QByteArray header;
+  if (context->isOpenGLES())
+    header = "#version 300 es\nprecision highp float;\nprecision highp int;\nprecision highp sampler2D;\n";
+  else if (format.profile() == QSurfaceFormat::CoreProfile)
+    header = "#version 150\n";
+  else
+    header = "#version 130\n";
+  
+  const char *vertexShader =
+      "uniform vec4 deviceRect; // left, bottom, right, top in normalized device coordinates\n"
+      "out vec2 mapPosition;\n"
+      "void main()\n"
+      "{\n"
+      "  mapPosition = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+      "  gl_Position = vec4(mix(deviceRect.xy, deviceRect.zw, mapPosition), 0.0, 1.0);\n"
+      "}\n";
+  // cellColor does what QCPColorGradient::colorize does for a single cell:
+  const char *fragmentShader =
+      "uniform sampler2D dataTexture;\n"
+      "uniform sampler2D lutTexture;\n"
+      "uniform ivec2 dataSize;\n"
+      "uniform float lower;\n"
+      "uniform float posToIndexFactor;\n"
+      "uniform int levelCount;\n"
+      "uniform bool logarithmic;\n"
+      "uniform bool periodic;\n"
+      "uniform bool interpolate;\n"
+      "uniform bool transposed;\n"
+      "uniform bool mirrorX;\n"
+      "uniform bool mirrorY;\n"
+      "in vec2 mapPosition;\n"
+      "out vec4 fragColor;\n"
+      "vec4 cellColor(ivec2 cell)\n"
+      "{\n"
+      "  float value = texelFetch(dataTexture, clamp(cell, ivec2(0), dataSize-1), 0).r;\n"
+      "  float index = trunc((logarithmic ? log(value/lower) : value-lower)*posToIndexFactor);\n"
+      "  if (periodic)\n"
+      "  {\n"
+      "    index -= float(levelCount)*trunc(index/float(levelCount));\n"
+      "    if (index < 0.0)\n"
+      "      index += float(levelCount);\n"
+      "  } else\n"
+      "    index = clamp(index, 0.0, float(levelCount-1));\n"
+      "  return texelFetch(lutTexture, ivec2(int(index), 0), 0);\n"
+      "}\n"
+      "void main()\n"
+      "{\n"
+      "  vec2 position = vec2(mirrorX ? 1.0-mapPosition.x : mapPosition.x, mirrorY ? 1.0-mapPosition.y : mapPosition.y);\n"
+      "  vec2 cell = (transposed ? position.yx : position)*vec2(dataSize);\n"
+      "  if (interpolate)\n"
+      "  {\n"
+      "    vec2 p = cell-0.5;\n"
+      "    ivec2 c = ivec2(floor(p));\n"
+      "    vec2 f = p-floor(p);\n"
+      "    fragColor = mix(mix(cellColor(c), cellColor(c+ivec2(1, 0)), f.x),\n"
+      "                    mix(cellColor(c+ivec2(0, 1)), cellColor(c+ivec2(1, 1)), f.x), f.y);\n"
+      "  } else\n"
+      "    fragColor = cellColor(ivec2(floor(cell)));\n"
+      "}\n";
+  
+  QOpenGLShaderProgram *program = new QOpenGLShaderProgram;
+  if (!program->addShaderFromSourceCode(QOpenGLShader::Vertex, header+vertexShader) ||
+      !program->addShaderFromSourceCode(QOpenGLShader::Fragment, header+fragmentShader) ||
+      !program->link())
+  {
+    qDebug() << Q_FUNC_INFO << "failed to build the colorize shaders:" << program->log();
+    delete program;
+    return false;
+  }
+  mProgram = program;
+  mVertexArray = new QOpenGLVertexArrayObject;
+  mVertexArray->create(); // only needed by core profiles, draws without it otherwise
+  
+  GLuint textures[2];
+  glGenTextures(2, textures);
+  mDataTexture = textures[0];
+  mLutTexture = textures[1];
+  for (int i=0; i<2; ++i)
+  {
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  mFailed = false;
+  return true;
+}
+
+/*! \internal
+  
+  Draws the map image of \a data into the current framebuffer of \a context. The data texture is uploaded if \a dataModified is true or its size changed, the lookup
+  texture if \a gradient differs from the one uploaded last; \a colorBuffer has to be the up to date
+  color buffer of \a gradient.
+  
+  \a paintFlipped tells whether the paint device has the origin of the device pixels at the
+  bottom. Returns false without drawing if the context can't do it, the caller then falls back to
+  the raster path.
+*/
+bool QCPColorMapGlRenderer::draw(QOpenGLContext *context, bool paintFlipped, const QCPColorMapData *data, bool dataModified,
+                                 const QCPColorGradient &gradient, const QVector<QRgb> &colorBuffer, const Parameters &parameters)
+{
+  if (!initialize(context))
+    return false;
+  
+  const int keySize = data->keySize();
+  const int valueSize = data->valueSize();
+  const int levelCount = colorBuffer.size();
+  GLint maxTextureSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  if (keySize > maxTextureSize || valueSize > maxTextureSize || levelCount > maxTextureSize)
+    return false;
+  
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, mLutTexture);
+  if (!mLutValid || gradient != mLutGradient)
+  {
+    mLut.resize(levelCount*4);
+    uchar *lut = mLut.data();
+    for (int i=0; i<levelCount; ++i)
+    {
+      const QRgb color = colorBuffer.at(i); // already premultiplied
+      lut[i*4+0] = qRed(color);
+      lut[i*4+1] = qGreen(color);
+      lut[i*4+2] = qBlue(color);
+      lut[i*4+3] = qAlpha(color);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, levelCount, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, mLut.constData());
+    mLutGradient = gradient;
+    mLutValid = true;
+  }
+  
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, mDataTexture);
+  const bool resized = keySize != mKeySize || valueSize != mValueSize;
+  if (dataModified || resized)
+  {
+    const int n = keySize*valueSize;
+    mStaging.resize(n);
+    float *staging = mStaging.data();
+    const void *cells = data->rawCells();
+    switch (data->cellType())
+    {
+      case QCPColorMapData::ctDouble: qcpCellsToFloat(static_cast<const double*>(cells), n, 1, 0, staging); break;
+      case QCPColorMapData::ctFloat: qcpCellsToFloat(static_cast<const float*>(cells), n, data->cellScale(), data->cellOffset(), staging); break;
+      case QCPColorMapData::ctInt16: qcpCellsToFloat(static_cast<const qint16*>(cells), n, data->cellScale(), data->cellOffset(), staging); break;
+      case QCPColorMapData::ctInt8: qcpCellsToFloat(static_cast<const qint8*>(cells), n, data->cellScale(), data->cellOffset(), staging); break;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (resized)
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, keySize, valueSize, 0, GL_RED, GL_FLOAT, staging);
+    else
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, keySize, valueSize, GL_RED, GL_FLOAT, staging);
+    mKeySize = keySize;
+    mValueSize = valueSize;
   }
+  
+  // device pixels have their origin at the top left unless the device paints flipped:
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if (viewport[2] <= 0 || viewport[3] <= 0)
+    return false;
+  const QRectF &r = parameters.imageRect;
+  const double top = paintFlipped ? r.top() : viewport[3]-r.top();
+  const double bottom = paintFlipped ? r.bottom() : viewport[3]-r.bottom();
+  const QRect clip = parameters.clipRect.toAlignedRect();
+  if (clip.isEmpty())
+    return true; // nothing of the map is visible
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(viewport[0]+clip.left(), viewport[1]+(paintFlipped ? clip.top() : viewport[3]-clip.top()-clip.height()), clip.width(), clip.height());
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_STENCIL_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // the lookup colors are premultiplied
+  
+  const double logRange = qLn(parameters.dataRange.upper/parameters.dataRange.lower);
+  mProgram->bind();
+  mProgram->setUniformValue("deviceRect", QVector4D(2*r.left()/viewport[2]-1, 2*bottom/viewport[3]-1,
+                                                    2*r.right()/viewport[2]-1, 2*top/viewport[3]-1));
+  mProgram->setUniformValue("dataTexture", 0);
+  mProgram->setUniformValue("lutTexture", 1);
+  glUniform2i(mProgram->uniformLocation("dataSize"), keySize, valueSize);
+  mProgram->setUniformValue("lower", (GLfloat)parameters.dataRange.lower);
+  mProgram->setUniformValue("posToIndexFactor", (GLfloat)((levelCount-1)/(parameters.logarithmic ? logRange : parameters.dataRange.size())));
+  mProgram->setUniformValue("levelCount", levelCount);
+  mProgram->setUniformValue("logarithmic", (GLint)parameters.logarithmic);
+  mProgram->setUniformValue("periodic", (GLint)gradient.periodic());
+  mProgram->setUniformValue("interpolate", (GLint)parameters.interpolate);
+  mProgram->setUniformValue("transposed", (GLint)parameters.transposed);
+  mProgram->setUniformValue("mirrorX", (GLint)parameters.mirrorX);
+  mProgram->setUniformValue("mirrorY", (GLint)parameters.mirrorY);
+  {
+    QOpenGLVertexArrayObject::Binder vertexArrayBinder(mVertexArray);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  }
+  mProgram->release();
+  
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_SCISSOR_TEST);
+  return true;
+}
+#endif // QCP_OPENGL_FBO
+
+/*! \internal
+  
+  Draws the map into \a imageRect on the GPU if \ref setOpenGlColorize is enabled and \a painter
+  paints with the OpenGL paint engine, see \ref QCPColorMapGlRenderer. Returns false if the map
+  wasn't drawn, \ref draw then colorizes it into the map image as usual. Maps with an alpha map
+  (\ref QCPColorMapData::setAlpha) are always drawn that way.
+*/
+bool QCPColorMap::drawOpenGl(QCPPainter *painter, const QRectF &imageRect, bool mirrorX, bool mirrorY)
+{
+#ifdef QCP_OPENGL_FBO
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context || mMapData->mAlpha || !painter->paintEngine() || painter->paintEngine()->type() != QPaintEngine::OpenGL2)
+    return false;
+  if (mDataScaleType == QCPAxis::stLogarithmic && mDataRange.lower <= 0)
+    return false;
+  if (!mGlRenderer)
+    mGlRenderer = new QCPColorMapGlRenderer;
+  if (mGradient.mColorBufferInvalidated)
+    mGradient.updateColorBuffer();
+  
+  const QTransform deviceTransform = painter->deviceTransform();
+  QCPColorMapGlRenderer::Parameters parameters;
+  parameters.imageRect = deviceTransform.mapRect(imageRect);
+  parameters.clipRect = parameters.imageRect;
+  if (painter->hasClipping())
+    parameters.clipRect &= deviceTransform.mapRect(painter->clipBoundingRect());
+  if (mTightBoundary)
+    parameters.clipRect &= deviceTransform.mapRect(QRectF(coordsToPixels(mMapData->keyRange().lower, mMapData->valueRange().lower),
+                                                          coordsToPixels(mMapData->keyRange().upper, mMapData->valueRange().upper)).normalized());
+  parameters.dataRange = mDataRange;
+  parameters.logarithmic = mDataScaleType == QCPAxis::stLogarithmic;
+  parameters.interpolate = mInterpolate;
+  parameters.transposed = keyAxis()->orientation() == Qt::Vertical;
+  parameters.mirrorX = mirrorX;
+  parameters.mirrorY = mirrorY;
+  const bool paintFlipped = painter->device()->devType() == QInternal::OpenGL && static_cast<QOpenGLPaintDevice*>(painter->device())->paintFlipped();
+  
+  painter->beginNativePainting();
+  const bool drawn = mGlRenderer->draw(context, paintFlipped, mMapData, mMapData->mDataModified, mGradient, mGradient.mColorBuffer, parameters);
+  painter->endNativePainting();
+  if (drawn && mMapData->mDataModified)
+  {
+    // the map image wasn't updated with the data, the raster path and the legend icon need it anew:
+    mMapData->clearModified();
+    mMapImageInvalidated = true;
+  }
+  return drawn;
+#else
+  Q_UNUSED(painter)
+  Q_UNUSED(imageRect)
+  Q_UNUSED(mirrorX)
+  Q_UNUSED(mirrorY)
+  return false;
+#endif
 }
 
 /* inherits documentation from base class */
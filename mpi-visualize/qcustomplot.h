@@ -65,12 +65,20 @@
 #include <QtCore/QStack>
 #include <QtCore/QCache>
 #include <QtCore/QMargins>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
 #include <qmath.h>
 #include <limits>
 #include <algorithm>
 #ifdef QCP_OPENGL_FBO
 #  include <QtGui/QOpenGLContext>
 #  include <QtGui/QOpenGLFramebufferObject>
+#  include <QtGui/QOpenGLFunctions>
+#  include <QtGui/QOpenGLPaintDevice>
+#  include <QtGui/QOpenGLShaderProgram>
+#  include <QtGui/QOpenGLVertexArrayObject>
 #  ifdef QCP_OPENGL_OFFSCREENSURFACE
 #    include <QtGui/QOffscreenSurface>
 #  else
@@ -109,6 +117,7 @@ class QCPLayer;
 class QCPAbstractLegendItem;
 class QCPSelectionRect;
 class QCPColorMap;
+class QCPColorMapGlRenderer;
 class QCPColorScale;
 class QCPBars;
 
@@ -4492,11 +4501,19 @@ public:
   // non-property methods:
   void colorize(const double *data, const QCPRange &range, QRgb *scanLine, int n, int dataIndexFactor=1, bool logarithmic=false);
   void colorize(const double *data, const unsigned char *alpha, const QCPRange &range, QRgb *scanLine, int n, int dataIndexFactor=1, bool logarithmic=false);
+  void colorize(const float *data, const unsigned char *alpha, const QCPRange &range, double scale, double offset, QRgb *scanLine, int n, int dataIndexFactor=1, bool logarithmic=false);
+  void colorize(const qint16 *data, const unsigned char *alpha, const QCPRange &range, double scale, double offset, QRgb *scanLine, int n, int dataIndexFactor=1, bool logarithmic=false);
+  void colorize(const qint8 *data, const unsigned char *alpha, const QCPRange &range, double scale, double offset, QRgb *scanLine, int n, int dataIndexFactor=1, bool logarithmic=false);
   QRgb color(double position, const QCPRange &range, bool logarithmic=false);
   void loadPreset(GradientPreset preset);
   void clearColorStops();
   QCPColorGradient inverted() const;
   
+  // static methods:
+  static bool simdEnabled() { return mSimdEnabled; }
+  static void setSimdEnabled(bool enabled);
+  static QString simdInstructionSet();
+  
 protected:
   // property members:
   int mLevelCount;
@@ -4507,10 +4524,21 @@ protected:
   // non-property members:
   QVector<QRgb> mColorBuffer; // have colors premultiplied with alpha (for usage with QImage::Format_ARGB32_Premultiplied)
   bool mColorBufferInvalidated;
+  QVector<QRgb> mCellColorBuffer; // the color of every element of an integer cell type, see updateCellColorBuffer
+  int mCellColorBufferBits; // 0 if invalidated
+  QCPRange mCellColorBufferRange;
+  double mCellColorBufferScale, mCellColorBufferOffset;
+  bool mCellColorBufferLogarithmic, mCellColorBufferPeriodic;
+  static bool mSimdEnabled;
   
   // non-virtual methods:
   bool stopsUseAlpha() const;
   void updateColorBuffer();
+  void updateCellColorBuffer(int bits, const QCPRange &range, double scale, double offset, bool logarithmic);
+  template <class T>
+  void colorizeCells(const T *data, const unsigned char *alpha, const QRgb *colors, QRgb *scanLine, int n, int dataIndexFactor);
+  
+  friend class QCPColorMap;
 };
 Q_DECLARE_METATYPE(QCPColorGradient::ColorInterpolation)
 Q_DECLARE_METATYPE(QCPColorGradient::GradientPreset)
@@ -5691,6 +5719,18 @@ protected:
 class QCP_LIB_DECL QCPColorMapData
 {
 public:
+  /*!
+    Defines the type of the elements the cells are stored as. The value of a cell that is not
+    stored as double is its element times \ref cellScale plus \ref cellOffset.
+    
+    \see setCellType
+  */
+  enum CellType { ctDouble ///< 64 bit floating point values (the default)
+                  ,ctFloat ///< 32 bit floating point values
+                  ,ctInt16 ///< 16 bit signed integers
+                  ,ctInt8  ///< 8 bit signed integers
+                };
+  
   QCPColorMapData(int keySize, int valueSize, const QCPRange &keyRange, const QCPRange &valueRange);
   ~QCPColorMapData();
   QCPColorMapData(const QCPColorMapData &other);
@@ -5702,6 +5742,9 @@ public:
   QCPRange keyRange() const { return mKeyRange; }
   QCPRange valueRange() const { return mValueRange; }
   QCPRange dataBounds() const { return mDataBounds; }
+  CellType cellType() const { return mCellType; }
+  double cellScale() const { return mCellScale; }
+  double cellOffset() const { return mCellOffset; }
   double data(double key, double value);
   double cell(int keyIndex, int valueIndex);
   unsigned char alpha(int keyIndex, int valueIndex);
@@ -5713,12 +5756,27 @@ public:
   void setRange(const QCPRange &keyRange, const QCPRange &valueRange);
   void setKeyRange(const QCPRange &keyRange);
   void setValueRange(const QCPRange &valueRange);
+  void setCellType(CellType type, double scale=1.0, double offset=0.0);
   void setData(double key, double value, double z);
   void setCell(int keyIndex, int valueIndex, double z);
   void setAlpha(int keyIndex, int valueIndex, unsigned char alpha);
   
+  // bulk access:
+  template <class T>
+  void setCells(const T *data, int keyIndex, int valueIndex, int keyCount, int valueCount, int rowStride, double scale=1.0, double offset=0.0);
+  template <class T>
+  void setCells(const T *data, double scale=1.0, double offset=0.0) { setCells(data, 0, 0, mKeySize, mValueSize, mKeySize, scale, offset); }
+  double *swapRawData(double *data, bool recalculateDataBounds=true);
+  double *swapRawData(double *data, int keySize, int valueSize, bool recalculateDataBounds=true);
+  double *swapRawData(double *data, const QVector<QRect> &changedCells, bool recalculateDataBounds=true);
+  void *swapRawCells(void *cells, int keySize, int valueSize, bool recalculateDataBounds=true);
+  void *swapRawCells(void *cells, const QVector<QRect> &changedCells, bool recalculateDataBounds=true);
+  const double *rawData() const { return mCellType == ctDouble ? static_cast<const double*>(mCells) : 0; }
+  const void *rawCells() const { return mCells; }
+  
   // non-property methods:
   void recalculateDataBounds();
+  void setDataBounds(const QCPRange &bounds) { mDataBounds = bounds; }
   void clear();
   void clearAlpha();
   void fill(double z);
@@ -5727,23 +5785,128 @@ public:
   void coordToCell(double key, double value, int *keyIndex, int *valueIndex) const;
   void cellToCoord(int keyIndex, int valueIndex, double *key, double *value) const;
   
+  // static methods:
+  static int cellTypeSize(CellType type);
+  static void *allocateCells(CellType type, int count);
+  static void freeCells(CellType type, void *cells);
+  
 protected:
   // property members:
   int mKeySize, mValueSize;
   QCPRange mKeyRange, mValueRange;
   bool mIsEmpty;
+  CellType mCellType;
+  double mCellScale, mCellOffset;
   
   // non-property members:
-  double *mData;
+  void *mCells; // keySize*valueSize elements of mCellType
   unsigned char *mAlpha;
   QCPRange mDataBounds;
   bool mDataModified;
+  QVector<QRect> mModifiedCells; // if mDataModified is set: the modified cells, or all cells if empty
   
   bool createAlpha(bool initializeOpaque=true);
+  void setAllModified() { mDataModified = true; mModifiedCells.resize(0); } // resize keeps the capacity, clear may not
+  void addModifiedCells(const QRect &cells);
+  void clearModified() { mDataModified = false; mModifiedCells.resize(0); }
+  double cellValue(int index) const { return element(mCellType, mCells, index)*mCellScale+mCellOffset; }
+  void setCellValue(int index, double z) { setElement(mCellType, mCells, index, (z-mCellOffset)/mCellScale); }
+  static double element(CellType type, const void *cells, int index);
+  static void setElement(CellType type, void *cells, int index, double element);
+  template <class C>
+  void fillCells(double z);
+  template <class C, class T>
+  void setCellsOf(C *cells, const T *data, int keyIndex, int valueIndex, int keyCount, int valueCount, int rowStride, double scale, double offset, T &minData, T &maxData);
+  
+  // conversion of values to elements, integers are rounded and saturated:
+  static void toCell(double value, double &cell) { cell = value; }
+  static void toCell(double value, float &cell) { cell = value; }
+  static void toCell(double value, qint16 &cell) { value = value > -32768.0 ? value : -32768.0; cell = qRound(value < 32767.0 ? value : 32767.0); }
+  static void toCell(double value, qint8 &cell) { value = value > -128.0 ? value : -128.0; cell = qRound(value < 127.0 ? value : 127.0); }
   
   friend class QCPColorMap;
 };
 
+/*!
+  Sets the cells of the rectangular region starting at \a keyIndex, \a valueIndex and spanning \a
+  keyCount by \a valueCount cells to the values in \a data, transformed as <tt>data*scale+offset</tt>.
+
+  \a data is read row-major, i.e. the elements of one value index (one row) are contiguous and
+  consecutive rows are \a rowStride elements apart. This matches the internal storage order, so the
+  whole region is written in a single pass over both arrays without per-cell bounds checks. \a T
+  may be any arithmetic type. If the cells are not stored as double (see \ref setCellType), the
+  transformation is folded into the one to the element type, so the values are not converted twice.
+
+  The data bounds are updated in the same pass. If the region covers the whole map, the bounds are
+  set to the exact minimum and maximum of the new data, otherwise they are only expanded, like with
+  \ref setCell.
+
+  \see setCell, swapRawData
+*/
+template <class T>
+void QCPColorMapData::setCells(const T *data, int keyIndex, int valueIndex, int keyCount, int valueCount, int rowStride, double scale, double offset)
+{
+  if (!data || keyCount <= 0 || valueCount <= 0)
+    return;
+  if (keyIndex < 0 || valueIndex < 0 || keyIndex+keyCount > mKeySize || valueIndex+valueCount > mValueSize || rowStride < keyCount)
+  {
+    qDebug() << Q_FUNC_INFO << "region out of bounds:" << keyIndex << valueIndex << keyCount << valueCount;
+    return;
+  }
+  
+  T minData = data[0];
+  T maxData = data[0];
+  switch (mCellType)
+  {
+    case ctDouble: setCellsOf(static_cast<double*>(mCells), data, keyIndex, valueIndex, keyCount, valueCount, rowStride, scale, offset, minData, maxData); break;
+    case ctFloat: setCellsOf(static_cast<float*>(mCells), data, keyIndex, valueIndex, keyCount, valueCount, rowStride, scale, offset, minData, maxData); break;
+    case ctInt16: setCellsOf(static_cast<qint16*>(mCells), data, keyIndex, valueIndex, keyCount, valueCount, rowStride, scale, offset, minData, maxData); break;
+    case ctInt8: setCellsOf(static_cast<qint8*>(mCells), data, keyIndex, valueIndex, keyCount, valueCount, rowStride, scale, offset, minData, maxData); break;
+  }
+  
+  // the transformation is monotonic, so the bounds can be transformed and need not be tracked per cell:
+  double lower = minData*scale+offset;
+  double upper = maxData*scale+offset;
+  if (lower > upper)
+    qSwap(lower, upper);
+  if (keyCount == mKeySize && valueCount == mValueSize)
+  {
+    mDataBounds = QCPRange(lower, upper);
+  } else
+  {
+    if (lower < mDataBounds.lower)
+      mDataBounds.lower = lower;
+    if (upper > mDataBounds.upper)
+      mDataBounds.upper = upper;
+  }
+  addModifiedCells(QRect(keyIndex, valueIndex, keyCount, valueCount));
+}
+
+/*! \internal
+
+  Writes the region of \ref setCells into \a cells, the elements of the cell type \a C, and
+  returns the minimum and maximum of \a data in the region via \a minData and \a maxData.
+*/
+template <class C, class T>
+void QCPColorMapData::setCellsOf(C *cells, const T *data, int keyIndex, int valueIndex, int keyCount, int valueCount, int rowStride, double scale, double offset, T &minData, T &maxData)
+{
+  // the transformation of the values and the inverse one of the cell type in one step:
+  const double cellFactor = scale/mCellScale;
+  const double cellOffset = (offset-mCellOffset)/mCellScale;
+  for (int row=0; row<valueCount; ++row)
+  {
+    const T *src = data+row*rowStride;
+    C *dest = cells+(valueIndex+row)*mKeySize+keyIndex;
+    for (int i=0; i<keyCount; ++i) // branch free so the compiler can vectorize it
+    {
+      const T value = src[i];
+      toCell(value*cellFactor+cellOffset, dest[i]);
+      minData = value < minData ? value : minData;
+      maxData = value > maxData ? value : maxData;
+    }
+  }
+}
+
 
 class QCP_LIB_DECL QCPColorMap : public QCPAbstractPlottable
 {
@@ -5754,6 +5917,8 @@ class QCP_LIB_DECL QCPColorMap : public QCPAbstractPlottable
   Q_PROPERTY(QCPColorGradient gradient READ gradient WRITE setGradient NOTIFY gradientChanged)
   Q_PROPERTY(bool interpolate READ interpolate WRITE setInterpolate)
   Q_PROPERTY(bool tightBoundary READ tightBoundary WRITE setTightBoundary)
+  Q_PROPERTY(int colorizeThreadCount READ colorizeThreadCount WRITE setColorizeThreadCount)
+  Q_PROPERTY(bool openGlColorize READ openGlColorize WRITE setOpenGlColorize)
   Q_PROPERTY(QCPColorScale* colorScale READ colorScale WRITE setColorScale)
   /// \endcond
 public:
@@ -5766,6 +5931,8 @@ public:
   QCPAxis::ScaleType dataScaleType() const { return mDataScaleType; }
   bool interpolate() const { return mInterpolate; }
   bool tightBoundary() const { return mTightBoundary; }
+  int colorizeThreadCount() const { return mColorizeThreadCount; }
+  bool openGlColorize() const { return mOpenGlColorize; }
   QCPColorGradient gradient() const { return mGradient; }
   QCPColorScale *colorScale() const { return mColorScale.data(); }
   
@@ -5776,6 +5943,8 @@ public:
   Q_SLOT void setGradient(const QCPColorGradient &gradient);
   void setInterpolate(bool enabled);
   void setTightBoundary(bool enabled);
+  void setColorizeThreadCount(int count);
+  void setOpenGlColorize(bool enabled);
   void setColorScale(QCPColorScale *colorScale);
   
   // non-property methods:
@@ -5800,12 +5969,17 @@ protected:
   QCPColorGradient mGradient;
   bool mInterpolate;
   bool mTightBoundary;
+  int mColorizeThreadCount;
+  bool mOpenGlColorize;
   QPointer<QCPColorScale> mColorScale;
   
   // non-property members:
   QImage mMapImage, mUndersampledMapImage;
+  QImage mMirroredMapImage; // mMapImage as drawn with reversed axes
+  bool mMirroredX, mMirroredY; // mirroring of mMirroredMapImage, both false if it is outdated
   QPixmap mLegendIcon;
   bool mMapImageInvalidated;
+  QCPColorMapGlRenderer *mGlRenderer;
   
   // introduced virtual methods:
   virtual void updateMapImage();
@@ -5814,6 +5988,11 @@ protected:
   virtual void draw(QCPPainter *painter) Q_DECL_OVERRIDE;
   virtual void drawLegendIcon(QCPPainter *painter, const QRectF &rect) const Q_DECL_OVERRIDE;
   
+  // non-virtual methods:
+  QRectF mapImageRect() const;
+  const QImage &mirroredMapImage(bool mirrorX, bool mirrorY);
+  bool drawOpenGl(QCPPainter *painter, const QRectF &imageRect, bool mirrorX, bool mirrorY);
+  
   friend class QCustomPlot;
   friend class QCPLegend;
 };
@@ -0,0 +1,597 @@
+/**************************************************************************//**
+ * @file main.cpp
+ * @brief Microbenchmarks of the QCustomPlot color map
+ *
+ * This file measures the stages the main window of mpi-visualize goes
+ * through for every frame, one at a time and over a range of map sizes:
+ * storing the cells with QCPColorMapData::setCell and finding their range
+ * with recalculateDataBounds, converting them to colors with
+ * QCPColorGradient::colorize in all its variants, building the map image
+ * with QCPColorMap::updateMapImage and finally a complete replot into the
+ * raster and, if available, the OpenGL paint buffer. Every case is repeated
+ * until a minimum time has passed and reported in nanoseconds per cell and
+ * allocations per frame. Beforehand the output of colorize with and without
+ * the SIMD kernels is compared byte for byte. The plot is never shown;
+ * without a display the offscreen platform is used.
+ * @author Daniel Queteschiner
+ * @date June 2019
+ *//*
+ * Copyright (c) 2019 Daniel Queteschiner.
+ *****************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <QApplication>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QFile>
+#include <QTextStream>
+#include <QVector>
+#include "allocationcount.h"
+#include "qcustomplot.h"
+
+#define MIN_SECONDS 0.5     // per case and size
+#define PLOT_WIDTH 1024
+#define PLOT_HEIGHT 768
+
+namespace {
+
+// makes the map image accessible to the benchmark
+class BenchmarkColorMap : public QCPColorMap
+{
+public:
+    BenchmarkColorMap(QCPAxis *keyAxis, QCPAxis *valueAxis) : QCPColorMap(keyAxis, valueAxis) {}
+
+    void invalidateMapImage() { mMapImageInvalidated = true; }
+    void colorizeMapImage() { mMapImageInvalidated = true; updateMapImage(); }
+};
+
+struct BenchmarkOptions
+{
+    QVector<int> sizes;
+    int threads;            // colorize threads of the map, 0 = one per core
+    double minSeconds;
+    QString csvFile;
+    bool openGl;            // the plot can paint into OpenGL buffers
+    bool verifyOnly;        // only compare the SIMD kernels with the scalar implementation
+};
+
+// everything a frame of a case works on
+struct BenchmarkState
+{
+    int size;
+    QVector<double> values;         // size*size cells in the data range
+    QVector<unsigned char> alpha;
+    QCPColorGradient gradient;
+    QCPRange range;
+    bool logarithmic;
+    bool useAlpha;
+    QImage image;                   // colorize target
+    QCPColorMapData *data;
+    BenchmarkColorMap *map;
+    QCustomPlot *plot;
+};
+
+typedef void (*FrameFunction)(BenchmarkState *state);
+
+/* ------------------------------------------------------------------------- */
+
+// the cases, one frame each
+
+void setCellFrame(BenchmarkState *state)
+{
+    const double *values = state->values.constData();
+    for (int y=0; y<state->size; ++y)
+    {
+        for (int x=0; x<state->size; ++x)
+        {
+            state->data->setCell(x, y, values[y*state->size+x]);
+        }
+    }
+}
+
+void recalculateDataBoundsFrame(BenchmarkState *state)
+{
+    state->data->recalculateDataBounds();
+}
+
+void colorizeFrame(BenchmarkState *state)
+{
+    const int n = state->size;
+    for (int y=0; y<n; ++y)
+    {
+        QRgb *scanLine = reinterpret_cast<QRgb*>(state->image.scanLine(y));
+        if (state->useAlpha)
+        {
+            state->gradient.colorize(state->values.constData()+y*n, state->alpha.constData()+y*n, state->range, scanLine, n, 1, state->logarithmic);
+        }
+        else
+        {
+            state->gradient.colorize(state->values.constData()+y*n, state->range, scanLine, n, 1, state->logarithmic);
+        }
+    }
+}
+
+void updateMapImageFrame(BenchmarkState *state)
+{
+    state->map->colorizeMapImage();
+}
+
+// the map image is built anew as if a frame had arrived
+void replotFrame(BenchmarkState *state)
+{
+    state->map->invalidateMapImage();
+    state->plot->replot(QCustomPlot::rpImmediateRefresh);
+}
+
+// e.g. after the axes were dragged, the map image is reused
+void replotUnchangedFrame(BenchmarkState *state)
+{
+    state->plot->replot(QCustomPlot::rpImmediateRefresh);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct Measurement
+{
+    QString name;
+    int size;
+    int frames;
+    double nsPerCell;
+    double allocationsPerFrame;
+};
+
+// runs frames until the minimum time has passed; the first frame warms up
+// the caches and buffers and is not measured
+Measurement measure(const QString &name, FrameFunction frame, BenchmarkState *state, double minSeconds)
+{
+    frame(state);
+
+    QElapsedTimer timer;
+    const unsigned int allocations = allocationCount();
+    int frames = 0;
+    timer.start();
+    do
+    {
+        frame(state);
+        ++frames;
+    }
+    while (timer.nsecsElapsed() < qint64(minSeconds*1e9));
+    const qint64 elapsed = timer.nsecsElapsed();
+
+    Measurement m;
+    m.name = name;
+    m.size = state->size;
+    m.frames = frames;
+    m.nsPerCell = double(elapsed)/frames/(double(state->size)*state->size);
+    m.allocationsPerFrame = double(allocationCount()-allocations)/frames;
+    return m;
+}
+
+void printMeasurement(const Measurement &m)
+{
+    printf("%-40s %5d^2 %10.3f ns/cell %10.2f allocations/frame %7d frames\n",
+           m.name.toLocal8Bit().constData(), m.size, m.nsPerCell, m.allocationsPerFrame, m.frames);
+    fflush(stdout);
+}
+
+// values in [1, 3] with some structure, positive for the logarithmic scale
+void fillValues(BenchmarkState *state)
+{
+    const int n = state->size;
+    state->values.resize(n*n);
+    state->alpha.resize(n*n);
+    for (int y=0; y<n; ++y)
+    {
+        for (int x=0; x<n; ++x)
+        {
+            const double u = 20.0*x/n - 10.0;
+            const double v = 20.0*y/n - 10.0;
+            const double r = std::sqrt(u*u + v*v) + 0.01;
+            state->values[y*n+x] = 2.0 + std::sin(r)*std::cos(0.5*u);
+            state->alpha[y*n+x] = static_cast<unsigned char>((x+y) & 0xff);
+        }
+    }
+    state->range = QCPRange(1.0, 3.0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void colorizeCases(BenchmarkState *state, double minSeconds, QVector<Measurement> *results)
+{
+    state->image = QImage(state->size, state->size, QImage::Format_ARGB32_Premultiplied);
+    state->gradient = QCPColorGradient(QCPColorGradient::gpJet);
+    for (int variant=0; variant<8; ++variant)
+    {
+        state->logarithmic = variant & 1;
+        state->gradient.setPeriodic(variant & 2);
+        state->useAlpha = variant & 4;
+        const QString name = QString("colorize %1%2%3")
+                             .arg(state->logarithmic ? "log" : "linear")
+                             .arg(state->gradient.periodic() ? " periodic" : "")
+                             .arg(state->useAlpha ? " alpha" : "");
+        results->append(measure(name, colorizeFrame, state, minSeconds));
+        printMeasurement(results->last());
+    }
+    state->image = QImage();
+}
+
+// updateMapImage only oversamples maps of at most 100 cells per side
+void oversampledCases(BenchmarkState *state, QCustomPlot *plot, const BenchmarkOptions &options, QVector<Measurement> *results)
+{
+    static const int oversampledSizes[] = { 25, 50, 100 };
+
+    for (unsigned int i=0; i<sizeof(oversampledSizes)/sizeof(oversampledSizes[0]); ++i)
+    {
+        state->size = oversampledSizes[i];
+        fillValues(state);
+        state->map = new BenchmarkColorMap(plot->xAxis, plot->yAxis);
+        state->map->data()->setSize(state->size, state->size);
+        state->map->data()->setRange(QCPRange(0.0, 1.0), QCPRange(0.0, 1.0));
+        state->map->data()->setCells(state->values.constData());
+        state->map->setGradient(QCPColorGradient::gpJet);
+        state->map->setDataRange(state->range);
+        state->map->setInterpolate(false);
+        state->map->setColorizeThreadCount(options.threads);
+        results->append(measure("updateMapImage oversampled", updateMapImageFrame, state, options.minSeconds));
+        printMeasurement(results->last());
+        plot->removePlottable(state->map);
+    }
+}
+
+void mapCases(BenchmarkState *state, QCustomPlot *plot, const BenchmarkOptions &options, QVector<Measurement> *results)
+{
+    state->plot = plot;
+    state->map = new BenchmarkColorMap(plot->xAxis, plot->yAxis);
+    state->data = state->map->data();
+    state->data->setSize(state->size, state->size);
+    state->data->setRange(QCPRange(0.0, 1.0), QCPRange(0.0, 1.0));
+    state->map->setGradient(QCPColorGradient::gpJet);
+    state->map->setDataRange(state->range);
+    state->map->setInterpolate(true);
+    state->map->setColorizeThreadCount(options.threads);
+    plot->xAxis->setRange(0.0, 1.0);
+    plot->yAxis->setRange(0.0, 1.0);
+
+    results->append(measure("setCell", setCellFrame, state, options.minSeconds));
+    printMeasurement(results->last());
+    results->append(measure("recalculateDataBounds", recalculateDataBoundsFrame, state, options.minSeconds));
+    printMeasurement(results->last());
+    results->append(measure("updateMapImage", updateMapImageFrame, state, options.minSeconds));
+    printMeasurement(results->last());
+
+    results->append(measure("replot raster", replotFrame, state, options.minSeconds));
+    printMeasurement(results->last());
+    results->append(measure("replot raster unchanged", replotUnchangedFrame, state, options.minSeconds));
+    printMeasurement(results->last());
+
+    if (options.openGl)
+    {
+        plot->setOpenGl(true);
+        results->append(measure("replot opengl", replotFrame, state, options.minSeconds));
+        printMeasurement(results->last());
+        results->append(measure("replot opengl unchanged", replotUnchangedFrame, state, options.minSeconds));
+        printMeasurement(results->last());
+        state->map->setOpenGlColorize(true);
+        results->append(measure("replot opengl colorize", replotFrame, state, options.minSeconds));
+        printMeasurement(results->last());
+        state->map->setOpenGlColorize(false);
+        plot->setOpenGl(false);
+    }
+
+    plot->removePlottable(state->map);
+    state->map = 0;
+    state->data = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// colorize has to give the same pixels with and without the SIMD kernels
+
+struct VerifyCells
+{
+    QVector<double> doubles;
+    QVector<float> floats;
+    QVector<qint16> int16s;         // data[i]*4/32768+2, in [-2, 6]
+    QVector<qint8> int8s;           // data[i]*4/128+2, in [-2, 6]
+    QVector<unsigned char> alpha;
+};
+
+enum VerifyCellType { vcDouble, vcFloat, vcInt16, vcInt8, vcCount };
+
+// cells below, inside and above the range [1, 3], on its bounds, zero, negative and not finite
+void fillVerifyCells(VerifyCells *cells, int count)
+{
+    static const double special[] = { 1.0, 3.0, 0.0, -1.0, 0.5, 3.5, 1e30, -1e30,
+                                      std::numeric_limits<double>::quiet_NaN(),
+                                      std::numeric_limits<double>::infinity(),
+                                      -std::numeric_limits<double>::infinity() };
+    const int specialCount = sizeof(special)/sizeof(special[0]);
+
+    cells->doubles.resize(count);
+    cells->floats.resize(count);
+    cells->int16s.resize(count);
+    cells->int8s.resize(count);
+    cells->alpha.resize(count);
+    for (int i=0; i<count; ++i)
+    {
+        // every third cell is special, the others stride through [0.5, 3.5)
+        const double value = i % 3 == 0 ? special[(i/3) % specialCount] : 0.5 + std::fmod(i*0.618034, 3.0);
+        cells->doubles[i] = value;
+        cells->floats[i] = static_cast<float>(value);
+        cells->int16s[i] = static_cast<qint16>((i*7919) % 65536 - 32768);
+        cells->int8s[i] = static_cast<qint8>((i*37) % 256 - 128);
+        cells->alpha[i] = i % 5 == 0 ? 255 : static_cast<unsigned char>((i*53) & 0xff);
+    }
+}
+
+// colorizes n cells, every stride-th one of the arrays
+void colorizeVerifyRow(QCPColorGradient *gradient, const VerifyCells &cells, int cellType, bool useAlpha, bool logarithmic,
+                       int n, int stride, QRgb *scanLine)
+{
+    const QCPRange range(1.0, 3.0);
+    const unsigned char *alpha = useAlpha ? cells.alpha.constData() : 0;
+    switch (cellType)
+    {
+    case vcDouble:
+        if (alpha)
+        {
+            gradient->colorize(cells.doubles.constData(), alpha, range, scanLine, n, stride, logarithmic);
+        }
+        else
+        {
+            gradient->colorize(cells.doubles.constData(), range, scanLine, n, stride, logarithmic);
+        }
+        break;
+    case vcFloat:
+        gradient->colorize(cells.floats.constData(), alpha, range, 1.0, 0.0, scanLine, n, stride, logarithmic);
+        break;
+    case vcInt16:
+        gradient->colorize(cells.int16s.constData(), alpha, range, 4.0/32768, 2.0, scanLine, n, stride, logarithmic);
+        break;
+    case vcInt8:
+        gradient->colorize(cells.int8s.constData(), alpha, range, 4.0/128, 2.0, scanLine, n, stride, logarithmic);
+        break;
+    }
+}
+
+// returns false and prints the first difference if a SIMD kernel deviates from the scalar loops
+bool verifyColorize()
+{
+    static const char *cellTypeNames[] = { "double", "float", "int16", "int8" };
+    // every tail length of the 4 and 8 lane kernels, and rows longer than a chunk of the float overload
+    static const int longWidths[] = { 255, 256, 257, 511, 1000 };
+    const int longWidthCount = sizeof(longWidths)/sizeof(longWidths[0]);
+    const int shortWidthCount = 40;
+    const int maxWidth = 1000;
+    const int maxStride = 3;
+
+    printf("comparing colorize with SIMD (%s) and without\n", QCPColorGradient::simdInstructionSet().toLocal8Bit().constData());
+    fflush(stdout);
+
+    VerifyCells cells;
+    fillVerifyCells(&cells, maxWidth*maxStride);
+    QVector<QRgb> scalarLine(maxWidth), simdLine(maxWidth);
+    int comparisons = 0;
+    bool identical = true;
+
+    for (int preset=QCPColorGradient::gpGrayscale; preset<=QCPColorGradient::gpHues && identical; ++preset)
+    {
+        for (int periodic=0; periodic<2 && identical; ++periodic)
+        {
+            // each gradient caches the color tables of the integer cell types with its own setting
+            QCPColorGradient scalarGradient(static_cast<QCPColorGradient::GradientPreset>(preset));
+            scalarGradient.setPeriodic(periodic);
+            QCPColorGradient simdGradient = scalarGradient;
+            for (int cellType=0; cellType<vcCount && identical; ++cellType)
+            {
+                for (int variant=0; variant<4 && identical; ++variant)
+                {
+                    const bool logarithmic = variant & 1;
+                    const bool useAlpha = variant & 2;
+                    for (int stride=1; stride<=maxStride && identical; stride+=2)
+                    {
+                        for (int w=0; w<shortWidthCount+longWidthCount && identical; ++w)
+                        {
+                            const int n = w < shortWidthCount ? w+1 : longWidths[w-shortWidthCount];
+                            scalarLine.fill(0);
+                            simdLine.fill(0);
+                            QCPColorGradient::setSimdEnabled(false);
+                            colorizeVerifyRow(&scalarGradient, cells, cellType, useAlpha, logarithmic, n, stride, scalarLine.data());
+                            QCPColorGradient::setSimdEnabled(true);
+                            colorizeVerifyRow(&simdGradient, cells, cellType, useAlpha, logarithmic, n, stride, simdLine.data());
+                            ++comparisons;
+                            if (memcmp(scalarLine.constData(), simdLine.constData(), n*sizeof(QRgb)) != 0)
+                            {
+                                int i = 0;
+                                while (scalarLine.at(i) == simdLine.at(i))
+                                {
+                                    ++i;
+                                }
+                                fprintf(stderr, "colorize differs for preset %d%s, %s cells%s%s, width %d, stride %d: pixel %d is %08x with SIMD and %08x without\n",
+                                        preset, periodic ? " periodic" : "", cellTypeNames[cellType], logarithmic ? " log" : "",
+                                        useAlpha ? " alpha" : "", n, stride, i, simdLine.at(i), scalarLine.at(i));
+                                fflush(stderr);
+                                identical = false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (identical)
+    {
+        printf("colorize is identical in %d rows\n", comparisons);
+        fflush(stdout);
+    }
+    return identical;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// returns false if the program should not run
+bool parseArguments(BenchmarkOptions *options)
+{
+    const QStringList arguments = QCoreApplication::arguments();
+
+    for (int i=1; i<arguments.size(); ++i)
+    {
+        if (arguments.at(i) == "--sizes" && i+1 < arguments.size())
+        {
+            options->sizes.clear();
+            const QStringList sizes = arguments.at(++i).split(',', QString::SkipEmptyParts);
+            for (int j=0; j<sizes.size(); ++j)
+            {
+                bool ok = false;
+                const int size = sizes.at(j).toInt(&ok);
+                if (ok && size > 0)
+                {
+                    options->sizes.append(size);
+                }
+                else
+                {
+                    fprintf(stderr, "Invalid size %s\n", sizes.at(j).toLocal8Bit().constData());
+                }
+            }
+        }
+        else if (arguments.at(i) == "--threads" && i+1 < arguments.size())
+        {
+            options->threads = qMax(0, arguments.at(++i).toInt());
+        }
+        else if (arguments.at(i) == "--min-time" && i+1 < arguments.size())
+        {
+            bool ok = false;
+            const double seconds = arguments.at(++i).toDouble(&ok);
+            if (ok && seconds >= 0.0)
+            {
+                options->minSeconds = seconds;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid time %s\n", arguments.at(i).toLocal8Bit().constData());
+            }
+        }
+        else if (arguments.at(i) == "--csv" && i+1 < arguments.size())
+        {
+            options->csvFile = arguments.at(++i);
+        }
+        else if (arguments.at(i) == "--verify")
+        {
+            options->verifyOnly = true;
+        }
+        else if (arguments.at(i) == "--help")
+        {
+            printf("measures the color map stages of QCustomPlot per cell and frame\n"
+                   "use '--sizes <n,n,...>' to set the side lengths of the square maps (default 128,256,...,8192)\n"
+                   "use '--threads <n>' to colorize the map image with n threads (default 1, 0 = one per core)\n"
+                   "use '--min-time <s>' to repeat every case for at least s seconds (default %g)\n"
+                   "use '--csv <file>' to write the results to file\n"
+                   "use '--verify' to only compare colorize with and without SIMD, which is always done first\n", MIN_SECONDS);
+            fflush(stdout);
+            return false;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arguments.at(i).toLocal8Bit().constData());
+        }
+    }
+    fflush(stderr);
+    return true;
+}
+
+bool writeResults(const QString &fileName, const QVector<Measurement> &results)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "case,size,frames,ns_per_cell,allocations_per_frame\n";
+    for (int i=0; i<results.size(); ++i)
+    {
+        const Measurement &m = results.at(i);
+        out << "\"" << m.name << "\"," << m.size << "," << m.frames << "," << m.nsPerCell << "," << m.allocationsPerFrame << "\n";
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // no window is ever shown, a display is not needed
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+
+    BenchmarkOptions options;
+    for (int size=128; size<=8192; size*=2)
+    {
+        options.sizes.append(size);
+    }
+    options.threads = 1;
+    options.minSeconds = MIN_SECONDS;
+    options.verifyOnly = false;
+    if (!parseArguments(&options))
+    {
+        return 0;
+    }
+
+    // the measurements of the SIMD kernels would be meaningless if they colorized differently
+    if (!verifyColorize())
+    {
+        return 1;
+    }
+    if (options.verifyOnly)
+    {
+        return 0;
+    }
+
+    QCustomPlot plot;
+    plot.resize(PLOT_WIDTH, PLOT_HEIGHT);
+    plot.axisRect()->setupFullAxesBox(true);
+
+    // setOpenGl falls back to the raster buffer if there is no OpenGL context
+    plot.setOpenGl(true);
+    options.openGl = plot.openGl();
+    if (options.openGl)
+    {
+        plot.setOpenGl(false);
+    }
+    else
+    {
+        printf("OpenGL paint buffers are not available, the opengl replot cases are skipped\n");
+        fflush(stdout);
+    }
+
+    BenchmarkState state;
+    state.map = 0;
+    state.data = 0;
+    state.plot = &plot;
+    QVector<Measurement> results;
+
+    for (int i=0; i<options.sizes.size(); ++i)
+    {
+        state.size = options.sizes.at(i);
+        fillValues(&state);
+        colorizeCases(&state, options.minSeconds, &results);
+        mapCases(&state, &plot, options, &results);
+    }
+    oversampledCases(&state, &plot, options, &results);
+
+    if (!options.csvFile.isEmpty() && !writeResults(options.csvFile, results))
+    {
+        fprintf(stderr, "Failed to write %s\n", options.csvFile.toLocal8Bit().constData());
+        fflush(stderr);
+    }
+    return 0;
+}
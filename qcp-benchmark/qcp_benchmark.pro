@@ -0,0 +1,25 @@
+# microbenchmarks of the color map stages of QCustomPlot, see main.cpp;
+# add CONFIG+=opengl to the qmake call to measure the OpenGL paint buffers
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets printsupport
+
+TARGET = qcp-benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    ../common/allocationcount.cpp \
+    ../mpi-visualize/qcustomplot.cpp
+
+HEADERS += ../common/allocationcount.h \
+    ../mpi-visualize/qcustomplot.h
+
+INCLUDEPATH += ../mpi-visualize ../common
+
+opengl {
+    DEFINES += QCUSTOMPLOT_USE_OPENGL
+    win32: LIBS += -lopengl32
+}